@@ -0,0 +1,280 @@
+/*
+Asynchronous Redis client (AsyncRedisClient)
+    Keeps a single non-blocking TCP socket registered with epoll and pipelines
+    every command over it, so many requests can be in flight per connection.
+
+    Implements:
+        command(args, cb) → appends the RESP command to the output buffer and
+                            the callback to the pending FIFO under one lock.
+        eventLoop()       → writes queued output when the socket is writable,
+                            parses replies as they arrive and completes the
+                            oldest pending request for each.
+    A reply that takes longer than requestTimeoutMs breaks the connection
+    (later replies could no longer be matched), failing all pending requests;
+    the next command() reconnects.
+*/
+
+#include "../include/AsyncRedisClient.h"
+#include "../include/CommandHandler.h"
+#include "../include/ResponseParser.h"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+AsyncRedisClient::AsyncRedisClient(const std::string &host, int port, int requestTimeoutMs)
+    : host(host), port(port), requestTimeoutMs(requestTimeoutMs), sockfd(-1), epollfd(-1), wakefd(-1),
+      connected(false), stopping(false), writeArmed(false) {}
+
+AsyncRedisClient::~AsyncRedisClient() {
+    close();
+}
+
+bool AsyncRedisClient::openSocket() {
+    int fd = -1;
+    if (!host.empty() && host[0] == '/') {
+        // Unix domain socket path, like RedisClient
+        struct sockaddr_un addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, host.c_str(), sizeof(addr.sun_path) - 1);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd != -1 && ::connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    } else {
+        struct addrinfo hints, *res = nullptr;
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        std::string portStr = std::to_string(port);
+        if (getaddrinfo(host.c_str(), portStr.c_str(), &hints, &res) != 0) {
+            return false;
+        }
+        for (auto p = res; p != nullptr; p = p->ai_next) {
+            fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+            if (fd == -1) continue;
+            if (::connect(fd, p->ai_addr, p->ai_addrlen) == 0) break;
+            ::close(fd);
+            fd = -1;
+        }
+        freeaddrinfo(res);
+        if (fd != -1) {
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+    }
+    if (fd == -1) {
+        return false;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &ev);
+    sockfd = fd;
+    writeArmed = false;
+    inBuffer.clear();
+    frame.reset();
+    connected = true;
+    return true;
+}
+
+bool AsyncRedisClient::connect() {
+    if (loopThread.joinable()) {
+        return connected;
+    }
+    epollfd = epoll_create1(0);
+    wakefd = eventfd(0, EFD_NONBLOCK);
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = wakefd;
+    epoll_ctl(epollfd, EPOLL_CTL_ADD, wakefd, &ev);
+
+    if (!openSocket()) {
+        std::cerr << "Could not connect to " << host << ":" << port << "\n";
+        ::close(wakefd);
+        ::close(epollfd);
+        wakefd = epollfd = -1;
+        return false;
+    }
+    stopping = false;
+    loopThread = std::thread(&AsyncRedisClient::eventLoop, this);
+    return true;
+}
+
+void AsyncRedisClient::close() {
+    if (loopThread.joinable()) {
+        stopping = true;
+        wake();
+        loopThread.join();
+    }
+    if (sockfd != -1) {
+        ::close(sockfd);
+        sockfd = -1;
+    }
+    failAll();
+    if (wakefd != -1) { ::close(wakefd); wakefd = -1; }
+    if (epollfd != -1) { ::close(epollfd); epollfd = -1; }
+    connected = false;
+}
+
+void AsyncRedisClient::wake() {
+    uint64_t one = 1;
+    ssize_t ignored = write(wakefd, &one, sizeof(one));
+    (void)ignored;
+}
+
+void AsyncRedisClient::command(const std::vector<std::string> &args, Callback cb) {
+    if (!loopThread.joinable()) {
+        cb(false, "(Error) not connected");
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        outBuffer += CommandHandler::buildRESPcommand(args);
+        pending.push_back({std::move(cb), std::chrono::steady_clock::now()});
+    }
+    wake();
+}
+
+std::future<std::string> AsyncRedisClient::command(const std::vector<std::string> &args) {
+    auto promise = std::make_shared<std::promise<std::string>>();
+    std::future<std::string> result = promise->get_future();
+    command(args, [promise](bool ok, const std::string &reply) {
+        if (ok) {
+            promise->set_value(reply);
+        } else {
+            promise->set_exception(std::make_exception_ptr(std::runtime_error(reply)));
+        }
+    });
+    return result;
+}
+
+size_t AsyncRedisClient::inFlight() {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    return pending.size();
+}
+
+void AsyncRedisClient::updateInterest(bool wantWrite) {
+    if (wantWrite == writeArmed || sockfd == -1) return;
+    struct epoll_event ev;
+    ev.events = wantWrite ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+    ev.data.fd = sockfd;
+    epoll_ctl(epollfd, EPOLL_CTL_MOD, sockfd, &ev);
+    writeArmed = wantWrite;
+}
+
+void AsyncRedisClient::flushOutput() {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    while (!outBuffer.empty()) {
+        ssize_t n = send(sockfd, outBuffer.data(), outBuffer.size(), MSG_NOSIGNAL);
+        if (n > 0) {
+            outBuffer.erase(0, n);
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break; // socket buffer full, wait for EPOLLOUT
+        }
+        connected = false;
+        return;
+    }
+    updateInterest(!outBuffer.empty());
+}
+
+void AsyncRedisClient::readInput() {
+    char chunk[16384];
+    while (true) {
+        ssize_t n = recv(sockfd, chunk, sizeof(chunk), 0);
+        if (n > 0) {
+            inBuffer.append(chunk, n);
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        connected = false; // EOF or hard error
+        break;
+    }
+
+    size_t pos = 0;
+    std::string reply;
+    while (frame.complete(inBuffer) && ResponseParser::parseBuffer(inBuffer, pos, reply)) {
+        frame.reset(pos);
+        Callback cb;
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            if (pending.empty()) {
+                continue; // unsolicited (e.g. push message), nobody to hand it to
+            }
+            cb = std::move(pending.front().cb);
+            pending.pop_front();
+        }
+        cb(true, reply);
+    }
+    inBuffer.erase(0, pos);
+    frame.shift(pos);
+}
+
+void AsyncRedisClient::failAll() {
+    std::deque<Pending> failed;
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        failed.swap(pending);
+        outBuffer.clear();
+    }
+    for (auto &p : failed) {
+        p.cb(false, "(Error) connection lost");
+    }
+}
+
+void AsyncRedisClient::eventLoop() {
+    struct epoll_event events[4];
+    while (!stopping) {
+        int n = epoll_wait(epollfd, events, 4, 100);
+        for (int i = 0; i < n; ++i) {
+            if (events[i].data.fd == wakefd) {
+                uint64_t drained;
+                ssize_t ignored = read(wakefd, &drained, sizeof(drained));
+                (void)ignored;
+                if (!connected && !stopping && !openSocket()) {
+                    failAll(); // reconnect lazily when new work shows up
+                }
+                if (connected) flushOutput();
+                continue;
+            }
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                connected = false;
+            }
+            if (connected && (events[i].events & EPOLLIN)) readInput();
+            if (connected && (events[i].events & EPOLLOUT)) flushOutput();
+        }
+
+        // Oldest request overdue: the stream is out of sync, drop the connection
+        if (connected && requestTimeoutMs > 0) {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            if (!pending.empty() && std::chrono::steady_clock::now() - pending.front().sentAt
+                                        > std::chrono::milliseconds(requestTimeoutMs)) {
+                connected = false;
+            }
+        }
+
+        if (!connected && sockfd != -1) {
+            epoll_ctl(epollfd, EPOLL_CTL_DEL, sockfd, nullptr);
+            ::close(sockfd);
+            sockfd = -1;
+            failAll();
+        }
+    }
+}
@@ -42,7 +42,10 @@ void printHelp() {
               << "      With arguments:            ./my_redis_cli -h <host> -p <port>\n"
               << "      Default Host (127.0.0.1):  ./my_redis_cli -p <port>\n"
               << "      Default Port (6379):       ./my_redis_cli -h <host>\n"
+              << "      Unix socket:               ./my_redis_cli -s <socket path>\n"
               << "      One-shot execution:        ./my_redis_cli <command> [arguments]\n"
+              << "      Cluster mode:              ./my_redis_cli -c -p <port of any node>\n"
+              << "      Move slots to a node:      ./my_redis_cli -p <port of any node> --reshard <first[-last]> <host:port>\n"
               << "\n"
               << "Interactive Mode (REPL):\n"
               << "      ./my_redis_cli\n"
@@ -64,8 +67,13 @@ void printHelp() {
               << std::endl;
 }
 
-CLI::CLI(const std::string &host, int port) 
-    : host(host), port(port), redisClient(host, port) {}
+CLI::CLI(const std::string &host, int port, bool cluster) 
+    : host(host), port(port), redisClient(host, port) {
+    if (cluster) {
+        clusterClient = std::make_unique<ClusterClient>(std::vector<std::string>{host + ":" + std::to_string(port)});
+        clusterClient->refreshSlots();
+    }
+}
 
 void CLI::run(const std::vector<std::string>& commandArgs) {
     bool readlineActive = false;
@@ -92,7 +100,8 @@ void CLI::run(const std::vector<std::string>& commandArgs) {
     fds[1].events = POLLIN;
 
     // Install readline handler once before the loop
-    rl_callback_handler_install((host + ":" + std::to_string(port) + "> ").c_str(), handleLine);
+    const std::string prompt = (host[0] == '/' ? host : host + ":" + std::to_string(port)) + "> ";
+    rl_callback_handler_install(prompt.c_str(), handleLine);
     readlineActive = true;
 
     while (true) {
@@ -167,17 +176,27 @@ void CLI::run(const std::vector<std::string>& commandArgs) {
     
             // std::cout<<"first command check : "<<firstCmd<<std::endl;
 
-            if (firstCmd == "SUBSCRIBE") {
+            if (firstCmd == "SUBSCRIBE" || firstCmd == "PSUBSCRIBE") {
                 if (readlineActive) {
                     rl_callback_handler_remove();
                     readlineActive = false;
                 }
                 handleSubscription(args);
-                rl_callback_handler_install((host + ":" + std::to_string(port) + "> ").c_str(), handleLine);
+                rl_callback_handler_install(prompt.c_str(), handleLine);
                 readlineActive = true;
                 continue;  // skip rest of loop
             }
     
+            if (clusterClient) {
+                std::string response;
+                if (!clusterClient->execute(args, response)) {
+                    response = "(Error) Failed to reach the cluster node.";
+                }
+                std::cout << "\n" << response << "\n";
+                std::cout.flush();
+                continue;
+            }
+
             std::string command = CommandHandler::buildRESPcommand(args);
             if (!redisClient.sendCommand(command)) {
                 std::cerr << "(Error) Failed to send command.\n";
@@ -220,6 +239,16 @@ void CLI::run(const std::vector<std::string>& commandArgs) {
 void CLI::executeCommand(const std::vector<std::string>& args) {
     if (args.empty()) return;
 
+    if (clusterClient) {
+        std::string response;
+        if (!clusterClient->execute(args, response)) {
+            std::cerr << "(Error) Failed to reach the cluster node.\n";
+            return;
+        }
+        std::cout << response << "\n";
+        return;
+    }
+
     std::string command = CommandHandler::buildRESPcommand(args);
     if (!redisClient.sendCommand(command)) {
         std::cerr << "(Error) Failed to send command.\n";
@@ -242,7 +271,7 @@ void CLI::executeCommand(const std::vector<std::string>& args) {
 void CLI::handleSubscription(const std::vector<std::string>& args) {
     std::string command = CommandHandler::buildRESPcommand(args);
     if (!redisClient.sendCommand(command)) {
-        std::cerr << "(Error) Failed to send SUBSCRIBE command.\n";
+        std::cerr << "(Error) Failed to send " << args[0] << " command.\n";
         return;
     }
 
@@ -307,9 +336,19 @@ void CLI::handleSubscription(const std::vector<std::string>& args) {
             lineReady = false;
 
             if (input == "exit" || input == "quit") {
-                std::vector<std::string> unsubCmd = {"UNSUBSCRIBE"};
-                std::string unsubCommand = CommandHandler::buildRESPcommand(unsubCmd);
+                std::string unsubCommand = CommandHandler::buildRESPcommand({"UNSUBSCRIBE"}) +
+                                           CommandHandler::buildRESPcommand({"PUNSUBSCRIBE"});
                 redisClient.sendCommand(unsubCommand);
+                // Skip messages still in flight up to the last confirmation, so they
+                // aren't taken for the replies of the next commands
+                while (true) {
+                    std::string reply = ResponseParser::parseResponse(sockfd);
+                    if (reply.rfind("(Error) No response", 0) == 0 ||
+                        (reply.rfind("punsubscribe\n", 0) == 0 && reply.size() >= 2 &&
+                         reply.compare(reply.size() - 2, 2, "\n0") == 0)) {
+                        break;
+                    }
+                }
                 inSubscription = false;
             } else {
                 std::cout << "(Info) Type 'exit'/'quit' to leave subscription mode.\n";
@@ -0,0 +1,279 @@
+/*
+Slot-aware routing for cluster mode (ClusterClient)
+    A command is sent to the node owning the hash slot of its key, so a
+    well-routed request costs one round trip like a plain RedisClient.
+
+    Implements:
+        keySlot()      → CRC16 of the key (or its {hash tag}) mod 16384, as the server does.
+        routingKey()   → which argument is the key (EVAL/EVALSHA use numkeys, a few commands have none).
+        refreshSlots() → CLUSTER SLOTS, flattened by the parser into first/last/host/port/id groups.
+        execute()      → route, then follow MOVED (remap), ASK (ASKING + retry there) and TRYAGAIN.
+        migrateSlot()  → reshard one slot with SETSLOT IMPORTING/MIGRATING, MIGRATE ... KEYS, SETSLOT NODE.
+*/
+
+#include "../include/ClusterClient.h"
+#include <set>
+#include <sstream>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+#include <algorithm>
+
+static const int kMaxRedirects = 5;
+
+static uint16_t crc16(const char *data, size_t len) {
+    uint16_t crc = 0;
+    for (size_t i = 0; i < len; ++i) {
+        crc ^= static_cast<uint16_t>(static_cast<uint8_t>(data[i]) << 8);
+        for (int b = 0; b < 8; ++b) {
+            crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021) : static_cast<uint16_t>(crc << 1);
+        }
+    }
+    return crc;
+}
+
+// "(Error) MOVED 3999 127.0.0.1:7001" -> slot, address
+static bool parseRedirect(const std::string &reply, const std::string &kind, int &slot, std::string &address) {
+    std::string prefix = "(Error) " + kind + " ";
+    if (reply.compare(0, prefix.size(), prefix) != 0) {
+        return false;
+    }
+    std::istringstream in(reply.substr(prefix.size()));
+    return static_cast<bool>(in >> slot >> address) && slot >= 0 && slot < ClusterClient::kSlots;
+}
+
+ClusterClient::ClusterClient(const std::vector<std::string> &seeds, int connectTimeoutMs, int readTimeoutMs)
+    : seeds(seeds), connectTimeoutMs(connectTimeoutMs), readTimeoutMs(readTimeoutMs), slotOwner(kSlots) {}
+
+int ClusterClient::keySlot(const std::string &key) {
+    size_t open = key.find('{');
+    if (open != std::string::npos) {
+        size_t close = key.find('}', open + 1);
+        if (close != std::string::npos && close != open + 1) {
+            return crc16(key.data() + open + 1, close - open - 1) & (kSlots - 1);
+        }
+    }
+    return crc16(key.data(), key.size()) & (kSlots - 1);
+}
+
+std::string ClusterClient::routingKey(const std::vector<std::string> &args) {
+    static const std::set<std::string> keyless = {
+        "PING", "ECHO", "INFO", "ROLE", "CLUSTER", "KEYS", "FLUSHALL", "MULTI", "EXEC", "DISCARD",
+        "UNWATCH", "SCRIPT", "ASKING", "REPLICAOF", "SLAVEOF", "MEMORY"};
+    if (args.size() < 2) {
+        return "";
+    }
+    std::string cmd = args[0];
+    std::transform(cmd.begin(), cmd.end(), cmd.begin(), ::toupper);
+    if (cmd == "EVAL" || cmd == "EVALSHA") {
+        if (args.size() > 3 && std::strtol(args[2].c_str(), nullptr, 10) > 0) {
+            return args[3];
+        }
+        return "";
+    }
+    if (cmd == "LMPOP") {
+        return args.size() > 2 ? args[2] : "";
+    }
+    if (keyless.count(cmd)) {
+        return "";
+    }
+    return args[1];
+}
+
+RedisClient *ClusterClient::node(const std::string &address) {
+    auto it = nodes.find(address);
+    if (it != nodes.end()) {
+        return it->second.get();
+    }
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos) {
+        return nullptr;
+    }
+    int port = std::atoi(address.c_str() + colon + 1);
+    auto client = std::make_unique<RedisClient>(address.substr(0, colon), port, connectTimeoutMs, readTimeoutMs);
+    RedisClient *raw = client.get();
+    nodes[address] = std::move(client);
+    return raw; // connects on first execute()
+}
+
+RedisClient *ClusterClient::anyNode() {
+    for (const auto &seed : seeds) {
+        RedisClient *client = node(seed);
+        if (client && (client->isConnected() || client->connectToServer())) {
+            return client;
+        }
+    }
+    for (auto &entry : nodes) {
+        if (entry.second->isConnected() || entry.second->connectToServer()) {
+            return entry.second.get();
+        }
+    }
+    return nullptr;
+}
+
+bool ClusterClient::refreshSlots() {
+    std::lock_guard<std::mutex> lock(clusterMutex);
+    return refreshSlotsLocked();
+}
+
+bool ClusterClient::refreshSlotsLocked() {
+    RedisClient *client = anyNode();
+    std::string reply;
+    if (!client || !client->execute({"CLUSTER", "SLOTS"}, reply) || reply.compare(0, 7, "(Error)") == 0) {
+        return false;
+    }
+    // One node per range :- first, last, host, port, id
+    std::vector<std::string> fields;
+    std::istringstream in(reply);
+    std::string line;
+    while (std::getline(in, line)) {
+        fields.push_back(line);
+    }
+    if (fields.size() % 5 != 0) {
+        return false;
+    }
+    std::fill(slotOwner.begin(), slotOwner.end(), std::string());
+    for (size_t i = 0; i + 4 < fields.size(); i += 5) {
+        int first = std::atoi(fields[i].c_str());
+        int last = std::atoi(fields[i + 1].c_str());
+        std::string address = fields[i + 2] + ":" + fields[i + 3];
+        for (int s = std::max(first, 0); s <= last && s < kSlots; ++s) {
+            slotOwner[s] = address;
+        }
+    }
+    return true;
+}
+
+bool ClusterClient::execute(const std::vector<std::string> &args, std::string &reply) {
+    std::lock_guard<std::mutex> lock(clusterMutex);
+    std::string key = routingKey(args);
+    RedisClient *target = nullptr;
+    if (!key.empty() && !slotOwner[keySlot(key)].empty()) {
+        target = node(slotOwner[keySlot(key)]);
+    }
+    if (!target) {
+        target = anyNode();
+    }
+
+    bool asking = false;
+    for (int attempt = 0; attempt <= kMaxRedirects; ++attempt) {
+        if (!target) {
+            return false;
+        }
+        if (asking) {
+            std::string ok;
+            if (!target->execute({"ASKING"}, ok)) {
+                return false;
+            }
+            asking = false;
+        }
+        if (!target->execute(args, reply)) {
+            return false;
+        }
+        int slot;
+        std::string address;
+        if (parseRedirect(reply, "MOVED", slot, address)) {
+            // The slot has a new owner for good, the rest of the map is probably stale too
+            slotOwner[slot] = address;
+            refreshSlotsLocked();
+            target = node(address);
+        } else if (parseRedirect(reply, "ASK", slot, address)) {
+            // Mid-migration: this key only, the map stays as it is
+            target = node(address);
+            asking = true;
+        } else if (reply.compare(0, 16, "(Error) TRYAGAIN") == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10 * (attempt + 1)));
+        } else {
+            return true;
+        }
+    }
+    return true; // out of redirects, hand back the last one
+}
+
+bool ClusterClient::migrateSlot(int slot, const std::string &target, std::string &error, size_t batchKeys, int timeoutMs) {
+    std::lock_guard<std::mutex> lock(clusterMutex);
+    if (slot < 0 || slot >= kSlots) {
+        error = "slot out of range";
+        return false;
+    }
+    if (!refreshSlotsLocked() || slotOwner[slot].empty()) {
+        error = "can't load the slot map";
+        return false;
+    }
+    std::string source = slotOwner[slot];
+    if (source == target) {
+        return true;
+    }
+
+    // Node ids and addresses from CLUSTER NODES :- "<id> <host:port@cport> ..."
+    std::string reply;
+    if (!node(source)->execute({"CLUSTER", "NODES"}, reply)) {
+        error = "can't reach " + source;
+        return false;
+    }
+    std::map<std::string, std::string> ids; // address -> id
+    std::istringstream lines(reply);
+    std::string line;
+    while (std::getline(lines, line)) {
+        std::istringstream fields(line);
+        std::string id, address;
+        if (fields >> id >> address) {
+            ids[address.substr(0, address.find('@'))] = id;
+        }
+    }
+    if (!ids.count(target)) {
+        error = target + " is not a cluster node";
+        return false;
+    }
+
+    RedisClient *from = node(source);
+    RedisClient *to = node(target);
+    std::string slotArg = std::to_string(slot);
+    if (!to->execute({"CLUSTER", "SETSLOT", slotArg, "IMPORTING", ids[source]}, reply) || reply != "OK") {
+        error = "IMPORTING on " + target + ": " + reply;
+        return false;
+    }
+    if (!from->execute({"CLUSTER", "SETSLOT", slotArg, "MIGRATING", ids[target]}, reply) || reply != "OK") {
+        error = "MIGRATING on " + source + ": " + reply;
+        return false;
+    }
+
+    size_t colon = target.rfind(':');
+    while (true) {
+        std::string keys;
+        if (!from->execute({"CLUSTER", "GETKEYSINSLOT", slotArg, std::to_string(batchKeys)}, keys)) {
+            error = "can't reach " + source;
+            return false;
+        }
+        if (keys.empty()) {
+            break;
+        }
+        std::vector<std::string> args = {"MIGRATE", target.substr(0, colon), target.substr(colon + 1), "", "0",
+                                         std::to_string(timeoutMs), "REPLACE", "KEYS"};
+        std::istringstream names(keys);
+        std::string key;
+        while (std::getline(names, key)) {
+            args.push_back(key);
+        }
+        if (!from->execute(args, reply) || (reply != "OK" && reply != "NOKEY")) {
+            error = "MIGRATE: " + reply;
+            return false;
+        }
+    }
+
+    // Hand over :- the target first, so it serves the slot before anyone is sent there
+    std::vector<std::string> order = {target, source};
+    for (const auto &entry : ids) {
+        if (entry.first != target && entry.first != source) {
+            order.push_back(entry.first);
+        }
+    }
+    for (const auto &address : order) {
+        if (!node(address)->execute({"CLUSTER", "SETSLOT", slotArg, "NODE", ids[target]}, reply) || reply != "OK") {
+            error = "SETSLOT NODE on " + address + ": " + reply;
+            return false;
+        }
+    }
+    slotOwner[slot] = target;
+    return true;
+}
@@ -0,0 +1,122 @@
+/*
+Thread-safe pool of RedisClient connections (ConnectionPool)
+    Threads borrow a connection with acquire(), use it exclusively and hand it
+    back automatically when the PooledConnection handle is destroyed.
+
+    Implements:
+        acquire() → reuses an idle connection (PINGing it first if it sat idle
+                    for a while), opens a new one under maxConnections, or waits.
+        execute() → one-shot borrow/run/return helper.
+    Broken connections are dropped instead of returned so the pool heals itself.
+*/
+
+#include "../include/ConnectionPool.h"
+
+PooledConnection::PooledConnection(ConnectionPool *pool, std::unique_ptr<RedisClient> client)
+    : pool(pool), client(std::move(client)) {}
+
+PooledConnection::PooledConnection(PooledConnection &&other) noexcept
+    : pool(other.pool), client(std::move(other.client)) {
+    other.pool = nullptr;
+}
+
+PooledConnection &PooledConnection::operator=(PooledConnection &&other) noexcept {
+    if (this != &other) {
+        release();
+        pool = other.pool;
+        client = std::move(other.client);
+        other.pool = nullptr;
+    }
+    return *this;
+}
+
+PooledConnection::~PooledConnection() {
+    release();
+}
+
+void PooledConnection::release() {
+    if (pool && client) {
+        pool->giveBack(std::move(client));
+    }
+    pool = nullptr;
+}
+
+ConnectionPool::ConnectionPool(const std::string &host, int port, const PoolConfig &config)
+    : host(host), port(port), config(config), open(0) {}
+
+ConnectionPool::~ConnectionPool() {
+    std::lock_guard<std::mutex> lock(poolMutex);
+    idle.clear();
+}
+
+PooledConnection ConnectionPool::acquire() {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(config.acquireTimeoutMs);
+    std::unique_lock<std::mutex> lock(poolMutex);
+    while (true) {
+        if (!idle.empty()) {
+            IdleEntry entry = std::move(idle.back());
+            idle.pop_back();
+            auto idleFor = std::chrono::steady_clock::now() - entry.since;
+            lock.unlock();
+            // Health check outside the lock: a stale socket gets one reconnect attempt
+            bool healthy = entry.client->isConnected();
+            if (healthy && idleFor > std::chrono::milliseconds(config.healthCheckIdleMs)) {
+                healthy = entry.client->ping();
+            }
+            if (!healthy) {
+                healthy = entry.client->reconnect();
+            }
+            if (healthy) {
+                return PooledConnection(this, std::move(entry.client));
+            }
+            lock.lock();
+            --open;
+            continue;
+        }
+        if (open < config.maxConnections) {
+            ++open; // reserve the slot before connecting without the lock held
+            lock.unlock();
+            std::unique_ptr<RedisClient> client(
+                new RedisClient(host, port, config.connectTimeoutMs, config.readTimeoutMs));
+            if (client->connectToServer()) {
+                return PooledConnection(this, std::move(client));
+            }
+            lock.lock();
+            --open;
+            available.notify_one();
+            return PooledConnection();
+        }
+        if (available.wait_until(lock, deadline) == std::cv_status::timeout && idle.empty()
+            && open >= config.maxConnections) {
+            return PooledConnection();
+        }
+    }
+}
+
+void ConnectionPool::giveBack(std::unique_ptr<RedisClient> client) {
+    std::lock_guard<std::mutex> lock(poolMutex);
+    if (client->isConnected()) {
+        idle.push_back({std::move(client), std::chrono::steady_clock::now()});
+    } else {
+        --open; // execute() gave up on it, let the slot be reopened
+    }
+    available.notify_one();
+}
+
+bool ConnectionPool::execute(const std::vector<std::string> &args, std::string &reply) {
+    PooledConnection conn = acquire();
+    if (!conn) {
+        return false;
+    }
+    return conn->execute(args, reply);
+}
+
+size_t ConnectionPool::idleCount() {
+    std::lock_guard<std::mutex> lock(poolMutex);
+    return idle.size();
+}
+
+size_t ConnectionPool::openCount() {
+    std::lock_guard<std::mutex> lock(poolMutex);
+    return open;
+}
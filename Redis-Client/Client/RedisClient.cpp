@@ -1,25 +1,102 @@
 /*
 Establishing a TCP Connection to Redis (RedisClient)
     Uses Berkeley sockets to open a TCP connection to the Redis server.
-    Supports IPv4 and IPv6 resolution using getaddrinfo.
+    Supports IPv4 and IPv6 resolution using getaddrinfo, and Unix domain sockets
+    when the host is a path (starts with '/'; the port is then ignored).
     
     Implements:
-        connectToServer() → Establishes the connection.
+        connectToServer() → Establishes the connection (optionally with a timeout).
         sendCommand() → Sends a command over the socket.
+        execute() → Sends a command and reads back the reply, reconnecting first if the server
+                    closed the socket (never resending a command that may have run).
+        enableNearCache() → Serves single-key reads from memory until the server invalidates them.
         disconnect() → Closes the socket when finished.
 */
 
 
 #include "../include/RedisClient.h"
+#include "../include/CommandHandler.h"
+#include "../include/ResponseParser.h"
+#include <fcntl.h>
+#include <poll.h>
+#include <cerrno>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/un.h>
+#include <algorithm>
+#include <unordered_set>
+#include <cstdlib>
 
-RedisClient::RedisClient(const std::string &host, int port) 
-    : host(host), port(port), sockfd(-1) {}
+static const char *kInvalidateChannel = "__redis__:invalidate";
+
+// Reads whose reply depends on their one key only, so one invalidation covers them
+static bool cacheableRead(const std::vector<std::string> &args) {
+    static const std::unordered_set<std::string> commands = {
+        "GET", "STRLEN", "TYPE", "HGET", "HMGET", "HGETALL", "HEXISTS", "HLEN", "HKEYS", "HVALS",
+        "LLEN", "LRANGE", "LINDEX", "SCARD", "SMEMBERS", "SISMEMBER", "ZCARD", "ZSCORE", "ZRANGE"};
+    if (args.size() < 2) return false;
+    std::string cmd = args[0];
+    std::transform(cmd.begin(), cmd.end(), cmd.begin(), ::toupper);
+    if (cmd == "EXISTS") return args.size() == 2;
+    return commands.count(cmd) > 0;
+}
+
+static bool flushesAll(const std::vector<std::string> &args) {
+    std::string cmd = args.empty() ? "" : args[0];
+    std::transform(cmd.begin(), cmd.end(), cmd.begin(), ::toupper);
+    return cmd == "FLUSHALL" || cmd == "FLUSHDB";
+}
+
+RedisClient::RedisClient(const std::string &host, int port, int connectTimeoutMs, int readTimeoutMs) 
+    : host(host), port(port), sockfd(-1), connectTimeoutMs(connectTimeoutMs), readTimeoutMs(readTimeoutMs) {}
 
 RedisClient::~RedisClient() {
     disconnect();
+    disableNearCache();
+}
+
+// Non-blocking connect + poll so an unreachable host fails after connectTimeoutMs
+bool RedisClient::connectWithTimeout(int fd, const struct sockaddr *addr, socklen_t len) {
+    if (connectTimeoutMs <= 0) {
+        return connect(fd, addr, len) == 0;
+    }
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    int rc = connect(fd, addr, len);
+    if (rc != 0 && errno == EINPROGRESS) {
+        struct pollfd pfd = {fd, POLLOUT, 0};
+        rc = -1;
+        if (poll(&pfd, 1, connectTimeoutMs) == 1) {
+            int soErr = 0;
+            socklen_t errLen = sizeof(soErr);
+            getsockopt(fd, SOL_SOCKET, SO_ERROR, &soErr, &errLen);
+            rc = (soErr == 0) ? 0 : -1;
+        }
+    }
+    fcntl(fd, F_SETFL, flags);
+    return rc == 0;
 }
 
 bool RedisClient::connectToServer() {
+    if (!host.empty() && host[0] == '/') {
+        // Unix domain socket :- same host, no TCP stack in between
+        struct sockaddr_un addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, host.c_str(), sizeof(addr.sun_path) - 1);
+        sockfd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (sockfd != -1 && !connectWithTimeout(sockfd, (struct sockaddr *)&addr, sizeof(addr))) {
+            close(sockfd);
+            sockfd = -1;
+        }
+        if (sockfd == -1) {
+            std::cerr << "Could not connect to " << host << "\n";
+            return false;
+        }
+        applyTimeouts();
+        return true;
+    }
+
     struct addrinfo hints, *res = nullptr;
     std::memset(&hints, 0, sizeof(hints)); 
     hints.ai_family = AF_UNSPEC; // IPv4 or IPv6
@@ -36,7 +113,7 @@ bool RedisClient::connectToServer() {
     for (auto p = res; p != nullptr; p = p->ai_next) {
         sockfd = socket(p->ai_family, p->ai_socktype, p->ai_protocol); 
         if(sockfd == -1) continue; 
-        if (connect(sockfd, p->ai_addr, p->ai_addrlen) == 0) { 
+        if (connectWithTimeout(sockfd, p->ai_addr, p->ai_addrlen)) { 
             break; 
         }
         close(sockfd); 
@@ -48,9 +125,23 @@ bool RedisClient::connectToServer() {
         std::cerr << "Could not connect to " << host << ":" << port << "\n"; 
         return false;
     }
+
+    int one = 1;
+    setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    applyTimeouts();
     return true; 
 }
 
+void RedisClient::applyTimeouts() {
+    if (readTimeoutMs > 0) {
+        struct timeval tv;
+        tv.tv_sec = readTimeoutMs / 1000;
+        tv.tv_usec = (readTimeoutMs % 1000) * 1000;
+        setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(sockfd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    }
+}
+
 void RedisClient::disconnect() {
     if (sockfd != -1) {
         close(sockfd); 
@@ -58,12 +149,247 @@ void RedisClient::disconnect() {
     }
 }
 
+bool RedisClient::reconnect() {
+    disconnect();
+    return connectToServer();
+}
+
+bool RedisClient::isConnected() const {
+    return sockfd != -1;
+}
+
 int RedisClient::getSocketFD() const {
     return sockfd;
 }
 
 bool RedisClient::sendCommand(const std::string &command) {
     if (sockfd == -1) return false;
-    ssize_t sent = send(sockfd, command.c_str(), command.size(), 0);
-    return (sent == (ssize_t)command.size());
-}
\ No newline at end of file
+    size_t total = 0;
+    while (total < command.size()) {
+        ssize_t sent = send(sockfd, command.c_str() + total, command.size() - total, MSG_NOSIGNAL);
+        if (sent <= 0) return false;
+        total += sent;
+    }
+    return true;
+}
+
+bool RedisClient::roundTrip(const std::string &command, std::string &reply, bool &sent) {
+    sent = false;
+    if (sockfd == -1) return false;
+    size_t total = 0;
+    while (total < command.size()) {
+        ssize_t n = send(sockfd, command.c_str() + total, command.size() - total, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        sent = true;
+        total += n;
+    }
+    if (!ResponseParser::readResponse(sockfd, reply)) {
+        return false;
+    }
+    lastReply = std::chrono::steady_clock::now();
+    return true;
+}
+
+// A send to a socket the server already closed (--timeout, restart) usually
+// succeeds and only the read fails, when it's too late to tell whether the
+// command ran. So a connection idle for a while is looked at first.
+bool RedisClient::peerClosed() {
+    char byte;
+    ssize_t n = recv(sockfd, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+    return n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK);
+}
+
+bool RedisClient::execute(const std::vector<std::string> &args, std::string &reply) {
+    std::lock_guard<std::mutex> lock(ioMutex);
+    std::string command = CommandHandler::buildRESPcommand(args);
+    bool cacheRead = false;
+    uint64_t epoch = 0;
+    if (nearCacheOn) {
+        std::lock_guard<std::mutex> cacheLock(cacheMutex);
+        if (cacheableRead(args)) {
+            auto it = nearCache.find(args[1]);
+            if (it != nearCache.end()) {
+                auto hit = it->second.find(command);
+                if (hit != it->second.end()) {
+                    ++stats.hits;
+                    reply = hit->second;
+                    return true;
+                }
+            }
+            ++stats.misses;
+            cacheRead = true;
+            epoch = cacheEpoch;
+        } else if (flushesAll(args)) {
+            nearCache.clear();
+            cachedReplies = 0;
+        } else {
+            // Our own write :- its invalidation may come after our next read, so
+            // drop every cached key it names now
+            for (size_t i = 1; i < args.size(); ++i) {
+                dropCached(args[i]);
+            }
+        }
+    }
+
+    if (sockfd != -1 && std::chrono::steady_clock::now() - lastReply >= std::chrono::seconds(1) && peerClosed()) {
+        disconnect();
+    }
+    bool sent = false;
+    bool ok = sockfd != -1 && roundTrip(command, reply, sent);
+    if (!ok) {
+        // Broken or timed out connection: whatever is left on it can't be trusted
+        disconnect();
+        if (sent) {
+            return false; // the server may have run it, sending it again could run it twice
+        }
+        ok = reconnect() && (!nearCacheOn || startTracking()) && roundTrip(command, reply, sent);
+        if (!ok) {
+            disconnect();
+            return false;
+        }
+    }
+
+    if (cacheRead && reply.rfind("(Error)", 0) != 0) {
+        std::lock_guard<std::mutex> cacheLock(cacheMutex);
+        // An invalidation that came in while the read was in flight may be about
+        // this very key, then the reply can't be kept
+        if (nearCacheOn && epoch == cacheEpoch && nearCacheMax > 0) {
+            if (cachedReplies >= nearCacheMax && !nearCache.empty()) {
+                dropCached(std::string(nearCache.begin()->first));
+            }
+            auto &entries = nearCache[args[1]];
+            if (entries.emplace(command, reply).second) {
+                ++cachedReplies;
+            }
+        }
+    }
+    return true;
+}
+
+bool RedisClient::ping() {
+    std::string reply;
+    return execute({"PING"}, reply) && reply == "PONG";
+}
+
+//Near cache
+
+bool RedisClient::enableNearCache(size_t maxEntries) {
+    disableNearCache();
+    // Its own connection, without a read timeout: it only waits for invalidations
+    std::unique_ptr<RedisClient> conn(new RedisClient(host, port, connectTimeoutMs, 0));
+    std::string reply;
+    if (!conn->connectToServer() || !conn->execute({"CLIENT", "ID"}, reply)) {
+        return false;
+    }
+    uint64_t id = std::strtoull(reply.c_str(), nullptr, 10);
+    if (id == 0 || !conn->execute({"SUBSCRIBE", kInvalidateChannel}, reply) || reply.rfind("subscribe", 0) != 0) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(ioMutex);
+    invalidations = std::move(conn);
+    invalidationsId = id;
+    nearCacheMax = maxEntries;
+    if ((sockfd == -1 && !connectToServer()) || !startTracking()) {
+        invalidations.reset();
+        return false;
+    }
+    nearCacheOn = true;
+    invalidationThread = std::thread(&RedisClient::invalidationLoop, this);
+    return true;
+}
+
+void RedisClient::disableNearCache() {
+    nearCacheOn = false;
+    if (invalidations) {
+        shutdown(invalidations->getSocketFD(), SHUT_RDWR); // wakes the loop up
+    }
+    if (invalidationThread.joinable()) {
+        invalidationThread.join();
+    }
+    if (!invalidations) {
+        return;
+    }
+    invalidations.reset();
+    std::lock_guard<std::mutex> lock(ioMutex);
+    if (sockfd != -1) {
+        std::string reply;
+        bool sent;
+        roundTrip(CommandHandler::buildRESPcommand({"CLIENT", "TRACKING", "OFF"}), reply, sent);
+    }
+    std::lock_guard<std::mutex> cacheLock(cacheMutex);
+    nearCache.clear();
+    cachedReplies = 0;
+}
+
+RedisClient::NearCacheStats RedisClient::nearCacheStats() {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    NearCacheStats current = stats;
+    current.entries = cachedReplies;
+    return current;
+}
+
+// A new connection isn't tracked yet, and whatever we cached may have changed
+// while the old one was gone
+bool RedisClient::startTracking() {
+    {
+        std::lock_guard<std::mutex> cacheLock(cacheMutex);
+        nearCache.clear();
+        cachedReplies = 0;
+        ++cacheEpoch;
+    }
+    std::string reply;
+    std::string command = CommandHandler::buildRESPcommand(
+        {"CLIENT", "TRACKING", "ON", "REDIRECT", std::to_string(invalidationsId)});
+    bool sent;
+    return roundTrip(command, reply, sent) && reply == "OK";
+}
+
+void RedisClient::dropCached(const std::string &key) {
+    auto it = nearCache.find(key);
+    if (it != nearCache.end()) {
+        cachedReplies -= it->second.size();
+        nearCache.erase(it);
+    }
+}
+
+// Runs on its own thread: *3 message __redis__:invalidate [key] per changed
+// key, a null key after a flush
+void RedisClient::invalidationLoop() {
+    int fd = invalidations->getSocketFD();
+    std::string buf;
+    size_t pos = 0;
+    char chunk[4096];
+    std::vector<std::string> message;
+    while (true) {
+        ssize_t r = recv(fd, chunk, sizeof(chunk), 0);
+        if (r <= 0) {
+            break;
+        }
+        buf.append(chunk, r);
+        while (ResponseParser::parseBufferElements(buf, pos, message)) {
+            if (message.size() < 3 || message[0] != "message" || message[1] != kInvalidateChannel) {
+                continue;
+            }
+            std::lock_guard<std::mutex> cacheLock(cacheMutex);
+            ++cacheEpoch;
+            ++stats.invalidations;
+            if (message.size() == 3 && message[2] == "(nil)") {
+                nearCache.clear();
+                cachedReplies = 0;
+            } else {
+                for (size_t i = 2; i < message.size(); ++i) {
+                    dropCached(message[i]);
+                }
+            }
+        }
+        buf.erase(0, pos);
+        pos = 0;
+    }
+    // Without invalidations nothing cached can be trusted any more
+    nearCacheOn = false;
+    std::lock_guard<std::mutex> cacheLock(cacheMutex);
+    nearCache.clear();
+    cachedReplies = 0;
+    ++cacheEpoch;
+}
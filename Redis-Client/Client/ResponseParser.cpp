@@ -1,4 +1,5 @@
-// ResponseParser.cpp work with Redis server responses using RESP2 protocol and parse them into human-readable strings.
+// ResponseParser.cpp work with Redis server responses using RESP2 (and RESP3, after HELLO 3) protocol and parse them into human-readable strings.
+// RESP3 maps are flattened into key and value lines like RESP2 replies, sets and pushes read like arrays.
 #include "../include/ResponseParser.h"
 #include <iostream>
 #include <sstream>
@@ -39,6 +40,20 @@ std::string ResponseParser::parseResponse(int sockfd) {
         case ':' : return parseInteger(sockfd);
         case '$' : return parseBulkString(sockfd);
         case '*' : return parseArray(sockfd);
+        // RESP3
+        case '_' : readLine(sockfd); return "(nil)";
+        case ',' : return readLine(sockfd);   // double
+        case '(' : return readLine(sockfd);   // big number
+        case '#' : return readLine(sockfd) == "t" ? "true" : "false";
+        case '=' : { // verbatim, drop the "txt:" format
+            std::string verbatim = parseBulkString(sockfd);
+            return verbatim.size() >= 4 ? verbatim.substr(4) : "(Error) Malformed verbatim reply.";
+        }
+        case '!' : return "(Error) " + parseBulkString(sockfd);
+        case '~' : return parseArray(sockfd); // set
+        case '>' : return parseArray(sockfd); // push
+        case '%' : return parseAggregate(sockfd, 2); // map
+        case '|' : parseAggregate(sockfd, 2); return parseResponse(sockfd); // attributes describe the next reply, skipped
         default: 
             return "(Error) Unkown reply type.";
     }
@@ -85,11 +100,17 @@ std::string ResponseParser::parseBulkString(int sockfd) {
 }
 
 std::string ResponseParser::parseArray(int sockfd) {
+    return parseAggregate(sockfd, 1);
+}
+
+// count entries of perEntry replies each :- 1 for arrays and sets, 2 for maps
+std::string ResponseParser::parseAggregate(int sockfd, int perEntry) {
     std::string countStr = readLine(sockfd);
     int count = std::stoi(countStr);
     if (count == -1) {
         return "(nil)";
     }
+    count *= perEntry;
     std::ostringstream oss;
     for (int i = 0; i < count; ++i) {
         oss << parseResponse(sockfd);
@@ -98,4 +119,235 @@ std::string ResponseParser::parseArray(int sockfd) {
         }
     }
     return oss.str();
-}
\ No newline at end of file
+}
+
+// Buffer based parsing :- same output format as the socket parser above, but
+// never blocks: it returns false as soon as it runs out of bytes.
+static bool bufferLine(const std::string &buf, size_t &pos, std::string &line) {
+    size_t crlf = buf.find("\r\n", pos);
+    if (crlf == std::string::npos) {
+        return false;
+    }
+    line.assign(buf, pos, crlf - pos);
+    pos = crlf + 2;
+    return true;
+}
+
+// Skips an attribute (|n followed by n key/value pairs) in front of a reply
+static bool skipAttribute(const std::string &buf, size_t &pos) {
+    if (pos >= buf.size() || buf[pos] != '|') {
+        return true;
+    }
+    size_t cur = pos + 1;
+    std::string line, element;
+    if (!bufferLine(buf, cur, line)) {
+        return false;
+    }
+    long count = 2 * std::strtol(line.c_str(), nullptr, 10);
+    for (long i = 0; i < count; ++i) {
+        if (!ResponseParser::parseBuffer(buf, cur, element)) {
+            return false;
+        }
+    }
+    pos = cur;
+    return true;
+}
+
+bool ResponseParser::parseBuffer(const std::string &buf, size_t &pos, std::string &out) {
+    size_t start = pos;
+    if (!skipAttribute(buf, start) || start >= buf.size()) {
+        return false;
+    }
+    size_t cur = start + 1;
+    std::string line;
+    if (!bufferLine(buf, cur, line)) {
+        return false;
+    }
+    char type = buf[start];
+    switch (type) {
+        case '+' : out = line; break;
+        case '-' : out = "(Error) " + line; break;
+        case ':' : out = line; break;
+        case '_' : out = "(nil)"; break;
+        case ',' : out = line; break;
+        case '(' : out = line; break;
+        case '#' : out = line == "t" ? "true" : "false"; break;
+        case '$' :
+        case '=' :
+        case '!' : {
+            long length = std::strtol(line.c_str(), nullptr, 10);
+            if (length < 0) {
+                out = "(nil)";
+                break;
+            }
+            if (cur + length + 2 > buf.size()) {
+                return false;
+            }
+            if (type == '=' && length < 4) {
+                out = "(Error) Malformed verbatim reply.";
+            } else if (type == '=') {
+                out.assign(buf, cur + 4, length - 4); // verbatim, drop the "txt:" format
+            } else {
+                out.assign(buf, cur, length);
+            }
+            if (type == '!') {
+                out = "(Error) " + out;
+            }
+            cur += length + 2;
+            break;
+        }
+        case '*' :
+        case '~' :
+        case '>' :
+        case '%' : {
+            long count = std::strtol(line.c_str(), nullptr, 10);
+            if (count < 0) {
+                out = "(nil)";
+                break;
+            }
+            if (type == '%') {
+                count *= 2; // map :- key and value lines
+            }
+            std::string joined, element;
+            for (long i = 0; i < count; ++i) {
+                if (!parseBuffer(buf, cur, element)) {
+                    return false;
+                }
+                joined += element;
+                if (i != count - 1) {
+                    joined += "\n";
+                }
+            }
+            out = joined;
+            break;
+        }
+        default:
+            out = "(Error) Unkown reply type.";
+            break;
+    }
+    pos = cur;
+    return true;
+}
+
+bool ResponseParser::parseBufferElements(const std::string &buf, size_t &pos, std::vector<std::string> &out) {
+    size_t cur = pos;
+    if (!skipAttribute(buf, cur) || cur >= buf.size()) {
+        return false;
+    }
+    std::vector<std::string> elements;
+    char type = buf[cur];
+    if (type != '*' && type != '~' && type != '>' && type != '%') {
+        std::string single;
+        if (!parseBuffer(buf, cur, single)) {
+            return false;
+        }
+        elements.push_back(single);
+    } else {
+        size_t at = cur + 1;
+        std::string line;
+        if (!bufferLine(buf, at, line)) {
+            return false;
+        }
+        long count = std::strtol(line.c_str(), nullptr, 10);
+        if (type == '%') {
+            count *= 2;
+        }
+        cur = at;
+        if (count < 0) {
+            elements.push_back("(nil)");
+        }
+        std::vector<std::string> nested;
+        for (long i = 0; i < count; ++i) {
+            if (!parseBufferElements(buf, cur, nested)) {
+                return false;
+            }
+            elements.insert(elements.end(), nested.begin(), nested.end());
+        }
+    }
+    out = std::move(elements);
+    pos = cur;
+    return true;
+}
+
+// Carries on from the last complete element instead of starting over, so a reply that
+// arrives in many reads is only scanned once
+void ResponseParser::Frame::elementDone() {
+    while (!open.empty()) {
+        if (--open.back().remaining > 0) {
+            return;
+        }
+        bool attribute = open.back().attribute;
+        open.pop_back();
+        if (attribute) {
+            return; // |n pairs describe the next reply and don't count as an element
+        }
+    }
+    done = true;
+}
+
+bool ResponseParser::Frame::complete(const std::string &buf) {
+    while (!done) {
+        size_t cur = scanned + 1;
+        std::string line;
+        if (scanned >= buf.size() || !bufferLine(buf, cur, line)) {
+            return false;
+        }
+        char type = buf[scanned];
+        long count = std::strtol(line.c_str(), nullptr, 10);
+        switch (type) {
+            case '$' :
+            case '=' :
+            case '!' :
+                if (count >= 0 && cur + count + 2 > buf.size()) {
+                    return false; // the header is read again next time, the payload isn't
+                }
+                scanned = count >= 0 ? cur + count + 2 : cur;
+                elementDone();
+                break;
+            case '*' :
+            case '~' :
+            case '>' :
+            case '%' :
+            case '|' :
+                scanned = cur;
+                if (type == '%' || type == '|') {
+                    count *= 2;
+                }
+                if (count > 0) {
+                    open.push_back({count, type == '|'});
+                } else if (type != '|') {
+                    elementDone();
+                }
+                break;
+            default:
+                scanned = cur;
+                elementDone();
+                break;
+        }
+    }
+    return true;
+}
+
+void ResponseParser::Frame::reset(size_t start) {
+    scanned = start;
+    open.clear();
+    done = false;
+}
+
+bool ResponseParser::readResponse(int sockfd, std::string &out) {
+    // Request/reply mode has exactly one reply in flight, so nothing after it can be lost
+    std::string buf;
+    char chunk[4096];
+    Frame frame;
+    while (true) {
+        size_t pos = 0;
+        if (frame.complete(buf) && parseBuffer(buf, pos, out)) {
+            return true;
+        }
+        ssize_t r = recv(sockfd, chunk, sizeof(chunk), 0);
+        if (r <= 0) {
+            return false; // closed, error or SO_RCVTIMEO expired
+        }
+        buf.append(chunk, r);
+    }
+}
@@ -0,0 +1,191 @@
+/*
+Client benchmark (client_bench)
+    Compares the three ways of talking to the server from this client library:
+        blocking → one RedisClient, one request at a time
+        pool     → N threads sharing a ConnectionPool
+        async    → one AsyncRedisClient with a window of requests in flight
+        multi    → N AsyncRedisClients (-c), each with its own window (-d);
+                   enough concurrent load to keep several server shards busy
+        nearcache → one RedisClient on a read-mostly mix (1 SET per 100 GETs),
+                   without and then with the near cache (client-side caching)
+    The other modes run the same SET/GET mix; all report requests per second.
+
+    Usage: ./client_bench [-h host] [-p port] [-s unix socket] [-n requests] [-c threads] [-d depth] [mode...]
+*/
+
+#include "../include/RedisClient.h"
+#include "../include/ConnectionPool.h"
+#include "../include/AsyncRedisClient.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct BenchOptions {
+    std::string host = "127.0.0.1";
+    int port = 6379;
+    int requests = 100000;
+    int threads = 8;
+    int depth = 64;
+};
+
+static std::vector<std::string> requestFor(int i) {
+    std::string key = "bench:" + std::to_string(i % 1000);
+    if (i % 2 == 0) return {"SET", key, "value"};
+    return {"GET", key};
+}
+
+static void report(const std::string &mode, int requests, int failures,
+                   std::chrono::steady_clock::duration elapsed) {
+    double secs = std::chrono::duration<double>(elapsed).count();
+    std::cout << mode << ": " << requests << " requests in " << secs << "s, "
+              << static_cast<long>(requests / secs) << " req/s";
+    if (failures) std::cout << " (" << failures << " failed)";
+    std::cout << "\n";
+}
+
+static void benchBlocking(const BenchOptions &opt) {
+    RedisClient client(opt.host, opt.port, 1000, 2000);
+    if (!client.connectToServer()) return;
+    int failures = 0;
+    std::string reply;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < opt.requests; ++i) {
+        if (!client.execute(requestFor(i), reply)) ++failures;
+    }
+    report("blocking", opt.requests, failures, std::chrono::steady_clock::now() - start);
+}
+
+static void benchPool(const BenchOptions &opt) {
+    PoolConfig config;
+    config.maxConnections = opt.threads;
+    ConnectionPool pool(opt.host, opt.port, config);
+    std::atomic<int> next(0), failures(0);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int t = 0; t < opt.threads; ++t) {
+        workers.emplace_back([&]() {
+            std::string reply;
+            for (int i = next++; i < opt.requests; i = next++) {
+                if (!pool.execute(requestFor(i), reply)) ++failures;
+            }
+        });
+    }
+    for (auto &w : workers) w.join();
+    report("pool(" + std::to_string(opt.threads) + " threads)", opt.requests, failures,
+           std::chrono::steady_clock::now() - start);
+}
+
+// One pipelined connection, requests [first, last) with up to depth in flight
+static int runWindow(AsyncRedisClient &client, int first, int last, int depth) {
+    std::mutex m;
+    std::condition_variable cv;
+    int inFlight = 0, done = 0, failures = 0;
+    for (int i = first; i < last; ++i) {
+        {
+            std::unique_lock<std::mutex> lock(m);
+            cv.wait(lock, [&]() { return inFlight < depth; });
+            ++inFlight;
+        }
+        client.command(requestFor(i), [&](bool ok, const std::string &) {
+            std::lock_guard<std::mutex> lock(m);
+            if (!ok) ++failures;
+            --inFlight;
+            ++done;
+            cv.notify_all();
+        });
+    }
+    std::unique_lock<std::mutex> lock(m);
+    cv.wait(lock, [&]() { return done == last - first; });
+    return failures;
+}
+
+static void benchAsync(const BenchOptions &opt) {
+    AsyncRedisClient client(opt.host, opt.port);
+    if (!client.connect()) return;
+    auto start = std::chrono::steady_clock::now();
+    int failures = runWindow(client, 0, opt.requests, opt.depth);
+    report("async(depth " + std::to_string(opt.depth) + ")", opt.requests, failures,
+           std::chrono::steady_clock::now() - start);
+}
+
+static void benchMulti(const BenchOptions &opt) {
+    std::vector<std::unique_ptr<AsyncRedisClient>> clients;
+    for (int t = 0; t < opt.threads; ++t) {
+        clients.push_back(std::make_unique<AsyncRedisClient>(opt.host, opt.port));
+        if (!clients.back()->connect()) return;
+    }
+    std::atomic<int> failures(0);
+    int per = opt.requests / opt.threads;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> drivers;
+    for (int t = 0; t < opt.threads; ++t) {
+        drivers.emplace_back([&, t]() {
+            failures += runWindow(*clients[t], t * per, (t + 1) * per, opt.depth);
+        });
+    }
+    for (auto &d : drivers) d.join();
+    report("multi(" + std::to_string(opt.threads) + " x depth " + std::to_string(opt.depth) + ")",
+           per * opt.threads, failures, std::chrono::steady_clock::now() - start);
+}
+
+// Config-lookup style traffic: hot keys read far more often than written
+static std::vector<std::string> readMostlyFor(int i) {
+    if (i % 100 == 0) return {"SET", "bench:cfg:" + std::to_string(i / 100 % 1000), "value" + std::to_string(i)};
+    return {"GET", "bench:cfg:" + std::to_string(i % 1000)};
+}
+
+static void benchNearCache(const BenchOptions &opt) {
+    for (int cached = 0; cached < 2; ++cached) {
+        RedisClient client(opt.host, opt.port, 1000, 2000);
+        if (!client.connectToServer()) return;
+        if (cached && !client.enableNearCache()) {
+            std::cerr << "near cache not available\n";
+            return;
+        }
+        int failures = 0;
+        std::string reply;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < opt.requests; ++i) {
+            if (!client.execute(readMostlyFor(i), reply)) ++failures;
+        }
+        report(cached ? "read-mostly(near cache)" : "read-mostly(no cache)", opt.requests, failures,
+               std::chrono::steady_clock::now() - start);
+        if (cached) {
+            RedisClient::NearCacheStats stats = client.nearCacheStats();
+            std::cout << "  near cache: " << stats.hits << " hits, " << stats.misses << " misses, "
+                      << stats.invalidations << " invalidations\n";
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    BenchOptions opt;
+    std::vector<std::string> modes;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-h" && i + 1 < argc) opt.host = argv[++i];
+        else if (arg == "-p" && i + 1 < argc) opt.port = std::stoi(argv[++i]);
+        else if (arg == "-s" && i + 1 < argc) opt.host = argv[++i]; // RedisClient takes a path as host
+        else if (arg == "-n" && i + 1 < argc) opt.requests = std::stoi(argv[++i]);
+        else if (arg == "-c" && i + 1 < argc) opt.threads = std::stoi(argv[++i]);
+        else if (arg == "-d" && i + 1 < argc) opt.depth = std::stoi(argv[++i]);
+        else modes.push_back(arg);
+    }
+    if (modes.empty()) modes = {"blocking", "pool", "async"};
+
+    for (const auto &mode : modes) {
+        if (mode == "blocking") benchBlocking(opt);
+        else if (mode == "pool") benchPool(opt);
+        else if (mode == "async") benchAsync(opt);
+        else if (mode == "multi") benchMulti(opt);
+        else if (mode == "nearcache") benchNearCache(opt);
+        else std::cerr << "unknown mode " << mode << "\n";
+    }
+    return 0;
+}
@@ -0,0 +1,37 @@
+#!/bin/bash
+# Event loop backends compared: throughput and socket system calls per request
+# under a growing number of connections, one shard each.
+# Usage: bench/io_backends.sh [server binary] [requests] [connection counts...]
+#   run from Redis-Client/Client after `make bench` (BENCH=path overrides the benchmark binary);
+#   the server runs in a temp dir so its dump files do not land here
+SERVER=$(realpath "${1:-../../my_redis_server}")
+REQUESTS=${2:-200000}
+shift 2 2>/dev/null
+COUNTS=${*:-64 256 1024}
+PORT=6391
+BENCH=$(realpath "${BENCH:-build/client_bench}")
+WORKDIR=$(mktemp -d)
+
+# io_syscalls from INFO io
+syscalls() {
+    exec 3<>/dev/tcp/127.0.0.1/$PORT
+    printf '*2\r\n$4\r\nINFO\r\n$2\r\nio\r\n' >&3
+    timeout 1 cat <&3 | tr -d '\r' | sed -n 's/^io_syscalls://p'
+    exec 3<&-
+}
+
+ulimit -n 65536 2>/dev/null
+for backend in epoll uring; do
+    for clients in $COUNTS; do
+        (cd "$WORKDIR" && exec "$SERVER" $PORT --io-backend $backend > /dev/null 2>&1) &
+        pid=$!
+        sleep 0.5
+        before=$(syscalls)
+        result=$("$BENCH" -p $PORT -n "$REQUESTS" -c "$clients" -d 1 multi)
+        after=$(syscalls)
+        echo "$backend  clients=$clients  $result  syscalls/request=$(awk "BEGIN { printf \"%.2f\", ($after - $before) / $REQUESTS }")"
+        kill $pid 2>/dev/null
+        wait $pid 2>/dev/null
+    done
+done
+rm -rf "$WORKDIR"
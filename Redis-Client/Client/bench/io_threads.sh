@@ -0,0 +1,28 @@
+#!/bin/bash
+# Thread per connection against --io-threads 1, 2, 4, ... under the same multi-client load.
+# Usage: bench/io_threads.sh [server binary] [max I/O threads] [requests] [connections]
+#   run from Redis-Client/Client after `make bench` (BENCH=path overrides the benchmark binary);
+#   the server runs in a temp dir so its dump files do not land here
+SERVER=$(realpath "${1:-../../my_redis_server}")
+MAX=${2:-$(nproc)}
+REQUESTS=${3:-200000}
+CLIENTS=${4:-64}
+PORT=6392
+BENCH=$(realpath "${BENCH:-build/client_bench}")
+WORKDIR=$(mktemp -d)
+
+threads=0
+while [ "$threads" -le "$MAX" ]; do
+    if [ "$threads" -eq 0 ]; then args=""; label="per-connection"; else args="--io-threads $threads"; label="io-threads=$threads"; fi
+    for depth in 1 16; do
+        (cd "$WORKDIR" && exec "$SERVER" $PORT $args > /dev/null 2>&1) &
+        pid=$!
+        sleep 0.5
+        echo -n "$label  "
+        "$BENCH" -p $PORT -n "$REQUESTS" -c "$CLIENTS" -d $depth multi
+        kill $pid 2>/dev/null
+        wait $pid 2>/dev/null
+    done
+    if [ "$threads" -eq 0 ]; then threads=1; else threads=$((threads * 2)); fi
+done
+rm -rf "$WORKDIR"
@@ -0,0 +1,25 @@
+#!/bin/bash
+# Throughput of the server with 1, 2, 4, ... shards under the same multi-client load.
+# Usage: bench/shard_scaling.sh [server binary] [max shards] [requests]
+#   run from Redis-Client/Client after `make bench` (BENCH=path overrides the benchmark binary);
+#   the server runs in a temp dir so its dump files do not land here
+SERVER=$(realpath "${1:-../../my_redis_server}")
+MAX=${2:-$(nproc)}
+REQUESTS=${3:-400000}
+PORT=6390
+BENCH=$(realpath "${BENCH:-build/client_bench}")
+WORKDIR=$(mktemp -d)
+
+shards=1
+while [ "$shards" -le "$MAX" ]; do
+    if [ "$shards" -eq 1 ]; then args=""; else args="--shards $shards"; fi
+    (cd "$WORKDIR" && exec "$SERVER" $PORT $args > /dev/null 2>&1) &
+    pid=$!
+    sleep 0.5
+    echo -n "shards=$shards  "
+    "$BENCH" -p $PORT -n "$REQUESTS" -c 16 -d 32 multi
+    kill $pid 2>/dev/null
+    wait $pid 2>/dev/null
+    shards=$((shards * 2))
+done
+rm -rf "$WORKDIR"
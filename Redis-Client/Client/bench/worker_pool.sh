@@ -0,0 +1,38 @@
+#!/bin/bash
+# Thread per connection against --io-threads with 1 and N command executors, at 10, 1k and 10k clients.
+# Usage: bench/worker_pool.sh [server binary] [executors] [requests] [I/O threads]
+#   run from Redis-Client/Client after `make bench` (BENCH=path overrides the benchmark binary);
+#   every benchmark client holds 3 fds, so more than 5000 clients are split over several
+#   client_bench processes started together (one result line each); the server needs
+#   `ulimit -n` above the client count. The clients run under nice 19: thousands of client
+#   threads on the same cores would otherwise starve the server's few threads into timeouts
+SERVER=$(realpath "${1:-../../my_redis_server}")
+EXECUTORS=${2:-$(nproc)}
+REQUESTS=${3:-200000}
+IO_THREADS=${4:-$(nproc)}
+PORT=6393
+BENCH=$(realpath "${BENCH:-build/client_bench}")
+WORKDIR=$(mktemp -d)
+
+for clients in 10 1000 10000; do
+    for mode in threads exec1 execN; do
+        case $mode in
+            threads) args=""; label="per-connection";;
+            exec1)   args="--io-threads $IO_THREADS --exec-threads 1"; label="exec-threads=1";;
+            execN)   args="--io-threads $IO_THREADS --exec-threads $EXECUTORS"; label="exec-threads=$EXECUTORS";;
+        esac
+        (cd "$WORKDIR" && exec "$SERVER" $PORT --maxclients 20000 --tcp-backlog 4096 $args > /dev/null 2>&1) &
+        pid=$!
+        sleep 0.5
+        procs=$(( (clients + 4999) / 5000 ))
+        benches=""
+        for i in $(seq $procs); do
+            nice -n 19 "$BENCH" -p $PORT -n $((REQUESTS / procs)) -c $((clients / procs)) -d 1 multi | sed "s/^/$clients clients  $label  /" &
+            benches="$benches $!"
+        done
+        wait $benches
+        kill $pid 2>/dev/null
+        wait $pid 2>/dev/null
+    done
+done
+rm -rf "$WORKDIR"
@@ -0,0 +1,69 @@
+#ifndef ASYNC_REDIS_CLIENT_H
+#define ASYNC_REDIS_CLIENT_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <future>
+#include <functional>
+#include <chrono>
+#include "ResponseParser.h"
+
+// Non-blocking client: one socket, one epoll loop thread, any number of
+// requests in flight. Replies come back in send order (RESP is strictly
+// ordered per connection) so a FIFO of callbacks is enough to match them.
+class AsyncRedisClient {
+public:
+    using Callback = std::function<void(bool ok, const std::string &reply)>;
+
+    AsyncRedisClient(const std::string &host, int port, int requestTimeoutMs = 5000);
+    ~AsyncRedisClient();
+
+    bool connect();
+    void close();
+    bool isConnected() const { return connected; }
+
+    // Queue a command; cb runs on the event loop thread when the reply arrives
+    // (ok == false if the connection failed or the request timed out).
+    void command(const std::vector<std::string> &args, Callback cb);
+    std::future<std::string> command(const std::vector<std::string> &args);
+
+    size_t inFlight();
+
+private:
+    struct Pending {
+        Callback cb;
+        std::chrono::steady_clock::time_point sentAt;
+    };
+
+    bool openSocket();
+    void eventLoop();
+    void wake();
+    void flushOutput();
+    void readInput();
+    void failAll();
+    void updateInterest(bool wantWrite);
+
+    std::string host;
+    int port;
+    int requestTimeoutMs;
+
+    int sockfd;
+    int epollfd;
+    int wakefd;           // eventfd used to kick the loop when new output is queued
+    std::atomic<bool> connected;
+    std::atomic<bool> stopping;
+    std::thread loopThread;
+
+    std::mutex queueMutex;           // guards outBuffer + pending together so their order matches
+    std::string outBuffer;
+    std::deque<Pending> pending;
+    std::string inBuffer;            // loop thread only
+    ResponseParser::Frame frame;     // loop thread only, how far into inBuffer's next reply we've scanned
+    bool writeArmed;                 // loop thread only
+};
+
+#endif // ASYNC_REDIS_CLIENT_H
@@ -2,13 +2,16 @@
 #define CLI_H
 
 #include <string>
+#include <memory>
 #include "RedisClient.h"
 #include "CommandHandler.h"
 #include "ResponseParser.h"
+#include "ClusterClient.h"
 
 class CLI {
 public:
-    CLI(const std::string &host, int port);
+    // cluster: route every command by key slot and follow MOVED/ASK (-c)
+    CLI(const std::string &host, int port, bool cluster = false);
     void run(const std::vector<std::string>& commandArgs);
     void executeCommand(const std::vector<std::string>& commandArgs);
     //handles pub-sub
@@ -18,6 +21,7 @@ private:
     std::string host;
     int port;
     RedisClient redisClient;
+    std::unique_ptr<ClusterClient> clusterClient;
 };
 
 #endif // CLI_H
\ No newline at end of file
@@ -0,0 +1,51 @@
+#ifndef CLUSTER_CLIENT_H
+#define CLUSTER_CLIENT_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include "RedisClient.h"
+
+// Slot-aware client for a server cluster (server started with --cluster).
+// Keeps the slot -> node map from CLUSTER SLOTS and sends each command straight
+// to the node owning its key. MOVED refreshes the map and retries, ASK retries
+// once on the named node after ASKING, TRYAGAIN backs off and retries.
+class ClusterClient {
+public:
+    static const int kSlots = 16384;
+
+    // seeds: "host:port" of one or more cluster nodes
+    ClusterClient(const std::vector<std::string> &seeds, int connectTimeoutMs = 1000, int readTimeoutMs = 2000);
+
+    // Same contract as RedisClient::execute: false only on transport failure
+    bool execute(const std::vector<std::string> &args, std::string &reply);
+    // Reload the slot map from any reachable node
+    bool refreshSlots();
+
+    // Reshard: move slot to the node at target while it keeps serving traffic.
+    // IMPORTING on the target, MIGRATING on the owner, MIGRATE batchKeys keys at a
+    // time until the slot is empty, then SETSLOT NODE on every node. On failure the
+    // states are left in place so the move can simply be run again; error says why.
+    bool migrateSlot(int slot, const std::string &target, std::string &error, size_t batchKeys = 100, int timeoutMs = 5000);
+
+    // Slot of a key, hash tag aware; identical to the server's
+    static int keySlot(const std::string &key);
+    // Key the command is routed by, empty for keyless commands
+    static std::string routingKey(const std::vector<std::string> &args);
+
+private:
+    RedisClient *node(const std::string &address);
+    RedisClient *anyNode();
+    bool refreshSlotsLocked();
+
+    std::vector<std::string> seeds;
+    int connectTimeoutMs;
+    int readTimeoutMs;
+    std::mutex clusterMutex; // one command (and its redirects) at a time
+    std::map<std::string, std::unique_ptr<RedisClient>> nodes; // "host:port" -> connection
+    std::vector<std::string> slotOwner; // slot -> "host:port", empty if unknown
+};
+
+#endif // CLUSTER_CLIENT_H
@@ -0,0 +1,77 @@
+#ifndef CONNECTION_POOL_H
+#define CONNECTION_POOL_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include "RedisClient.h"
+
+struct PoolConfig {
+    size_t maxConnections = 8;       // hard cap on open sockets
+    int connectTimeoutMs = 1000;
+    int readTimeoutMs = 2000;
+    int acquireTimeoutMs = 5000;     // how long acquire() waits for a free connection
+    int healthCheckIdleMs = 30000;   // PING connections that sat idle longer than this before handing them out
+};
+
+class ConnectionPool;
+
+// RAII handle: the connection goes back to the pool when this goes out of scope
+class PooledConnection {
+public:
+    PooledConnection() : pool(nullptr) {}
+    PooledConnection(ConnectionPool *pool, std::unique_ptr<RedisClient> client);
+    PooledConnection(PooledConnection &&other) noexcept;
+    PooledConnection &operator=(PooledConnection &&other) noexcept;
+    ~PooledConnection();
+
+    explicit operator bool() const { return client != nullptr; }
+    RedisClient *operator->() const { return client.get(); }
+    RedisClient &operator*() const { return *client; }
+
+private:
+    void release();
+
+    ConnectionPool *pool;
+    std::unique_ptr<RedisClient> client;
+};
+
+class ConnectionPool {
+public:
+    ConnectionPool(const std::string &host, int port, const PoolConfig &config = PoolConfig());
+    ~ConnectionPool();
+
+    // Borrow a healthy connection, opening a new one if under the cap.
+    // Returns an empty handle if none became available within acquireTimeoutMs.
+    PooledConnection acquire();
+
+    // Convenience: borrow, run one command, give it back
+    bool execute(const std::vector<std::string> &args, std::string &reply);
+
+    size_t idleCount();
+    size_t openCount();
+
+private:
+    friend class PooledConnection;
+    void giveBack(std::unique_ptr<RedisClient> client);
+
+    struct IdleEntry {
+        std::unique_ptr<RedisClient> client;
+        std::chrono::steady_clock::time_point since;
+    };
+
+    std::string host;
+    int port;
+    PoolConfig config;
+
+    std::mutex poolMutex;
+    std::condition_variable available;
+    std::deque<IdleEntry> idle;   // most recently returned at the back
+    size_t open;                  // idle + borrowed
+};
+
+#endif // CONNECTION_POOL_H
@@ -2,6 +2,13 @@
 #define REDIS_CLIENT_H
 
 #include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <unordered_map>
+#include <chrono>
 #include <iostream>
 #include <netdb.h>
 #include <sys/socket.h>
@@ -10,18 +17,75 @@
 
 class RedisClient {
 public:
-    RedisClient(const std::string &host, int port);
+    // Timeouts are in milliseconds, 0 means block forever (the old behaviour).
+    // A host starting with '/' is the path of the server's Unix socket.
+    RedisClient(const std::string &host, int port, int connectTimeoutMs = 0, int readTimeoutMs = 0);
     ~RedisClient();
 
     bool connectToServer();
     void disconnect();
+    bool reconnect();
+    bool isConnected() const;
     int getSocketFD() const;
     bool sendCommand(const std::string &command);
 
+    // Send a command and wait for its parsed reply. Thread-safe. It reconnects
+    // and retries once only when none of the command went out (a dead socket);
+    // after a timeout or a lost reply it returns false, since the server may
+    // already have run it and INCR, RPUSH, ... must not run twice.
+    bool execute(const std::vector<std::string> &args, std::string &reply);
+    // Health check used by the connection pool
+    bool ping();
+
+    // Near cache (client-side caching) :- a second connection subscribes to the
+    // server's __redis__:invalidate channel and this one turns on CLIENT TRACKING
+    // with REDIRECT to it. Single-key reads (GET, HGET, HGETALL, LRANGE, ...)
+    // are then answered from memory until the server reports the key changed.
+    // At most maxEntries replies are kept. Losing the invalidation connection
+    // empties the cache and turns it off.
+    bool enableNearCache(size_t maxEntries = 10000);
+    void disableNearCache();
+    bool nearCacheEnabled() const { return nearCacheOn.load(); }
+    struct NearCacheStats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t invalidations = 0;
+        size_t entries = 0;
+    };
+    NearCacheStats nearCacheStats();
+
+    const std::string &getHost() const { return host; }
+    int getPort() const { return port; }
+
 private:
+    bool connectWithTimeout(int fd, const struct sockaddr *addr, socklen_t len);
+    void applyTimeouts(); // read/write timeouts on a freshly connected socket
+    // sent :- some of the command reached the socket, so it may have run
+    bool roundTrip(const std::string &command, std::string &reply, bool &sent);
+    bool peerClosed(); // the server hung up on the idle connection
+    bool startTracking(); // call with ioMutex held
+    void invalidationLoop();
+    void dropCached(const std::string &key); // call with cacheMutex held
+
     std::string host;
     int port;
     int sockfd;
+    int connectTimeoutMs;
+    int readTimeoutMs;
+    std::mutex ioMutex; // serialises request/response pairs on the socket
+    std::chrono::steady_clock::time_point lastReply; // idle connections are checked before use
+
+    // Near cache: key -> encoded command -> reply
+    std::mutex cacheMutex;
+    std::unordered_map<std::string, std::unordered_map<std::string, std::string>> nearCache;
+    size_t cachedReplies = 0;
+    size_t nearCacheMax = 0;
+    uint64_t cacheEpoch = 0; // bumped by every invalidation, a read started before one isn't cached
+    NearCacheStats stats;
+    std::atomic<bool> nearCacheOn{false};
+    std::unique_ptr<RedisClient> invalidations; // the REDIRECT target connection
+    uint64_t invalidationsId = 0;
+    std::thread invalidationThread;
 };
 
-#endif // REDIS_CLIENT_H
\ No newline at end of file
+#endif // REDIS_CLIENT_H
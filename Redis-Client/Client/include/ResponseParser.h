@@ -2,18 +2,55 @@
 #define RESPONSEPARSER_H
 
 #include <string>
+#include <cstddef>
+#include <vector>
 
 class ResponseParser {
 public:
     // Read from the given socket and return parsed response a string, return "" in failure.
     static std::string parseResponse(int sockfd);
+
+    // Read one full reply from the socket into out. Unlike parseResponse this
+    // reports transport failures (EOF, read timeout) by returning false.
+    static bool readResponse(int sockfd, std::string &out);
+
+    // Parse one reply from an in-memory buffer starting at pos. Returns false
+    // (and leaves pos untouched) if the buffer doesn't hold a complete reply yet.
+    // Used by the async client, which reads whatever the socket has.
+    static bool parseBuffer(const std::string &buf, size_t &pos, std::string &out);
+
+    // Like parseBuffer, but the elements of an array reply stay apart (nested
+    // arrays are flattened into them). Pub/sub messages need this when their
+    // payload is itself an array, like the server's key invalidations.
+    static bool parseBufferElements(const std::string &buf, size_t &pos, std::vector<std::string> &out);
+
+    // Finds where the reply at the front of a growing buffer ends without building it, picking
+    // up where the previous call stopped. Parse it once complete() is true, then reset(end()).
+    class Frame {
+    public:
+        bool complete(const std::string &buf);
+        size_t end() const { return scanned; }
+        void reset(size_t start = 0);
+        void shift(size_t dropped) { scanned -= dropped; } // the buffer's first bytes were erased
+    private:
+        struct Open {
+            long remaining;
+            bool attribute;
+        };
+        void elementDone();
+
+        size_t scanned = 0;
+        std::vector<Open> open;
+        bool done = false;
+    };
 private:
-    // Redis Serialization Protocol 2
+    // Redis Serialization Protocol 2, the RESP3 types map onto these
     static std::string parseSimpleString(int sockfd);
     static std::string parseSimpleError(int sockfd);
     static std::string parseInteger(int sockfd);
     static std::string parseBulkString(int sockfd);
     static std::string parseArray(int sockfd);
+    static std::string parseAggregate(int sockfd, int perEntry);
 };
 
 #endif // RESPONSEPARSER_H
\ No newline at end of file
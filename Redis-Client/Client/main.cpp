@@ -1,10 +1,13 @@
 #include "../include/CLI.h"
+#include "../include/ClusterClient.h"
 #include <iostream>
 #include <string>
 
 int main(int argc, char* argv[]) {
     std::string host = "127.0.0.1"; // Default host 
     int port = 6379; // Default port
+    bool cluster = false;
+    std::string reshardSlots, reshardTarget;
     int i = 1;
     std::vector<std::string> commandArgs;
 
@@ -15,6 +18,13 @@ int main(int argc, char* argv[]) {
             host = argv[++i];
         } else if (arg == "-p" && i + 1 < argc) {
             port = std::stoi(argv[++i]);
+        } else if (arg == "-s" && i + 1 < argc) { // -s /tmp/redis.sock, overrides -h/-p
+            host = argv[++i];
+        } else if (arg == "-c") {
+            cluster = true;
+        } else if (arg == "--reshard" && i + 2 < argc) { // --reshard 100-199 127.0.0.1:7001
+            reshardSlots = argv[++i];
+            reshardTarget = argv[++i];
         } else {
             // Remaining args
             while (i <argc) {
@@ -26,8 +36,25 @@ int main(int argc, char* argv[]) {
         ++i;
     }
 
+    // Move a slot range to another node, the cluster keeps serving meanwhile
+    if (!reshardSlots.empty()) {
+        ClusterClient client({host + ":" + std::to_string(port)});
+        size_t dash = reshardSlots.find('-');
+        int first = std::stoi(reshardSlots.substr(0, dash));
+        int last = dash == std::string::npos ? first : std::stoi(reshardSlots.substr(dash + 1));
+        for (int slot = first; slot <= last; ++slot) {
+            std::string error;
+            if (!client.migrateSlot(slot, reshardTarget, error)) {
+                std::cerr << "(Error) slot " << slot << ": " << error << "\n";
+                return 1;
+            }
+        }
+        std::cout << "Moved slots " << first << "-" << last << " to " << reshardTarget << "\n";
+        return 0;
+    }
+
     // Handle REPL and one-shot command modes
-    CLI cli(host, port);
+    CLI cli(host, port, cluster);
     cli.run(commandArgs);
 
     return 0;
@@ -0,0 +1,125 @@
+#ifndef CLIENT_REGISTRY_H
+#define CLIENT_REGISTRY_H
+
+#include "OutputLimits.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+class Subscriber;
+
+// What CLIENT LIST shows of one connection. The stats are stored by the
+// thread serving it and read by whoever runs CLIENT LIST.
+struct ClientInfo {
+    uint64_t id = 0;
+    int fd = -1;
+    std::string addr;                      // ip:port, or the socket path for Unix clients
+    std::chrono::steady_clock::time_point created = std::chrono::steady_clock::now();
+    std::atomic<int64_t> lastActive{0};    // steady clock ms when its last command ended (or it connected)
+    std::atomic<bool> busy{false};         // running a command, maybe blocked in one :- never idle
+    std::atomic<size_t> queryBuffer{0};    // qbuf :- received, not run yet
+    std::atomic<size_t> outputBuffer{0};   // omem :- replies not sent yet (a replica's lag)
+    std::atomic<ClientClass> cls{ClientClass::NORMAL}; // REPLICA once it ran PSYNC; subscribers are told by subscriber
+    std::atomic<bool> killed{false};       // CLIENT KILL or the idle timeout shut its socket down
+    std::weak_ptr<Subscriber> subscriber;  // its queue adds to omem; guarded by the registry mutex
+
+    std::mutex mutex;                      // guards name and lastCommand
+    std::string name;                      // CLIENT SETNAME
+    std::string lastCommand;               // upper case, shown lower case like Redis
+};
+
+// Milliseconds on the steady clock, what ClientInfo::lastActive holds
+inline int64_t steadyMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Marks the connection busy while one command runs and records it (cmd, idle)
+class ClientActivity {
+public:
+    ClientActivity(ClientInfo* info, const std::string& cmd) : info(info) {
+        if (!info)
+            return;
+        info->busy.store(true, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(info->mutex);
+        info->lastCommand = cmd;
+    }
+    ~ClientActivity() {
+        if (!info)
+            return;
+        info->lastActive.store(steadyMs(), std::memory_order_relaxed);
+        info->busy.store(false, std::memory_order_relaxed);
+    }
+    ClientActivity(const ClientActivity&) = delete;
+    ClientActivity& operator=(const ClientActivity&) = delete;
+
+private:
+    ClientInfo* info;
+};
+
+/* Connected clients
+ * Every connection is listed by CLIENT ID: admitted when accepted, removed by
+ * RedisCommandHandler::closeSession. They are held to maxclients; a connection
+ * past it gets an error and is closed by the accept loop (or event loop) before
+ * any thread or buffer is spent on it.
+ * closeIdle() and kill() shut the socket down under the registry lock, while
+ * the connection is still listed and its fd can't have been reused; the thread
+ * or event loop serving it then sees EOF and closes it as usual. */
+class ClientRegistry {
+public:
+    static const size_t kDefaultMaxClients = 10000;
+
+    static ClientRegistry& getInstance();
+
+    // From the command line, before the server starts (--maxclients, --timeout; 0 = no idle timeout)
+    void configure(size_t maxClients, int idleTimeout);
+    size_t maxClients() const { return maxclients; }
+    int idleTimeout() const { return timeout; }
+
+    // nullptr when maxclients are connected (counted as rejected)
+    std::shared_ptr<ClientInfo> admit(uint64_t id, int fd);
+    void remove(uint64_t id);
+    // "-ERR max number of clients reached" without blocking, then close
+    static void reject(int fd);
+
+    void setSubscriber(ClientInfo& info, const std::shared_ptr<Subscriber>& sub);
+
+    // CLIENT KILL filters; empty/0 fields match everything
+    struct KillFilter {
+        uint64_t id = 0;
+        std::string addr;
+        int cls = -1;          // ClientClass, -1 for any
+        uint64_t skip = 0;     // SKIPME yes :- the caller's id
+    };
+    // Number of connections shut down; self :- the caller, whose reply still goes out
+    size_t kill(const KillFilter& filter, uint64_t self);
+    // Shut down listed connections idle for the idle timeout (not replicas, subscribers or blocked
+    // ones); returns how many
+    size_t closeIdle();
+    // The event loops time their own connections out and count them here
+    void countIdleClosed() { idleClosed.fetch_add(1, std::memory_order_relaxed); }
+
+    // CLIENT LIST :- one line per connection; CLIENT INFO :- just id's
+    std::string list(uint64_t only = 0);
+    // INFO clients
+    std::string info();
+
+private:
+    ClientRegistry() = default;
+    ClientRegistry(const ClientRegistry&) = delete;
+    ClientRegistry& operator=(const ClientRegistry&) = delete;
+
+    std::mutex mutex;
+    std::unordered_map<uint64_t, std::shared_ptr<ClientInfo>> clients;
+    size_t maxclients = kDefaultMaxClients;
+    int timeout = 0;
+    std::atomic<uint64_t> rejected{0};
+    std::atomic<uint64_t> idleClosed{0};
+};
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef CLIENT_SESSION_H
+#define CLIENT_SESSION_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <cstdint>
+
+class Subscriber;
+struct ClientInfo;
+
+// Per-connection state. Owned by the connection's thread in RedisServer (with
+// --io-threads, by the executor while a batch of the connection is running) and
+// passed to every processCommand() call made on behalf of that connection.
+struct ClientSession {
+    // Unique per connection (CLIENT ID), 0 for internal callers
+    uint64_t id = 0;
+
+    // MULTI/EXEC
+    bool inMulti = false;
+    bool multiError = false; // a command failed to queue, EXEC must abort
+    std::vector<std::vector<std::string>> queued;
+
+    // WATCH: key -> version seen when the key was watched
+    std::unordered_map<std::string, uint64_t> watched;
+
+    // Set while running inside EXEC or a script: blocking commands must not block there
+    bool inAtomic = false;
+
+    // Replication: this is the link from our master (writes allowed, nothing
+    // propagated), or the listening port a replica announced with REPLCONF
+    bool isMaster = false;
+    int replicaPort = 0;
+
+    // Cluster: ASKING was sent, the next command may use a slot being imported here
+    bool asking = false;
+
+    // Pub/Sub: created by the first (P)SUBSCRIBE, from then on every reply of
+    // this connection goes out through its queue
+    std::shared_ptr<Subscriber> subscriber;
+
+    // Client-side caching: CLIENT TRACKING is on; unless in BCAST mode the keys
+    // this connection reads are remembered in Tracking's invalidation table
+    bool tracking = false;
+    bool trackingBcast = false;
+
+    // Protocol chosen with HELLO :- 2 or 3 (RESP3 maps, sets, doubles, pushes)
+    int resp = 2;
+
+    // Client socket, -1 for internal callers. Blocking commands poll it to notice hang-ups.
+    int socket = -1;
+
+    // CLIENT LIST entry (ClientRegistry), none for internal callers
+    std::shared_ptr<ClientInfo> info;
+};
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <shared_mutex>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+class RedisDatabase;
+struct DetachedKey;
+
+/* Cluster mode (--cluster <nodes file>)
+ * The keyspace is cut into 16384 hash slots, slot = CRC16(key) % 16384, where
+ * only the part between the first '{' and the next '}' is hashed when that part
+ * is not empty, so {user1}.name and {user1}.mail always land together.
+ * The slot map is static: every node is started with the same file,
+ *   # host port slots...
+ *   127.0.0.1 7000 0-5460
+ *   127.0.0.1 7001 5461-10922
+ *   127.0.0.1 7002 10923-16383
+ * and finds itself by its port. CLUSTER SETSLOT changes are written to
+ * nodes-<port>.conf, which is preferred over the shared file on restart.
+ *
+ * Before a command runs, its keys are checked against the map:
+ *  - keys in different slots :- -CROSSSLOT
+ *  - slot owned by another node :- -MOVED <slot> <host>:<port>
+ *  - slot MIGRATING from here and the keys are gone :- -ASK <slot> <host>:<port>
+ *  - slot IMPORTING here :- served only right after ASKING
+ *
+ * Resharding moves a slot with MIGRATE while it is MIGRATING on the source and
+ * IMPORTING on the target, then hands it over with SETSLOT NODE on every node.
+ * MIGRATE takes its keys out of the keyspace in O(1), sends them in the
+ * snapshot encoding as pipelined ASKING + RESTORE pairs (big values cut into
+ * chunks of kMigrateChunk elements, one RESTORE ... APPEND each) and only then
+ * forgets them, or puts them back if the target failed. Commands on a key in
+ * transit get -TRYAGAIN. MIGRATE also works outside cluster mode. */
+
+class Cluster {
+public:
+    static const int kSlots = 16384;
+    static const size_t kMigrateChunk = 1024;         // elements per RESTORE of a big value
+    static const size_t kMigratePipeline = 1024 * 1024; // bytes sent before waiting for replies
+
+    static Cluster& getInstance();
+
+    // Slot of a key, hash tag aware
+    static int keySlot(const std::string& key);
+
+    // Read the slot map, false (with the reason on stderr) if it can't be used
+    bool load(const std::string& configFile, int port);
+    bool enabled() const { return clusterMode; }
+
+    // Empty if the command can run here, otherwise the error reply to send back
+    std::string redirect(const std::vector<std::string>& keys, bool asking, RedisDatabase& db);
+
+    //CLUSTER subcommands, RESP encoded replies
+    std::string slotsReply();
+    std::string nodesReply();
+    std::string infoReply();
+    const std::string& myId() const { return nodes[self].id; }
+    // SETSLOT <slot> IMPORTING|MIGRATING|NODE <node-id> and SETSLOT <slot> STABLE
+    std::string setSlot(int slot, const std::string& state, const std::string& nodeId);
+
+    //MIGRATE
+    // Move keys to host:port (or copy them); the names of the keys that left go to moved
+    std::string migrate(const std::string& host, int port, const std::vector<std::string>& keys, int timeoutMs,
+                        bool copy, bool replace, RedisDatabase& db, std::vector<std::string>& moved);
+    // Keys are in transit, or a slot is migrating: routing must run under the db lock
+    bool moving() const {
+        return transfers.load(std::memory_order_acquire) > 0 || migratingSlots.load(std::memory_order_acquire) > 0;
+    }
+
+private:
+    struct Node {
+        std::string id; // sha1 of host:port, stable across restarts
+        std::string host;
+        int port;
+    };
+
+    Cluster() = default;
+    Cluster(const Cluster&) = delete;
+    Cluster& operator=(const Cluster&) = delete;
+
+    bool parse(const std::string& file, int port);
+    // Send the keys over the cached link, ok[i] set for every key the target stored
+    std::string transfer(const std::string& host, int port, const std::vector<DetachedKey>& keys, int timeoutMs,
+                         bool replace, std::vector<bool>& ok);
+    int link(const std::string& host, int port, int timeoutMs);
+    void closeLink();
+    bool save(); // call with map_mutex held
+    int nodeIndex(const std::string& id) const;
+    std::string address(int node) const { return nodes[node].host + ":" + std::to_string(nodes[node].port); }
+
+    bool clusterMode = false;
+    std::string saveFile;
+    std::shared_mutex map_mutex; // taken shared by every routed command
+    std::vector<Node> nodes;
+    int self = -1;
+    std::vector<int16_t> owner;             // slot -> index in nodes, -1 unassigned
+    std::unordered_map<int, int> migrating; // slot -> node it is moving to
+    std::unordered_map<int, int> importing; // slot -> node it is coming from
+    std::atomic<size_t> migratingSlots{0};
+
+    // MIGRATE state
+    std::mutex migrate_mutex;               // one MIGRATE at a time, they share the link
+    std::atomic<size_t> transfers{0};
+    std::mutex transit_mutex;
+    std::unordered_set<std::string> inTransit; // keys out of the keyspace, not yet stored by the target
+    int linkSocket = -1;                    // connection to the last target, reused for 10s
+    std::string linkAddress;
+    std::chrono::steady_clock::time_point linkUsed;
+};
+
+#endif
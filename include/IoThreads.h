@@ -0,0 +1,86 @@
+#ifndef IO_THREADS_H
+#define IO_THREADS_H
+
+#include "ClientSession.h"
+#include "WorkerPool.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <functional>
+#include <atomic>
+#include <cstdint>
+
+class RedisCommandHandler;
+struct ClientInfo;
+
+// --io-threads, --exec-threads, --io-cpus, --exec-cpus
+struct ThreadOptions {
+    size_t ioThreads = 0;   // 0 :- one thread per connection, no I/O threads
+    size_t execThreads = 1; // command executors of the I/O threads mode
+    std::vector<int> ioCpus;
+    std::vector<int> execCpus;
+};
+
+/* I/O threads mode (--io-threads N)
+ * N I/O threads each run an epoll loop over their share of the connections:
+ * they read, cut the input into commands and write the replies. The commands
+ * run on a WorkerPool of executors (--exec-threads, default one, so the
+ * database is only ever touched by one thread and db_mutex is never
+ * contended). A connection has at most one batch (the complete commands it
+ * sent, up to kMaxBatch) with the executors at a time, which keeps its replies
+ * in order; whichever executor has it runs up to kQuantum commands, then puts
+ * it behind the other waiting batches. Executors hand each I/O thread its
+ * finished batches in groups with one wake-up. A batch also stops after about
+ * OutputLimits::kWriteChunk of replies and runs the rest once they are out.
+ * Commands that wait (BLPOP, BRPOP, BLMOVE, XREAD/XREADGROUP BLOCK), PSYNC/SYNC
+ * and subscribed connections would stall an executor or write to the socket
+ * themselves, so their connection is handed over to a thread of its own
+ * (takeOver) with its session and unread input, as in the default model. */
+class IoThreads {
+public:
+    static const size_t kMaxBatch = 1024; // commands per batch, so a deep pipeline doesn't hog the executors
+    static const size_t kQuantum = 64;    // commands per turn on an executor
+
+    // takeOver(fd, session, input, output) serves the connection from then on, on
+    // its own thread: input was received but not run yet, output must go out first
+    using TakeOver = std::function<void(int, ClientSession&, std::string&, std::string&)>;
+
+    IoThreads(const ThreadOptions& options, RedisCommandHandler& handler, TakeOver takeOver);
+    ~IoThreads();
+    void start();
+    // Stop the threads and close every connection still served here
+    void stop();
+    // A freshly accepted connection (already in ClientRegistry), given to the I/O threads in turn
+    void adopt(int fd, std::shared_ptr<ClientInfo> info);
+
+    struct Connection;
+    struct Worker;
+
+private:
+    void ioLoop(Worker& w, size_t index);
+    bool execute(Connection& conn, size_t executor); // one turn, true when it has commands left
+    void deliver(size_t executor);                   // finished batches back to their I/O threads
+
+    bool readConnection(Worker& w, Connection& conn);
+    bool flush(Worker& w, Connection& conn);
+    void watch(Worker& w, Connection& conn); // epoll interest follows eof and pending output
+    void advance(Worker& w, Connection& conn); // next batch, hand-over or close
+    void completed(Worker& w, Connection& conn);
+    void checkOutputLimits(Worker& w); // once a second
+    void closeConnection(Worker& w, Connection& conn);
+    void handOver(Worker& w, Connection& conn);
+
+    ThreadOptions options;
+    RedisCommandHandler& handler;
+    TakeOver takeOver;
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<size_t> nextWorker{0};
+    std::atomic<bool> stopping{false};
+
+    std::unique_ptr<WorkerPool> executors;
+    std::vector<std::vector<Connection*>> finished; // per executor, only touched by it
+};
+
+#endif
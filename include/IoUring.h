@@ -0,0 +1,165 @@
+#ifndef IO_URING_H
+#define IO_URING_H
+
+#include <string>
+#include <streambuf>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+class WorkerPool;
+
+/* io_uring over the raw system calls (no liburing)
+ * Operations are queued in the submission ring and handed to the kernel in
+ * one io_uring_enter() that also waits for completions, so a loop iteration
+ * costs one system call however many sockets it reads and writes.
+ * - multishot accept and recv: one submission keeps producing completions
+ * - recv picks its buffer from a provided buffer ring registered with the
+ *   kernel, so memory is only tied up while data is being copied out, not
+ *   per idle connection
+ * - WRITE_FIXED from buffers registered once (IoUringFile)
+ * Built without it when NO_IO_URING is defined (make IO_URING=0) or the
+ * kernel headers lack it; supported() then says no and callers use epoll. */
+class IoUring {
+public:
+    struct Completion {
+        uint64_t data = 0; // user data of the operation
+        int res = 0;       // bytes / new fd, or -errno
+        uint32_t flags = 0;
+        bool more() const;   // a multishot operation stays armed
+        int bufferId() const; // provided buffer holding a recv's data, -1 if none
+    };
+
+    // Compiled in, allowed by the kernel, and every operation used here is there
+    static bool supported();
+
+    explicit IoUring(unsigned entries);
+    ~IoUring();
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+    bool ok() const { return ringFd >= 0; }
+
+    // Queue an operation, submitting early only if the ring is full; false
+    // when even that leaves no room
+    bool acceptMultishot(int fd, uint64_t data);
+    bool recvMultishot(int fd, uint16_t group, uint64_t data);
+    bool pollMultishot(int fd, uint64_t data); // POLLIN
+    bool cancel(uint64_t target, uint64_t data); // the operation queued with user data target
+    bool send(int fd, const void* buf, size_t len, uint64_t data);
+    bool writeFixed(int fd, const void* buf, unsigned len, uint64_t offset, uint16_t bufIndex, uint64_t data);
+
+    // Submit everything queued and wait for at least `wait` completions, or
+    // timeoutMs (-1 = no limit). One system call. False on error.
+    bool submitAndWait(unsigned wait, int timeoutMs = -1);
+    // Next completion, if any
+    bool pop(Completion& c);
+
+    // Buffers for writeFixed(), registered once for the ring's lifetime
+    bool registerBuffers(char* const* bufs, unsigned count, unsigned size);
+    // Provided buffer ring `group` of count buffers (a power of 2) of size bytes for recv
+    bool setupBufferRing(uint16_t group, unsigned count, unsigned size);
+    const char* buffer(int id) const { return recvBuffers + static_cast<size_t>(id) * recvBufferSize; }
+    void recycle(int id); // give a recv buffer back to the kernel
+
+    uint64_t syscalls() const { return enters; }
+
+private:
+    void* nextSqe();
+    void release();
+
+    int ringFd = -1;
+    unsigned features = 0;
+    void* sqRing = nullptr;
+    void* cqRing = nullptr;
+    size_t sqRingSize = 0;
+    size_t cqRingSize = 0;
+    void* sqes = nullptr;
+    size_t sqesSize = 0;
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned* sqMask = nullptr;
+    unsigned* sqArray = nullptr;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned* cqMask = nullptr;
+    void* cqes = nullptr;
+    unsigned sqEntries = 0;
+    unsigned queued = 0; // sqes filled in since the last submit
+
+    // provided buffer ring for recv
+    void* bufRing = nullptr;
+    size_t bufRingSize = 0;
+    unsigned bufRingMask = 0;
+    char* recvBuffers = nullptr;
+    unsigned recvBufferCount = 0;
+    unsigned recvBufferSize = 0;
+
+    uint64_t enters = 0;
+};
+
+// Which server does the socket I/O (thread per connection, --io-threads,
+// --io-backend) and its I/O counters for INFO io
+class IoBackend {
+public:
+    enum Kind { THREADS, IO_THREADS, EPOLL, URING };
+
+    static IoBackend& getInstance();
+
+    void select(Kind k) { current = k; }
+    Kind kind() const { return current; }
+    const char* name() const;
+
+    // Event loops add what they did since the last call, once per iteration
+    void count(uint64_t syscalls, uint64_t operations) {
+        syscallCount.fetch_add(syscalls, std::memory_order_relaxed);
+        operationCount.fetch_add(operations, std::memory_order_relaxed);
+    }
+    // The I/O threads' executors, shown in INFO io while they run
+    void setExecutors(const WorkerPool* pool) { executors = pool; }
+    std::string info();
+
+private:
+    IoBackend() = default;
+    IoBackend(const IoBackend&) = delete;
+    IoBackend& operator=(const IoBackend&) = delete;
+
+    Kind current = THREADS;
+    std::atomic<uint64_t> syscallCount{0};
+    std::atomic<uint64_t> operationCount{0}; // socket reads and writes that moved data
+    std::atomic<const WorkerPool*> executors{nullptr};
+};
+
+/* Output file written through io_uring: the stream fills one registered
+ * buffer while the previous ones are being written by the kernel, so
+ * serializing a snapshot and writing it overlap. */
+class IoUringFile : public std::streambuf {
+public:
+    explicit IoUringFile(const std::string& path);
+    ~IoUringFile() override;
+    bool ok() const { return fd >= 0 && ring.ok() && !failed; }
+    // Write what is buffered, wait for every write; false if any failed
+    bool close();
+
+protected:
+    int_type overflow(int_type ch) override;
+    int sync() override;
+
+private:
+    static const unsigned kBuffers = 4;
+    static const unsigned kBufferSize = 1 << 20;
+
+    bool submitCurrent();        // queue the filled part of the current buffer
+    bool waitFor(unsigned index); // until that buffer's write is done
+
+    IoUring ring;
+    int fd = -1;
+    char* buffers[kBuffers] = {};
+    bool busy[kBuffers] = {};
+    unsigned lengths[kBuffers] = {}; // of the write in flight, to finish a short one
+    uint64_t offsets[kBuffers] = {};
+    unsigned current = 0;
+    uint64_t offset = 0; // file position of the next write
+    bool failed = false;
+};
+
+#endif
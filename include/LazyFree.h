@@ -0,0 +1,61 @@
+#ifndef LAZY_FREE_H
+#define LAZY_FREE_H
+
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+
+/* Background reclamation (lazy free)
+ * Destroying a multi-million element list or hash takes a while and used to
+ * happen under db_mutex. UNLINK, FLUSHALL ASYNC and overwrites instead move
+ * the value out of the keyspace (O(1)) and hand it to one background thread
+ * that runs the destructor. Values with at most kThreshold elements are
+ * cheaper to free inline than to queue, so callers free those themselves. */
+
+class LazyFree {
+public:
+    static const size_t kThreshold = 64; // elements, same default as Redis' LAZYFREE_THRESHOLD
+
+    static LazyFree& getInstance();
+
+    // Take ownership of value and destroy it on the background thread
+    template <typename T>
+    void free(T&& value) {
+        submit(std::unique_ptr<Object>(new Holder<typename std::decay<T>::type>(std::forward<T>(value))));
+    }
+
+    size_t pending() const { return pendingObjects.load(); }
+    size_t freed() const { return freedObjects.load(); }
+
+private:
+    struct Object {
+        virtual ~Object() = default;
+    };
+    template <typename T>
+    struct Holder : Object {
+        explicit Holder(T&& v) : value(std::move(v)) {}
+        T value;
+    };
+
+    LazyFree();
+    ~LazyFree();
+    LazyFree(const LazyFree&) = delete;
+    LazyFree& operator=(const LazyFree&) = delete;
+
+    void submit(std::unique_ptr<Object> object);
+    void run();
+
+    std::mutex queue_mutex;
+    std::condition_variable queue_cv;
+    std::deque<std::unique_ptr<Object>> queue;
+    std::atomic<size_t> pendingObjects{0};
+    std::atomic<size_t> freedObjects{0};
+    bool stopping = false;
+    std::thread worker;
+};
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef LISTENER_H
+#define LISTENER_H
+
+#include <string>
+#include <cstddef>
+
+// Listening sockets and the options applied to every accepted connection
+struct ListenOptions {
+    int port = 6379;
+    int backlog = 511;              // --tcp-backlog, capped by net.core.somaxconn
+    size_t acceptors = 1;           // --reuseport N :- TCP listeners sharing the port, one accept thread each
+    std::string unixSocket;         // --unixsocket path, none when empty
+    int unixSocketPerm = 0700;      // --unixsocketperm (octal)
+    bool tcpNoDelay = true;         // --tcp-nodelay yes|no
+    int tcpKeepAlive = 300;         // --tcp-keepalive seconds, 0 = off
+};
+
+/* Both servers listen through these. With SO_REUSEPORT several sockets bind
+ * the same port and the kernel spreads new connections over them, so accepts
+ * don't serialize on one listener. The Unix domain socket skips the TCP stack
+ * for clients on the same host. Every call logs its own failure. */
+namespace Listener {
+
+// Bound and listening TCP socket on all interfaces, -1 on failure
+int tcp(const ListenOptions& options, bool reusePort);
+// Unix domain socket at options.unixSocket (a stale file is replaced), -1 on failure
+int local(const ListenOptions& options);
+// TCP_NODELAY and keepalive on an accepted connection (no-op for Unix sockets)
+void configure(int fd, const ListenOptions& options);
+
+} // namespace Listener
+
+#endif
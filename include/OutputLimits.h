@@ -0,0 +1,71 @@
+#ifndef OUTPUT_LIMITS_H
+#define OUTPUT_LIMITS_H
+
+#include <string>
+#include <functional>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+/* Client output buffer limits (--client-output-buffer-limit <class> <hard> <soft> <seconds>)
+ * Every connection is in one class: normal, replica (a PSYNC link) or pubsub
+ * (it has a push queue :- subscribed, or receiving tracking invalidations).
+ * A connection whose unsent output passes its class' hard limit, or stays
+ * above the soft limit for the soft seconds, is disconnected; 0 turns a limit
+ * off. Defaults as in Redis: normal none, replica 256mb 64mb 60, pubsub 32mb 8mb 60.
+ *
+ * The servers keep the output small in the first place: replies are written
+ * in pieces of kWriteChunk instead of a whole pipeline's worth at once, and a
+ * connection with kPauseBytes or more still to send runs no more commands
+ * (the event loops stop reading it too) until the client has taken some. */
+enum class ClientClass { NORMAL = 0, REPLICA = 1, PUBSUB = 2 };
+
+struct OutputLimit {
+    size_t hard = 0;
+    size_t soft = 0;
+    int softSeconds = 0;
+};
+
+class OutputLimits {
+public:
+    static const size_t kWriteChunk = 64 * 1024;
+    static const size_t kPauseBytes = 1024 * 1024;
+
+    static OutputLimits& getInstance();
+
+    // From the command line, before the server starts; sizes may end in kb, mb or gb.
+    // False on an unknown class or a bad number.
+    bool configure(const std::string& cls, const std::string& hard, const std::string& soft, const std::string& seconds);
+    const OutputLimit& get(ClientClass cls) const { return limits[static_cast<int>(cls)]; }
+
+    void countDisconnect(ClientClass cls) { disconnects[static_cast<int>(cls)].fetch_add(1, std::memory_order_relaxed); }
+    uint64_t disconnected(ClientClass cls) const { return disconnects[static_cast<int>(cls)].load(std::memory_order_relaxed); }
+    static const char* name(ClientClass cls);
+
+private:
+    OutputLimits();
+    OutputLimits(const OutputLimits&) = delete;
+    OutputLimits& operator=(const OutputLimits&) = delete;
+
+    OutputLimit limits[3];
+    std::atomic<uint64_t> disconnects[3];
+};
+
+// One connection's standing against its class' limits; not thread-safe
+class OutputGuard {
+public:
+    // pending :- output not sent yet. True once the connection must be dropped,
+    // which is counted in INFO clients
+    bool exceeded(ClientClass cls, size_t pending);
+
+private:
+    bool overSoft = false;
+    std::chrono::steady_clock::time_point softSince;
+};
+
+// Blocking send of all of data. While the socket is full it asks
+// overLimit(unsent bytes) at least once a second and gives up when it says so.
+bool sendLimited(int socket, const char* data, size_t size, const std::function<bool(size_t)>& overLimit);
+
+#endif
@@ -0,0 +1,154 @@
+#ifndef PUBSUB_H
+#define PUBSUB_H
+
+#include "OutputLimits.h"
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <bitset>
+#include <unordered_map>
+#include <shared_mutex>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+/* Pub/Sub
+ * PUBLISH encodes the message once per channel (and once per matching pattern
+ * for pmessage) and hands the same buffer, by shared_ptr, to every receiver;
+ * RESP3 subscribers share a second encoding as a push.
+ * Each subscribed connection has an output queue of such buffers: the
+ * publisher writes straight to the socket while the queue is empty and the
+ * socket takes it, anything left waits in the queue and the connection's
+ * thread sends it when the socket is writable again. A subscriber that can't
+ * keep up is disconnected once its queue breaks the pubsub class of the
+ * client output buffer limits (OutputLimits.h).
+ *
+ * Patterns live in a GlobTrie, so one walk over the channel name finds every
+ * matching pattern instead of trying the patterns one by one. */
+
+// Glob patterns (* ? [abc] [^a-z] \x) compiled into a trie, patterns with a
+// common prefix share nodes
+class GlobTrie {
+public:
+    GlobTrie();
+    ~GlobTrie();
+    // pattern must stay alive (and at the same address) while it is in the trie
+    void insert(const std::string& pattern);
+    void erase(const std::string& pattern);
+    // Every pattern in the trie that matches text, each once
+    void match(const std::string& text, std::vector<const std::string*>& out) const;
+    size_t size() const { return count; }
+
+private:
+    struct Token {
+        enum Kind { CHAR, ANY, STAR, CLASS } kind;
+        unsigned char c = 0;
+        std::bitset<256> set; // CLASS, already negated for [^...]
+    };
+    struct Node;
+
+    static std::vector<Token> compile(const std::string& pattern);
+    static Node* child(Node* node, const Token& token, bool create);
+    static bool eraseFrom(Node* node, const std::vector<Token>& tokens, size_t i);
+
+    std::unique_ptr<Node> root;
+    size_t count = 0;
+};
+
+// Output side of one subscribed connection
+class Subscriber {
+public:
+    explicit Subscriber(int socket);
+    ~Subscriber();
+
+    //publisher side
+    void deliver(const std::shared_ptr<const std::string>& message);
+
+    //connection side
+    // Replies of the commands being run go out before anything published meanwhile
+    void hold();
+    // Queue the replies (ahead of held messages), release the hold and send; false once dead
+    bool reply(std::string data);
+    // Send what the socket takes; false once the connection must close
+    bool flush();
+    bool pending();         // queued bytes waiting for the socket to be writable
+    int wakeFd() const { return wake; } // readable after a publisher left bytes queued
+    void drainWake();
+    size_t queuedBytes();
+
+    // Channels + patterns; in subscribed mode while > 0
+    size_t subscriptions() const { return subscribed.load(std::memory_order_relaxed); }
+
+    // RESP version of the connection (HELLO), 3 gets messages as pushes
+    int protocol() const { return resp.load(std::memory_order_relaxed); }
+    void setProtocol(int version) { resp.store(version, std::memory_order_relaxed); }
+
+private:
+    friend class PubSub;
+
+    bool sendLocked(); // call with mutex held
+    void killLocked();
+
+    std::mutex mutex;
+    int socket;
+    int wake = -1;
+    std::deque<std::shared_ptr<const std::string>> queue;
+    size_t offset = 0;              // bytes of queue.front() already sent
+    size_t bytes = 0;               // queued bytes not sent yet
+    size_t heldAt = SIZE_MAX;       // where the replies go while held
+    bool dead = false;
+    OutputGuard guard;
+
+    // channel/pattern -> our index in PubSub's subscriber vector for it,
+    // guarded by registry_mutex
+    std::unordered_map<std::string, size_t> channels;
+    std::unordered_map<std::string, size_t> patterns;
+    std::atomic<size_t> subscribed{0};
+    std::atomic<int> resp{2};
+};
+
+class PubSub {
+public:
+    static PubSub& getInstance();
+
+    // (P)SUBSCRIBE / (P)UNSUBSCRIBE, the confirmations RESP encoded; no names
+    // unsubscribes from everything
+    std::string subscribe(const std::shared_ptr<Subscriber>& sub, const std::vector<std::string>& names, bool pattern);
+    std::string unsubscribe(const std::shared_ptr<Subscriber>& sub, const std::vector<std::string>& names, bool pattern);
+    // Connection closed
+    void drop(const std::shared_ptr<Subscriber>& sub);
+
+    // Number of connections the message was handed to
+    size_t publish(const std::string& channel, const std::string& message);
+
+    //PUBSUB subcommands
+    std::string channelsReply(const std::string* pattern);
+    std::string numsubReply(const std::vector<std::string>& names);
+    size_t numpat();
+    std::string info();
+
+    // Called by a Subscriber it had to disconnect
+    void countSlowDisconnect() { slowDisconnects.fetch_add(1, std::memory_order_relaxed); }
+
+private:
+    using Subscribers = std::vector<std::shared_ptr<Subscriber>>;
+
+    PubSub() = default;
+    PubSub(const PubSub&) = delete;
+    PubSub& operator=(const PubSub&) = delete;
+
+    // call with registry_mutex held exclusively
+    bool addLocked(const std::shared_ptr<Subscriber>& sub, const std::string& name, bool pattern);
+    bool removeLocked(const std::shared_ptr<Subscriber>& sub, const std::string& name, bool pattern);
+
+    std::shared_mutex registry_mutex; // shared by PUBLISH, exclusive for (un)subscribing
+    std::unordered_map<std::string, Subscribers> channelIndex;
+    std::unordered_map<std::string, Subscribers> patternIndex;
+    GlobTrie trie; // keys of patternIndex
+
+    std::atomic<uint64_t> published{0};
+    std::atomic<uint64_t> slowDisconnects{0};
+};
+
+#endif
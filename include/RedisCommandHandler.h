@@ -3,20 +3,104 @@
 
 #include <string>
 #include <vector>
+#include <unordered_map>
+#include "ClientSession.h"
 
 class RedisDatabase;
+struct CompiledScript;
 
 class RedisCommandHandler {
 public:
     RedisCommandHandler();
     // Process a Redis command and return the response RESP FORMAT
     std::string processCommand(const std::string& command);
+    // Process an already tokenized command
+    std::string processCommand(const std::vector<std::string>& tokens);
+    // Process a command on behalf of a connection (MULTI/WATCH state lives in session)
+    std::string processCommand(const std::vector<std::string>& tokens, ClientSession& session);
+    // Same, against a given database (sharded mode gives every shard its own)
+    std::string processCommand(const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db);
+    // Release whatever a connection still holds (watched keys) when it goes away
+    void closeSession(ClientSession& session);
+    void closeSession(ClientSession& session, RedisDatabase& db);
+
+    // Indexes of the key arguments of a command, false for an unknown command
+    static bool commandKeys(const std::vector<std::string>& tokens, std::vector<size_t>& keyIndexes);
+
+    // Frame limits, as in Redis :- a client can't make the server buffer more than this for one command
+    static const long kMaxMultibulk = 1024 * 1024;            // arguments of one command
+    static const long kMaxBulkLength = 512L * 1024 * 1024;    // bytes of one argument
+    static const size_t kMaxInline = 64 * 1024;               // an inline command or a header line
+
+    // Pull one complete command off buffer starting at pos.
+    // Returns bytes consumed, 0 if more data is needed, npos on protocol error
+    // (including a frame past the limits above).
+    static size_t extractCommand(const std::string& buffer, size_t pos, std::vector<std::string>& tokens);
 
 private:
+    using Handler = std::string (RedisCommandHandler::*)(const std::vector<std::string>&, RedisDatabase&);
+    // For the few commands that need the calling connection (blocking, scripting)
+    using SessionHandler = std::string (RedisCommandHandler::*)(const std::vector<std::string>&, ClientSession&, RedisDatabase&);
+    struct CommandSpec {
+        Handler handler;
+        SessionHandler sessionHandler;
+        int firstKey = 0; // 0 :- no keys
+        int lastKey = 0;  // < 0 counts back from the last argument
+        int keyStep = 0;
+        bool write = false;
+        bool noscript = false; // refused from redis.call()
+    };
+    // Command name (upper case) -> handler, built once
+    static const std::unordered_map<std::string, CommandSpec>& commandTable();
+    std::string execute(const std::string& cmd, const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db);
+
+    // Transactions
+    std::string handleMulti(ClientSession& session);
+    std::string handleExec(ClientSession& session, RedisDatabase& db);
+    std::string handleDiscard(ClientSession& session, RedisDatabase& db);
+    std::string handleWatch(const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db);
+    std::string handleUnwatch(ClientSession& session, RedisDatabase& db);
+
+    // Scripting
+    std::string handleEval(const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db);
+    std::string handleEvalsha(const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db);
+    std::string handleScript(const std::vector<std::string>& tokens, RedisDatabase& db);
+    std::string runScript(const CompiledScript& script, const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db);
+
+    // Replication
+    std::string handleReplicaof(const std::vector<std::string>& tokens, RedisDatabase& db);
+    std::string handleReplconf(const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db);
+    std::string handlePsync(const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db);
+    std::string handleRole(const std::vector<std::string>& tokens, RedisDatabase& db);
+    std::string handleInfo(const std::vector<std::string>& tokens, RedisDatabase& db);
+
+    // Cluster
+    std::string clusterRedirect(const std::string& cmd, const std::vector<std::string>& tokens, bool asking, RedisDatabase& db);
+    std::string handleCluster(const std::vector<std::string>& tokens, RedisDatabase& db);
+
+    // Key Migration
+    std::string handleMigrate(const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db);
+    std::string handleRestore(const std::vector<std::string>& tokens, RedisDatabase& db);
+    std::string handleDump(const std::vector<std::string>& tokens, RedisDatabase& db);
+
+    // Pub/Sub
+    std::string handleSubscribe(const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db);
+    std::string handleUnsubscribe(const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db);
+    std::string handlePsubscribe(const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db);
+    std::string handlePunsubscribe(const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db);
+    std::string subscription(const std::vector<std::string>& tokens, bool subscribe, bool pattern, ClientSession& session);
+    std::string handlePublish(const std::vector<std::string>& tokens, RedisDatabase& db);
+    std::string handlePubsub(const std::vector<std::string>& tokens, RedisDatabase& db);
+
+    // Connections
+    std::string handleClient(const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db);
+    std::string handleHello(const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db);
+
     // Common Commands
     std::string handlePing(const std::vector<std::string>& tokens, RedisDatabase& db);
     std::string handleEcho(const std::vector<std::string>& tokens, RedisDatabase& db);
     std::string handleFlushAll(const std::vector<std::string>& tokens, RedisDatabase& db);
+    std::string handleMemory(const std::vector<std::string>& tokens, RedisDatabase& db);
 
     // Key/Value Operations
     std::string handleSet(const std::vector<std::string>& tokens, RedisDatabase& db);
@@ -24,8 +108,18 @@ private:
     std::string handleKeys(const std::vector<std::string>& tokens, RedisDatabase& db);
     std::string handleType(const std::vector<std::string>& tokens, RedisDatabase& db);
     std::string handleDel(const std::vector<std::string>& tokens, RedisDatabase& db);
+    std::string handleUnlink(const std::vector<std::string>& tokens, RedisDatabase& db);
+    std::string handleExists(const std::vector<std::string>& tokens, RedisDatabase& db);
+    std::string handleMget(const std::vector<std::string>& tokens, RedisDatabase& db);
+    std::string handleMset(const std::vector<std::string>& tokens, RedisDatabase& db);
+    std::string handleMsetnx(const std::vector<std::string>& tokens, RedisDatabase& db);
     std::string handleExpire(const std::vector<std::string>& tokens, RedisDatabase& db);
     std::string handleRename(const std::vector<std::string>& tokens, RedisDatabase& db);
+    std::string handleIncr(const std::vector<std::string>& tokens, RedisDatabase& db);
+    std::string handleDecr(const std::vector<std::string>& tokens, RedisDatabase& db);
+    std::string handleIncrby(const std::vector<std::string>& tokens, RedisDatabase& db);
+    std::string handleDecrby(const std::vector<std::string>& tokens, RedisDatabase& db);
+    std::string handleIncrbyfloat(const std::vector<std::string>& tokens, RedisDatabase& db);
 
     // List Operations
     std::string handleLpush(const std::vector<std::string>& tokens, RedisDatabase& db);
@@ -37,6 +131,17 @@ private:
     std::string handleLget(const std::vector<std::string>& tokens, RedisDatabase& db);
     std::string handleLset(const std::vector<std::string>& tokens, RedisDatabase& db);
     std::string handleLrem(const std::vector<std::string>& tokens, RedisDatabase& db);
+    std::string handleLmove(const std::vector<std::string>& tokens, RedisDatabase& db);
+    std::string handleLrange(const std::vector<std::string>& tokens, RedisDatabase& db);
+    std::string handleLtrim(const std::vector<std::string>& tokens, RedisDatabase& db);
+    std::string handleLinsert(const std::vector<std::string>& tokens, RedisDatabase& db);
+    std::string handleLmpop(const std::vector<std::string>& tokens, RedisDatabase& db);
+
+    // Blocking List Operations
+    std::string handleBlpop(const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db);
+    std::string handleBrpop(const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db);
+    std::string handleBlmove(const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db);
+    std::string blockingPop(const std::vector<std::string>& tokens, bool fromLeft, ClientSession& session, RedisDatabase& db);
 
     // Hash Operations
     std::string handleHset(const std::vector<std::string>& tokens, RedisDatabase& db);
@@ -48,6 +153,44 @@ private:
     std::string handleHvals(const std::vector<std::string>& tokens, RedisDatabase& db);
     std::string handleHlen(const std::vector<std::string>& tokens, RedisDatabase& db);
     std::string handleHmset(const std::vector<std::string>& tokens, RedisDatabase& db);
+    std::string handleHmget(const std::vector<std::string>& tokens, RedisDatabase& db);
+
+    // Sorted Set Operations
+    std::string handleZadd(const std::vector<std::string>& tokens, RedisDatabase& db);
+    std::string handleZincrby(const std::vector<std::string>& tokens, RedisDatabase& db);
+    std::string handleZrem(const std::vector<std::string>& tokens, RedisDatabase& db);
+    std::string handleZscore(const std::vector<std::string>& tokens, RedisDatabase& db);
+    std::string handleZcard(const std::vector<std::string>& tokens, RedisDatabase& db);
+    std::string handleZrank(const std::vector<std::string>& tokens, RedisDatabase& db);
+    std::string handleZrevrank(const std::vector<std::string>& tokens, RedisDatabase& db);
+    std::string handleZrange(const std::vector<std::string>& tokens, RedisDatabase& db);
+    std::string handleZrevrange(const std::vector<std::string>& tokens, RedisDatabase& db);
+    std::string handleZrangebyscore(const std::vector<std::string>& tokens, RedisDatabase& db);
+
+    // Set Operations
+    std::string handleSadd(const std::vector<std::string>& tokens, RedisDatabase& db);
+    std::string handleSrem(const std::vector<std::string>& tokens, RedisDatabase& db);
+    std::string handleSismember(const std::vector<std::string>& tokens, RedisDatabase& db);
+    std::string handleSmembers(const std::vector<std::string>& tokens, RedisDatabase& db);
+    std::string handleScard(const std::vector<std::string>& tokens, RedisDatabase& db);
+    std::string handleSinter(const std::vector<std::string>& tokens, RedisDatabase& db);
+    std::string handleSunion(const std::vector<std::string>& tokens, RedisDatabase& db);
+    std::string handleSdiff(const std::vector<std::string>& tokens, RedisDatabase& db);
+
+    // Stream Operations
+    std::string handleXadd(const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db);
+    std::string handleXlen(const std::vector<std::string>& tokens, RedisDatabase& db);
+    std::string handleXrange(const std::vector<std::string>& tokens, RedisDatabase& db);
+    std::string handleXrevrange(const std::vector<std::string>& tokens, RedisDatabase& db);
+    std::string handleXdel(const std::vector<std::string>& tokens, RedisDatabase& db);
+    std::string handleXtrim(const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db);
+    std::string handleXread(const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db);
+    std::string handleXreadgroup(const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db);
+    std::string handleXgroup(const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db);
+    std::string handleXack(const std::vector<std::string>& tokens, RedisDatabase& db);
+    std::string handleXpending(const std::vector<std::string>& tokens, RedisDatabase& db);
+    std::string handleXclaim(const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db);
+    std::string handleXinfo(const std::vector<std::string>& tokens, RedisDatabase& db);
 };
 
 #endif
\ No newline at end of file
@@ -6,50 +6,210 @@
 #include <unordered_map>
 #include <vector>
 #include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <optional>
+#include <iosfwd>
+#include "SortedSet.h"
+#include "Set.h"
+#include "Stream.h"
+#include "StringValue.h"
+#include "SlabAllocator.h"
+
+// Top level key -> value maps; their nodes come from the slab allocator
+template <typename V>
+using Keyspace = std::unordered_map<std::string, V, std::hash<std::string>, std::equal_to<std::string>,
+                                    SlabStdAllocator<std::pair<const std::string, V>>>;
+
+// A client blocked in BLPOP/BRPOP/BLMOVE. lpush()/rpush() hand new elements
+// straight to the oldest waiter of the key, one waiter per element, so only the
+// client that actually gets data is woken up.
+struct ListWaiter {
+    std::vector<std::string> keys;
+    bool fromLeft = true;
+    bool move = false;          // BLMOVE: push the popped element onto destination
+    std::string destination;
+    bool toLeft = true;
+
+    bool served = false;
+    std::string servedKey;
+    std::string value;
+    // Runs with db_mutex held once served: the thread-per-connection server
+    // signals a condition variable, an event loop would queue the reply.
+    std::function<void()> notify;
+    // Also runs with db_mutex held, right after the pop (replication records it)
+    std::function<void()> onServed;
+};
+
+// A client blocked in XREAD/XREADGROUP BLOCK. Stream writes only mark it
+// ready; the blocked thread then retries its read, which may still come up
+// empty (entries older than the ids it asked for, or taken by another consumer).
+struct StreamWaiter {
+    std::vector<std::string> keys;
+    bool ready = false;
+    std::function<void()> notify; // runs with db_mutex held
+};
+
+// A key taken out of the keyspace with its value and remaining TTL (MIGRATE, DUMP)
+struct DetachedKey {
+    std::string key;
+    std::string type; // "string", "list", "hash", "zset", "set" or "stream"
+    std::string str;
+    std::deque<std::string> list;
+    std::unordered_map<std::string, std::string> hash;
+    SortedSet zset;
+    Set set;
+    Stream stream;
+    long long ttlMs = -1; // -1 :- no expiry
+};
 
 class RedisDatabase {
 public:
     static RedisDatabase& getInstance();
 
     //command operations
-    bool flushAll();
+    bool flushAll(bool async = false); // async: old contents are freed by the LazyFree thread
 
     //key-value operations
     bool set(const std::string& key, const std::string& value);
     bool get(const std::string& key, std::string& value);
+    // Multi-key variants take db_mutex once for the whole batch
+    std::vector<std::optional<std::string>> mget(const std::vector<std::string>& keys);
+    void mset(const std::vector<std::pair<std::string, std::string>>& keyValues);
+    bool msetnx(const std::vector<std::pair<std::string, std::string>>& keyValues);
+    // 0 ok, -1 wrong type, -2 value is not an integer/float, -3 overflow (or NaN/inf result)
+    int incrby(const std::string& key, int64_t delta, int64_t& result);
+    int incrbyfloat(const std::string& key, long double delta, std::string& result);
     std::vector<std::string> keys();
+    // Keys for which match() is true, at most limit of them; the scan stops once it has them
+    std::vector<std::string> keysMatching(const std::function<bool(const std::string&)>& match, size_t limit);
     std::string type(const std::string& key);
     bool del(const std::string& key);
+    // lazy = UNLINK: big values are handed to the LazyFree thread instead of destroyed here
+    size_t del(const std::vector<std::string>& keys, bool lazy = false);
+    size_t exists(const std::vector<std::string>& keys);
     bool expire(const std::string& key, int seconds);
     bool rename(const std::string& oldKey, const std::string& newKey);
 
     //list operations
     std::vector<std::string> lget(const std::string& key);
     ssize_t llen(const std::string& key);
-    void lpush(const std::string& key, const std::string& value);
-    void rpush(const std::string& key, const std::string& value);
+    // return the list length after the push, before blocked clients take their elements
+    ssize_t lpush(const std::string& key, const std::string& value);
+    ssize_t rpush(const std::string& key, const std::string& value);
+    // variadic push: all values inserted under one lock, in argument order
+    ssize_t lpush(const std::string& key, const std::vector<std::string>& values);
+    ssize_t rpush(const std::string& key, const std::vector<std::string>& values);
     bool lpop(const std::string& key, std::string& value);
     bool rpop(const std::string& key, std::string& value);
     int lrem(const std::string& key, int count, const std::string& value);
     bool lindex(const std::string& key, int index, std::string& value);
     bool lset(const std::string& key, int index, const std::string& value);
+    bool lmove(const std::string& source, const std::string& destination, bool fromLeft, bool toLeft, std::string& value);
+    // start/stop are inclusive and may be negative (from the tail), like Redis
+    std::vector<std::string> lrange(const std::string& key, long start, long stop);
+    bool ltrim(const std::string& key, long start, long stop);
+    // returns the new length, -1 if pivot wasn't found, 0 if the key doesn't exist
+    ssize_t linsert(const std::string& key, bool before, const std::string& pivot, const std::string& value);
+    // pop up to count elements from one end
+    std::vector<std::string> popMany(const std::string& key, bool fromLeft, size_t count);
+    // LMPOP: pop up to count elements from the first non-empty list, its name goes to poppedKey
+    std::vector<std::string> lmpop(const std::vector<std::string>& keys, bool fromLeft, size_t count, std::string& poppedKey);
+
+    //blocking list operations
+    // Serve the waiter right away if one of its keys has data, otherwise queue it (FIFO per key)
+    bool popOrBlock(const std::shared_ptr<ListWaiter>& waiter);
+    void cancelWait(const std::shared_ptr<ListWaiter>& waiter);
+    // Blocking flavour for thread-per-connection: waits until served, the timeout
+    // expires (zero = wait forever) or cancelled() returns true
+    bool blockingPop(const std::shared_ptr<ListWaiter>& waiter, std::chrono::milliseconds timeout,
+                     const std::function<bool()>& cancelled);
 
     //hash operations
     bool hset(const std::string& key, const std::string& field, const std::string& value);
     bool hget(const std::string& key, const std::string& field, std::string& value);
     bool hexists(const std::string& key, const std::string& field);
     bool hdel(const std::string& key, const std::string& field);
+    size_t hdel(const std::string& key, const std::vector<std::string>& fields);
+    std::vector<std::optional<std::string>> hmget(const std::string& key, const std::vector<std::string>& fields);
     std::unordered_map<std::string, std::string> hgetall(const std::string& key);
     std::vector<std::string> hkeys(const std::string& key);
     std::vector<std::string> hvals(const std::string& key);
     ssize_t hlen(const std::string& key);
     bool hmset(const std::string& key, const std::vector<std::pair<std::string, std::string>>& fieldValues);
 
+    //sorted set operations
+    enum ZaddFlags { ZADD_NX = 1, ZADD_XX = 2 };
+    // returns the number of new members (-1 if key holds another type), changed = added + updated
+    long zadd(const std::string& key, const std::vector<std::pair<double, std::string>>& entries, int flags, size_t& changed);
+    // 0 ok, -1 wrong type, -2 result is not a number
+    int zincrby(const std::string& key, const std::string& member, double delta, double& newScore);
+    size_t zrem(const std::string& key, const std::vector<std::string>& members);
+    bool zscore(const std::string& key, const std::string& member, double& score);
+    long zrank(const std::string& key, const std::string& member, bool reverse);
+    ssize_t zcard(const std::string& key);
+    std::vector<std::pair<std::string, double>> zrange(const std::string& key, long start, long stop, bool reverse);
+    std::vector<std::pair<std::string, double>> zrangebyscore(const std::string& key, const ScoreRange& range, size_t offset, long count);
+
+    //set operations
+    ssize_t sadd(const std::string& key, const std::vector<std::string>& members); // -1 if key holds another type
+    size_t srem(const std::string& key, const std::vector<std::string>& members);
+    bool sismember(const std::string& key, const std::string& member);
+    std::vector<std::string> smembers(const std::string& key);
+    ssize_t scard(const std::string& key);
+    // false if one of the keys holds another type
+    bool sinter(const std::vector<std::string>& keys, std::vector<std::string>& out);
+    bool sunion(const std::vector<std::string>& keys, std::vector<std::string>& out);
+    bool sdiff(const std::vector<std::string>& keys, std::vector<std::string>& out);
+
+    //stream operations
+    // Run fn on the stream at key with db_mutex held. create makes an empty stream
+    // if the key is missing; write marks the key modified (WATCH) and, if fn added
+    // entries, wakes the readers blocked on it.
+    // Returns -1 if key holds another type, 0 if there is no stream, 1 once fn ran.
+    int withStream(const std::string& key, bool create, bool write, const std::function<void(Stream&)>& fn);
+    // XREAD/XREADGROUP BLOCK: run attempt (with db_mutex held) now and again after every
+    // write to one of keys until it returns true, the timeout expires (zero = wait
+    // forever) or cancelled() returns true
+    bool blockOnStreams(const std::vector<std::string>& keys, std::chrono::milliseconds timeout,
+                        const std::function<bool()>& attempt, const std::function<bool()>& cancelled);
+
+    //transaction support
+    // Hold the database lock across several operations (MULTI/EXEC). The mutex
+    // is recursive, so the individual operations can still be called under it.
+    std::unique_lock<std::recursive_mutex> acquireLock();
+    // WATCH: keys are versioned only while at least one connection watches them
+    uint64_t watchKey(const std::string& key);
+    void unwatchKey(const std::string& key);
+    uint64_t keyVersion(const std::string& key);
+
+    //memory introspection
+    // Approximate bytes used by key and its value, false if the key does not exist
+    bool memoryUsage(const std::string& key, size_t& bytes);
+    size_t keyCount();
+
     //Persistenance - dump and load from a file
     bool dump(const std::string& filename);
     bool load(const std::string& filename);
+    bool dump(std::ostream& out);
+    bool load(std::istream& in);
+
+    //key migration (MIGRATE/RESTORE/DUMP), values travel in the snapshot encoding
+    // Copy key out, or with remove move it out in O(1) and delete it; false if missing
+    bool extractKey(const std::string& key, DetachedKey& out, bool remove);
+    // Put an extracted key back, false (and nothing changes) if the key exists again
+    bool attachKey(DetachedKey&& detached);
+    // Snapshot lines of an extracted key, big values cut into chunks of chunkElements elements
+    static void encodeKey(const DetachedKey& detached, size_t chunkElements, std::vector<std::string>& chunks);
+    // 0 ok, -1 key exists (no replace), -2 payload is not the encoding of key, -3 append to another type.
+    // append adds the elements of a later chunk to the value created by the first.
+    int restoreKey(const std::string& key, const std::string& payload, long long ttlMs, bool replace, bool append);
 
 private:
+    friend class ShardedServer; // sharded mode gives each shard its own instance
+
     //private constructor to prevent instantiation
     //private destructor to prevent deletion
     RedisDatabase() = default;
@@ -57,11 +217,44 @@ private:
     RedisDatabase(const RedisDatabase&) = delete;
     RedisDatabase& operator=(const RedisDatabase&) = delete;
 
-    std::mutex db_mutex; // mutex for thread-safe database operations
-    std::unordered_map<std::string, std::string> kv_store; // simple key-value store
-    std::unordered_map<std::string, std::vector<std::string>> list_store; // simple list store
-    std::unordered_map<std::string, std::unordered_map<std::string, std::string>> hash_store; // simple hash store
-    std::unordered_map<std::string, std::chrono::steady_clock::time_point> expiry_map; // map to store key expiry times
+    // type name of key ("none" if missing), call with db_mutex held
+    const char* typeOf(const std::string& key);
+    bool wrongType(const std::string& key, const char* expected);
+    bool eraseKey(const std::string& key, bool lazy);
+    void dropOtherType(const std::string& key, const char* keep);
+    bool collectSets(const std::vector<std::string>& keys, std::vector<const Set*>& sets);
+    void loadLine(const std::string& line, std::string& current);
+
+    // bump the version of a watched key, call with db_mutex held
+    void touch(const std::string& key);
+    void touchAll();
+
+    // list helpers, call with db_mutex held
+    bool popFront(const std::string& key, bool fromLeft, std::string& value);
+    void pushTo(const std::string& key, bool toLeft, const std::string& value);
+    bool normalizeRange(size_t size, long& start, long& stop);
+    bool tryServe(const std::shared_ptr<ListWaiter>& waiter);
+    void serveListWaiters(const std::string& key);
+    void unregisterWaiter(const std::shared_ptr<ListWaiter>& waiter);
+    void signalStreamWaiters(const std::string& key);
+    void unregisterStreamWaiter(const std::shared_ptr<StreamWaiter>& waiter);
+
+    struct WatchEntry {
+        size_t watchers = 0;
+        uint64_t version = 0;
+    };
+
+    std::recursive_mutex db_mutex; // mutex for thread-safe database operations, recursive for MULTI/EXEC
+    std::unordered_map<std::string, WatchEntry> watched_keys; // versions of keys under WATCH
+    std::unordered_map<std::string, std::deque<std::shared_ptr<ListWaiter>>> list_waiters; // blocked clients per list key
+    std::unordered_map<std::string, std::vector<std::shared_ptr<StreamWaiter>>> stream_waiters; // blocked readers per stream key
+    Keyspace<StringValue> kv_store; // simple key-value store (integers stored as int64, short values inline)
+    Keyspace<std::deque<std::string>> list_store; // list store, deque for O(1) push/pop at both ends
+    Keyspace<std::unordered_map<std::string, std::string>> hash_store; // simple hash store
+    Keyspace<SortedSet> zset_store; // sorted sets (compact vector or skiplist + dict)
+    Keyspace<Set> set_store;        // sets (intset or hash)
+    Keyspace<Stream> stream_store;  // streams (delta encoded nodes under a radix tree)
+    Keyspace<std::chrono::steady_clock::time_point> expiry_map; // map to store key expiry times
 };
 
 #endif 
\ No newline at end of file
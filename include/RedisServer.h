@@ -1,21 +1,56 @@
 #ifndef REDIS_SERVER_H
 #define REDIS_SERVER_H
 
+#include "Listener.h"
+#include "IoThreads.h"
 #include <string>
+#include <vector>
 #include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <functional>
+#include <cstdint>
+
+class RedisCommandHandler;
+struct ClientSession;
+struct ClientInfo;
 
 class RedisServer {
     public:
-        RedisServer(int port);
+        // threads.ioThreads > 0 :- that many I/O threads and a pool of command executors (--io-threads)
+        RedisServer(const ListenOptions& options, const std::string& dumpFile = "dump.my_rdb", const ThreadOptions& threads = ThreadOptions());
+        ~RedisServer();
         void run();
         void shutdown();
 
+        // A connection's blocking loop :- input already received, output to send before anything
+        // else, run executes each command. Returns once the client is gone; the caller ends the
+        // session and closes the socket. Sharded mode serves its handed-over connections with it too.
+        using CommandRunner = std::function<std::string(const std::vector<std::string>&, ClientSession&)>;
+        static void serveConnection(ClientSession& session, std::string input, std::string output, const CommandRunner& run);
+
     private:
-        int port;
-        int server_socket;
+        ListenOptions options;
+        std::string dumpFile; // snapshot written on shutdown
+        std::vector<int> listeners; // TCP (one per acceptor with --reuseport) and the Unix socket
         std::atomic<bool> running;
+        ThreadOptions threads;
+        std::unique_ptr<IoThreads> io;
+        // One thread per connection (with --io-threads, the ones handed over), by client id.
+        // A thread adds its id to finishedThreads as it returns, cronLoop() joins it.
+        std::mutex threadsMutex;
+        std::unordered_map<uint64_t, std::thread> clientThreads;
+        std::vector<uint64_t> finishedThreads;
 
         void setupSignalHandlers();// for graceful shutdown
+        void acceptLoop(int listener, RedisCommandHandler& cmdHandler); // one thread per listener
+        void cronLoop(); // reaps finished threads, idle timeout
+        void finished(uint64_t clientId);
+        void serveClient(int client_socket, std::shared_ptr<ClientInfo> info, RedisCommandHandler& cmdHandler); // one thread per connection
+        // the connection's loop :- input already received, output to send before anything else
+        void serveSession(ClientSession& session, std::string input, std::string output, RedisCommandHandler& cmdHandler);
 
 };  
 
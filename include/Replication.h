@@ -0,0 +1,122 @@
+#ifndef REPLICATION_H
+#define REPLICATION_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+
+class RedisDatabase;
+struct ClientInfo;
+
+/* Master-replica replication
+ * Every write command that succeeds is appended, RESP encoded, to the
+ * replication stream while db_mutex is still held, so the stream has the
+ * same order as the writes. The stream is addressed by offset (bytes written
+ * since the replication id was created) and its most recent kBacklogSize
+ * bytes are kept in a ring buffer, the backlog.
+ *
+ * A replica sends PSYNC <replid> <offset>:
+ *  - same replid and offset still in the backlog :- +CONTINUE, the master
+ *    resends from offset (partial resync after a short disconnect)
+ *  - otherwise :- +FULLRESYNC <replid> <offset> followed by $<len>\r\n and a
+ *    snapshot in the dump() format taken at exactly that offset
+ * after which the master keeps streaming and the replica answers with
+ * REPLCONF ACK <offset> once a second.
+ *
+ * A replica applies the stream through the normal command path, refuses
+ * writes from its own clients (-READONLY) and copies the stream verbatim into
+ * its own backlog, so it can itself serve replicas and a promoted replica
+ * (REPLICAOF NO ONE) can still partially resync the others. */
+
+class Replication {
+public:
+    static const size_t kBacklogSize = 1024 * 1024;
+
+    static Replication& getInstance();
+
+    // Port this server listens on, announced to masters with REPLCONF listening-port
+    void setListeningPort(int port) { listeningPort = port; }
+
+    //master side
+    // True once the stream is being recorded (first replica connected, or we are a replica)
+    bool active() const { return streaming.load(std::memory_order_acquire); }
+    // Append one command to the stream; call with db_mutex held
+    void propagate(const std::vector<std::string>& tokens);
+    // A pop handed to a blocked client happens inside the push that fed it, before that
+    // push is propagated; it is held back until the next flushDeferred(). db_mutex held.
+    void propagateLater(std::vector<std::string> tokens);
+    void flushDeferred();
+    // PSYNC: resync the replica on socket, then stream to it until it goes away
+    // or breaks the replica output buffer limits (its lag is shown in info).
+    // Blocks the calling connection thread.
+    void serveReplica(int socket, const std::string& replid, long long offset, int replicaPort, RedisDatabase& db,
+                      ClientInfo* info = nullptr);
+
+    //replica side
+    bool isReplica() const { return replicaMode.load(std::memory_order_acquire); }
+    // REPLICAOF host port, or an empty host for REPLICAOF NO ONE
+    void replicaOf(const std::string& host, int port, RedisDatabase& db);
+
+    //introspection
+    std::string roleReply();
+    std::string info();
+
+private:
+    struct ReplicaInfo {
+        uint64_t id;
+        std::string ip;
+        int port;
+        long long ackOffset;
+        bool online; // false while the full sync payload is being sent
+    };
+
+    Replication();
+    Replication(const Replication&) = delete;
+    Replication& operator=(const Replication&) = delete;
+
+    // call with repl_mutex held
+    void appendLocked(const char* data, size_t len);
+    void flushDeferredLocked();
+    void startStreamingLocked();
+    static std::string newReplicationId();
+
+    // Replica link thread: connect, sync, apply the stream, reconnect with PSYNC after errors
+    void replicaLoop(uint64_t generation, RedisDatabase* db);
+    bool syncWithMaster(int sock, std::string& buffer, RedisDatabase& db);
+    void streamFromMaster(int sock, std::string& buffer, RedisDatabase& db, uint64_t generation);
+
+    std::mutex repl_mutex;
+    std::condition_variable stream_cv; // new bytes in the backlog, wakes the replica feeders
+
+    // Stream state
+    std::atomic<bool> streaming{false};
+    std::string replid;
+    std::string replid2;           // previous id after a promotion, valid up to secondOffset
+    long long secondOffset = -1;
+    long long masterOffset = 0;    // stream bytes written so far
+    std::vector<char> backlog;     // ring, holds [masterOffset - backlogLen, masterOffset)
+    size_t backlogLen = 0;
+    std::deque<std::vector<std::string>> deferred;
+    uint64_t streamEpoch = 0;      // bumped when a full sync replaces the stream, feeders of the old one stop
+
+    // Connected replicas
+    std::vector<ReplicaInfo> replicas;
+    uint64_t nextReplicaId = 1;
+    uint64_t fullSyncs = 0;
+    uint64_t partialSyncs = 0;
+
+    // Our own master, empty host when we are a master
+    std::atomic<bool> replicaMode{false};
+    std::string masterHost;
+    int masterPort = 0;
+    std::string linkState = "connect"; // connect, sync, connected
+    uint64_t generation = 0;           // bumped by every REPLICAOF, stale loops exit
+    int masterSocket = -1;
+    int listeningPort = 0;
+};
+
+#endif
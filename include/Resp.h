@@ -0,0 +1,44 @@
+#ifndef RESP_H
+#define RESP_H
+
+#include <string>
+#include <cstddef>
+
+/* Reply encoding
+ * Handlers build their replies inline. The types RESP3 added go through
+ * these helpers instead: they produce the native RESP3 type when the
+ * connection sent HELLO 3, and the RESP2 shape otherwise (a map becomes a
+ * flat array, a double a bulk string, a boolean an integer...). The protocol
+ * is a per-thread setting installed by Resp::Scope around each command, so
+ * handlers don't need the session to know it. */
+namespace Resp {
+
+// Protocol of the reply being built, 2 or 3
+int protocol();
+
+// Installs a protocol for the commands run during its lifetime, restores the previous one
+class Scope {
+public:
+    explicit Scope(int version);
+    ~Scope();
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+private:
+    int previous;
+};
+
+std::string bulk(const std::string& s);
+std::string null();                                // missing value :- _ / $-1
+std::string nullArray();                           // missing array :- _ / *-1
+std::string map(size_t pairs);                     // header, 2 * pairs elements follow :- %n / *2n
+std::string set(size_t size);                      // ~n / *n
+std::string push(size_t size);                     // out of band data :- >n / *n
+std::string dbl(const std::string& formatted);     // ,1.5 / $3 1.5 (also inf, -inf)
+std::string boolean(bool value);                   // #t #f / :1 :0
+std::string bigNumber(const std::string& digits);  // (123... / bulk
+std::string verbatim(const std::string& text);     // =n txt:... / bulk
+
+} // namespace Resp
+
+#endif
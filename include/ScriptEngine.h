@@ -0,0 +1,92 @@
+#ifndef SCRIPT_ENGINE_H
+#define SCRIPT_ENGINE_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <unordered_map>
+#include <stdexcept>
+#include <cstdint>
+
+/* Server-side scripting (EVAL/EVALSHA)
+ * Scripts are written in a small Lua-like language, compiled once to bytecode
+ * and cached by the SHA1 of their source. The VM is sandboxed: no I/O, no
+ * globals other than KEYS/ARGV and a handful of builtins, and an instruction
+ * budget so a runaway loop can't hold the database lock forever.
+ *
+ *   local v = redis.call("LINDEX", KEYS[1], ARGV[1])
+ *   if v == nil then return nil end
+ *   redis.call("LSET", KEYS[1], ARGV[1], tonumber(v) + tonumber(ARGV[2]))
+ *   return tonumber(v) + tonumber(ARGV[2])
+ */
+
+struct ScriptError : public std::runtime_error {
+    explicit ScriptError(const std::string& msg) : std::runtime_error(msg) {}
+};
+
+struct ScriptValue {
+    enum Type { NIL, BOOL, NUMBER, STRING, ARRAY };
+    Type type = NIL;
+    bool boolean = false;
+    double number = 0;
+    std::string str;
+    std::shared_ptr<std::vector<ScriptValue>> array;
+};
+
+enum class OpCode : uint8_t {
+    PUSH_CONST, PUSH_NIL, PUSH_TRUE, PUSH_FALSE,
+    LOAD_LOCAL, STORE_LOCAL, LOAD_KEYS, LOAD_ARGV,
+    GET_INDEX, SET_INDEX, NEW_ARRAY,
+    ADD, SUB, MUL, DIV, MOD, NEG, NOT, LEN, CONCAT,
+    EQ, NE, LT, LE, GT, GE,
+    JMP, JMP_IF_FALSE, JMP_IF_FALSE_KEEP, JMP_IF_TRUE_KEEP,
+    CALL_BUILTIN, POP, RETURN
+};
+
+struct Instruction {
+    OpCode op;
+    int a; // constant index, local slot, jump target, builtin id or element count
+    int b; // argument count for CALL_BUILTIN
+};
+
+struct CompiledScript {
+    std::string sha;
+    std::vector<Instruction> code;
+    std::vector<ScriptValue> constants;
+    int numLocals = 0;
+};
+
+class ScriptEngine {
+public:
+    // Runs one command for the script and returns its RESP reply
+    using CommandExecutor = std::function<std::string(const std::vector<std::string>&)>;
+
+    static ScriptEngine& getInstance();
+
+    // Compile (or fetch from cache) a script. Returns nullptr and sets error on a syntax error.
+    std::shared_ptr<CompiledScript> load(const std::string& source, std::string& error);
+    std::shared_ptr<CompiledScript> find(const std::string& sha);
+    bool exists(const std::string& sha);
+    void flush();
+
+    // Execute a compiled script and return its result as a RESP reply
+    std::string run(const CompiledScript& script, const std::vector<std::string>& keys,
+                    const std::vector<std::string>& argv, const CommandExecutor& executor);
+
+    static std::string sha1Hex(const std::string& data);
+
+    static const long kInstructionBudget = 50000000; // ~a few hundred ms of bytecode
+
+private:
+    ScriptEngine() = default;
+    ~ScriptEngine() = default;
+    ScriptEngine(const ScriptEngine&) = delete;
+    ScriptEngine& operator=(const ScriptEngine&) = delete;
+
+    std::mutex cache_mutex;
+    std::unordered_map<std::string, std::shared_ptr<CompiledScript>> script_cache; // sha1 -> bytecode
+};
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef SET_H
+#define SET_H
+
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include <cstdint>
+#include <functional>
+
+/* Set value
+ * While every member is a canonical integer ("42", "-7", not "007") and the
+ * set holds at most kMaxIntsetEntries members, it is stored as a sorted
+ * vector<int64_t> (intset) - 8 bytes per member and no per-member allocation.
+ * Adding anything else converts it to a hash set of strings for good.
+ * Intersections of intsets run as sorted-array kernels (SIMD merge or
+ * galloping search, see Set.cpp) instead of hash probes. */
+
+class Set {
+public:
+    static const size_t kMaxIntsetEntries = 512;
+
+    // true if the member was not already present
+    bool add(const std::string& member);
+    bool remove(const std::string& member);
+    bool contains(const std::string& member) const;
+    size_t size() const;
+    bool isIntset() const { return !hashed; }
+
+    std::vector<std::string> members() const;
+    void forEach(const std::function<void(const std::string&)>& fn) const;
+    // Approximate heap bytes owned by this set (MEMORY USAGE)
+    size_t memoryUsage() const;
+
+    // Set algebra over one or more sets (nullptr = missing key = empty set)
+    static Set intersect(std::vector<const Set*> sets);
+    static Set unite(const std::vector<const Set*>& sets);
+    static Set difference(const std::vector<const Set*>& sets);
+
+    // out = a & b, both sorted ascending without duplicates
+    static void intersectSorted(const std::vector<int64_t>& a, const std::vector<int64_t>& b, std::vector<int64_t>& out);
+
+private:
+    void convertToHash();
+
+    bool hashed = false;
+    std::vector<int64_t> ints;           // intset encoding, sorted
+    std::unordered_set<std::string> strs; // hash encoding
+};
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef SHARDED_SERVER_H
+#define SHARDED_SERVER_H
+
+#include "Listener.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+struct ClientSession;
+
+/* Shared-nothing server (--shards N)
+ * The keyspace is split into N shards, one thread per shard pinned to its own
+ * core. A shard owns a private RedisDatabase, its own SO_REUSEPORT listener and
+ * its own event loop, so a command on a local key only touches that shard's
+ * data (and the allocator, shared by all). The Unix socket, if any, is served by
+ * shard 0. The loops use epoll, or io_uring with --io-backend uring (which
+ * also runs a single event loop when there is only one shard).
+ * A key belongs to shard hash(key) % N. A command whose keys live on another
+ * shard is forwarded to it through a single-producer/single-consumer ring and
+ * the reply comes back the same way; replies are queued per connection so
+ * pipelined commands still answer in order. MGET/MSET/DEL/UNLINK/EXISTS are
+ * split by shard and merged, KEYS and FLUSHALL go to every shard, any other
+ * command spanning shards is refused with -CROSSSLOT. A transaction runs on the
+ * connection's shard and its keys must live there. A connection whose next
+ * command waits (BLPOP, BRPOP, BLMOVE, XREAD BLOCK) or subscribes is handed to
+ * a thread of its own, as in the default server, which runs its commands against
+ * the owning shards' databases under their locks. */
+
+// Fixed size lock-free queue between exactly one producer and one consumer thread
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacity) : slots(roundUp(capacity)), mask(slots.size() - 1) {}
+
+    bool push(T value) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == slots.size()) {
+            return false; // full
+        }
+        slots[t & mask] = value;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& value) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = slots[h & mask];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    static size_t roundUp(size_t n) {
+        size_t p = 1;
+        while (p < n) {
+            p <<= 1;
+        }
+        return p;
+    }
+
+    std::vector<T> slots;
+    size_t mask;
+    alignas(64) std::atomic<size_t> head{0}; // consumer side
+    alignas(64) std::atomic<size_t> tail{0}; // producer side
+};
+
+class ShardedServer {
+public:
+    // uring: io_uring event loops instead of epoll (the caller checked IoUring::supported())
+    ShardedServer(const ListenOptions& options, size_t numShards, bool uring = false);
+    ~ShardedServer();
+    // Start one thread per shard and serve until the process exits
+    void run();
+
+    // Which shard owns key
+    size_t shardOf(const std::string& key) const;
+
+    struct Message;
+    struct Shard;
+    struct Connection;
+    struct PendingReply;
+
+private:
+    ListenOptions options;
+    size_t numShards;
+    bool uring;
+    std::vector<std::unique_ptr<Shard>> shards;
+    // rings[from * numShards + to]
+    std::vector<std::unique_ptr<SpscRing<Message*>>> rings;
+
+    bool listen(Shard& shard);
+    void shardLoop(Shard& shard);
+    void pollEpoll(Shard& shard, int timeoutMs);
+    void pollUring(Shard& shard, int timeoutMs);
+    void accept(Shard& shard, int listenFd);
+    void addConnection(Shard& shard, int fd);
+    bool readConnection(Shard& shard, Connection& conn);
+    bool runCommands(Shard& shard, Connection& conn);
+    bool flush(Shard& shard, Connection& conn);
+    void checkClients(Shard& shard); // once a second :- output limits, idle timeout
+    void closeConnection(Shard& shard, uint64_t connId);
+
+    // Connections whose next command waits get a thread of their own
+    void leave(Shard& shard, Connection& conn);
+    void handOverLeaving(Shard& shard);
+    void handOver(Shard& shard, Connection& conn);
+    std::string runAlone(Shard& home, ClientSession& session, const std::vector<std::string>& tokens);
+
+    // Routing :- run here, forward to the owner, or split over several shards
+    std::string refusal(size_t home, ClientSession& session, const std::string& cmd,
+                        const std::vector<std::string>& tokens) const; // empty if it may run
+    bool route(size_t home, const std::string& cmd, const std::vector<std::string>& tokens,
+               std::vector<std::pair<size_t, std::vector<std::string>>>& parts, PendingReply& pending) const;
+    void dispatch(Shard& shard, Connection& conn, const std::vector<std::string>& tokens);
+    void scatter(Shard& shard, Connection& conn, std::vector<std::pair<size_t, std::vector<std::string>>>& parts,
+                 PendingReply& pending);
+    void onReply(Shard& shard, Message* msg);
+
+    // Messaging, only ever called from the sending shard's own thread
+    void send(Shard& from, size_t to, Message* msg);
+    void drainInbox(Shard& shard);
+    void flushBacklog(Shard& shard);
+};
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef SLAB_ALLOCATOR_H
+#define SLAB_ALLOCATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <atomic>
+#include <vector>
+
+/* Size-class slab allocator for keyspace nodes and small values
+ * Requests up to kMaxSmall bytes are rounded up to one of a few size classes
+ * and carved out of 64KB slabs; freed blocks go on a per-class free list and
+ * are reused for the same class only. Millions of small allocations then sit
+ * densely in a few big blocks instead of being spread over the malloc heap.
+ * Bigger requests go straight to operator new. Slabs are never returned to
+ * the OS, so reserved - used is the fragmentation MEMORY STATS reports. */
+
+class SlabAllocator {
+public:
+    static const size_t kMaxSmall = 512;
+    static const size_t kSlabSize = 64 * 1024;
+
+    struct ClassStats {
+        size_t blockSize;
+        size_t blocksInUse;
+        size_t slabs;
+    };
+
+    struct Stats {
+        size_t smallInUse = 0;    // bytes of blocks handed out (rounded to class size)
+        size_t smallReserved = 0; // bytes of slabs obtained from the system
+        size_t largeInUse = 0;    // bytes of requests above kMaxSmall
+        size_t allocations = 0;   // live allocations, small + large
+        std::vector<ClassStats> classes;
+    };
+
+    static SlabAllocator& getInstance();
+
+    void* allocate(size_t size);
+    void deallocate(void* p, size_t size);
+    // Bytes actually taken for a request of this size
+    static size_t usableSize(size_t size);
+
+    Stats stats();
+
+private:
+    struct SizeClass {
+        size_t blockSize = 0;
+        std::mutex lock;
+        void* freeList = nullptr; // singly linked through the first word of each free block
+        char* bump = nullptr;     // unused tail of the newest slab
+        char* bumpEnd = nullptr;
+        size_t inUse = 0;
+        size_t slabs = 0;
+    };
+
+    SlabAllocator();
+    SlabAllocator(const SlabAllocator&) = delete;
+    SlabAllocator& operator=(const SlabAllocator&) = delete;
+
+    static size_t classIndex(size_t size);
+
+    std::vector<SizeClass> classes;
+    std::atomic<size_t> largeBytes{0};
+    std::atomic<size_t> largeCount{0};
+};
+
+// std allocator on top of SlabAllocator, used by the keyspace containers
+template <typename T>
+struct SlabStdAllocator {
+    using value_type = T;
+    static_assert(alignof(T) <= alignof(void*), "slab blocks are pointer aligned");
+
+    SlabStdAllocator() noexcept = default;
+    template <typename U>
+    SlabStdAllocator(const SlabStdAllocator<U>&) noexcept {}
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(SlabAllocator::getInstance().allocate(n * sizeof(T)));
+    }
+    void deallocate(T* p, size_t n) noexcept {
+        SlabAllocator::getInstance().deallocate(p, n * sizeof(T));
+    }
+
+    template <typename U>
+    bool operator==(const SlabStdAllocator<U>&) const noexcept { return true; }
+    template <typename U>
+    bool operator!=(const SlabStdAllocator<U>&) const noexcept { return false; }
+};
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef SORTED_SET_H
+#define SORTED_SET_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <utility>
+#include <memory>
+#include <functional>
+
+/* Sorted set (ZSET) value
+ * Small sets are kept as a vector of (score, member) sorted by score then
+ * member - compact and cache friendly. Past kMaxCompactEntries entries (or a
+ * member longer than kMaxCompactMember) the set converts to a skiplist whose
+ * links carry spans, giving O(log n) rank queries, plus a hash from member to
+ * score for O(1) ZSCORE. Both encodings order by (score, member). */
+
+struct ScoreRange {
+    double min, max;
+    bool minExclusive = false;
+    bool maxExclusive = false;
+};
+
+class SortedSet {
+public:
+    static const size_t kMaxCompactEntries = 128;
+    static const size_t kMaxCompactMember = 64;
+
+    SortedSet();
+    ~SortedSet();
+    SortedSet(const SortedSet& other);
+    SortedSet& operator=(const SortedSet& other);
+    SortedSet(SortedSet&& other) noexcept;
+    SortedSet& operator=(SortedSet&& other) noexcept;
+
+    // Insert or update; returns true if the member is new
+    bool add(const std::string& member, double score);
+    bool remove(const std::string& member);
+    bool score(const std::string& member, double& out) const;
+    // 0-based rank, -1 if missing
+    long rank(const std::string& member, bool reverse) const;
+    size_t size() const;
+    bool isCompact() const { return skiplist == nullptr; }
+
+    // Inclusive rank range, indexes already normalized to [0, size)
+    std::vector<std::pair<std::string, double>> rangeByRank(size_t start, size_t stop, bool reverse) const;
+    std::vector<std::pair<std::string, double>> rangeByScore(const ScoreRange& range, size_t offset, long count) const;
+
+    void forEach(const std::function<void(const std::string&, double)>& fn) const;
+    // Approximate heap bytes owned by this set (MEMORY USAGE)
+    size_t memoryUsage() const;
+
+private:
+    struct SkipList;
+
+    void convertToSkiplist();
+
+    std::vector<std::pair<double, std::string>> compact; // small encoding, sorted
+    SkipList* skiplist;                                  // big encoding (with dict), null when compact
+};
+
+#endif
@@ -0,0 +1,380 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <cstdint>
+#include <functional>
+
+/* Stream value
+ * Entries (an id plus field/value pairs) are appended to macro nodes of up to
+ * kNodeMaxEntries entries / kNodeMaxBytes bytes. A node keeps the id and the
+ * field names of its first entry (the master entry); every entry is stored as
+ * varints relative to it - flags, ms delta, seq - followed by length prefixed
+ * values, and entries with the master's field names don't repeat them. An
+ * entry with two short fields costs about a dozen bytes instead of a
+ * std::string (32 bytes plus heap) per field and value.
+ *
+ * Nodes are indexed by a path-compressed radix tree over the big-endian bytes
+ * of their master id, so a range lookup finds its first node in one descent
+ * and consecutive ids share their common prefix. XDEL only flags an entry, a
+ * node goes away once all of its entries are deleted or trimmed.
+ *
+ * Consumer groups keep their pending entries list (PEL) in the same kind of
+ * radix tree, plus one per consumer for reading its own history. */
+
+struct StreamID {
+    uint64_t ms = 0;
+    uint64_t seq = 0;
+
+    bool operator==(const StreamID& o) const { return ms == o.ms && seq == o.seq; }
+    bool operator!=(const StreamID& o) const { return !(*this == o); }
+    bool operator<(const StreamID& o) const { return ms < o.ms || (ms == o.ms && seq < o.seq); }
+    bool operator<=(const StreamID& o) const { return !(o < *this); }
+    bool operator>(const StreamID& o) const { return o < *this; }
+    bool operator>=(const StreamID& o) const { return !(*this < o); }
+
+    static StreamID min() { return StreamID(); }
+    static StreamID max() { return StreamID{UINT64_MAX, UINT64_MAX}; }
+    // false at the ends of the id space
+    bool increment();
+    bool decrement();
+
+    std::string str() const;
+    // "ms-seq", or "ms" with seq = missingSeq; false if malformed
+    static bool parse(const std::string& text, StreamID& out, uint64_t missingSeq);
+};
+
+struct StreamEntry {
+    StreamID id;
+    std::vector<std::string> fields; // field, value, field, value...
+    bool deleted = false;            // XREADGROUP history of an entry that was XDEL'ed
+};
+
+// Ordered map keyed by StreamID: a radix tree over the 16 id bytes (ms then
+// seq, big-endian), edges compressed so single-child chains are one node
+template <typename V>
+class StreamRadix {
+public:
+    StreamRadix() : root(new Node()) {}
+    StreamRadix(const StreamRadix& other) : root(clone(other.root.get())), count(other.count) {}
+    StreamRadix& operator=(const StreamRadix& other) {
+        if (this != &other) {
+            root.reset(clone(other.root.get()));
+            count = other.count;
+        }
+        return *this;
+    }
+    StreamRadix(StreamRadix&& other) noexcept : root(std::move(other.root)), count(other.count) {
+        other.root.reset(new Node());
+        other.count = 0;
+    }
+    StreamRadix& operator=(StreamRadix&& other) noexcept {
+        std::swap(root, other.root);
+        std::swap(count, other.count);
+        return *this;
+    }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    // Value for id, created (default constructed) if missing
+    V& operator[](const StreamID& id) {
+        uint8_t key[16];
+        encode(id, key);
+        Node* n = root.get();
+        size_t depth = 0;
+        while (depth < 16) {
+            size_t i = childIndex(n, key[depth]);
+            if (i == n->children.size() || static_cast<uint8_t>(n->children[i]->edge[0]) != key[depth]) {
+                // no child starts with this byte :- the rest of the key becomes one leaf edge
+                Node* leaf = new Node();
+                leaf->edge.assign(key + depth, key + 16);
+                leaf->leaf = true;
+                leaf->id = id;
+                n->children.insert(n->children.begin() + i, std::unique_ptr<Node>(leaf));
+                ++count;
+                return leaf->value;
+            }
+            Node* c = n->children[i].get();
+            size_t common = 0;
+            while (common < c->edge.size() && static_cast<uint8_t>(c->edge[common]) == key[depth + common])
+                ++common;
+            if (common < c->edge.size()) {
+                // split the edge, the old child hangs below the shared part
+                Node* mid = new Node();
+                mid->edge.assign(c->edge.begin(), c->edge.begin() + common);
+                std::unique_ptr<Node> old = std::move(n->children[i]);
+                old->edge.erase(0, common);
+                mid->children.push_back(std::move(old));
+                n->children[i].reset(mid);
+                c = mid;
+            }
+            n = c;
+            depth += common;
+        }
+        return n->value;
+    }
+
+    V* find(const StreamID& id) {
+        uint8_t key[16];
+        encode(id, key);
+        Node* n = root.get();
+        size_t depth = 0;
+        while (depth < 16) {
+            size_t i = childIndex(n, key[depth]);
+            if (i == n->children.size())
+                return nullptr;
+            Node* c = n->children[i].get();
+            if (c->edge.compare(0, c->edge.size(), reinterpret_cast<const char*>(key + depth), c->edge.size()) != 0)
+                return nullptr;
+            n = c;
+            depth += c->edge.size();
+        }
+        return &n->value;
+    }
+    const V* find(const StreamID& id) const { return const_cast<StreamRadix*>(this)->find(id); }
+
+    bool erase(const StreamID& id) {
+        uint8_t key[16];
+        encode(id, key);
+        std::vector<std::pair<Node*, size_t>> path; // parent, index of the child taken
+        Node* n = root.get();
+        size_t depth = 0;
+        while (depth < 16) {
+            size_t i = childIndex(n, key[depth]);
+            if (i == n->children.size())
+                return false;
+            Node* c = n->children[i].get();
+            if (c->edge.compare(0, c->edge.size(), reinterpret_cast<const char*>(key + depth), c->edge.size()) != 0)
+                return false;
+            path.emplace_back(n, i);
+            n = c;
+            depth += c->edge.size();
+        }
+        Node* parent = path.back().first;
+        parent->children.erase(parent->children.begin() + path.back().second);
+        --count;
+        // A non-root node left with one child is merged into it to keep edges compressed
+        if (parent != root.get() && parent->children.size() == 1) {
+            std::unique_ptr<Node> only = std::move(parent->children[0]);
+            parent->edge += only->edge;
+            parent->children = std::move(only->children);
+            parent->leaf = only->leaf;
+            parent->id = only->id;
+            parent->value = std::move(only->value);
+        }
+        return true;
+    }
+
+    // Entry with the greatest id <= id, or the smallest id >= id; null if there is none
+    V* floor(const StreamID& id, StreamID* found = nullptr) { return search(id, true, found); }
+    V* ceil(const StreamID& id, StreamID* found = nullptr) { return search(id, false, found); }
+    const V* floor(const StreamID& id, StreamID* found = nullptr) const { return const_cast<StreamRadix*>(this)->search(id, true, found); }
+    const V* ceil(const StreamID& id, StreamID* found = nullptr) const { return const_cast<StreamRadix*>(this)->search(id, false, found); }
+    // Strictly after / before id
+    V* next(const StreamID& id, StreamID* found = nullptr) {
+        StreamID k = id;
+        return k.increment() ? ceil(k, found) : nullptr;
+    }
+    V* prev(const StreamID& id, StreamID* found = nullptr) {
+        StreamID k = id;
+        return k.decrement() ? floor(k, found) : nullptr;
+    }
+    const V* next(const StreamID& id, StreamID* found = nullptr) const { return const_cast<StreamRadix*>(this)->next(id, found); }
+    const V* prev(const StreamID& id, StreamID* found = nullptr) const { return const_cast<StreamRadix*>(this)->prev(id, found); }
+    V* first(StreamID* found = nullptr) { return ceil(StreamID::min(), found); }
+    V* last(StreamID* found = nullptr) { return floor(StreamID::max(), found); }
+    const V* first(StreamID* found = nullptr) const { return ceil(StreamID::min(), found); }
+    const V* last(StreamID* found = nullptr) const { return floor(StreamID::max(), found); }
+
+    // In id order
+    void forEach(const std::function<void(const StreamID&, const V&)>& fn) const { walk(root.get(), fn); }
+
+    // Tree nodes (XINFO STREAM radix-tree-nodes) and approximate bytes, values not included
+    size_t nodeCount() const { return countNodes(root.get()); }
+    size_t memoryUsage() const { return nodeCount() * sizeof(Node); }
+
+private:
+    struct Node {
+        std::string edge; // bytes of the key between the parent and this node
+        std::vector<std::unique_ptr<Node>> children; // sorted by their first edge byte
+        bool leaf = false;
+        StreamID id;
+        V value{};
+    };
+
+    static void encode(const StreamID& id, uint8_t key[16]) {
+        for (int i = 0; i < 8; ++i) {
+            key[i] = static_cast<uint8_t>(id.ms >> (56 - 8 * i));
+            key[8 + i] = static_cast<uint8_t>(id.seq >> (56 - 8 * i));
+        }
+    }
+
+    // First child whose edge starts at or after byte
+    static size_t childIndex(const Node* n, uint8_t byte) {
+        size_t lo = 0, hi = n->children.size();
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (static_cast<uint8_t>(n->children[mid]->edge[0]) < byte)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return lo;
+    }
+
+    static Node* extreme(Node* n, bool greatest) {
+        while (!n->leaf)
+            n = greatest ? n->children.back().get() : n->children.front().get();
+        return n;
+    }
+
+    // floor: greatest leaf <= key below n, ceil: smallest leaf >= key; n's bytes before depth equal key's
+    static Node* bound(Node* n, const uint8_t* key, size_t depth, bool floor) {
+        if (n->leaf)
+            return n;
+        size_t count = n->children.size();
+        for (size_t k = 0; k < count; ++k) {
+            Node* c = n->children[floor ? count - 1 - k : k].get();
+            int cmp = c->edge.compare(0, c->edge.size(), reinterpret_cast<const char*>(key + depth), c->edge.size());
+            if (cmp == 0) {
+                Node* found = bound(c, key, depth + c->edge.size(), floor);
+                if (found)
+                    return found;
+            } else if ((cmp < 0) == floor) {
+                return extreme(c, floor); // the whole subtree is on the wanted side
+            }
+        }
+        return nullptr;
+    }
+
+    V* search(const StreamID& id, bool floor, StreamID* found) {
+        if (count == 0)
+            return nullptr;
+        uint8_t key[16];
+        encode(id, key);
+        Node* n = bound(root.get(), key, 0, floor);
+        if (!n)
+            return nullptr;
+        if (found)
+            *found = n->id;
+        return &n->value;
+    }
+
+    static Node* clone(const Node* n) {
+        Node* copy = new Node();
+        copy->edge = n->edge;
+        copy->leaf = n->leaf;
+        copy->id = n->id;
+        copy->value = n->value;
+        for (const auto& c : n->children)
+            copy->children.emplace_back(clone(c.get()));
+        return copy;
+    }
+
+    static void walk(const Node* n, const std::function<void(const StreamID&, const V&)>& fn) {
+        if (n->leaf)
+            fn(n->id, n->value);
+        for (const auto& c : n->children)
+            walk(c.get(), fn);
+    }
+
+    static size_t countNodes(const Node* n) {
+        size_t total = 1;
+        for (const auto& c : n->children)
+            total += countNodes(c.get());
+        return total;
+    }
+
+    std::unique_ptr<Node> root;
+    size_t count = 0;
+};
+
+class Stream {
+public:
+    static const size_t kNodeMaxEntries = 128;
+    static const size_t kNodeMaxBytes = 4096;
+
+    struct Pending {
+        std::string consumer;
+        uint64_t deliveryTime = 0; // unix ms
+        uint64_t deliveries = 0;
+    };
+    struct Consumer {
+        uint64_t seenTime = 0; // unix ms
+        StreamRadix<char> pending; // this consumer's part of the group PEL
+    };
+    struct Group {
+        StreamID lastDelivered;
+        StreamRadix<Pending> pel;
+        std::map<std::string, Consumer> consumers;
+    };
+
+    size_t size() const { return length; }
+    const StreamID& lastId() const { return last; }
+    size_t nodeCount() const { return index.size(); }
+    size_t radixNodes() const { return index.nodeCount(); }
+
+    // Id XADD would give an entry for "*" (autoMs) or "<ms>-*" (autoSeq only);
+    // false if it would not be greater than the last id
+    bool nextId(StreamID& id, bool autoMs, bool autoSeq, uint64_t nowMs) const;
+    // Append; false if id is not greater than the last id
+    bool add(const StreamID& id, const std::vector<std::string>& fields);
+    // Deleted entries, unknown ids are ignored
+    size_t remove(const std::vector<StreamID>& ids);
+    // Drop the oldest entries down to maxLen. approx only removes whole nodes,
+    // leaving up to one node's worth above maxLen. Returns entries removed.
+    size_t trim(size_t maxLen, bool approx);
+    // Entries with start <= id <= end, at most count of them (0 = no limit), newest first when reverse
+    void range(const StreamID& start, const StreamID& end, size_t count, bool reverse, std::vector<StreamEntry>& out) const;
+    bool get(const StreamID& id, StreamEntry& out) const;
+    bool firstEntry(StreamEntry& out) const;
+    bool lastEntry(StreamEntry& out) const;
+    // Raise the last id (restore of a stream whose newest entries were deleted)
+    void setLastId(const StreamID& id);
+
+    //consumer groups
+    Group* group(const std::string& name);
+    const std::map<std::string, Group>& groupList() const { return groups; }
+    bool createGroup(const std::string& name, const StreamID& lastDelivered);
+    bool destroyGroup(const std::string& name);
+    // ">" read: entries after the group's last delivered id, added to the PEL unless noack
+    void readNew(Group& g, const std::string& consumer, size_t count, bool noack, uint64_t nowMs, std::vector<StreamEntry>& out);
+    // History read: the consumer's pending entries after start
+    void readPending(Group& g, const std::string& consumer, const StreamID& start, size_t count, uint64_t nowMs,
+                     std::vector<StreamEntry>& out);
+    // XACK, number of ids that were pending
+    size_t ack(Group& g, const std::vector<StreamID>& ids);
+    // XCLAIM: ids pending for at least minIdle ms (or force) move to consumer; claimed ids go to claimed
+    void claim(Group& g, const std::string& consumer, uint64_t minIdle, const std::vector<StreamID>& ids, bool force,
+               bool bumpDeliveries, uint64_t nowMs, std::vector<StreamID>& claimed);
+    Consumer& consumer(Group& g, const std::string& name, uint64_t nowMs);
+    // Pending entries the consumer still had, -1 if it did not exist
+    long deleteConsumer(Group& g, const std::string& name);
+
+    // Snapshot/DUMP encoding (see RedisDatabase::encodeKey)
+    void forEach(const std::function<void(const StreamEntry&)>& fn) const;
+    // Approximate heap bytes owned by this stream (MEMORY USAGE)
+    size_t memoryUsage() const;
+
+private:
+    struct Node {
+        StreamID master;                       // id of the first entry added to the node
+        std::vector<std::string> masterFields; // its field names
+        std::string data;                      // encoded entries
+        uint32_t entries = 0;                  // including deleted ones
+        uint32_t live = 0;
+    };
+
+    bool markDeleted(Node& node, const StreamID& id);
+
+    StreamRadix<Node> index; // master id -> node
+    size_t length = 0;
+    StreamID last;           // never goes back, even when the newest entries are deleted
+    std::map<std::string, Group> groups;
+};
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef STRING_VALUE_H
+#define STRING_VALUE_H
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+/* String value stored in kv_store
+ * Three encodings, all in a 32 byte object:
+ *  - INT    :- a canonical decimal integer ("42", "-7" but not "007", "+1"
+ *              or " 1") kept as int64_t, so INCR works on it directly
+ *  - EMBED  :- up to kMaxEmbedded bytes stored inline, no allocation at all
+ *  - HEAP   :- longer values in a block from the SlabAllocator
+ * str() gives back exactly the bytes that were SET whatever the encoding. */
+
+// Parse s only if it is the canonical form of an int64 (what formatInt would print)
+bool parseCanonicalInt(const std::string& s, int64_t& out);
+
+// Write v in decimal into buf (at least 21 bytes), returns the length; two digits per step
+size_t formatInt(int64_t v, char* buf);
+
+// Decimal text / RESP ":n\r\n" reply of v; 0..kSharedIntegers-1 come from a shared preformatted pool
+std::string intToString(int64_t v);
+std::string integerReply(int64_t v);
+
+class StringValue {
+public:
+    static const int64_t kSharedIntegers = 10000;
+    static const size_t kMaxEmbedded = 24;
+
+    StringValue() : encoding(EMBED), embeddedLen(0) {}
+    StringValue(const std::string& s);
+    explicit StringValue(int64_t v) : encoding(INT), embeddedLen(0) { ival = v; }
+    StringValue(const StringValue& other);
+    StringValue(StringValue&& other) noexcept;
+    StringValue& operator=(const StringValue& other);
+    StringValue& operator=(StringValue&& other) noexcept;
+    ~StringValue();
+
+    bool isInt() const { return encoding == INT; }
+    // Integer value, false if the value is not an integer
+    bool toInt(int64_t& out) const;
+    std::string str() const;
+    size_t size() const;
+    // Bytes held outside the object itself (0 unless HEAP)
+    size_t allocatedBytes() const;
+
+private:
+    enum Encoding : uint8_t { INT, EMBED, HEAP };
+
+    void assign(const char* data, size_t len);
+    void release();
+
+    union {
+        int64_t ival;
+        char embedded[kMaxEmbedded];
+        struct {
+            char* data;
+            size_t len;
+        } heap;
+    };
+    Encoding encoding;
+    uint8_t embeddedLen;
+};
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef TRACKING_H
+#define TRACKING_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+class Subscriber;
+
+/* Client-side caching (CLIENT TRACKING)
+ * Default mode: every key a tracking connection reads goes into the
+ * invalidation table, key -> ids of the connections that may hold it in a
+ * local cache. The first write to the key sends each of them one invalidation
+ * and drops the key from the table; the client reads it again to be told
+ * about the next change. The table keeps at most kMaxKeys keys, a new key
+ * past that evicts an arbitrary one and invalidates it on its clients, so no
+ * client keeps a value the server no longer watches for it.
+ * BCAST mode remembers nothing: every modified key that starts with one of
+ * the client's prefixes (any key when it gave none) is sent.
+ *
+ * Invalidations are queued on the receiving connection's Subscriber: the
+ * tracking connection itself, or the one named by REDIRECT. A RESP3 (HELLO 3)
+ * receiver gets an "invalidate" push. RESP2 has no pushes, so a RESP2
+ * receiver gets a pub/sub message on __redis__:invalidate and must have
+ * subscribed to that channel. A flush sends a null key: drop everything.
+ *
+ * All calls that can send happen under the db lock (RedisDatabase::touch and
+ * the tracked read in RedisCommandHandler::execute), which orders an
+ * invalidation after the read it invalidates. */
+class Tracking {
+public:
+    static const size_t kMaxKeys = 1000000;
+
+    static Tracking& getInstance();
+
+    // CLIENT TRACKING ON/OFF; redirect 0 means the connection itself
+    void enable(uint64_t client, uint64_t redirect, bool bcast, const std::vector<std::string>& prefixes);
+    void disable(uint64_t client);
+    uint64_t redirectOf(uint64_t client); // CLIENT GETREDIR :- -1 when not tracking
+    bool tracking(uint64_t client);
+
+    // Connections that can receive invalidations, registered by their first SUBSCRIBE
+    void attach(uint64_t client, const std::shared_ptr<Subscriber>& sub);
+    bool attached(uint64_t client);
+    // Connection closed :- stops tracking and receiving
+    void detach(uint64_t client);
+
+    // Anyone tracking at all; checked on every write before taking our lock
+    bool active() const { return trackingClients.load(std::memory_order_relaxed) > 0; }
+
+    // The client read these keys
+    void remember(uint64_t client, const std::vector<std::string>& keys);
+    // A key changed or went away
+    void keyModified(const std::string& key);
+    // FLUSHALL / a reload :- every cached key is stale
+    void flushed();
+
+    std::string info();
+
+private:
+    struct Client {
+        uint64_t redirect = 0;
+        bool bcast = false;
+        std::vector<std::string> prefixes;
+    };
+
+    Tracking() = default;
+    Tracking(const Tracking&) = delete;
+    Tracking& operator=(const Tracking&) = delete;
+
+    // RESP2 and RESP3 encodings of one invalidation
+    using Frames = std::shared_ptr<const std::string>[2];
+
+    // call with mutex held
+    void invalidateLocked(const std::vector<uint64_t>& clients, const std::string* key);
+    void sendLocked(uint64_t client, const std::string* key, Frames& frames, std::vector<uint64_t>& sentTo);
+
+    std::mutex mutex;
+    std::unordered_map<uint64_t, Client> clients;
+    std::unordered_map<uint64_t, std::weak_ptr<Subscriber>> receivers;
+    std::unordered_map<std::string, std::vector<uint64_t>> table; // invalidation table
+    std::vector<uint64_t> broadcasters;                            // clients in BCAST mode
+    size_t tableItems = 0;                                         // client ids over all keys
+    std::atomic<size_t> trackingClients{0};
+    uint64_t invalidations = 0;
+};
+
+#endif
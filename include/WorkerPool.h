@@ -0,0 +1,79 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/* Fixed-size pool of worker threads with work stealing
+ * Each worker has a deque of its own. submit() spreads tasks over the deques
+ * in turn; a worker takes from the front of its own deque (oldest first) and,
+ * when that is empty, steals from the back of another worker's before going
+ * to sleep. A submit wakes one sleeping worker, which wakes another when
+ * there is still work queued, and so on. run(task, worker) does one turn of
+ * a task and returns true when the task has more to do :- it goes to the back
+ * of the worker's deque, behind everything already waiting, so one long task
+ * can't starve the others.
+ * drain(worker) is called whenever the worker runs out of local work and at
+ * least every kDrainEvery turns, so results can be handed back in groups.
+ * A task is in at most one deque at a time and only ever run by one worker. */
+class WorkerPool {
+public:
+    static const size_t kDrainEvery = 32;
+
+    struct Task {};
+    using Run = std::function<bool(Task*, size_t)>;
+    using Drain = std::function<void(size_t)>;
+
+    // threads > 0; worker i is pinned to cpus[i % cpus.size()] unless cpus is empty
+    WorkerPool(size_t threads, std::vector<int> cpus, Run run, Drain drain);
+    ~WorkerPool();
+    void start();
+    // Wakes and joins the workers; tasks still queued are dropped
+    void stop();
+    void submit(const std::vector<Task*>& tasks);
+
+    size_t size() const { return queues.size(); }
+    uint64_t turns() const { return turnCount.load(std::memory_order_relaxed); }
+    uint64_t steals() const { return stealCount.load(std::memory_order_relaxed); }
+
+    // "0-3,8,10-11" -> {0,1,2,3,8,10,11}; false on anything else
+    static bool parseCpuList(const std::string& text, std::vector<int>& cpus);
+    // Pin the calling thread to cpus[index % cpus.size()]; nothing if cpus is empty
+    static void pin(const std::vector<int>& cpus, size_t index);
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task*> tasks;
+        std::thread thread;
+    };
+
+    void workerLoop(size_t index);
+    Task* pop(size_t index);
+    Task* steal(size_t index);
+    void push(size_t index, Task* task);
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<int> cpus;
+    Run run;
+    Drain drain;
+    std::atomic<size_t> nextQueue{0};
+    std::atomic<size_t> queued{0};   // tasks in all deques together, what sleeping workers wait for
+    std::atomic<size_t> sleeping{0}; // workers waiting on wakeUp
+    std::mutex sleepMutex;
+    std::condition_variable wakeUp;
+    std::atomic<bool> stopping{false};
+    std::atomic<uint64_t> turnCount{0};
+    std::atomic<uint64_t> stealCount{0};
+};
+
+#endif
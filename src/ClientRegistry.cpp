@@ -0,0 +1,194 @@
+#include "../include/ClientRegistry.h"
+#include "../include/PubSub.h"
+#include <algorithm>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+namespace {
+
+std::string peerAddress(int fd) {
+    sockaddr_storage storage{};
+    socklen_t len = sizeof(storage);
+    if (getpeername(fd, (sockaddr*)&storage, &len) != 0)
+        return "?:0";
+    char ip[INET6_ADDRSTRLEN] = "?";
+    if (storage.ss_family == AF_INET) {
+        auto* in = (sockaddr_in*)&storage;
+        inet_ntop(AF_INET, &in->sin_addr, ip, sizeof(ip));
+        return std::string(ip) + ":" + std::to_string(ntohs(in->sin_port));
+    }
+    if (storage.ss_family == AF_INET6) {
+        auto* in6 = (sockaddr_in6*)&storage;
+        inet_ntop(AF_INET6, &in6->sin6_addr, ip, sizeof(ip));
+        return std::string(ip) + ":" + std::to_string(ntohs(in6->sin6_port));
+    }
+    // the client end of a Unix socket has no name, show ours like Redis does
+    sockaddr_un local{};
+    len = sizeof(local);
+    if (getsockname(fd, (sockaddr*)&local, &len) == 0 && local.sun_path[0])
+        return std::string(local.sun_path) + ":0";
+    return "?:0";
+}
+
+// S, P or N in CLIENT LIST :- a PSYNC link, subscribed to something, anything else;
+// call with the registry mutex held (subscriber)
+ClientClass classOf(const ClientInfo& info) {
+    if (info.cls.load(std::memory_order_relaxed) == ClientClass::REPLICA)
+        return ClientClass::REPLICA;
+    auto sub = info.subscriber.lock();
+    return sub && sub->subscriptions() > 0 ? ClientClass::PUBSUB : ClientClass::NORMAL;
+}
+
+} // namespace
+
+ClientRegistry& ClientRegistry::getInstance() {
+    static ClientRegistry instance;
+    return instance;
+}
+
+void ClientRegistry::configure(size_t maxClients, int idleTimeout) {
+    maxclients = maxClients;
+    timeout = idleTimeout;
+}
+
+std::shared_ptr<ClientInfo> ClientRegistry::admit(uint64_t id, int fd) {
+    auto info = std::make_shared<ClientInfo>();
+    info->id = id;
+    info->fd = fd;
+    info->lastActive = steadyMs();
+    std::lock_guard<std::mutex> lock(mutex);
+    if (clients.size() >= maxclients) {
+        rejected.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    info->addr = peerAddress(fd);
+    clients[id] = info;
+    return info;
+}
+
+void ClientRegistry::remove(uint64_t id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    clients.erase(id);
+}
+
+void ClientRegistry::reject(int fd) {
+    static const char kReply[] = "-ERR max number of clients reached\r\n";
+    ssize_t ignored = send(fd, kReply, sizeof(kReply) - 1, MSG_DONTWAIT | MSG_NOSIGNAL);
+    (void)ignored;
+    close(fd);
+}
+
+void ClientRegistry::setSubscriber(ClientInfo& info, const std::shared_ptr<Subscriber>& sub) {
+    std::lock_guard<std::mutex> lock(mutex);
+    info.subscriber = sub;
+}
+
+size_t ClientRegistry::kill(const KillFilter& filter, uint64_t self) {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t count = 0;
+    for (const auto& entry : clients) {
+        ClientInfo& info = *entry.second;
+        if ((filter.id && info.id != filter.id) || (!filter.addr.empty() && info.addr != filter.addr) ||
+            (filter.cls >= 0 && static_cast<int>(classOf(info)) != filter.cls) ||
+            (filter.skip && info.id == filter.skip) || info.killed.exchange(true)) {
+            continue;
+        }
+        // our own connection still sends this command's reply, then reads EOF
+        shutdown(info.fd, info.id == self ? SHUT_RD : SHUT_RDWR);
+        ++count;
+    }
+    return count;
+}
+
+size_t ClientRegistry::closeIdle() {
+    if (timeout <= 0)
+        return 0;
+    int64_t now = steadyMs();
+    size_t count = 0;
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& entry : clients) {
+        ClientInfo& info = *entry.second;
+        // replicas and subscribers wait for the stream or messages, not for commands
+        if (info.busy.load(std::memory_order_relaxed) ||
+            now - info.lastActive.load(std::memory_order_relaxed) < static_cast<int64_t>(timeout) * 1000 ||
+            classOf(info) != ClientClass::NORMAL || info.killed.exchange(true)) {
+            continue;
+        }
+        shutdown(info.fd, SHUT_RDWR);
+        ++count;
+    }
+    idleClosed.fetch_add(count, std::memory_order_relaxed);
+    return count;
+}
+
+std::string ClientRegistry::list(uint64_t only) {
+    std::vector<std::shared_ptr<ClientInfo>> all;
+    std::vector<std::shared_ptr<Subscriber>> subs;
+    std::vector<ClientClass> classes;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& entry : clients) {
+            if (!only || entry.first == only)
+                all.push_back(entry.second);
+        }
+        std::sort(all.begin(), all.end(), [](const std::shared_ptr<ClientInfo>& a, const std::shared_ptr<ClientInfo>& b) {
+            return a->id < b->id;
+        });
+        for (const auto& info : all) {
+            subs.push_back(info->subscriber.lock());
+            classes.push_back(classOf(*info));
+        }
+    }
+    auto now = std::chrono::steady_clock::now();
+    int64_t nowMs = steadyMs();
+    std::string text;
+    for (size_t i = 0; i < all.size(); ++i) {
+        ClientInfo& info = *all[i];
+        size_t omem = info.outputBuffer.load(std::memory_order_relaxed);
+        const char* flags = classes[i] == ClientClass::REPLICA ? "S" : classes[i] == ClientClass::PUBSUB ? "P" : "N";
+        if (subs[i]) {
+            omem += subs[i]->queuedBytes(); // the queue is the connection's output from then on
+        }
+        std::string name, cmd;
+        {
+            std::lock_guard<std::mutex> lock(info.mutex);
+            name = info.name;
+            cmd = info.lastCommand;
+        }
+        std::transform(cmd.begin(), cmd.end(), cmd.begin(), ::tolower);
+        int64_t age = std::chrono::duration_cast<std::chrono::seconds>(now - info.created).count();
+        int64_t idle = info.busy.load(std::memory_order_relaxed) ? 0 : (nowMs - info.lastActive.load(std::memory_order_relaxed)) / 1000;
+        text += "id=" + std::to_string(info.id) + " addr=" + info.addr + " fd=" + std::to_string(info.fd) +
+                " name=" + name + " age=" + std::to_string(age) + " idle=" + std::to_string(idle) +
+                " flags=" + flags + " qbuf=" + std::to_string(info.queryBuffer.load(std::memory_order_relaxed)) +
+                " omem=" + std::to_string(omem) + " cmd=" + (cmd.empty() ? "NULL" : cmd) + "\n";
+    }
+    return text;
+}
+
+std::string ClientRegistry::info() {
+    size_t connected;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        connected = clients.size();
+    }
+    OutputLimits& limits = OutputLimits::getInstance();
+    std::string text = "# Clients\r\nconnected_clients:" + std::to_string(connected) + "\r\nmaxclients:" +
+                       std::to_string(maxclients) + "\r\nrejected_connections:" + std::to_string(rejected.load()) +
+                       "\r\ntimeout:" + std::to_string(timeout) + "\r\nidle_disconnects:" +
+                       std::to_string(idleClosed.load()) + "\r\n";
+    for (ClientClass cls : {ClientClass::NORMAL, ClientClass::REPLICA, ClientClass::PUBSUB}) {
+        const OutputLimit& limit = limits.get(cls);
+        text += "client_output_buffer_limit_" + std::string(OutputLimits::name(cls)) + ":" +
+                std::to_string(limit.hard) + " " + std::to_string(limit.soft) + " " +
+                std::to_string(limit.softSeconds) + "\r\n";
+    }
+    text += "client_output_disconnects:normal=" + std::to_string(limits.disconnected(ClientClass::NORMAL)) +
+            ",replica=" + std::to_string(limits.disconnected(ClientClass::REPLICA)) +
+            ",pubsub=" + std::to_string(limits.disconnected(ClientClass::PUBSUB)) + "\r\n";
+    return text;
+}
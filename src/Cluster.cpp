@@ -0,0 +1,557 @@
+#include "../include/Cluster.h"
+#include "../include/RedisDatabase.h"
+#include "../include/ScriptEngine.h"
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <algorithm>
+#include <cstdlib>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+namespace {
+
+// CRC16-CCITT (XMODEM), the variant Redis Cluster uses: poly 0x1021, init 0
+struct Crc16Table {
+    uint16_t t[256];
+    Crc16Table() {
+        for (int i = 0; i < 256; ++i) {
+            uint16_t crc = static_cast<uint16_t>(i << 8);
+            for (int b = 0; b < 8; ++b) {
+                crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021) : static_cast<uint16_t>(crc << 1);
+            }
+            t[i] = crc;
+        }
+    }
+};
+
+uint16_t crc16(const char* data, size_t len) {
+    static const Crc16Table table;
+    uint16_t crc = 0;
+    for (size_t i = 0; i < len; ++i) {
+        crc = static_cast<uint16_t>((crc << 8) ^ table.t[((crc >> 8) ^ static_cast<uint8_t>(data[i])) & 0xff]);
+    }
+    return crc;
+}
+
+std::string bulk(const std::string& s) {
+    return "$" + std::to_string(s.size()) + "\r\n" + s + "\r\n";
+}
+
+void appendCommand(std::string& out, const std::vector<std::string>& tokens) {
+    out += "*" + std::to_string(tokens.size()) + "\r\n";
+    for (const auto& t : tokens) {
+        out += bulk(t);
+    }
+}
+
+bool sendAll(int sock, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(sock, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        sent += n;
+    }
+    return true;
+}
+
+// One status or error reply line off the link (RESTORE and ASKING answer nothing else)
+bool readReply(int sock, std::string& buffer, std::string& line) {
+    size_t crlf;
+    char chunk[4096];
+    while ((crlf = buffer.find("\r\n")) == std::string::npos) {
+        ssize_t r = recv(sock, chunk, sizeof(chunk), 0);
+        if (r <= 0) {
+            return false; // closed, error or SO_RCVTIMEO expired
+        }
+        buffer.append(chunk, r);
+    }
+    line = buffer.substr(0, crlf);
+    buffer.erase(0, crlf + 2);
+    return true;
+}
+
+// Connect within timeoutMs, then make every send/recv on the socket time out the same way
+int connectWithTimeout(const std::string& host, int port, int timeoutMs) {
+    addrinfo hints{};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* result = nullptr;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result) != 0) {
+        return -1;
+    }
+    int sock = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+    if (sock >= 0) {
+        int flags = fcntl(sock, F_GETFL, 0);
+        fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+        int rc = connect(sock, result->ai_addr, result->ai_addrlen);
+        if (rc != 0 && errno == EINPROGRESS) {
+            pollfd pfd = {sock, POLLOUT, 0};
+            int err = 0;
+            socklen_t len = sizeof(err);
+            if (poll(&pfd, 1, timeoutMs) == 1 && getsockopt(sock, SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err == 0) {
+                rc = 0;
+            }
+        }
+        fcntl(sock, F_SETFL, flags);
+        if (rc != 0) {
+            close(sock);
+            sock = -1;
+        }
+    }
+    freeaddrinfo(result);
+    if (sock >= 0) {
+        timeval tv{timeoutMs / 1000, (timeoutMs % 1000) * 1000};
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    }
+    return sock;
+}
+
+} // namespace
+
+Cluster& Cluster::getInstance() {
+    static Cluster instance;
+    return instance;
+}
+
+int Cluster::keySlot(const std::string& key) {
+    // {tag} :- hash only what is between the first '{' and the next '}', if not empty
+    size_t open = key.find('{');
+    if (open != std::string::npos) {
+        size_t close = key.find('}', open + 1);
+        if (close != std::string::npos && close != open + 1) {
+            return crc16(key.data() + open + 1, close - open - 1) & (kSlots - 1);
+        }
+    }
+    return crc16(key.data(), key.size()) & (kSlots - 1);
+}
+
+bool Cluster::load(const std::string& configFile, int port) {
+    saveFile = "nodes-" + std::to_string(port) + ".conf";
+    std::ifstream saved(saveFile);
+    if (saved.good()) {
+        saved.close();
+        std::cout << "Cluster: using saved slot map " << saveFile << std::endl;
+        if (!parse(saveFile, port)) {
+            return false;
+        }
+    } else if (!parse(configFile, port)) {
+        return false;
+    }
+    clusterMode = true;
+    return true;
+}
+
+// host port [slot | first-last]...
+bool Cluster::parse(const std::string& file, int port) {
+    std::ifstream in(file);
+    if (!in) {
+        std::cerr << "Cluster: can't open " << file << std::endl;
+        return false;
+    }
+    nodes.clear();
+    owner.assign(kSlots, -1);
+    self = -1;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        Node node;
+        if (!(fields >> node.host) || node.host[0] == '#') {
+            continue;
+        }
+        if (!(fields >> node.port)) {
+            std::cerr << "Cluster: bad node line '" << line << "' in " << file << std::endl;
+            return false;
+        }
+        node.id = ScriptEngine::sha1Hex(node.host + ":" + std::to_string(node.port));
+        int index = static_cast<int>(nodes.size());
+        if (node.port == port) {
+            if (self >= 0) {
+                std::cerr << "Cluster: port " << port << " appears twice in " << file << std::endl;
+                return false;
+            }
+            self = index;
+        }
+        std::string range;
+        while (fields >> range) {
+            char* end = nullptr;
+            long first = std::strtol(range.c_str(), &end, 10);
+            long last = first;
+            if (*end == '-') {
+                last = std::strtol(end + 1, &end, 10);
+            }
+            if (*end != '\0' || first < 0 || last >= kSlots || first > last) {
+                std::cerr << "Cluster: bad slot range '" << range << "' in " << file << std::endl;
+                return false;
+            }
+            for (long s = first; s <= last; ++s) {
+                owner[s] = static_cast<int16_t>(index);
+            }
+        }
+        nodes.push_back(node);
+    }
+    if (self < 0) {
+        std::cerr << "Cluster: no node with port " << port << " in " << file << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool Cluster::save() {
+    std::ofstream out(saveFile, std::ios::trunc);
+    if (!out) {
+        return false;
+    }
+    out << "# host port slots...\n";
+    for (size_t n = 0; n < nodes.size(); ++n) {
+        out << nodes[n].host << " " << nodes[n].port;
+        for (int s = 0; s < kSlots; ++s) {
+            if (owner[s] != static_cast<int>(n)) {
+                continue;
+            }
+            int e = s;
+            while (e + 1 < kSlots && owner[e + 1] == owner[s]) {
+                ++e;
+            }
+            out << " " << s;
+            if (e > s) {
+                out << "-" << e;
+            }
+            s = e;
+        }
+        out << "\n";
+    }
+    return out.good();
+}
+
+int Cluster::nodeIndex(const std::string& id) const {
+    for (size_t n = 0; n < nodes.size(); ++n) {
+        if (nodes[n].id == id) {
+            return static_cast<int>(n);
+        }
+    }
+    return -1;
+}
+
+std::string Cluster::redirect(const std::vector<std::string>& keys, bool asking, RedisDatabase& db) {
+    if (keys.empty()) {
+        return "";
+    }
+    if (transfers.load(std::memory_order_acquire) > 0) {
+        std::lock_guard<std::mutex> lock(transit_mutex);
+        for (const auto& key : keys) {
+            if (inTransit.count(key)) {
+                return "-TRYAGAIN Key is being migrated\r\n";
+            }
+        }
+    }
+    if (!clusterMode) {
+        return "";
+    }
+    int slot = keySlot(keys[0]);
+    for (size_t i = 1; i < keys.size(); ++i) {
+        if (keySlot(keys[i]) != slot) {
+            return "-CROSSSLOT Keys in request don't hash to the same slot\r\n";
+        }
+    }
+
+    int target;
+    {
+        std::shared_lock<std::shared_mutex> lock(map_mutex);
+        int own = owner[slot];
+        if (own != self) {
+            auto imp = importing.find(slot);
+            if (asking && imp != importing.end()) {
+                return "";
+            }
+            if (own < 0) {
+                return "-CLUSTERDOWN Hash slot not served\r\n";
+            }
+            return "-MOVED " + std::to_string(slot) + " " + address(own) + "\r\n";
+        }
+        auto mig = migrating.find(slot);
+        if (mig == migrating.end()) {
+            return "";
+        }
+        target = mig->second;
+    }
+
+    // Migrating :- keys still here are served here, the others already moved (or are new)
+    size_t present = 0;
+    for (const auto& key : keys) {
+        present += db.exists({key});
+    }
+    if (present == keys.size()) {
+        return "";
+    }
+    if (present == 0) {
+        std::shared_lock<std::shared_mutex> lock(map_mutex);
+        return "-ASK " + std::to_string(slot) + " " + address(target) + "\r\n";
+    }
+    return "-TRYAGAIN Multiple keys request during rehashing of slot\r\n";
+}
+
+// *N of [first, last, [host, port, id]] per contiguous range
+std::string Cluster::slotsReply() {
+    std::shared_lock<std::shared_mutex> lock(map_mutex);
+    std::ostringstream body;
+    size_t ranges = 0;
+    for (int s = 0; s < kSlots; ++s) {
+        if (owner[s] < 0) {
+            continue;
+        }
+        int e = s;
+        while (e + 1 < kSlots && owner[e + 1] == owner[s]) {
+            ++e;
+        }
+        const Node& node = nodes[owner[s]];
+        body << "*3\r\n:" << s << "\r\n:" << e << "\r\n*3\r\n"
+             << bulk(node.host) << ":" << node.port << "\r\n" << bulk(node.id);
+        ++ranges;
+        s = e;
+    }
+    return "*" + std::to_string(ranges) + "\r\n" + body.str();
+}
+
+// One line per node in the CLUSTER NODES layout:
+// <id> <host:port@cport> <flags> <master> <ping-sent> <pong-recv> <epoch> <link> <slots...>
+std::string Cluster::nodesReply() {
+    std::shared_lock<std::shared_mutex> lock(map_mutex);
+    std::ostringstream out;
+    for (size_t n = 0; n < nodes.size(); ++n) {
+        const Node& node = nodes[n];
+        out << node.id << " " << node.host << ":" << node.port << "@" << node.port + 10000 << " "
+            << (static_cast<int>(n) == self ? "myself,master" : "master") << " - 0 0 0 connected";
+        for (int s = 0; s < kSlots; ++s) {
+            if (owner[s] != static_cast<int>(n)) {
+                continue;
+            }
+            int e = s;
+            while (e + 1 < kSlots && owner[e + 1] == owner[s]) {
+                ++e;
+            }
+            out << " " << s;
+            if (e > s) {
+                out << "-" << e;
+            }
+            s = e;
+        }
+        if (static_cast<int>(n) == self) {
+            for (const auto& m : migrating) {
+                out << " [" << m.first << "->-" << nodes[m.second].id << "]";
+            }
+            for (const auto& i : importing) {
+                out << " [" << i.first << "-<-" << nodes[i.second].id << "]";
+            }
+        }
+        out << "\n";
+    }
+    return bulk(out.str());
+}
+
+std::string Cluster::infoReply() {
+    std::shared_lock<std::shared_mutex> lock(map_mutex);
+    size_t assigned = 0;
+    std::vector<bool> serving(nodes.size(), false);
+    for (int s = 0; s < kSlots; ++s) {
+        if (owner[s] >= 0) {
+            ++assigned;
+            serving[owner[s]] = true;
+        }
+    }
+    std::ostringstream out;
+    out << "cluster_enabled:1\r\n"
+        << "cluster_state:" << (assigned == kSlots ? "ok" : "fail") << "\r\n"
+        << "cluster_slots_assigned:" << assigned << "\r\n"
+        << "cluster_known_nodes:" << nodes.size() << "\r\n"
+        << "cluster_size:" << std::count(serving.begin(), serving.end(), true) << "\r\n"
+        << "cluster_migrating_slots:" << migrating.size() << "\r\n"
+        << "cluster_importing_slots:" << importing.size() << "\r\n";
+    return bulk(out.str());
+}
+
+std::string Cluster::setSlot(int slot, const std::string& state, const std::string& nodeId) {
+    std::unique_lock<std::shared_mutex> lock(map_mutex);
+    if (state == "STABLE") {
+        migrating.erase(slot);
+        importing.erase(slot);
+        migratingSlots = migrating.size();
+        return "+OK\r\n";
+    }
+    int node = nodeIndex(nodeId);
+    if (node < 0) {
+        return "-ERR I don't know about node " + nodeId + "\r\n";
+    }
+    if (state == "MIGRATING") {
+        if (owner[slot] != self) {
+            return "-ERR I'm not the owner of hash slot " + std::to_string(slot) + "\r\n";
+        }
+        if (node == self) {
+            return "-ERR I can't migrate a slot to myself\r\n";
+        }
+        migrating[slot] = node;
+    } else if (state == "IMPORTING") {
+        if (owner[slot] == self) {
+            return "-ERR I'm already the owner of hash slot " + std::to_string(slot) + "\r\n";
+        }
+        if (node == self) {
+            return "-ERR I can't import a slot from myself\r\n";
+        }
+        importing[slot] = node;
+    } else if (state == "NODE") {
+        // Final step of a migration, sent to every node: the slot now belongs to node
+        owner[slot] = static_cast<int16_t>(node);
+        importing.erase(slot);
+        migrating.erase(slot);
+        if (!save()) {
+            std::cerr << "Cluster: failed to write " << saveFile << std::endl;
+        }
+    } else {
+        return "-ERR Invalid CLUSTER SETSLOT action or number of arguments\r\n";
+    }
+    migratingSlots = migrating.size();
+    return "+OK\r\n";
+}
+
+std::string Cluster::migrate(const std::string& host, int port, const std::vector<std::string>& keys, int timeoutMs,
+                             bool copy, bool replace, RedisDatabase& db, std::vector<std::string>& moved) {
+    std::lock_guard<std::mutex> migrateLock(migrate_mutex);
+    transfers.fetch_add(1, std::memory_order_acq_rel);
+
+    // Out of the keyspace under the db lock, so a command routed under that lock
+    // sees the key either here or in transit, never missing
+    std::vector<DetachedKey> sending;
+    {
+        auto lock = db.acquireLock();
+        std::lock_guard<std::mutex> guard(transit_mutex);
+        for (const auto& key : keys) {
+            DetachedKey detached;
+            if (!inTransit.count(key) && db.extractKey(key, detached, !copy)) {
+                if (!copy) {
+                    inTransit.insert(key);
+                }
+                sending.push_back(std::move(detached));
+            }
+        }
+    }
+    if (sending.empty()) {
+        transfers.fetch_sub(1, std::memory_order_acq_rel);
+        return "+NOKEY\r\n";
+    }
+
+    std::vector<bool> ok;
+    std::string error = transfer(host, port, sending, timeoutMs, replace, ok);
+
+    if (!copy) {
+        for (size_t i = 0; i < sending.size(); ++i) {
+            if (ok[i]) {
+                moved.push_back(sending[i].key);
+            } else {
+                db.attachKey(std::move(sending[i])); // the target didn't take it, it stays here
+            }
+        }
+        std::lock_guard<std::mutex> guard(transit_mutex);
+        for (const auto& key : sending) {
+            inTransit.erase(key.key);
+        }
+    }
+    transfers.fetch_sub(1, std::memory_order_acq_rel);
+    return error.empty() ? "+OK\r\n" : error;
+}
+
+int Cluster::link(const std::string& host, int port, int timeoutMs) {
+    std::string address = host + ":" + std::to_string(port);
+    auto now = std::chrono::steady_clock::now();
+    if (linkSocket >= 0 && (linkAddress != address || now - linkUsed > std::chrono::seconds(10))) {
+        closeLink();
+    }
+    if (linkSocket < 0) {
+        linkSocket = connectWithTimeout(host, port, timeoutMs);
+        linkAddress = address;
+    }
+    linkUsed = now;
+    return linkSocket;
+}
+
+void Cluster::closeLink() {
+    if (linkSocket >= 0) {
+        close(linkSocket);
+        linkSocket = -1;
+    }
+}
+
+// Pipelined ASKING + RESTORE key ttl payload [REPLACE] per chunk, replies read back
+// every kMigratePipeline bytes. A key counts as stored once all its chunks are.
+std::string Cluster::transfer(const std::string& host, int port, const std::vector<DetachedKey>& keys, int timeoutMs,
+                              bool replace, std::vector<bool>& ok) {
+    ok.assign(keys.size(), false);
+    int sock = link(host, port, timeoutMs);
+    if (sock < 0) {
+        return "-IOERR error or timeout connecting to the client\r\n";
+    }
+
+    std::string error;
+    std::string out, buffer, line;
+    std::vector<size_t> pending; // key of each RESTORE sent and not answered yet
+    std::vector<size_t> chunksLeft(keys.size());
+    auto drain = [&]() {
+        if (!sendAll(sock, out)) {
+            return false;
+        }
+        out.clear();
+        for (size_t key : pending) {
+            std::string asking;
+            if (!readReply(sock, buffer, asking) || !readReply(sock, buffer, line)) {
+                return false;
+            }
+            if (line[0] == '-') {
+                if (error.empty()) {
+                    error = "-ERR Target instance replied with error: " + line.substr(1) + "\r\n";
+                }
+            } else if (--chunksLeft[key] == 0) {
+                ok[key] = true;
+            }
+        }
+        pending.clear();
+        return true;
+    };
+
+    std::vector<std::string> chunks;
+    bool linkUp = true;
+    for (size_t i = 0; i < keys.size() && linkUp; ++i) {
+        RedisDatabase::encodeKey(keys[i], kMigrateChunk, chunks);
+        chunksLeft[i] = chunks.size();
+        for (size_t c = 0; c < chunks.size(); ++c) {
+            std::vector<std::string> restore = {"RESTORE", keys[i].key, c == 0 ? std::to_string(std::max(keys[i].ttlMs, 0LL)) : "0", chunks[c]};
+            if (c > 0) {
+                restore.push_back("APPEND");
+            } else if (replace) {
+                restore.push_back("REPLACE");
+            }
+            appendCommand(out, {"ASKING"});
+            appendCommand(out, restore);
+            pending.push_back(i);
+            if (out.size() >= kMigratePipeline && !drain()) {
+                linkUp = false;
+                break;
+            }
+        }
+    }
+    if (linkUp && !pending.empty() && !drain()) {
+        linkUp = false;
+    }
+    if (!linkUp) {
+        closeLink(); // replies may still be on the way, the link is out of step
+        return "-IOERR error or timeout reading to target instance\r\n";
+    }
+    return error;
+}
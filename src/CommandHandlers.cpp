@@ -1,7 +1,26 @@
 #include "../include/RedisCommandHandler.h"
 #include "../include/RedisDatabase.h"
+#include "../include/ScriptEngine.h"
+#include "../include/Replication.h"
+#include "../include/Cluster.h"
+#include "../include/PubSub.h"
+#include "../include/Tracking.h"
+#include "../include/ClientRegistry.h"
+#include "../include/IoUring.h"
+#include "../include/Resp.h"
+#include "../include/StringValue.h"
+#include "../include/SlabAllocator.h"
 #include <sstream>
 #include <string>
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <fstream>
 
 //Common Commands
 
@@ -25,13 +44,781 @@ std::string RedisCommandHandler::handleEcho(const std::vector<std::string>& toke
     return response.str();
 }
 
+// FLUSHALL [ASYNC|SYNC]
 std::string RedisCommandHandler::handleFlushAll(const std::vector<std::string>& tokens, RedisDatabase& db) {
-    if (db.flushAll()) {
+    bool async = false;
+    if (tokens.size() == 2) {
+        std::string mode = tokens[1];
+        std::transform(mode.begin(), mode.end(), mode.begin(), ::toupper);
+        if (mode != "ASYNC" && mode != "SYNC")
+            return "-ERR syntax error\r\n";
+        async = (mode == "ASYNC");
+    } else if (tokens.size() > 2) {
+        return "-ERR syntax error\r\n";
+    }
+    if (db.flushAll(async)) {
         return "+OK\r\n";
     }
     return "-ERR could not flush database\r\n";
 }
 
+// Resident set size from /proc, 0 where that is not available
+static size_t residentBytes() {
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0, resident = 0;
+    if (!(statm >> pages >> resident))
+        return 0;
+    return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+// MEMORY STATS | MEMORY USAGE key [SAMPLES count]
+std::string RedisCommandHandler::handleMemory(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() < 2)
+        return "-ERR wrong number of arguments for 'memory' command\r\n";
+    std::string sub = tokens[1];
+    std::transform(sub.begin(), sub.end(), sub.begin(), ::toupper);
+
+    if (sub == "USAGE" && (tokens.size() == 3 || tokens.size() == 5)) {
+        size_t bytes;
+        if (!db.memoryUsage(tokens[2], bytes))
+            return Resp::null();
+        return ":" + std::to_string(bytes) + "\r\n";
+    }
+
+    if (sub == "STATS" && tokens.size() == 2) {
+        SlabAllocator::Stats stats = SlabAllocator::getInstance().stats();
+        size_t rss = residentBytes();
+        size_t allocated = stats.smallInUse + stats.largeInUse;
+        char ratio[32];
+        snprintf(ratio, sizeof(ratio), "%.3f", stats.smallInUse ? double(stats.smallReserved) / stats.smallInUse : 1.0);
+        char rssRatio[32];
+        snprintf(rssRatio, sizeof(rssRatio), "%.3f", allocated ? double(rss) / allocated : 0.0);
+
+        std::ostringstream oss;
+        size_t fields = 0;
+        auto integer = [&](const std::string& name, size_t value) {
+            oss << "$" << name.size() << "\r\n" << name << "\r\n:" << value << "\r\n";
+            ++fields;
+        };
+        auto text = [&](const std::string& name, const std::string& value) {
+            oss << "$" << name.size() << "\r\n" << name << "\r\n$" << value.size() << "\r\n" << value << "\r\n";
+            ++fields;
+        };
+        integer("keys.count", db.keyCount());
+        integer("allocator.allocated", allocated);
+        integer("allocator.allocations", stats.allocations);
+        integer("slab.used", stats.smallInUse);
+        integer("slab.reserved", stats.smallReserved);
+        text("slab.fragmentation.ratio", ratio);
+        integer("large.allocated", stats.largeInUse);
+        integer("rss", rss);
+        text("rss.allocated.ratio", rssRatio);
+        for (const auto& cls : stats.classes) {
+            if (cls.slabs == 0)
+                continue;
+            integer("slab.class." + std::to_string(cls.blockSize) + ".blocks", cls.blocksInUse);
+        }
+        return Resp::map(fields) + oss.str();
+    }
+    return "-ERR unknown subcommand or wrong number of arguments for 'MEMORY'\r\n";
+}
+
+//Transactions
+
+std::string RedisCommandHandler::handleMulti(ClientSession& session) {
+    if (session.inMulti) {
+        return "-ERR MULTI calls can not be nested\r\n";
+    }
+    session.inMulti = true;
+    session.multiError = false;
+    session.queued.clear();
+    return "+OK\r\n";
+}
+
+std::string RedisCommandHandler::handleExec(ClientSession& session, RedisDatabase& db) {
+    if (!session.inMulti) {
+        return "-ERR EXEC without MULTI\r\n";
+    }
+    std::vector<std::vector<std::string>> queued;
+    queued.swap(session.queued);
+    session.inMulti = false;
+    if (session.multiError) {
+        handleUnwatch(session, db);
+        return "-EXECABORT Transaction discarded because of previous errors.\r\n";
+    }
+
+    std::ostringstream response;
+    {
+        // One acquisition for the whole transaction: the version check and every
+        // queued command run without any other client getting in between
+        auto lock = db.acquireLock();
+        for (const auto& w : session.watched) {
+            if (db.keyVersion(w.first) != w.second) {
+                lock.unlock();
+                handleUnwatch(session, db);
+                return Resp::nullArray(); // a watched key changed, abort
+            }
+        }
+        response << "*" << queued.size() << "\r\n";
+        // Replicas apply the transaction's writes as one MULTI/EXEC block too
+        Replication& repl = Replication::getInstance();
+        bool propagating = repl.active() && !session.isMaster && !repl.isReplica();
+        if (propagating) {
+            repl.flushDeferred();
+            repl.propagate({"MULTI"});
+        }
+        session.inAtomic = true;
+        for (const auto& tokens : queued) {
+            std::string cmd = tokens[0];
+            std::transform(cmd.begin(), cmd.end(), cmd.begin(), ::toupper);
+            response << execute(cmd, tokens, session, db);
+        }
+        session.inAtomic = false;
+        if (propagating) {
+            repl.flushDeferred();
+            repl.propagate({"EXEC"});
+        }
+    }
+    handleUnwatch(session, db);
+    return response.str();
+}
+
+std::string RedisCommandHandler::handleDiscard(ClientSession& session, RedisDatabase& db) {
+    if (!session.inMulti) {
+        return "-ERR DISCARD without MULTI\r\n";
+    }
+    session.inMulti = false;
+    session.queued.clear();
+    handleUnwatch(session, db);
+    return "+OK\r\n";
+}
+
+std::string RedisCommandHandler::handleWatch(const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db) {
+    if (tokens.size() < 2) {
+        return "-ERR wrong number of arguments for 'watch' command\r\n";
+    }
+    if (session.inMulti) {
+        return "-ERR WATCH inside MULTI is not allowed\r\n";
+    }
+    for (size_t i = 1; i < tokens.size(); ++i) {
+        if (session.watched.count(tokens[i]) == 0) {
+            session.watched[tokens[i]] = db.watchKey(tokens[i]);
+        }
+    }
+    return "+OK\r\n";
+}
+
+std::string RedisCommandHandler::handleUnwatch(ClientSession& session, RedisDatabase& db) {
+    for (const auto& w : session.watched) {
+        db.unwatchKey(w.first);
+    }
+    session.watched.clear();
+    return "+OK\r\n";
+}
+
+//Scripting
+
+// EVAL script numkeys key [key ...] arg [arg ...]
+std::string RedisCommandHandler::runScript(const CompiledScript& script, const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db) {
+    long numKeys;
+    try {
+        numKeys = std::stol(tokens[2]);
+    } catch (const std::exception&) {
+        return "-ERR value is not an integer or out of range\r\n";
+    }
+    if (numKeys < 0 || numKeys > static_cast<long>(tokens.size()) - 3) {
+        return "-ERR Number of keys can't be greater than number of args\r\n";
+    }
+    std::vector<std::string> keys(tokens.begin() + 3, tokens.begin() + 3 + numKeys);
+    std::vector<std::string> argv(tokens.begin() + 3 + numKeys, tokens.end());
+
+    // The whole script runs under one lock acquisition, redis.call() re-enters it
+    auto lock = db.acquireLock();
+    bool wasAtomic = session.inAtomic; // EVAL queued inside MULTI
+    session.inAtomic = true;
+    std::string reply = ScriptEngine::getInstance().run(script, keys, argv,
+        [this, &session, &db](const std::vector<std::string>& command) -> std::string {
+            std::string cmd = command[0];
+            std::transform(cmd.begin(), cmd.end(), cmd.begin(), ::toupper);
+            auto spec = commandTable().find(cmd);
+            if (spec != commandTable().end() && spec->second.noscript) {
+                return "-ERR This Redis command is not allowed from script\r\n";
+            }
+            Resp::Scope protocol(2); // redis.call() replies are read back as RESP2
+            return execute(cmd, command, session, db);
+        });
+    session.inAtomic = wasAtomic;
+    return reply;
+}
+
+std::string RedisCommandHandler::handleEval(const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db) {
+    if (tokens.size() < 3) {
+        return "-ERR wrong number of arguments for 'eval' command\r\n";
+    }
+    std::string error;
+    auto script = ScriptEngine::getInstance().load(tokens[1], error);
+    if (!script) {
+        return "-ERR Error compiling script: " + error + "\r\n";
+    }
+    return runScript(*script, tokens, session, db);
+}
+
+std::string RedisCommandHandler::handleEvalsha(const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db) {
+    if (tokens.size() < 3) {
+        return "-ERR wrong number of arguments for 'evalsha' command\r\n";
+    }
+    std::string sha = tokens[1];
+    std::transform(sha.begin(), sha.end(), sha.begin(), ::tolower);
+    auto script = ScriptEngine::getInstance().find(sha);
+    if (!script) {
+        return "-NOSCRIPT No matching script. Please use EVAL.\r\n";
+    }
+    return runScript(*script, tokens, session, db);
+}
+
+// SCRIPT LOAD source | SCRIPT EXISTS sha [sha ...] | SCRIPT FLUSH
+std::string RedisCommandHandler::handleScript(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() < 2) {
+        return "-ERR wrong number of arguments for 'script' command\r\n";
+    }
+    std::string sub = tokens[1];
+    std::transform(sub.begin(), sub.end(), sub.begin(), ::toupper);
+    ScriptEngine& engine = ScriptEngine::getInstance();
+    if (sub == "LOAD" && tokens.size() == 3) {
+        std::string error;
+        auto script = engine.load(tokens[2], error);
+        if (!script) {
+            return "-ERR Error compiling script: " + error + "\r\n";
+        }
+        return "$" + std::to_string(script->sha.size()) + "\r\n" + script->sha + "\r\n";
+    }
+    if (sub == "EXISTS" && tokens.size() >= 3) {
+        std::ostringstream response;
+        response << "*" << tokens.size() - 2 << "\r\n";
+        for (size_t i = 2; i < tokens.size(); ++i) {
+            std::string sha = tokens[i];
+            std::transform(sha.begin(), sha.end(), sha.begin(), ::tolower);
+            response << ":" << (engine.exists(sha) ? 1 : 0) << "\r\n";
+        }
+        return response.str();
+    }
+    if (sub == "FLUSH") {
+        engine.flush();
+        return "+OK\r\n";
+    }
+    return "-ERR unknown subcommand or wrong number of arguments for 'script|" + tokens[1] + "'\r\n";
+}
+
+//Replication
+
+// REPLICAOF host port | REPLICAOF NO ONE
+std::string RedisCommandHandler::handleReplicaof(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() != 3)
+        return "-ERR wrong number of arguments for 'replicaof' command\r\n";
+    std::string host = tokens[1], port = tokens[2];
+    std::transform(host.begin(), host.end(), host.begin(), ::toupper);
+    std::transform(port.begin(), port.end(), port.begin(), ::toupper);
+    if (host == "NO" && port == "ONE") {
+        Replication::getInstance().replicaOf("", 0, db);
+        return "+OK\r\n";
+    }
+    char* end = nullptr;
+    long portNumber = std::strtol(tokens[2].c_str(), &end, 10);
+    if (*end != '\0' || portNumber <= 0 || portNumber > 65535)
+        return "-ERR Invalid master port\r\n";
+    Replication::getInstance().replicaOf(tokens[1], static_cast<int>(portNumber), db);
+    return "+OK\r\n";
+}
+
+// REPLCONF listening-port <port> during the handshake; ACKs are read by serveReplica()
+std::string RedisCommandHandler::handleReplconf(const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db) {
+    if (tokens.size() < 3)
+        return "-ERR wrong number of arguments for 'replconf' command\r\n";
+    std::string option = tokens[1];
+    std::transform(option.begin(), option.end(), option.begin(), ::tolower);
+    if (option == "listening-port")
+        session.replicaPort = std::atoi(tokens[2].c_str());
+    else if (option == "ack")
+        return ""; // never answered
+    return "+OK\r\n";
+}
+
+// PSYNC replid offset (SYNC = always a full resync). Takes the connection over until the replica leaves.
+std::string RedisCommandHandler::handlePsync(const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db) {
+    if (session.socket < 0 || session.inAtomic)
+        return "-ERR PSYNC is not allowed here\r\n";
+    std::string replid = "?";
+    long long offset = -1;
+    if (tokens.size() >= 3) {
+        replid = tokens[1];
+        offset = std::strtoll(tokens[2].c_str(), nullptr, 10);
+    }
+    if (session.info)
+        session.info->cls = ClientClass::REPLICA;
+    Replication::getInstance().serveReplica(session.socket, replid, offset, session.replicaPort, db, session.info.get());
+    return "";
+}
+
+std::string RedisCommandHandler::handleRole(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    return Replication::getInstance().roleReply();
+}
+
+// INFO [section] :- clients, replication, cluster, pubsub, tracking and io sections
+std::string RedisCommandHandler::handleInfo(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    std::string section = tokens.size() > 1 ? tokens[1] : "default";
+    std::transform(section.begin(), section.end(), section.begin(), ::tolower);
+    bool all = section == "default" || section == "all" || section == "everything";
+    std::string text;
+    if (section == "clients" || all)
+        text = ClientRegistry::getInstance().info();
+    if (section == "replication" || all) {
+        if (!text.empty())
+            text += "\r\n";
+        text += Replication::getInstance().info();
+    }
+    if (section == "cluster" || all) {
+        if (!text.empty())
+            text += "\r\n";
+        text += "# Cluster\r\ncluster_enabled:" + std::string(Cluster::getInstance().enabled() ? "1" : "0") + "\r\n";
+    }
+    if (section == "pubsub" || all) {
+        if (!text.empty())
+            text += "\r\n";
+        text += PubSub::getInstance().info();
+    }
+    if (section == "tracking" || all) {
+        if (!text.empty())
+            text += "\r\n";
+        text += Tracking::getInstance().info();
+    }
+    if (section == "io" || all) {
+        if (!text.empty())
+            text += "\r\n";
+        text += IoBackend::getInstance().info();
+    }
+    return Resp::verbatim(text);
+}
+
+//Cluster
+
+// CLUSTER KEYSLOT|SLOTS|NODES|MYID|INFO|COUNTKEYSINSLOT|GETKEYSINSLOT|SETSLOT
+std::string RedisCommandHandler::handleCluster(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() < 2) {
+        return "-ERR wrong number of arguments for 'cluster' command\r\n";
+    }
+    Cluster& cluster = Cluster::getInstance();
+    if (!cluster.enabled()) {
+        return "-ERR This instance has cluster support disabled\r\n";
+    }
+    std::string sub = tokens[1];
+    std::transform(sub.begin(), sub.end(), sub.begin(), ::toupper);
+
+    if (sub == "KEYSLOT" && tokens.size() == 3)
+        return ":" + std::to_string(Cluster::keySlot(tokens[2])) + "\r\n";
+    if (sub == "SLOTS")
+        return cluster.slotsReply();
+    if (sub == "NODES")
+        return cluster.nodesReply();
+    if (sub == "INFO")
+        return cluster.infoReply();
+    if (sub == "MYID")
+        return "$" + std::to_string(cluster.myId().size()) + "\r\n" + cluster.myId() + "\r\n";
+
+    if ((sub == "COUNTKEYSINSLOT" && tokens.size() == 3) || (sub == "GETKEYSINSLOT" && tokens.size() == 4) ||
+        (sub == "SETSLOT" && tokens.size() >= 4)) {
+        char* end = nullptr;
+        long slot = std::strtol(tokens[2].c_str(), &end, 10);
+        if (tokens[2].empty() || *end != '\0' || slot < 0 || slot >= Cluster::kSlots) {
+            return "-ERR Invalid or out of range slot\r\n";
+        }
+        if (sub == "SETSLOT") {
+            std::string state = tokens[3];
+            std::transform(state.begin(), state.end(), state.begin(), ::toupper);
+            if ((state == "STABLE") != (tokens.size() == 4) || tokens.size() > 5) {
+                return "-ERR Invalid CLUSTER SETSLOT action or number of arguments\r\n";
+            }
+            return cluster.setSlot(static_cast<int>(slot), state, tokens.size() == 5 ? tokens[4] : "");
+        }
+        long count = -1;
+        if (sub == "GETKEYSINSLOT") {
+            count = std::strtol(tokens[3].c_str(), &end, 10);
+            if (tokens[3].empty() || *end != '\0' || count < 0) {
+                return "-ERR Invalid number of keys\r\n";
+            }
+        }
+        // Keyspace scan (GETKEYSINSLOT stops after count keys), meant for resharding tools
+        std::vector<std::string> found = db.keysMatching([slot](const std::string& key) {
+            return Cluster::keySlot(key) == slot;
+        }, count < 0 ? SIZE_MAX : static_cast<size_t>(count));
+        if (sub == "COUNTKEYSINSLOT")
+            return ":" + std::to_string(found.size()) + "\r\n";
+        std::ostringstream response;
+        response << "*" << found.size() << "\r\n";
+        for (const auto& key : found)
+            response << "$" << key.size() << "\r\n" << key << "\r\n";
+        return response.str();
+    }
+    return "-ERR unknown subcommand or wrong number of arguments for 'CLUSTER " + tokens[1] + "'\r\n";
+}
+
+//Key Migration
+
+// MIGRATE host port key|"" destination-db timeout [COPY] [REPLACE] [KEYS key...]
+std::string RedisCommandHandler::handleMigrate(const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db) {
+    if (tokens.size() < 6) {
+        return "-ERR wrong number of arguments for 'migrate' command\r\n";
+    }
+    char* end = nullptr;
+    long port = std::strtol(tokens[2].c_str(), &end, 10);
+    if (tokens[2].empty() || *end != '\0' || port <= 0 || port > 65535) {
+        return "-ERR value is not an integer or out of range\r\n";
+    }
+    if (tokens[4] != "0") {
+        return "-ERR only database 0 exists\r\n";
+    }
+    long timeout = std::strtol(tokens[5].c_str(), &end, 10);
+    if (tokens[5].empty() || *end != '\0' || timeout < 0) {
+        return "-ERR timeout is not an integer or out of range\r\n";
+    }
+    bool copy = false, replace = false;
+    for (size_t i = 6; i < tokens.size(); ++i) {
+        std::string opt = tokens[i];
+        std::transform(opt.begin(), opt.end(), opt.begin(), ::toupper);
+        if (opt == "COPY") {
+            copy = true;
+        } else if (opt == "REPLACE") {
+            replace = true;
+        } else if (opt == "KEYS") {
+            if (!tokens[3].empty()) {
+                return "-ERR When using MIGRATE KEYS option, the key argument must be set to the empty string\r\n";
+            }
+            break;
+        } else {
+            return "-ERR syntax error\r\n";
+        }
+    }
+    std::vector<size_t> keyIndexes;
+    commandKeys(tokens, keyIndexes);
+    std::vector<std::string> keys;
+    for (size_t i : keyIndexes) {
+        keys.push_back(tokens[i]);
+    }
+    if (keys.empty()) {
+        return "+NOKEY\r\n";
+    }
+
+    std::vector<std::string> moved;
+    std::string reply = Cluster::getInstance().migrate(tokens[1], static_cast<int>(port), keys,
+                                                       timeout == 0 ? 1000 : static_cast<int>(timeout), copy, replace, db, moved);
+    // Our replicas drop what left; execute() flushes this after the handler
+    Replication& repl = Replication::getInstance();
+    if (!moved.empty() && repl.active()) {
+        auto lock = db.acquireLock();
+        std::vector<std::string> del = {"DEL"};
+        del.insert(del.end(), moved.begin(), moved.end());
+        repl.propagateLater(del);
+    }
+    return reply;
+}
+
+// RESTORE key ttl payload [REPLACE] [APPEND] :- payload in the snapshot encoding (see DUMP);
+// APPEND adds the elements of a later chunk of a big value
+std::string RedisCommandHandler::handleRestore(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() < 4) {
+        return "-ERR wrong number of arguments for 'restore' command\r\n";
+    }
+    char* end = nullptr;
+    long long ttl = std::strtoll(tokens[2].c_str(), &end, 10);
+    if (tokens[2].empty() || *end != '\0' || ttl < 0) {
+        return "-ERR Invalid TTL value, must be >= 0\r\n";
+    }
+    bool replace = false, append = false;
+    for (size_t i = 4; i < tokens.size(); ++i) {
+        std::string opt = tokens[i];
+        std::transform(opt.begin(), opt.end(), opt.begin(), ::toupper);
+        if (opt == "REPLACE") {
+            replace = true;
+        } else if (opt == "APPEND") {
+            append = true;
+        } else {
+            return "-ERR syntax error\r\n";
+        }
+    }
+    switch (db.restoreKey(tokens[1], tokens[3], ttl, replace, append)) {
+        case 0: return "+OK\r\n";
+        case -1: return "-BUSYKEY Target key name already exists.\r\n";
+        case -3: return "-WRONGTYPE Operation against a key holding the wrong kind of value\r\n";
+        default: return "-ERR Bad data format\r\n";
+    }
+}
+
+// DUMP key :- the key's lines in the snapshot (dump.my_rdb) encoding, what RESTORE takes
+std::string RedisCommandHandler::handleDump(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() != 2) {
+        return "-ERR wrong number of arguments for 'dump' command\r\n";
+    }
+    DetachedKey copy;
+    if (!db.extractKey(tokens[1], copy, false)) {
+        return Resp::null();
+    }
+    std::vector<std::string> chunks;
+    RedisDatabase::encodeKey(copy, SIZE_MAX, chunks);
+    return "$" + std::to_string(chunks[0].size()) + "\r\n" + chunks[0] + "\r\n";
+}
+
+//Pub/Sub
+
+// The connection's output queue, created on first use (SUBSCRIBE, or RESP3 tracking)
+static void ensureSubscriber(ClientSession& session) {
+    if (session.subscriber)
+        return;
+    session.subscriber = std::make_shared<Subscriber>(session.socket);
+    session.subscriber->setProtocol(session.resp);
+    session.subscriber->hold(); // this batch's replies go first
+    Tracking::getInstance().attach(session.id, session.subscriber); // can be a REDIRECT target now
+    if (session.info)
+        ClientRegistry::getInstance().setSubscriber(*session.info, session.subscriber);
+}
+
+// Shared by the four (un)subscribe commands; the first SUBSCRIBE turns the
+// connection's output over to a Subscriber queue (see RedisServer::run)
+std::string RedisCommandHandler::subscription(const std::vector<std::string>& tokens, bool subscribe, bool pattern, ClientSession& session) {
+    if (session.socket < 0 || session.inAtomic) {
+        std::string cmd = tokens[0];
+        std::transform(cmd.begin(), cmd.end(), cmd.begin(), ::toupper);
+        return "-ERR " + cmd + " is not allowed here\r\n";
+    }
+    std::vector<std::string> names(tokens.begin() + 1, tokens.end());
+    if (subscribe) {
+        if (names.empty()) {
+            return "-ERR wrong number of arguments for '" + tokens[0] + "' command\r\n";
+        }
+        ensureSubscriber(session);
+        return PubSub::getInstance().subscribe(session.subscriber, names, pattern);
+    }
+    if (!session.subscriber) {
+        // never subscribed, still answered like Redis does
+        return Resp::push(3) + (pattern ? "$12\r\npunsubscribe\r\n" : "$11\r\nunsubscribe\r\n") + Resp::null() + ":0\r\n";
+    }
+    return PubSub::getInstance().unsubscribe(session.subscriber, names, pattern);
+}
+
+// SUBSCRIBE channel [channel ...]
+std::string RedisCommandHandler::handleSubscribe(const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db) {
+    return subscription(tokens, true, false, session);
+}
+
+// UNSUBSCRIBE [channel ...] :- all channels when none is given
+std::string RedisCommandHandler::handleUnsubscribe(const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db) {
+    return subscription(tokens, false, false, session);
+}
+
+// PSUBSCRIBE pattern [pattern ...]
+std::string RedisCommandHandler::handlePsubscribe(const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db) {
+    return subscription(tokens, true, true, session);
+}
+
+// PUNSUBSCRIBE [pattern ...]
+std::string RedisCommandHandler::handlePunsubscribe(const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db) {
+    return subscription(tokens, false, true, session);
+}
+
+// PUBLISH channel message :- number of subscriptions that got it
+std::string RedisCommandHandler::handlePublish(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() != 3) {
+        return "-ERR wrong number of arguments for 'publish' command\r\n";
+    }
+    return ":" + std::to_string(PubSub::getInstance().publish(tokens[1], tokens[2])) + "\r\n";
+}
+
+// PUBSUB CHANNELS [pattern] | NUMSUB [channel ...] | NUMPAT
+std::string RedisCommandHandler::handlePubsub(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() < 2) {
+        return "-ERR wrong number of arguments for 'pubsub' command\r\n";
+    }
+    std::string sub = tokens[1];
+    std::transform(sub.begin(), sub.end(), sub.begin(), ::toupper);
+    PubSub& pubsub = PubSub::getInstance();
+    if (sub == "CHANNELS" && tokens.size() <= 3)
+        return pubsub.channelsReply(tokens.size() == 3 ? &tokens[2] : nullptr);
+    if (sub == "NUMSUB")
+        return pubsub.numsubReply(std::vector<std::string>(tokens.begin() + 2, tokens.end()));
+    if (sub == "NUMPAT" && tokens.size() == 2)
+        return ":" + std::to_string(pubsub.numpat()) + "\r\n";
+    return "-ERR Unknown PUBSUB subcommand or wrong number of arguments for '" + tokens[1] + "'\r\n";
+}
+
+//Connections
+
+// CLIENT KILL ip:port, or CLIENT KILL [ID id] [ADDR ip:port] [TYPE normal|replica|pubsub] [SKIPME yes|no]
+static std::string clientKill(const std::vector<std::string>& tokens, ClientSession& session) {
+    ClientRegistry& registry = ClientRegistry::getInstance();
+    ClientRegistry::KillFilter filter;
+    if (tokens.size() == 3) {
+        filter.addr = tokens[2];
+        return registry.kill(filter, session.id) ? "+OK\r\n" : "-ERR No such client\r\n";
+    }
+    filter.skip = session.id;
+    for (size_t i = 2; i < tokens.size(); i += 2) {
+        if (i + 1 >= tokens.size())
+            return "-ERR syntax error\r\n";
+        std::string opt = tokens[i];
+        std::string value = tokens[i + 1];
+        std::transform(opt.begin(), opt.end(), opt.begin(), ::toupper);
+        std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+        if (opt == "ID") {
+            char* end = nullptr;
+            filter.id = std::strtoull(tokens[i + 1].c_str(), &end, 10);
+            if (*end != '\0' || filter.id == 0)
+                return "-ERR client-id should be greater than 0\r\n";
+        } else if (opt == "ADDR") {
+            filter.addr = tokens[i + 1];
+        } else if (opt == "TYPE") {
+            if (value == "normal")
+                filter.cls = static_cast<int>(ClientClass::NORMAL);
+            else if (value == "replica" || value == "slave" || value == "master")
+                filter.cls = static_cast<int>(ClientClass::REPLICA);
+            else if (value == "pubsub")
+                filter.cls = static_cast<int>(ClientClass::PUBSUB);
+            else
+                return "-ERR Unknown client type '" + tokens[i + 1] + "'\r\n";
+        } else if (opt == "SKIPME") {
+            if (value != "yes" && value != "no")
+                return "-ERR syntax error\r\n";
+            filter.skip = value == "yes" ? session.id : 0;
+        } else {
+            return "-ERR syntax error\r\n";
+        }
+    }
+    return ":" + std::to_string(registry.kill(filter, session.id)) + "\r\n";
+}
+
+// CLIENT ID | LIST | INFO | SETNAME name | GETNAME | KILL ... | GETREDIR | TRACKING ON|OFF [REDIRECT id] [BCAST] [PREFIX prefix ...]
+std::string RedisCommandHandler::handleClient(const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db) {
+    if (tokens.size() < 2) {
+        return "-ERR wrong number of arguments for 'client' command\r\n";
+    }
+    std::string sub = tokens[1];
+    std::transform(sub.begin(), sub.end(), sub.begin(), ::toupper);
+    Tracking& tracking = Tracking::getInstance();
+
+    if (sub == "ID" && tokens.size() == 2)
+        return ":" + std::to_string(session.id) + "\r\n";
+    if (sub == "LIST" && tokens.size() == 2)
+        return Resp::bulk(ClientRegistry::getInstance().list());
+    if (sub == "INFO" && tokens.size() == 2)
+        return Resp::bulk(ClientRegistry::getInstance().list(session.id));
+    if (sub == "SETNAME" && tokens.size() == 3) {
+        for (char c : tokens[2]) {
+            if (c < '!' || c > '~')
+                return "-ERR Client names cannot contain spaces, newlines or special characters.\r\n";
+        }
+        if (session.info) {
+            std::lock_guard<std::mutex> lock(session.info->mutex);
+            session.info->name = tokens[2];
+        }
+        return "+OK\r\n";
+    }
+    if (sub == "GETNAME" && tokens.size() == 2) {
+        std::string name;
+        if (session.info) {
+            std::lock_guard<std::mutex> lock(session.info->mutex);
+            name = session.info->name;
+        }
+        return name.empty() ? Resp::null() : Resp::bulk(name);
+    }
+    if (sub == "KILL" && tokens.size() >= 3)
+        return clientKill(tokens, session);
+    if (sub == "GETREDIR" && tokens.size() == 2)
+        return session.tracking ? ":" + std::to_string(tracking.redirectOf(session.id)) + "\r\n" : ":-1\r\n";
+    if (sub != "TRACKING" || tokens.size() < 3) {
+        return "-ERR Unknown CLIENT subcommand or wrong number of arguments for '" + tokens[1] + "'\r\n";
+    }
+    if (session.socket < 0 || session.inAtomic) {
+        return "-ERR CLIENT TRACKING is not allowed here\r\n";
+    }
+
+    std::string mode = tokens[2];
+    std::transform(mode.begin(), mode.end(), mode.begin(), ::toupper);
+    if (mode == "OFF" && tokens.size() == 3) {
+        tracking.disable(session.id);
+        session.tracking = false;
+        session.trackingBcast = false;
+        return "+OK\r\n";
+    }
+    if (mode != "ON") {
+        return "-ERR syntax error\r\n";
+    }
+    uint64_t redirect = 0;
+    bool bcast = false;
+    std::vector<std::string> prefixes;
+    for (size_t i = 3; i < tokens.size(); ++i) {
+        std::string opt = tokens[i];
+        std::transform(opt.begin(), opt.end(), opt.begin(), ::toupper);
+        if (opt == "BCAST") {
+            bcast = true;
+        } else if (opt == "REDIRECT" && i + 1 < tokens.size()) {
+            char* end = nullptr;
+            redirect = std::strtoull(tokens[++i].c_str(), &end, 10);
+            if (*end != '\0' || redirect == 0) {
+                return "-ERR value is not an integer or out of range\r\n";
+            }
+            if (redirect != session.id && !tracking.attached(redirect)) {
+                return "-ERR The client ID you want redirect to does not exist\r\n";
+            }
+        } else if (opt == "PREFIX" && i + 1 < tokens.size()) {
+            prefixes.push_back(tokens[++i]);
+        } else {
+            return "-ERR syntax error\r\n";
+        }
+    }
+    if (!prefixes.empty() && !bcast) {
+        return "-ERR PREFIX option requires BCAST mode to be enabled\r\n";
+    }
+    if (redirect == session.id) {
+        redirect = 0;
+    }
+    if (redirect == 0 && session.resp == 3) {
+        ensureSubscriber(session); // invalidations come in as pushes on this connection
+    }
+    tracking.enable(session.id, redirect, bcast, prefixes);
+    session.tracking = true;
+    session.trackingBcast = bcast;
+    return "+OK\r\n";
+}
+
+// HELLO [protover] :- switches the connection to RESP2 or RESP3, answers with server info
+std::string RedisCommandHandler::handleHello(const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db) {
+    if (tokens.size() > 2) {
+        return "-ERR syntax error\r\n"; // AUTH and SETNAME are not supported
+    }
+    if (tokens.size() == 2) {
+        char* end = nullptr;
+        long version = std::strtol(tokens[1].c_str(), &end, 10);
+        if (tokens[1].empty() || *end != '\0') {
+            return "-ERR Protocol version is not an integer or out of range\r\n";
+        }
+        if (version != 2 && version != 3) {
+            return "-NOPROTO unsupported protocol version\r\n";
+        }
+        session.resp = static_cast<int>(version);
+        if (session.subscriber) {
+            session.subscriber->setProtocol(session.resp);
+        }
+    }
+    Resp::Scope protocol(session.resp); // the reply already uses the new version
+    std::string proto = std::to_string(session.resp);
+    std::string id = std::to_string(session.id);
+    return Resp::map(7) +
+           "$6\r\nserver\r\n$5\r\nredis\r\n" +
+           "$7\r\nversion\r\n$5\r\n7.0.0\r\n" +
+           "$5\r\nproto\r\n:" + proto + "\r\n" +
+           "$2\r\nid\r\n:" + id + "\r\n" +
+           "$4\r\nmode\r\n" + Resp::bulk(Cluster::getInstance().enabled() ? "cluster" : "standalone") +
+           "$4\r\nrole\r\n" + Resp::bulk(Replication::getInstance().isReplica() ? "replica" : "master") +
+           "$7\r\nmodules\r\n*0\r\n";
+}
+
 //Key/Value Operations 
 
 std::string RedisCommandHandler::handleSet(const std::vector<std::string>& tokens, RedisDatabase& db) {
@@ -54,7 +841,7 @@ std::string RedisCommandHandler::handleGet(const std::vector<std::string>& token
         if (db.get(tokens[1], value)) {
             response << "$" << value.size() << "\r\n" << value << "\r\n";
         } else {
-            response << "$-1\r\n";
+            response << Resp::null();
         }
     }
     return response.str();
@@ -86,12 +873,73 @@ std::string RedisCommandHandler::handleDel(const std::vector<std::string>& token
     if (tokens.size() < 2) {
         response << "-ERR wrong number of arguments for 'del' command\r\n";
     } else {
-        bool deleted = db.del(tokens[1]);
-        response << ":" << (deleted ? 1 : 0) << "\r\n";
+        std::vector<std::string> keys(tokens.begin() + 1, tokens.end());
+        response << ":" << db.del(keys) << "\r\n";
     }
     return response.str();
 }
 
+// Like DEL, but big values are freed in the background
+std::string RedisCommandHandler::handleUnlink(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() < 2)
+        return "-ERR wrong number of arguments for 'unlink' command\r\n";
+    std::vector<std::string> keys(tokens.begin() + 1, tokens.end());
+    return ":" + std::to_string(db.del(keys, true)) + "\r\n";
+}
+
+std::string RedisCommandHandler::handleExists(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() < 2)
+        return "-ERR wrong number of arguments for 'exists' command\r\n";
+    std::vector<std::string> keys(tokens.begin() + 1, tokens.end());
+    return ":" + std::to_string(db.exists(keys)) + "\r\n";
+}
+
+// Array reply where missing values are null bulk strings (MGET/HMGET)
+static std::string nullableArrayReply(const std::vector<std::optional<std::string>>& values) {
+    std::string out = "*" + std::to_string(values.size()) + "\r\n";
+    for (const auto& v : values) {
+        if (v) {
+            out += "$" + std::to_string(v->size()) + "\r\n";
+            out += *v;
+            out += "\r\n";
+        } else {
+            out += Resp::null();
+        }
+    }
+    return out;
+}
+
+std::string RedisCommandHandler::handleMget(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() < 2)
+        return "-ERR wrong number of arguments for 'mget' command\r\n";
+    std::vector<std::string> keys(tokens.begin() + 1, tokens.end());
+    return nullableArrayReply(db.mget(keys));
+}
+
+static bool keyValuePairs(const std::vector<std::string>& tokens, std::vector<std::pair<std::string, std::string>>& pairs) {
+    if (tokens.size() < 3 || tokens.size() % 2 == 0)
+        return false;
+    for (size_t i = 1; i < tokens.size(); i += 2) {
+        pairs.emplace_back(tokens[i], tokens[i + 1]);
+    }
+    return true;
+}
+
+std::string RedisCommandHandler::handleMset(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    std::vector<std::pair<std::string, std::string>> pairs;
+    if (!keyValuePairs(tokens, pairs))
+        return "-ERR wrong number of arguments for 'mset' command\r\n";
+    db.mset(pairs);
+    return "+OK\r\n";
+}
+
+std::string RedisCommandHandler::handleMsetnx(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    std::vector<std::pair<std::string, std::string>> pairs;
+    if (!keyValuePairs(tokens, pairs))
+        return "-ERR wrong number of arguments for 'msetnx' command\r\n";
+    return db.msetnx(pairs) ? ":1\r\n" : ":0\r\n";
+}
+
 std::string RedisCommandHandler::handleExpire(const std::vector<std::string>& tokens, RedisDatabase& db) {
     std::ostringstream response;
     if (tokens.size() < 3) {
@@ -118,28 +966,109 @@ std::string RedisCommandHandler::handleRename(const std::vector<std::string>& to
     return response.str();
 }
 
+// Shared by INCR/DECR/INCRBY/DECRBY
+static std::string incrReply(const std::string& key, int64_t delta, RedisDatabase& db) {
+    int64_t result;
+    switch (db.incrby(key, delta, result)) {
+        case -1: return "-WRONGTYPE Operation against a key holding the wrong kind of value\r\n";
+        case -2: return "-ERR value is not an integer or out of range\r\n";
+        case -3: return "-ERR increment or decrement would overflow\r\n";
+    }
+    return integerReply(result);
+}
+
+std::string RedisCommandHandler::handleIncr(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() != 2)
+        return "-ERR wrong number of arguments for 'incr' command\r\n";
+    return incrReply(tokens[1], 1, db);
+}
+
+std::string RedisCommandHandler::handleDecr(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() != 2)
+        return "-ERR wrong number of arguments for 'decr' command\r\n";
+    return incrReply(tokens[1], -1, db);
+}
+
+std::string RedisCommandHandler::handleIncrby(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() != 3)
+        return "-ERR wrong number of arguments for 'incrby' command\r\n";
+    int64_t delta;
+    if (!parseCanonicalInt(tokens[2], delta))
+        return "-ERR value is not an integer or out of range\r\n";
+    return incrReply(tokens[1], delta, db);
+}
+
+std::string RedisCommandHandler::handleDecrby(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() != 3)
+        return "-ERR wrong number of arguments for 'decrby' command\r\n";
+    int64_t delta;
+    if (!parseCanonicalInt(tokens[2], delta))
+        return "-ERR value is not an integer or out of range\r\n";
+    if (delta == INT64_MIN)
+        return "-ERR decrement would overflow\r\n";
+    return incrReply(tokens[1], -delta, db);
+}
+
+std::string RedisCommandHandler::handleIncrbyfloat(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() != 3)
+        return "-ERR wrong number of arguments for 'incrbyfloat' command\r\n";
+    char* end = nullptr;
+    long double delta = std::strtold(tokens[2].c_str(), &end);
+    if (tokens[2].empty() || end != tokens[2].c_str() + tokens[2].size() || std::isnan(delta) || std::isinf(delta))
+        return "-ERR value is not a valid float\r\n";
+    std::string result;
+    switch (db.incrbyfloat(tokens[1], delta, result)) {
+        case -1: return "-WRONGTYPE Operation against a key holding the wrong kind of value\r\n";
+        case -2: return "-ERR value is not a valid float\r\n";
+        case -3: return "-ERR increment would produce NaN or Infinity\r\n";
+    }
+    return "$" + std::to_string(result.size()) + "\r\n" + result + "\r\n";
+}
+
 //List Operations
 
 std::string RedisCommandHandler::handleLpush(const std::vector<std::string>& tokens, RedisDatabase& db) {
     if (tokens.size() < 3){ 
         return "-Error: LPUSH requires key and value\r\n";
     }
-    for (size_t i = 2; i < tokens.size(); ++i) {
-        db.lpush(tokens[1], tokens[i]);
-    }
-    ssize_t len = db.llen(tokens[1]);
+    std::vector<std::string> values(tokens.begin() + 2, tokens.end());
+    ssize_t len = db.lpush(tokens[1], values);
     return ":" + std::to_string(len) + "\r\n";
 }
 
+// LPOP/RPOP key count :- array of up to count elements
+static std::string popCountReply(const std::vector<std::string>& tokens, bool fromLeft, RedisDatabase& db) {
+    long count;
+    try {
+        count = std::stol(tokens[2]);
+    } catch (const std::exception&) {
+        return "-ERR value is out of range, must be positive\r\n";
+    }
+    if (count < 0)
+        return "-ERR value is out of range, must be positive\r\n";
+    if (db.llen(tokens[1]) == 0)
+        return Resp::nullArray();
+    auto popped = db.popMany(tokens[1], fromLeft, count);
+    std::ostringstream oss;
+    oss << "*" << popped.size() << "\r\n";
+    for (const auto& e : popped) {
+        oss << "$" << e.size() << "\r\n" << e << "\r\n";
+    }
+    return oss.str();
+}
+
 std::string RedisCommandHandler::handleLpop(const std::vector<std::string>& tokens, RedisDatabase& db) {
     if (tokens.size() < 2) {
         return "-ERR wrong number of arguments for 'lpop' command\r\n";
     }
+    if (tokens.size() > 2) {
+        return popCountReply(tokens, true, db);
+    }
     std::string value;
     if (db.lpop(tokens[1], value)) {
         return "$" + std::to_string(value.size()) + "\r\n" + value + "\r\n";
     } else {
-        return "$-1\r\n";
+        return Resp::null();
     }
 }
 
@@ -147,10 +1076,8 @@ std::string RedisCommandHandler::handleRpush(const std::vector<std::string>& tok
     if (tokens.size() < 3){
         return "-Error: RPUSH requires key and value\r\n";
     }
-    for (size_t i = 2; i < tokens.size(); ++i) {
-        db.rpush(tokens[1], tokens[i]);
-    }    
-    ssize_t len = db.llen(tokens[1]);
+    std::vector<std::string> values(tokens.begin() + 2, tokens.end());
+    ssize_t len = db.rpush(tokens[1], values);
     return ":" + std::to_string(len) + "\r\n";
 }
 
@@ -158,10 +1085,13 @@ std::string RedisCommandHandler::handleRpop(const std::vector<std::string>& toke
     if (tokens.size() < 2){ 
         return "-Error: RPOP requires key\r\n";
     }
+    if (tokens.size() > 2) {
+        return popCountReply(tokens, false, db);
+    }
     std::string val;
     if (db.rpop(tokens[1], val))
         return "$" + std::to_string(val.size()) + "\r\n" + val + "\r\n";
-    return "$-1\r\n";
+    return Resp::null();
 }
 
 std::string RedisCommandHandler::handleLlen(const std::vector<std::string>& tokens, RedisDatabase& db) {
@@ -182,7 +1112,7 @@ std::string RedisCommandHandler::handleLindex(const std::vector<std::string>& to
         if (db.lindex(tokens[1], index, value)) 
             return "$" + std::to_string(value.size()) + "\r\n" + value + "\r\n";
         else 
-            return "$-1\r\n";
+            return Resp::null();
     } catch (const std::exception&) {
         return "-Error: Invalid index\r\n";
     }
@@ -230,6 +1160,209 @@ std::string RedisCommandHandler::handleLrem(const std::vector<std::string>& toke
     }
 }
 
+static std::string arrayReply(const std::vector<std::string>& elems) {
+    std::ostringstream oss;
+    oss << "*" << elems.size() << "\r\n";
+    for (const auto& e : elems) {
+        oss << "$" << e.size() << "\r\n" << e << "\r\n";
+    }
+    return oss.str();
+}
+
+// Unordered members :- a RESP3 set, a plain array in RESP2
+static std::string setReply(const std::vector<std::string>& elems) {
+    std::string out = Resp::set(elems.size());
+    for (const auto& e : elems) {
+        out += Resp::bulk(e);
+    }
+    return out;
+}
+
+std::string RedisCommandHandler::handleLrange(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() != 4)
+        return "-ERR wrong number of arguments for 'lrange' command\r\n";
+    try {
+        return arrayReply(db.lrange(tokens[1], std::stol(tokens[2]), std::stol(tokens[3])));
+    } catch (const std::exception&) {
+        return "-ERR value is not an integer or out of range\r\n";
+    }
+}
+
+std::string RedisCommandHandler::handleLtrim(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() != 4)
+        return "-ERR wrong number of arguments for 'ltrim' command\r\n";
+    try {
+        db.ltrim(tokens[1], std::stol(tokens[2]), std::stol(tokens[3]));
+        return "+OK\r\n";
+    } catch (const std::exception&) {
+        return "-ERR value is not an integer or out of range\r\n";
+    }
+}
+
+// LINSERT key BEFORE|AFTER pivot element
+std::string RedisCommandHandler::handleLinsert(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() != 5)
+        return "-ERR wrong number of arguments for 'linsert' command\r\n";
+    std::string where = tokens[2];
+    std::transform(where.begin(), where.end(), where.begin(), ::toupper);
+    if (where != "BEFORE" && where != "AFTER")
+        return "-ERR syntax error\r\n";
+    ssize_t len = db.linsert(tokens[1], where == "BEFORE", tokens[3], tokens[4]);
+    return ":" + std::to_string(len) + "\r\n";
+}
+
+// LMPOP numkeys key [key ...] LEFT|RIGHT [COUNT count]
+std::string RedisCommandHandler::handleLmpop(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() < 4)
+        return "-ERR wrong number of arguments for 'lmpop' command\r\n";
+    long numKeys, count = 1;
+    try {
+        numKeys = std::stol(tokens[1]);
+    } catch (const std::exception&) {
+        return "-ERR numkeys should be greater than 0\r\n";
+    }
+    if (numKeys <= 0 || 2 + numKeys >= static_cast<long>(tokens.size()))
+        return "-ERR numkeys should be greater than 0\r\n";
+    std::string where = tokens[2 + numKeys];
+    std::transform(where.begin(), where.end(), where.begin(), ::toupper);
+    if (where != "LEFT" && where != "RIGHT")
+        return "-ERR syntax error\r\n";
+    size_t next = 3 + numKeys;
+    if (next < tokens.size()) {
+        std::string opt = tokens[next];
+        std::transform(opt.begin(), opt.end(), opt.begin(), ::toupper);
+        if (opt != "COUNT" || next + 2 != tokens.size())
+            return "-ERR syntax error\r\n";
+        try {
+            count = std::stol(tokens[next + 1]);
+        } catch (const std::exception&) {
+            count = 0;
+        }
+        if (count <= 0)
+            return "-ERR count should be greater than 0\r\n";
+    }
+    std::vector<std::string> keys(tokens.begin() + 2, tokens.begin() + 2 + numKeys);
+    std::string poppedKey;
+    auto popped = db.lmpop(keys, where == "LEFT", count, poppedKey);
+    if (popped.empty())
+        return Resp::nullArray();
+    return "*2\r\n$" + std::to_string(poppedKey.size()) + "\r\n" + poppedKey + "\r\n" + arrayReply(popped);
+}
+
+// LMOVE source destination LEFT|RIGHT LEFT|RIGHT
+static bool parseDirection(const std::string& token, bool& left) {
+    std::string dir = token;
+    std::transform(dir.begin(), dir.end(), dir.begin(), ::toupper);
+    if (dir != "LEFT" && dir != "RIGHT")
+        return false;
+    left = (dir == "LEFT");
+    return true;
+}
+
+std::string RedisCommandHandler::handleLmove(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() != 5)
+        return "-ERR wrong number of arguments for 'lmove' command\r\n";
+    bool fromLeft, toLeft;
+    if (!parseDirection(tokens[3], fromLeft) || !parseDirection(tokens[4], toLeft))
+        return "-ERR syntax error\r\n";
+    std::string value;
+    if (db.lmove(tokens[1], tokens[2], fromLeft, toLeft, value))
+        return "$" + std::to_string(value.size()) + "\r\n" + value + "\r\n";
+    return Resp::null();
+}
+
+//Blocking List Operations
+
+// Timeouts are seconds (fractions allowed), 0 blocks forever
+static bool parseTimeout(const std::string& token, std::chrono::milliseconds& timeout) {
+    try {
+        double seconds = std::stod(token);
+        if (seconds < 0)
+            return false;
+        timeout = std::chrono::milliseconds(static_cast<long long>(seconds * 1000));
+        if (seconds > 0 && timeout.count() == 0)
+            timeout = std::chrono::milliseconds(1);
+        return true;
+    } catch (const std::exception&) {
+        return false;
+    }
+}
+
+// Has the client on the other end of this socket gone away?
+static bool clientHungUp(int socket) {
+    if (socket < 0)
+        return false;
+    char probe;
+    ssize_t n = recv(socket, &probe, 1, MSG_PEEK | MSG_DONTWAIT);
+    return n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK);
+}
+
+// Wait on the waiter unless we're inside EXEC/EVAL, where blocking would stall everyone
+static bool waitForList(const std::shared_ptr<ListWaiter>& waiter, std::chrono::milliseconds timeout,
+                        ClientSession& session, RedisDatabase& db) {
+    // Replicas see the pop as the non-blocking command it amounts to
+    ListWaiter* w = waiter.get();
+    w->onServed = [w]() {
+        Replication& repl = Replication::getInstance();
+        if (!repl.active())
+            return;
+        if (w->move)
+            repl.propagateLater({"LMOVE", w->servedKey, w->destination, w->fromLeft ? "LEFT" : "RIGHT", w->toLeft ? "LEFT" : "RIGHT"});
+        else
+            repl.propagateLater({w->fromLeft ? "LPOP" : "RPOP", w->servedKey});
+    };
+    if (session.inAtomic) {
+        if (db.popOrBlock(waiter))
+            return true;
+        db.cancelWait(waiter);
+        return false;
+    }
+    int socket = session.socket;
+    return db.blockingPop(waiter, timeout, [socket]() { return clientHungUp(socket); });
+}
+
+std::string RedisCommandHandler::blockingPop(const std::vector<std::string>& tokens, bool fromLeft, ClientSession& session, RedisDatabase& db) {
+    if (tokens.size() < 3)
+        return "-ERR wrong number of arguments for '" + std::string(fromLeft ? "blpop" : "brpop") + "' command\r\n";
+    std::chrono::milliseconds timeout;
+    if (!parseTimeout(tokens.back(), timeout))
+        return "-ERR timeout is not a float or out of range\r\n";
+
+    auto waiter = std::make_shared<ListWaiter>();
+    waiter->keys.assign(tokens.begin() + 1, tokens.end() - 1);
+    waiter->fromLeft = fromLeft;
+    if (!waitForList(waiter, timeout, session, db))
+        return Resp::nullArray();
+    return "*2\r\n$" + std::to_string(waiter->servedKey.size()) + "\r\n" + waiter->servedKey + "\r\n"
+         + "$" + std::to_string(waiter->value.size()) + "\r\n" + waiter->value + "\r\n";
+}
+
+std::string RedisCommandHandler::handleBlpop(const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db) {
+    return blockingPop(tokens, true, session, db);
+}
+
+std::string RedisCommandHandler::handleBrpop(const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db) {
+    return blockingPop(tokens, false, session, db);
+}
+
+// BLMOVE source destination LEFT|RIGHT LEFT|RIGHT timeout
+std::string RedisCommandHandler::handleBlmove(const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db) {
+    if (tokens.size() != 6)
+        return "-ERR wrong number of arguments for 'blmove' command\r\n";
+    auto waiter = std::make_shared<ListWaiter>();
+    waiter->keys.push_back(tokens[1]);
+    waiter->move = true;
+    waiter->destination = tokens[2];
+    if (!parseDirection(tokens[3], waiter->fromLeft) || !parseDirection(tokens[4], waiter->toLeft))
+        return "-ERR syntax error\r\n";
+    std::chrono::milliseconds timeout;
+    if (!parseTimeout(tokens[5], timeout))
+        return "-ERR timeout is not a float or out of range\r\n";
+    if (!waitForList(waiter, timeout, session, db))
+        return Resp::null();
+    return "$" + std::to_string(waiter->value.size()) + "\r\n" + waiter->value + "\r\n";
+}
+
 //Hash Operations
 
 std::string RedisCommandHandler::handleHset(const std::vector<std::string>& tokens, RedisDatabase& db) {
@@ -245,7 +1378,7 @@ std::string RedisCommandHandler::handleHget(const std::vector<std::string>& toke
     std::string value;
     if (db.hget(tokens[1], tokens[2], value))
         return "$" + std::to_string(value.size()) + "\r\n" + value + "\r\n";
-    return "$-1\r\n";
+    return Resp::null();
 }
 
 std::string RedisCommandHandler::handleHexists(const std::vector<std::string>& tokens, RedisDatabase& db) {
@@ -258,8 +1391,15 @@ std::string RedisCommandHandler::handleHexists(const std::vector<std::string>& t
 std::string RedisCommandHandler::handleHdel(const std::vector<std::string>& tokens, RedisDatabase& db) {
     if (tokens.size() < 3) 
         return "-Error: HDEL requires key and field\r\n";
-    bool res = db.hdel(tokens[1], tokens[2]);
-    return ":" + std::to_string(res ? 1 : 0) + "\r\n";
+    std::vector<std::string> fields(tokens.begin() + 2, tokens.end());
+    return ":" + std::to_string(db.hdel(tokens[1], fields)) + "\r\n";
+}
+
+std::string RedisCommandHandler::handleHmget(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() < 3)
+        return "-ERR wrong number of arguments for 'hmget' command\r\n";
+    std::vector<std::string> fields(tokens.begin() + 2, tokens.end());
+    return nullableArrayReply(db.hmget(tokens[1], fields));
 }
 
 std::string RedisCommandHandler::handleHgetall(const std::vector<std::string>& tokens, RedisDatabase& db) {
@@ -267,7 +1407,7 @@ std::string RedisCommandHandler::handleHgetall(const std::vector<std::string>& t
         return "-Error: HGETALL requires key\r\n";
     auto hash = db.hgetall(tokens[1]);
     std::ostringstream oss;
-    oss << "*" << hash.size() * 2 << "\r\n";
+    oss << Resp::map(hash.size());
     for (const auto& pair: hash) {
         oss << "$" << pair.first.size() << "\r\n" << pair.first << "\r\n";
         oss << "$" << pair.second.size() << "\r\n" << pair.second << "\r\n";
@@ -317,3 +1457,961 @@ std::string RedisCommandHandler::handleHmset(const std::vector<std::string>& tok
     return "+OK\r\n";
 }
 
+
+//Sorted Set Operations
+
+static bool parseScore(const std::string& s, double& out) {
+    if (s.empty())
+        return false;
+    char* end = nullptr;
+    errno = 0;
+    out = std::strtod(s.c_str(), &end);
+    return end == s.c_str() + s.size() && !std::isnan(out);
+}
+
+// Whole scores print as integers like Redis (300, not 3e+02), the rest as %.17g like the snapshot,
+// which reads back as the same double
+static std::string formatScore(double score) {
+    if (std::isinf(score))
+        return score > 0 ? "inf" : "-inf";
+    char buf[32];
+    if (std::floor(score) == score && std::fabs(score) < 1e17)
+        snprintf(buf, sizeof(buf), "%.0f", score);
+    else
+        snprintf(buf, sizeof(buf), "%.17g", score);
+    return buf;
+}
+
+static std::string bulk(const std::string& s) {
+    return "$" + std::to_string(s.size()) + "\r\n" + s + "\r\n";
+}
+
+// WITHSCORES :- member, score, member, score... in RESP2, [member, score] pairs with double scores in RESP3
+static std::string zsetReply(const std::vector<std::pair<std::string, double>>& entries, bool withScores) {
+    bool pairs = withScores && Resp::protocol() == 3;
+    std::ostringstream oss;
+    oss << "*" << entries.size() * (withScores && !pairs ? 2 : 1) << "\r\n";
+    for (const auto& e : entries) {
+        if (pairs)
+            oss << "*2\r\n";
+        oss << bulk(e.first);
+        if (withScores)
+            oss << Resp::dbl(formatScore(e.second));
+    }
+    return oss.str();
+}
+
+// min/max of ZRANGEBYSCORE: "(" prefix makes the bound exclusive, -inf/+inf allowed
+static bool parseScoreBound(const std::string& s, double& out, bool& exclusive) {
+    exclusive = !s.empty() && s[0] == '(';
+    return parseScore(exclusive ? s.substr(1) : s, out);
+}
+
+// ZADD key [NX|XX] [CH] [INCR] score member [score member ...]
+std::string RedisCommandHandler::handleZadd(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() < 4)
+        return "-ERR wrong number of arguments for 'zadd' command\r\n";
+    int flags = 0;
+    bool ch = false, incr = false;
+    size_t i = 2;
+    for (; i < tokens.size(); ++i) {
+        std::string opt = tokens[i];
+        std::transform(opt.begin(), opt.end(), opt.begin(), ::toupper);
+        if (opt == "NX") flags |= RedisDatabase::ZADD_NX;
+        else if (opt == "XX") flags |= RedisDatabase::ZADD_XX;
+        else if (opt == "CH") ch = true;
+        else if (opt == "INCR") incr = true;
+        else break;
+    }
+    if (flags == (RedisDatabase::ZADD_NX | RedisDatabase::ZADD_XX))
+        return "-ERR XX and NX options at the same time are not compatible\r\n";
+    if (i >= tokens.size() || (tokens.size() - i) % 2 != 0)
+        return "-ERR syntax error\r\n";
+    std::vector<std::pair<double, std::string>> entries;
+    for (; i < tokens.size(); i += 2) {
+        double score;
+        if (!parseScore(tokens[i], score))
+            return "-ERR value is not a valid float\r\n";
+        entries.emplace_back(score, tokens[i + 1]);
+    }
+
+    if (incr) {
+        if (entries.size() != 1)
+            return "-ERR INCR option supports a single increment-element pair\r\n";
+        double current;
+        bool exists = db.zscore(tokens[1], entries[0].second, current);
+        if ((exists && (flags & RedisDatabase::ZADD_NX)) || (!exists && (flags & RedisDatabase::ZADD_XX)))
+            return Resp::null();
+        double score;
+        int rc = db.zincrby(tokens[1], entries[0].second, entries[0].first, score);
+        if (rc == -1)
+            return "-WRONGTYPE Operation against a key holding the wrong kind of value\r\n";
+        if (rc == -2)
+            return "-ERR resulting score is not a number (NaN)\r\n";
+        return Resp::dbl(formatScore(score));
+    }
+
+    size_t changed;
+    long added = db.zadd(tokens[1], entries, flags, changed);
+    if (added < 0)
+        return "-WRONGTYPE Operation against a key holding the wrong kind of value\r\n";
+    return ":" + std::to_string(ch ? static_cast<long>(changed) : added) + "\r\n";
+}
+
+std::string RedisCommandHandler::handleZincrby(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() != 4)
+        return "-ERR wrong number of arguments for 'zincrby' command\r\n";
+    double delta, score;
+    if (!parseScore(tokens[2], delta))
+        return "-ERR value is not a valid float\r\n";
+    int rc = db.zincrby(tokens[1], tokens[3], delta, score);
+    if (rc == -1)
+        return "-WRONGTYPE Operation against a key holding the wrong kind of value\r\n";
+    if (rc == -2)
+        return "-ERR resulting score is not a number (NaN)\r\n";
+    return Resp::dbl(formatScore(score));
+}
+
+std::string RedisCommandHandler::handleZrem(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() < 3)
+        return "-ERR wrong number of arguments for 'zrem' command\r\n";
+    std::vector<std::string> members(tokens.begin() + 2, tokens.end());
+    return ":" + std::to_string(db.zrem(tokens[1], members)) + "\r\n";
+}
+
+std::string RedisCommandHandler::handleZscore(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() != 3)
+        return "-ERR wrong number of arguments for 'zscore' command\r\n";
+    double score;
+    if (!db.zscore(tokens[1], tokens[2], score))
+        return Resp::null();
+    return Resp::dbl(formatScore(score));
+}
+
+std::string RedisCommandHandler::handleZcard(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() != 2)
+        return "-ERR wrong number of arguments for 'zcard' command\r\n";
+    return ":" + std::to_string(db.zcard(tokens[1])) + "\r\n";
+}
+
+static std::string zrankReply(const std::vector<std::string>& tokens, bool reverse, RedisDatabase& db) {
+    if (tokens.size() != 3)
+        return "-ERR wrong number of arguments for 'zrank' command\r\n";
+    long rank = db.zrank(tokens[1], tokens[2], reverse);
+    if (rank < 0)
+        return Resp::null();
+    return ":" + std::to_string(rank) + "\r\n";
+}
+
+std::string RedisCommandHandler::handleZrank(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    return zrankReply(tokens, false, db);
+}
+
+std::string RedisCommandHandler::handleZrevrank(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    return zrankReply(tokens, true, db);
+}
+
+// ZRANGE/ZREVRANGE key start stop [WITHSCORES]
+static std::string zrangeReply(const std::vector<std::string>& tokens, bool reverse, RedisDatabase& db) {
+    if (tokens.size() != 4 && tokens.size() != 5)
+        return "-ERR wrong number of arguments for 'zrange' command\r\n";
+    bool withScores = false;
+    if (tokens.size() == 5) {
+        std::string opt = tokens[4];
+        std::transform(opt.begin(), opt.end(), opt.begin(), ::toupper);
+        if (opt != "WITHSCORES")
+            return "-ERR syntax error\r\n";
+        withScores = true;
+    }
+    try {
+        return zsetReply(db.zrange(tokens[1], std::stol(tokens[2]), std::stol(tokens[3]), reverse), withScores);
+    } catch (const std::exception&) {
+        return "-ERR value is not an integer or out of range\r\n";
+    }
+}
+
+std::string RedisCommandHandler::handleZrange(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    return zrangeReply(tokens, false, db);
+}
+
+std::string RedisCommandHandler::handleZrevrange(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    return zrangeReply(tokens, true, db);
+}
+
+// ZRANGEBYSCORE key min max [WITHSCORES] [LIMIT offset count]
+std::string RedisCommandHandler::handleZrangebyscore(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() < 4)
+        return "-ERR wrong number of arguments for 'zrangebyscore' command\r\n";
+    ScoreRange range;
+    if (!parseScoreBound(tokens[2], range.min, range.minExclusive) ||
+        !parseScoreBound(tokens[3], range.max, range.maxExclusive))
+        return "-ERR min or max is not a float\r\n";
+    bool withScores = false;
+    long offset = 0, count = -1;
+    for (size_t i = 4; i < tokens.size(); ++i) {
+        std::string opt = tokens[i];
+        std::transform(opt.begin(), opt.end(), opt.begin(), ::toupper);
+        if (opt == "WITHSCORES") {
+            withScores = true;
+        } else if (opt == "LIMIT" && i + 2 < tokens.size()) {
+            try {
+                offset = std::stol(tokens[i + 1]);
+                count = std::stol(tokens[i + 2]);
+            } catch (const std::exception&) {
+                return "-ERR value is not an integer or out of range\r\n";
+            }
+            i += 2;
+        } else {
+            return "-ERR syntax error\r\n";
+        }
+    }
+    if (offset < 0)
+        return "*0\r\n";
+    return zsetReply(db.zrangebyscore(tokens[1], range, offset, count < 0 ? -1 : count), withScores);
+}
+
+//Set Operations
+
+std::string RedisCommandHandler::handleSadd(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() < 3)
+        return "-ERR wrong number of arguments for 'sadd' command\r\n";
+    std::vector<std::string> members(tokens.begin() + 2, tokens.end());
+    ssize_t added = db.sadd(tokens[1], members);
+    if (added < 0)
+        return "-WRONGTYPE Operation against a key holding the wrong kind of value\r\n";
+    return ":" + std::to_string(added) + "\r\n";
+}
+
+std::string RedisCommandHandler::handleSrem(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() < 3)
+        return "-ERR wrong number of arguments for 'srem' command\r\n";
+    std::vector<std::string> members(tokens.begin() + 2, tokens.end());
+    return ":" + std::to_string(db.srem(tokens[1], members)) + "\r\n";
+}
+
+std::string RedisCommandHandler::handleSismember(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() != 3)
+        return "-ERR wrong number of arguments for 'sismember' command\r\n";
+    return db.sismember(tokens[1], tokens[2]) ? ":1\r\n" : ":0\r\n";
+}
+
+std::string RedisCommandHandler::handleSmembers(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() != 2)
+        return "-ERR wrong number of arguments for 'smembers' command\r\n";
+    return setReply(db.smembers(tokens[1]));
+}
+
+std::string RedisCommandHandler::handleScard(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() != 2)
+        return "-ERR wrong number of arguments for 'scard' command\r\n";
+    return ":" + std::to_string(db.scard(tokens[1])) + "\r\n";
+}
+
+// SINTER/SUNION/SDIFF key [key ...]
+static std::string setAlgebraReply(const std::vector<std::string>& tokens, RedisDatabase& db,
+                                   bool (RedisDatabase::*op)(const std::vector<std::string>&, std::vector<std::string>&)) {
+    if (tokens.size() < 2) {
+        std::string name = tokens[0];
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        return "-ERR wrong number of arguments for '" + name + "' command\r\n";
+    }
+    std::vector<std::string> keys(tokens.begin() + 1, tokens.end());
+    std::vector<std::string> members;
+    if (!(db.*op)(keys, members))
+        return "-WRONGTYPE Operation against a key holding the wrong kind of value\r\n";
+    return setReply(members);
+}
+
+std::string RedisCommandHandler::handleSinter(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    return setAlgebraReply(tokens, db, &RedisDatabase::sinter);
+}
+
+std::string RedisCommandHandler::handleSunion(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    return setAlgebraReply(tokens, db, &RedisDatabase::sunion);
+}
+
+std::string RedisCommandHandler::handleSdiff(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    return setAlgebraReply(tokens, db, &RedisDatabase::sdiff);
+}
+
+//Stream Operations
+
+static const char* kWrongType = "-WRONGTYPE Operation against a key holding the wrong kind of value\r\n";
+static const char* kInvalidStreamId = "-ERR Invalid stream ID specified as stream command argument\r\n";
+
+static uint64_t unixMillis() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static std::string upper(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), ::toupper);
+    return s;
+}
+
+static bool parseNonNegative(const std::string& s, long long& out) {
+    char* end = nullptr;
+    errno = 0;
+    out = std::strtoll(s.c_str(), &end, 10);
+    return !s.empty() && *end == '\0' && errno != ERANGE && out >= 0;
+}
+
+// Stream writes replicate what they did rather than what was asked: the id "*"
+// picked, an approximate trim's result, the entries a group read handed out.
+// Call with the db lock held (inside withStream); execute() flushes it after the handler.
+static void propagateStream(const ClientSession& session, std::vector<std::string> tokens) {
+    Replication& repl = Replication::getInstance();
+    if (repl.active() && !session.isMaster) {
+        repl.propagateLater(std::move(tokens));
+    }
+}
+
+// [id, [field, value, ...]], or [id, nil] for a pending entry that was deleted since
+static std::string entryReply(const StreamEntry& entry) {
+    std::string out = "*2\r\n" + bulk(entry.id.str());
+    if (entry.deleted)
+        return out + Resp::nullArray();
+    out += "*" + std::to_string(entry.fields.size()) + "\r\n";
+    for (const auto& s : entry.fields)
+        out += bulk(s);
+    return out;
+}
+
+// XREAD/XREADGROUP :- a map key -> entries in RESP3, [[key, entries], ...] in RESP2
+static std::string streamsHeader(size_t streams) {
+    return Resp::protocol() == 3 ? Resp::map(streams) : "*" + std::to_string(streams) + "\r\n";
+}
+
+static std::string entriesReply(const std::vector<StreamEntry>& entries);
+
+static std::string streamReply(const std::string& key, const std::vector<StreamEntry>& entries) {
+    return (Resp::protocol() == 3 ? "" : "*2\r\n") + bulk(key) + entriesReply(entries);
+}
+
+static std::string entriesReply(const std::vector<StreamEntry>& entries) {
+    std::string out = "*" + std::to_string(entries.size()) + "\r\n";
+    for (const auto& e : entries)
+        out += entryReply(e);
+    return out;
+}
+
+// XRANGE bounds :- "-" and "+" are the ends of the id space, "(" makes a bound exclusive,
+// a bare <ms> means <ms>-0 as a start and <ms>-<max> as an end
+static bool parseRangeBound(const std::string& s, bool start, StreamID& id) {
+    if (s == "-" || s == "+") {
+        id = s == "-" ? StreamID::min() : StreamID::max();
+        return true;
+    }
+    bool exclusive = !s.empty() && s[0] == '(';
+    if (!StreamID::parse(exclusive ? s.substr(1) : s, id, start ? 0 : UINT64_MAX))
+        return false;
+    return !exclusive || (start ? id.increment() : id.decrement());
+}
+
+// MAXLEN [=|~] threshold, i at the token after MAXLEN and moved past the threshold
+static bool parseMaxLen(const std::vector<std::string>& tokens, size_t& i, long long& maxLen, bool& approx) {
+    approx = false;
+    if (i < tokens.size() && (tokens[i] == "=" || tokens[i] == "~")) {
+        approx = tokens[i] == "~";
+        ++i;
+    }
+    return i < tokens.size() && parseNonNegative(tokens[i++], maxLen);
+}
+
+// XADD key [NOMKSTREAM] [MAXLEN [=|~] threshold] *|id|<ms>-* field value [field value ...]
+std::string RedisCommandHandler::handleXadd(const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db) {
+    if (tokens.size() < 5)
+        return "-ERR wrong number of arguments for 'xadd' command\r\n";
+    bool noMkStream = false, approx = false;
+    long long maxLen = -1;
+    size_t i = 2;
+    while (i < tokens.size()) {
+        std::string opt = upper(tokens[i]);
+        if (opt == "NOMKSTREAM") {
+            noMkStream = true;
+            ++i;
+        } else if (opt == "MAXLEN") {
+            ++i;
+            if (!parseMaxLen(tokens, i, maxLen, approx))
+                return "-ERR value is not an integer or out of range\r\n";
+        } else {
+            break;
+        }
+    }
+    if (i + 1 >= tokens.size() || (tokens.size() - i - 1) % 2 != 0)
+        return "-ERR wrong number of arguments for 'xadd' command\r\n";
+
+    const std::string& idArg = tokens[i];
+    StreamID id;
+    bool autoMs = idArg == "*", autoSeq = false;
+    if (!autoMs) {
+        size_t dash = idArg.find('-');
+        autoSeq = dash != std::string::npos && idArg.compare(dash + 1, std::string::npos, "*") == 0;
+        if (!StreamID::parse(autoSeq ? idArg.substr(0, dash) : idArg, id, 0))
+            return kInvalidStreamId;
+        if (!autoSeq && id == StreamID::min())
+            return "-ERR The ID specified in XADD must be greater than 0-0\r\n";
+    }
+    std::vector<std::string> fields(tokens.begin() + i + 1, tokens.end());
+
+    bool tooSmall = false;
+    int found = db.withStream(tokens[1], !noMkStream, true, [&](Stream& stream) {
+        if (!stream.nextId(id, autoMs, autoSeq, unixMillis())) {
+            tooSmall = true;
+            return;
+        }
+        stream.add(id, fields);
+        std::vector<std::string> add = {"XADD", tokens[1], id.str()};
+        add.insert(add.end(), fields.begin(), fields.end());
+        propagateStream(session, std::move(add));
+        if (maxLen >= 0 && stream.trim(static_cast<size_t>(maxLen), approx) > 0) {
+            propagateStream(session, {"XTRIM", tokens[1], "MAXLEN", std::to_string(stream.size())});
+        }
+    });
+    if (found < 0)
+        return kWrongType;
+    if (found == 0)
+        return Resp::null();
+    if (tooSmall)
+        return "-ERR The ID specified in XADD is equal or smaller than the target stream top item\r\n";
+    return bulk(id.str());
+}
+
+std::string RedisCommandHandler::handleXlen(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() != 2)
+        return "-ERR wrong number of arguments for 'xlen' command\r\n";
+    size_t length = 0;
+    if (db.withStream(tokens[1], false, false, [&](Stream& stream) { length = stream.size(); }) < 0)
+        return kWrongType;
+    return ":" + std::to_string(length) + "\r\n";
+}
+
+// XRANGE key start end [COUNT n] / XREVRANGE key end start [COUNT n]
+static std::string xrangeReply(const std::vector<std::string>& tokens, bool reverse, RedisDatabase& db) {
+    if (tokens.size() != 4 && tokens.size() != 6)
+        return std::string("-ERR wrong number of arguments for '") + (reverse ? "xrevrange" : "xrange") + "' command\r\n";
+    StreamID start, end;
+    if (!parseRangeBound(tokens[reverse ? 3 : 2], true, start) || !parseRangeBound(tokens[reverse ? 2 : 3], false, end))
+        return kInvalidStreamId;
+    long long count = 0;
+    if (tokens.size() == 6) {
+        if (upper(tokens[4]) != "COUNT")
+            return "-ERR syntax error\r\n";
+        if (!parseNonNegative(tokens[5], count))
+            return "-ERR value is not an integer or out of range\r\n";
+        if (count == 0)
+            return "*0\r\n";
+    }
+    std::vector<StreamEntry> entries;
+    int found = db.withStream(tokens[1], false, false, [&](Stream& stream) {
+        stream.range(start, end, static_cast<size_t>(count), reverse, entries);
+    });
+    if (found < 0)
+        return kWrongType;
+    return entriesReply(entries);
+}
+
+std::string RedisCommandHandler::handleXrange(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    return xrangeReply(tokens, false, db);
+}
+
+std::string RedisCommandHandler::handleXrevrange(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    return xrangeReply(tokens, true, db);
+}
+
+// XDEL key id [id ...]
+std::string RedisCommandHandler::handleXdel(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() < 3)
+        return "-ERR wrong number of arguments for 'xdel' command\r\n";
+    std::vector<StreamID> ids(tokens.size() - 2);
+    for (size_t i = 2; i < tokens.size(); ++i) {
+        if (!StreamID::parse(tokens[i], ids[i - 2], 0))
+            return kInvalidStreamId;
+    }
+    size_t removed = 0;
+    if (db.withStream(tokens[1], false, true, [&](Stream& stream) { removed = stream.remove(ids); }) < 0)
+        return kWrongType;
+    return ":" + std::to_string(removed) + "\r\n";
+}
+
+// XTRIM key MAXLEN [=|~] threshold
+std::string RedisCommandHandler::handleXtrim(const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db) {
+    if (tokens.size() < 4)
+        return "-ERR wrong number of arguments for 'xtrim' command\r\n";
+    if (upper(tokens[2]) != "MAXLEN")
+        return "-ERR syntax error\r\n";
+    size_t i = 3;
+    long long maxLen = 0;
+    bool approx = false;
+    if (!parseMaxLen(tokens, i, maxLen, approx))
+        return "-ERR value is not an integer or out of range\r\n";
+    if (i != tokens.size())
+        return "-ERR syntax error\r\n";
+    size_t removed = 0;
+    int found = db.withStream(tokens[1], false, true, [&](Stream& stream) {
+        removed = stream.trim(static_cast<size_t>(maxLen), approx);
+        if (removed > 0)
+            propagateStream(session, {"XTRIM", tokens[1], "MAXLEN", std::to_string(stream.size())});
+    });
+    if (found < 0)
+        return kWrongType;
+    return ":" + std::to_string(removed) + "\r\n";
+}
+
+// [COUNT n] [BLOCK ms] [NOACK] STREAMS key [key ...] id [id ...] starting at tokens[i];
+// NOACK only for XREADGROUP. Empty string if fine, else the error reply.
+static std::string parseStreamsArgs(const std::vector<std::string>& tokens, size_t i, bool group, long long& count,
+                                    long long& block, bool& noack, std::vector<std::string>& keys, std::vector<std::string>& ids) {
+    count = 0;
+    block = -1;
+    noack = false;
+    for (; i < tokens.size(); ++i) {
+        std::string opt = upper(tokens[i]);
+        if ((opt == "COUNT" || opt == "BLOCK") && i + 1 < tokens.size()) {
+            if (!parseNonNegative(tokens[++i], opt == "COUNT" ? count : block))
+                return opt == "BLOCK" ? "-ERR timeout is not an integer or out of range\r\n"
+                                      : "-ERR value is not an integer or out of range\r\n";
+        } else if (opt == "NOACK" && group) {
+            noack = true;
+        } else if (opt == "STREAMS") {
+            break;
+        } else {
+            return "-ERR syntax error\r\n";
+        }
+    }
+    size_t rest = i < tokens.size() ? tokens.size() - i - 1 : 0;
+    if (rest == 0 || rest % 2 != 0)
+        return "-ERR Unbalanced '" + std::string(group ? "xreadgroup" : "xread") +
+               "' list of streams: for each stream key an ID or '$' must be specified.\r\n";
+    keys.assign(tokens.begin() + i + 1, tokens.begin() + i + 1 + rest / 2);
+    ids.assign(tokens.begin() + i + 1 + rest / 2, tokens.end());
+    return "";
+}
+
+// Run a stream read that may block. Inside EXEC/EVAL it never waits.
+static bool readOrBlock(const std::vector<std::string>& keys, long long block, const std::function<bool()>& attempt,
+                        ClientSession& session, RedisDatabase& db) {
+    if (block < 0 || session.inAtomic) {
+        auto lock = db.acquireLock();
+        return attempt();
+    }
+    int socket = session.socket;
+    return db.blockOnStreams(keys, std::chrono::milliseconds(block), attempt, [socket]() { return clientHungUp(socket); });
+}
+
+// XREAD [COUNT n] [BLOCK ms] STREAMS key [key ...] id|$ [id|$ ...]
+std::string RedisCommandHandler::handleXread(const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db) {
+    long long count, block;
+    bool noack;
+    std::vector<std::string> keys, idArgs;
+    std::string error = parseStreamsArgs(tokens, 1, false, count, block, noack, keys, idArgs);
+    if (!error.empty())
+        return error;
+
+    // "$" :- only entries added from now on
+    std::vector<StreamID> after(keys.size());
+    for (size_t k = 0; k < keys.size(); ++k) {
+        if (idArgs[k] == "$") {
+            if (db.withStream(keys[k], false, false, [&](Stream& stream) { after[k] = stream.lastId(); }) < 0)
+                return kWrongType;
+        } else if (!StreamID::parse(idArgs[k], after[k], 0)) {
+            return kInvalidStreamId;
+        }
+    }
+
+    std::string reply;
+    auto attempt = [&]() -> bool {
+        std::string body;
+        size_t streams = 0;
+        for (size_t k = 0; k < keys.size(); ++k) {
+            StreamID start = after[k];
+            std::vector<StreamEntry> entries;
+            if (!start.increment())
+                continue;
+            int found = db.withStream(keys[k], false, false, [&](Stream& stream) {
+                stream.range(start, StreamID::max(), static_cast<size_t>(count), false, entries);
+            });
+            if (found < 0) {
+                reply = kWrongType;
+                return true;
+            }
+            if (entries.empty())
+                continue;
+            ++streams;
+            body += streamReply(keys[k], entries);
+        }
+        if (streams == 0)
+            return false;
+        reply = streamsHeader(streams) + body;
+        return true;
+    };
+    if (!readOrBlock(keys, block, attempt, session, db))
+        return Resp::nullArray();
+    return reply;
+}
+
+// XREADGROUP GROUP group consumer [COUNT n] [BLOCK ms] [NOACK] STREAMS key [key ...] >|id [>|id ...]
+// ">" hands out entries no consumer of the group got yet, an id re-reads the consumer's own pending entries
+std::string RedisCommandHandler::handleXreadgroup(const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db) {
+    if (tokens.size() < 7 || upper(tokens[1]) != "GROUP")
+        return "-ERR wrong number of arguments for 'xreadgroup' command\r\n";
+    const std::string& group = tokens[2];
+    const std::string& consumer = tokens[3];
+    long long count, block;
+    bool noack;
+    std::vector<std::string> keys, idArgs;
+    std::string error = parseStreamsArgs(tokens, 4, true, count, block, noack, keys, idArgs);
+    if (!error.empty())
+        return error;
+    std::vector<StreamID> after(keys.size());
+    for (size_t k = 0; k < keys.size(); ++k) {
+        if (idArgs[k] != ">" && !StreamID::parse(idArgs[k], after[k], 0))
+            return kInvalidStreamId;
+    }
+
+    std::string reply;
+    auto attempt = [&]() -> bool {
+        std::string body;
+        size_t streams = 0;
+        for (size_t k = 0; k < keys.size(); ++k) {
+            bool fresh = idArgs[k] == ">";
+            bool noGroup = false;
+            std::vector<StreamEntry> entries;
+            int found = db.withStream(keys[k], false, fresh, [&](Stream& stream) {
+                Stream::Group* g = stream.group(group);
+                if (!g) {
+                    noGroup = true;
+                    return;
+                }
+                if (!fresh) {
+                    stream.readPending(*g, consumer, after[k], static_cast<size_t>(count), unixMillis(), entries);
+                    return;
+                }
+                if (g->consumers.count(consumer) == 0)
+                    propagateStream(session, {"XGROUP", "CREATECONSUMER", keys[k], group, consumer});
+                stream.readNew(*g, consumer, static_cast<size_t>(count), noack, unixMillis(), entries);
+                if (entries.empty())
+                    return;
+                // Replicas get the group's new state: the PEL entries as a forced claim, or just the last id
+                if (noack) {
+                    propagateStream(session, {"XGROUP", "SETID", keys[k], group, g->lastDelivered.str()});
+                    return;
+                }
+                std::vector<std::string> claim = {"XCLAIM", keys[k], group, consumer, "0"};
+                for (const auto& e : entries)
+                    claim.push_back(e.id.str());
+                claim.insert(claim.end(), {"FORCE", "LASTID", g->lastDelivered.str()});
+                propagateStream(session, std::move(claim));
+            });
+            if (found < 0) {
+                reply = kWrongType;
+                return true;
+            }
+            if (found == 0 || noGroup) {
+                reply = "-NOGROUP No such key '" + keys[k] + "' or consumer group '" + group +
+                        "' in XREADGROUP with GROUP option\r\n";
+                return true;
+            }
+            if (fresh && entries.empty())
+                continue; // history reads answer even when empty
+            ++streams;
+            body += streamReply(keys[k], entries);
+        }
+        if (streams == 0)
+            return false;
+        reply = streamsHeader(streams) + body;
+        return true;
+    };
+    if (!readOrBlock(keys, block, attempt, session, db))
+        return Resp::nullArray();
+    return reply;
+}
+
+// XGROUP CREATE key group id|$ [MKSTREAM] | SETID key group id|$ | DESTROY key group
+//      | CREATECONSUMER key group consumer | DELCONSUMER key group consumer
+std::string RedisCommandHandler::handleXgroup(const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db) {
+    if (tokens.size() < 4)
+        return "-ERR wrong number of arguments for 'xgroup' command\r\n";
+    std::string sub = upper(tokens[1]);
+    const std::string& key = tokens[2];
+    const std::string& name = tokens[3];
+    bool mkStream = sub == "CREATE" && tokens.size() == 6 && upper(tokens[5]) == "MKSTREAM";
+    size_t wanted = sub == "DESTROY" ? 4 : mkStream ? 6 : 5;
+    if (sub != "CREATE" && sub != "SETID" && sub != "DESTROY" && sub != "CREATECONSUMER" && sub != "DELCONSUMER")
+        return "-ERR unknown subcommand '" + tokens[1] + "'. Try XGROUP HELP.\r\n";
+    if (tokens.size() != wanted)
+        return "-ERR syntax error\r\n";
+    StreamID id;
+    bool dollar = (sub == "CREATE" || sub == "SETID") && tokens[4] == "$";
+    if ((sub == "CREATE" || sub == "SETID") && !dollar && !StreamID::parse(tokens[4], id, 0))
+        return kInvalidStreamId;
+
+    std::string reply;
+    int found = db.withStream(key, mkStream, true, [&](Stream& stream) {
+        if (dollar)
+            id = stream.lastId();
+        if (sub == "CREATE") {
+            if (!stream.createGroup(name, id)) {
+                reply = "-BUSYGROUP Consumer Group name already exists\r\n";
+                return;
+            }
+            propagateStream(session, {"XGROUP", "CREATE", key, name, id.str(), "MKSTREAM"});
+            reply = "+OK\r\n";
+            return;
+        }
+        if (sub == "DESTROY") {
+            bool destroyed = stream.destroyGroup(name);
+            if (destroyed)
+                propagateStream(session, tokens);
+            reply = destroyed ? ":1\r\n" : ":0\r\n";
+            return;
+        }
+        Stream::Group* g = stream.group(name);
+        if (!g) {
+            reply = "-NOGROUP No such consumer group '" + name + "' for key name '" + key + "'\r\n";
+            return;
+        }
+        if (sub == "SETID") {
+            g->lastDelivered = id;
+            propagateStream(session, {"XGROUP", "SETID", key, name, id.str()});
+            reply = "+OK\r\n";
+        } else if (sub == "CREATECONSUMER") {
+            bool created = g->consumers.count(tokens[4]) == 0;
+            stream.consumer(*g, tokens[4], unixMillis());
+            if (created)
+                propagateStream(session, tokens);
+            reply = created ? ":1\r\n" : ":0\r\n";
+        } else {
+            long pending = stream.deleteConsumer(*g, tokens[4]);
+            if (pending >= 0)
+                propagateStream(session, tokens);
+            reply = ":" + std::to_string(std::max(0L, pending)) + "\r\n";
+        }
+    });
+    if (found < 0)
+        return kWrongType;
+    if (found == 0)
+        return "-ERR The XGROUP subcommand requires the key to exist. Note that for CREATE you may want to use "
+               "the MKSTREAM option to create an empty stream automatically.\r\n";
+    return reply;
+}
+
+// XACK key group id [id ...]
+std::string RedisCommandHandler::handleXack(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() < 4)
+        return "-ERR wrong number of arguments for 'xack' command\r\n";
+    std::vector<StreamID> ids(tokens.size() - 3);
+    for (size_t i = 3; i < tokens.size(); ++i) {
+        if (!StreamID::parse(tokens[i], ids[i - 3], 0))
+            return kInvalidStreamId;
+    }
+    size_t acked = 0;
+    int found = db.withStream(tokens[1], false, true, [&](Stream& stream) {
+        Stream::Group* g = stream.group(tokens[2]);
+        if (g)
+            acked = stream.ack(*g, ids);
+    });
+    if (found < 0)
+        return kWrongType;
+    return ":" + std::to_string(acked) + "\r\n";
+}
+
+// XPENDING key group :- summary (count, smallest and greatest id, count per consumer)
+// XPENDING key group [IDLE min-idle] start end count [consumer] :- one line per pending entry
+std::string RedisCommandHandler::handleXpending(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() < 3)
+        return "-ERR wrong number of arguments for 'xpending' command\r\n";
+    bool extended = tokens.size() > 3;
+    long long minIdle = 0, count = 0;
+    size_t i = 3;
+    StreamID start, end;
+    if (extended) {
+        if (upper(tokens[i]) == "IDLE") {
+            if (i + 1 >= tokens.size() || !parseNonNegative(tokens[i + 1], minIdle))
+                return "-ERR value is not an integer or out of range\r\n";
+            i += 2;
+        }
+        if (tokens.size() - i != 3 && tokens.size() - i != 4)
+            return "-ERR syntax error\r\n";
+        if (!parseRangeBound(tokens[i], true, start) || !parseRangeBound(tokens[i + 1], false, end))
+            return kInvalidStreamId;
+        if (!parseNonNegative(tokens[i + 2], count))
+            return "-ERR value is not an integer or out of range\r\n";
+    }
+    const std::string* onlyConsumer = extended && tokens.size() - i == 4 ? &tokens[i + 3] : nullptr;
+
+    std::string reply;
+    bool noGroup = false;
+    int found = db.withStream(tokens[1], false, false, [&](Stream& stream) {
+        Stream::Group* g = stream.group(tokens[2]);
+        if (!g) {
+            noGroup = true;
+            return;
+        }
+        if (!extended) {
+            StreamID first, last;
+            if (!g->pel.first(&first)) {
+                reply = "*4\r\n:0\r\n" + Resp::null() + Resp::null() + Resp::nullArray();
+                return;
+            }
+            g->pel.last(&last);
+            std::string perConsumer;
+            size_t consumers = 0;
+            for (const auto& c : g->consumers) {
+                if (c.second.pending.empty())
+                    continue;
+                ++consumers;
+                perConsumer += "*2\r\n" + bulk(c.first) + bulk(std::to_string(c.second.pending.size()));
+            }
+            reply = "*4\r\n:" + std::to_string(g->pel.size()) + "\r\n" + bulk(first.str()) + bulk(last.str()) +
+                    "*" + std::to_string(consumers) + "\r\n" + perConsumer;
+            return;
+        }
+        uint64_t now = unixMillis();
+        std::string lines;
+        long long n = 0;
+        StreamID id;
+        for (const Stream::Pending* p = g->pel.ceil(start, &id); p && id <= end && n < count; p = g->pel.next(id, &id)) {
+            uint64_t idle = now > p->deliveryTime ? now - p->deliveryTime : 0;
+            if ((onlyConsumer && p->consumer != *onlyConsumer) || idle < static_cast<uint64_t>(minIdle))
+                continue;
+            ++n;
+            lines += "*4\r\n" + bulk(id.str()) + bulk(p->consumer) + ":" + std::to_string(idle) + "\r\n:" +
+                     std::to_string(p->deliveries) + "\r\n";
+        }
+        reply = "*" + std::to_string(n) + "\r\n" + lines;
+    });
+    if (found < 0)
+        return kWrongType;
+    if (found == 0 || noGroup)
+        return "-NOGROUP No such key '" + tokens[1] + "' or consumer group '" + tokens[2] + "'\r\n";
+    return reply;
+}
+
+// XCLAIM key group consumer min-idle-time id [id ...] [FORCE] [JUSTID] [LASTID id]
+std::string RedisCommandHandler::handleXclaim(const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db) {
+    if (tokens.size() < 6)
+        return "-ERR wrong number of arguments for 'xclaim' command\r\n";
+    long long minIdle = 0;
+    if (!parseNonNegative(tokens[4], minIdle))
+        return "-ERR Invalid min-idle-time argument for XCLAIM\r\n";
+    std::vector<StreamID> ids;
+    size_t i = 5;
+    for (StreamID id; i < tokens.size() && StreamID::parse(tokens[i], id, 0); ++i)
+        ids.push_back(id);
+    bool force = false, justId = false, hasLastId = false;
+    StreamID lastId;
+    for (; i < tokens.size(); ++i) {
+        std::string opt = upper(tokens[i]);
+        if (opt == "FORCE") {
+            force = true;
+        } else if (opt == "JUSTID") {
+            justId = true;
+        } else if (opt == "LASTID" && i + 1 < tokens.size()) {
+            if (!StreamID::parse(tokens[++i], lastId, 0))
+                return kInvalidStreamId;
+            hasLastId = true;
+        } else {
+            return "-ERR syntax error\r\n";
+        }
+    }
+    if (ids.empty())
+        return kInvalidStreamId;
+
+    std::vector<StreamEntry> entries;
+    std::vector<StreamID> claimed;
+    bool noGroup = false;
+    int found = db.withStream(tokens[1], false, true, [&](Stream& stream) {
+        Stream::Group* g = stream.group(tokens[2]);
+        if (!g) {
+            noGroup = true;
+            return;
+        }
+        if (hasLastId && lastId > g->lastDelivered)
+            g->lastDelivered = lastId;
+        stream.claim(*g, tokens[3], static_cast<uint64_t>(minIdle), ids, force, !justId, unixMillis(), claimed);
+        for (const auto& id : claimed) {
+            StreamEntry e;
+            if (!justId && stream.get(id, e))
+                entries.push_back(std::move(e));
+        }
+        if (claimed.empty()) {
+            if (hasLastId)
+                propagateStream(session, {"XGROUP", "SETID", tokens[1], tokens[2], g->lastDelivered.str()});
+            return;
+        }
+        // min-idle 0 and FORCE :- the replica claims exactly what we did
+        std::vector<std::string> claim = {"XCLAIM", tokens[1], tokens[2], tokens[3], "0"};
+        for (const auto& id : claimed)
+            claim.push_back(id.str());
+        claim.push_back("FORCE");
+        if (justId)
+            claim.push_back("JUSTID");
+        claim.insert(claim.end(), {"LASTID", g->lastDelivered.str()});
+        propagateStream(session, std::move(claim));
+    });
+    if (found < 0)
+        return kWrongType;
+    if (found == 0 || noGroup)
+        return "-NOGROUP No such key '" + tokens[1] + "' or consumer group '" + tokens[2] + "'\r\n";
+    if (!justId)
+        return entriesReply(entries);
+    std::string out = "*" + std::to_string(claimed.size()) + "\r\n";
+    for (const auto& id : claimed)
+        out += bulk(id.str());
+    return out;
+}
+
+// XINFO STREAM key | GROUPS key | CONSUMERS key group
+std::string RedisCommandHandler::handleXinfo(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() < 3)
+        return "-ERR wrong number of arguments for 'xinfo' command\r\n";
+    std::string sub = upper(tokens[1]);
+    if (sub != "STREAM" && sub != "GROUPS" && sub != "CONSUMERS")
+        return "-ERR unknown subcommand '" + tokens[1] + "'. Try XINFO HELP.\r\n";
+    if (tokens.size() != (sub == "CONSUMERS" ? 4u : 3u))
+        return "-ERR wrong number of arguments for 'xinfo|" + upper(tokens[1]) + "' command\r\n";
+
+    std::string reply;
+    int found = db.withStream(tokens[2], false, false, [&](Stream& stream) {
+        uint64_t now = unixMillis();
+        if (sub == "STREAM") {
+            StreamEntry first, last;
+            bool any = stream.firstEntry(first);
+            stream.lastEntry(last);
+            reply = Resp::map(7) + bulk("length") + ":" + std::to_string(stream.size()) + "\r\n" +
+                    bulk("radix-tree-keys") + ":" + std::to_string(stream.nodeCount()) + "\r\n" +
+                    bulk("radix-tree-nodes") + ":" + std::to_string(stream.radixNodes()) + "\r\n" +
+                    bulk("last-generated-id") + bulk(stream.lastId().str()) +
+                    bulk("groups") + ":" + std::to_string(stream.groupList().size()) + "\r\n" +
+                    bulk("first-entry") + (any ? entryReply(first) : Resp::null()) +
+                    bulk("last-entry") + (any ? entryReply(last) : Resp::null());
+        } else if (sub == "GROUPS") {
+            reply = "*" + std::to_string(stream.groupList().size()) + "\r\n";
+            for (const auto& g : stream.groupList()) {
+                reply += Resp::map(4) + bulk("name") + bulk(g.first) +
+                         bulk("consumers") + ":" + std::to_string(g.second.consumers.size()) + "\r\n" +
+                         bulk("pending") + ":" + std::to_string(g.second.pel.size()) + "\r\n" +
+                         bulk("last-delivered-id") + bulk(g.second.lastDelivered.str());
+            }
+        } else {
+            Stream::Group* g = stream.group(tokens[3]);
+            if (!g) {
+                reply = "-NOGROUP No such consumer group '" + tokens[3] + "' for key name '" + tokens[2] + "'\r\n";
+                return;
+            }
+            reply = "*" + std::to_string(g->consumers.size()) + "\r\n";
+            for (const auto& c : g->consumers) {
+                uint64_t idle = now > c.second.seenTime ? now - c.second.seenTime : 0;
+                reply += Resp::map(3) + bulk("name") + bulk(c.first) +
+                         bulk("pending") + ":" + std::to_string(c.second.pending.size()) + "\r\n" +
+                         bulk("idle") + ":" + std::to_string(idle) + "\r\n";
+            }
+        }
+    });
+    if (found < 0)
+        return kWrongType;
+    if (found == 0)
+        return "-ERR no such key\r\n";
+    return reply;
+}
@@ -0,0 +1,442 @@
+#include "../include/IoThreads.h"
+#include "../include/RedisCommandHandler.h"
+#include "../include/IoUring.h"
+#include "../include/ClientRegistry.h"
+#include "../include/OutputLimits.h"
+#include <unordered_map>
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+struct IoThreads::Connection : WorkerPool::Task {
+    int fd = -1;
+    Worker* worker = nullptr;
+    std::string in;
+    std::string out;
+    uint32_t events = 0;          // epoll interest currently registered
+    bool inFlight = false;        // the batch is with the executors, which own session meanwhile
+    bool eof = false;             // peer shut down its side :- finish what it sent, then close
+    bool closing = false;         // gone while in flight, closed when the batch comes back
+    bool closeAfterWrite = false; // protocol error
+    ClientSession session;
+    OutputGuard guard;
+    std::vector<std::vector<std::string>> batch;
+    std::string reply;
+};
+
+struct IoThreads::Worker {
+    int epollFd = -1;
+    int wakeFd = -1; // eventfd :- new connections or finished batches
+    std::thread thread;
+    std::unordered_map<int, std::unique_ptr<Connection>> connections; // by fd
+
+    std::mutex mutex; // guards incoming and done
+    std::vector<std::pair<int, std::shared_ptr<ClientInfo>>> incoming; // accepted sockets and their registry entries
+    std::vector<Connection*> done;                  // batches the executors finished
+
+    std::vector<WorkerPool::Task*> submit; // batches made this iteration, queued together
+    uint64_t syscalls = 0;           // since the last report to IoBackend
+    uint64_t operations = 0;
+    std::chrono::steady_clock::time_point lastLimitCheck;
+};
+
+namespace {
+
+// Waiting commands block the thread running them; PSYNC turns the connection into a replica link
+bool takesOver(const std::vector<std::string>& tokens) {
+    std::string cmd = tokens[0];
+    std::transform(cmd.begin(), cmd.end(), cmd.begin(), ::toupper);
+    if (cmd == "BLPOP" || cmd == "BRPOP" || cmd == "BLMOVE" || cmd == "SUBSCRIBE" || cmd == "PSUBSCRIBE" ||
+        cmd == "PSYNC" || cmd == "SYNC") {
+        return true;
+    }
+    if (cmd == "XREAD" || cmd == "XREADGROUP") {
+        for (const auto& token : tokens) {
+            std::string opt = token;
+            std::transform(opt.begin(), opt.end(), opt.begin(), ::toupper);
+            if (opt == "STREAMS")
+                break;
+            if (opt == "BLOCK")
+                return true;
+        }
+    }
+    return false;
+}
+
+void wake(int fd) {
+    uint64_t one = 1;
+    ssize_t ignored = write(fd, &one, sizeof(one));
+    (void)ignored;
+}
+
+} // namespace
+
+IoThreads::IoThreads(const ThreadOptions& options, RedisCommandHandler& handler, TakeOver takeOver)
+    : options(options), handler(handler), takeOver(std::move(takeOver)) {
+    size_t execThreads = std::max<size_t>(1, options.execThreads);
+    finished.resize(execThreads);
+    executors = std::make_unique<WorkerPool>(
+        execThreads, options.execCpus,
+        [this](WorkerPool::Task* task, size_t executor) { return execute(*static_cast<Connection*>(task), executor); },
+        [this](size_t executor) { deliver(executor); });
+    for (size_t i = 0; i < options.ioThreads; ++i) {
+        auto w = std::make_unique<Worker>();
+        w->epollFd = epoll_create1(0);
+        w->wakeFd = eventfd(0, EFD_NONBLOCK);
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = w->wakeFd;
+        epoll_ctl(w->epollFd, EPOLL_CTL_ADD, w->wakeFd, &ev);
+        workers.push_back(std::move(w));
+    }
+}
+
+IoThreads::~IoThreads() {
+    stop();
+    for (auto& w : workers) {
+        close(w->epollFd);
+        close(w->wakeFd);
+    }
+}
+
+void IoThreads::start() {
+    executors->start();
+    IoBackend::getInstance().setExecutors(executors.get());
+    for (size_t i = 0; i < workers.size(); ++i) {
+        Worker* worker = workers[i].get();
+        worker->thread = std::thread([this, worker, i]() { ioLoop(*worker, i); });
+    }
+}
+
+void IoThreads::stop() {
+    if (stopping.exchange(true)) {
+        return;
+    }
+    IoBackend::getInstance().setExecutors(nullptr);
+    executors->stop();
+    for (auto& w : workers) {
+        if (w->thread.joinable()) {
+            w->thread.join();
+        }
+        for (auto& entry : w->connections) {
+            handler.closeSession(entry.second->session);
+            close(entry.first);
+        }
+        w->connections.clear();
+        for (auto& pending : w->incoming) {
+            ClientRegistry::getInstance().remove(pending.second->id);
+            close(pending.first);
+        }
+    }
+}
+
+void IoThreads::adopt(int fd, std::shared_ptr<ClientInfo> info) {
+    Worker& w = *workers[nextWorker++ % workers.size()];
+    {
+        std::lock_guard<std::mutex> lock(w.mutex);
+        w.incoming.emplace_back(fd, std::move(info));
+    }
+    wake(w.wakeFd);
+}
+
+void IoThreads::ioLoop(Worker& w, size_t index) {
+    WorkerPool::pin(options.ioCpus, index);
+    epoll_event events[256];
+    std::vector<std::pair<int, std::shared_ptr<ClientInfo>>> incoming;
+    std::vector<Connection*> done;
+    while (!stopping) {
+        int n = epoll_wait(w.epollFd, events, 256, 100);
+        ++w.syscalls;
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == w.wakeFd) {
+                uint64_t count;
+                ssize_t ignored = read(w.wakeFd, &count, sizeof(count));
+                (void)ignored;
+                ++w.syscalls;
+                continue; // incoming and done are picked up below
+            }
+            auto it = w.connections.find(fd);
+            if (it == w.connections.end()) {
+                continue;
+            }
+            Connection& conn = *it->second;
+            bool alive = true;
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                alive = readConnection(w, conn);
+            }
+            if (alive && (events[i].events & EPOLLOUT)) {
+                alive = flush(w, conn);
+            }
+            if (!alive) {
+                closeConnection(w, conn);
+                continue;
+            }
+            advance(w, conn);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(w.mutex);
+            incoming.swap(w.incoming);
+            done.swap(w.done);
+        }
+        for (auto& accepted : incoming) {
+            auto conn = std::make_unique<Connection>();
+            conn->fd = accepted.first;
+            conn->worker = &w;
+            conn->session.socket = accepted.first;
+            conn->session.id = accepted.second->id;
+            conn->session.info = std::move(accepted.second);
+            int flags = fcntl(conn->fd, F_GETFL, 0);
+            fcntl(conn->fd, F_SETFL, flags | O_NONBLOCK);
+            epoll_event ev{};
+            ev.events = conn->events = EPOLLIN;
+            ev.data.fd = conn->fd;
+            epoll_ctl(w.epollFd, EPOLL_CTL_ADD, conn->fd, &ev);
+            w.syscalls += 3;
+            w.connections[conn->fd] = std::move(conn);
+        }
+        incoming.clear();
+        for (Connection* conn : done) {
+            completed(w, *conn);
+        }
+        done.clear();
+        auto now = std::chrono::steady_clock::now();
+        if (now - w.lastLimitCheck >= std::chrono::seconds(1)) {
+            w.lastLimitCheck = now;
+            checkOutputLimits(w);
+        }
+
+        if (!w.submit.empty()) {
+            executors->submit(w.submit);
+            w.submit.clear();
+        }
+        IoBackend::getInstance().count(w.syscalls, w.operations);
+        w.syscalls = w.operations = 0;
+    }
+}
+
+// Every command runs here, kQuantum of a batch per turn
+bool IoThreads::execute(Connection& conn, size_t executor) {
+    // about kWriteChunk of replies at a time, the rest of the batch waits until they
+    // are written; a connection that got an output queue is handed over with none left
+    size_t ran = 0;
+    while (ran < conn.batch.size() && ran < kQuantum &&
+           (conn.reply.size() < OutputLimits::kWriteChunk || conn.session.subscriber)) {
+        conn.reply += handler.processCommand(conn.batch[ran++], conn.session);
+    }
+    conn.batch.erase(conn.batch.begin(), conn.batch.begin() + ran);
+    if (!conn.batch.empty() && (conn.reply.size() < OutputLimits::kWriteChunk || conn.session.subscriber)) {
+        return true; // back in line behind the other connections
+    }
+    finished[executor].push_back(&conn);
+    return false;
+}
+
+void IoThreads::deliver(size_t executor) {
+    std::vector<Connection*>& work = finished[executor];
+    if (work.empty()) {
+        return;
+    }
+    for (auto& w : workers) {
+        bool any = false;
+        {
+            std::lock_guard<std::mutex> lock(w->mutex);
+            for (Connection* conn : work) {
+                if (conn->worker == w.get()) {
+                    w->done.push_back(conn);
+                    any = true;
+                }
+            }
+        }
+        if (any) {
+            wake(w->wakeFd);
+        }
+    }
+    work.clear();
+}
+
+// Take what the socket has; false on an error
+bool IoThreads::readConnection(Worker& w, Connection& conn) {
+    char buffer[16384];
+    while (true) {
+        ssize_t bytes = recv(conn.fd, buffer, sizeof(buffer), 0);
+        ++w.syscalls;
+        if (bytes > 0) {
+            conn.in.append(buffer, bytes);
+            ++w.operations;
+            if (conn.session.info) {
+                conn.session.info->queryBuffer = conn.in.size();
+            }
+            continue;
+        }
+        if (bytes == 0) {
+            conn.eof = true; // commands already received still get their replies
+            watch(w, conn);
+            return true;
+        }
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+}
+
+// Write as much as the socket takes; false on an error, once a protocol error
+// was sent, or when the rest breaks the output buffer limits
+bool IoThreads::flush(Worker& w, Connection& conn) {
+    size_t sent = 0;
+    while (sent < conn.out.size()) {
+        ssize_t n = send(conn.fd, conn.out.data() + sent, conn.out.size() - sent, MSG_NOSIGNAL);
+        ++w.syscalls;
+        if (n > 0) {
+            sent += n;
+            ++w.operations;
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        return false;
+    }
+    conn.out.erase(0, sent);
+    if (conn.session.info) {
+        conn.session.info->outputBuffer = conn.out.size();
+    }
+    if (conn.guard.exceeded(ClientClass::NORMAL, conn.out.size())) {
+        return false;
+    }
+    watch(w, conn);
+    return !(conn.closeAfterWrite && conn.out.empty());
+}
+
+void IoThreads::watch(Worker& w, Connection& conn) {
+    bool paused = conn.out.size() >= OutputLimits::kPauseBytes; // let TCP hold the client back
+    uint32_t events = (conn.eof || paused ? 0 : EPOLLIN) | (conn.out.empty() ? 0 : EPOLLOUT);
+    if (events != conn.events) {
+        conn.events = events;
+        epoll_event ev{};
+        ev.events = events;
+        ev.data.fd = conn.fd;
+        epoll_ctl(w.epollFd, EPOLL_CTL_MOD, conn.fd, &ev);
+        ++w.syscalls;
+    }
+}
+
+// Nothing in flight :- send the next batch to the executors, or hand the
+// connection over, or close it once a finished peer has all its replies.
+// Waits while kPauseBytes of output are still to be written.
+void IoThreads::advance(Worker& w, Connection& conn) {
+    if (conn.inFlight || conn.closeAfterWrite || conn.out.size() >= OutputLimits::kPauseBytes) {
+        return;
+    }
+    std::vector<std::string> tokens;
+    size_t pos = 0;
+    bool protocolError = false;
+    bool handOff = false;
+    while (pos < conn.in.size() && conn.batch.size() < kMaxBatch) {
+        size_t used = RedisCommandHandler::extractCommand(conn.in, pos, tokens);
+        if (used == 0) {
+            break; // wait for the rest of the frame
+        }
+        if (used == std::string::npos) {
+            protocolError = true;
+            break;
+        }
+        if (!tokens.empty() && takesOver(tokens)) {
+            handOff = true; // after the commands in front of it have answered
+            break;
+        }
+        pos += used;
+        if (!tokens.empty()) {
+            conn.batch.push_back(std::move(tokens));
+        }
+    }
+    conn.in.erase(0, pos);
+    if (conn.session.info) {
+        conn.session.info->queryBuffer = conn.in.size();
+    }
+
+    if (!conn.batch.empty()) {
+        conn.inFlight = true;
+        w.submit.push_back(&conn);
+        return;
+    }
+    if (protocolError) {
+        conn.out += "-ERR Protocol error\r\n";
+        conn.closeAfterWrite = true;
+        if (!flush(w, conn)) {
+            closeConnection(w, conn);
+        }
+        return;
+    }
+    if (handOff) {
+        handOver(w, conn);
+        return;
+    }
+    if (conn.eof && conn.out.empty()) {
+        closeConnection(w, conn);
+    }
+}
+
+// The executors are done with the connection's batch
+void IoThreads::completed(Worker& w, Connection& conn) {
+    conn.inFlight = false;
+    if (conn.closing) {
+        closeConnection(w, conn);
+        return;
+    }
+    conn.out += conn.reply;
+    conn.reply.clear();
+    if (conn.session.subscriber) {
+        // the batch gave it an output queue (CLIENT TRACKING under RESP3), which writes to the socket itself
+        handOver(w, conn);
+        return;
+    }
+    if (!flush(w, conn)) {
+        closeConnection(w, conn);
+        return;
+    }
+    advance(w, conn);
+}
+
+// A client that reads nothing gets no events :- its soft limit is timed here
+void IoThreads::checkOutputLimits(Worker& w) {
+    std::vector<Connection*> over;
+    for (auto& entry : w.connections) {
+        Connection& conn = *entry.second;
+        if (!conn.out.empty() && !conn.closing && conn.guard.exceeded(ClientClass::NORMAL, conn.out.size())) {
+            over.push_back(&conn);
+        }
+    }
+    for (Connection* conn : over) {
+        closeConnection(w, *conn);
+    }
+}
+
+void IoThreads::closeConnection(Worker& w, Connection& conn) {
+    if (!conn.closing) {
+        conn.closing = true;
+        epoll_ctl(w.epollFd, EPOLL_CTL_DEL, conn.fd, nullptr);
+        ++w.syscalls;
+    }
+    if (conn.inFlight) {
+        return; // an executor still has the session
+    }
+    handler.closeSession(conn.session);
+    close(conn.fd);
+    w.connections.erase(conn.fd);
+}
+
+// From now on the connection has a thread of its own, blocking again
+void IoThreads::handOver(Worker& w, Connection& conn) {
+    epoll_ctl(w.epollFd, EPOLL_CTL_DEL, conn.fd, nullptr);
+    int flags = fcntl(conn.fd, F_GETFL, 0);
+    fcntl(conn.fd, F_SETFL, flags & ~O_NONBLOCK);
+    w.syscalls += 3;
+    int fd = conn.fd;
+    takeOver(fd, conn.session, conn.in, conn.out);
+    w.connections.erase(fd);
+}
@@ -0,0 +1,520 @@
+#include "../include/IoUring.h"
+#include "../include/WorkerPool.h"
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+#if !defined(NO_IO_URING) && __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <cstddef>
+#else
+#define HAVE_IO_URING 0
+#endif
+
+#if HAVE_IO_URING
+
+namespace {
+
+int ringSetup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int ringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags, const void* arg, size_t argSize) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argSize));
+}
+
+int ringRegister(int fd, unsigned op, const void* arg, unsigned count) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, op, arg, count));
+}
+
+template <typename T>
+T* at(void* base, unsigned offset) {
+    return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+}
+
+// The kernel reads the tails we publish and publishes the heads/tails we read
+unsigned loadAcquire(const unsigned* p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+void storeRelease(unsigned* p, unsigned v) {
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+} // namespace
+
+bool IoUring::Completion::more() const {
+    return flags & IORING_CQE_F_MORE;
+}
+
+int IoUring::Completion::bufferId() const {
+    return (flags & IORING_CQE_F_BUFFER) ? static_cast<int>(flags >> IORING_CQE_BUFFER_SHIFT) : -1;
+}
+
+bool IoUring::supported() {
+    static const bool result = [] {
+        IoUring ring(4);
+        if (!ring.ok() || !(ring.features & IORING_FEAT_EXT_ARG)) {
+            return false; // no timed waits before 5.11
+        }
+        const unsigned kProbeOps = 256;
+        std::vector<char> memory(sizeof(io_uring_probe) + kProbeOps * sizeof(io_uring_probe_op), 0);
+        auto* probe = reinterpret_cast<io_uring_probe*>(memory.data());
+        if (ringRegister(ring.ringFd, IORING_REGISTER_PROBE, probe, kProbeOps) < 0) {
+            return false;
+        }
+        for (int op : {IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SEND, IORING_OP_POLL_ADD, IORING_OP_WRITE_FIXED,
+                       IORING_OP_ASYNC_CANCEL}) {
+            if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+                return false;
+            }
+        }
+        // provided buffer rings came with multishot accept/recv
+        return ring.setupBufferRing(0, 1, 64);
+    }();
+    return result;
+}
+
+IoUring::IoUring(unsigned entries) {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    // COOP_TASKRUN: completions are run when we next enter the kernel instead
+    // of interrupting the loop (5.19+, retried without it on older kernels)
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN;
+    params.cq_entries = entries * 4; // a multishot submission completes many times
+    int fd = ringSetup(entries, &params);
+    if (fd < 0 && errno == EINVAL) {
+        std::memset(&params, 0, sizeof(params));
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = entries * 4;
+        fd = ringSetup(entries, &params);
+    }
+    if (fd < 0) {
+        return;
+    }
+    ringFd = fd;
+    features = params.features;
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single = features & IORING_FEAT_SINGLE_MMAP; // both rings in one mapping
+    if (single) {
+        sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+    }
+    sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sqRing == MAP_FAILED) {
+        sqRing = nullptr;
+        release();
+        return;
+    }
+    if (single) {
+        cqRing = sqRing;
+    } else {
+        cqRing = mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (cqRing == MAP_FAILED) {
+            cqRing = nullptr;
+            release();
+            return;
+        }
+    }
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        sqes = nullptr;
+        release();
+        return;
+    }
+
+    sqHead = at<unsigned>(sqRing, params.sq_off.head);
+    sqTail = at<unsigned>(sqRing, params.sq_off.tail);
+    sqMask = at<unsigned>(sqRing, params.sq_off.ring_mask);
+    sqArray = at<unsigned>(sqRing, params.sq_off.array);
+    cqHead = at<unsigned>(cqRing, params.cq_off.head);
+    cqTail = at<unsigned>(cqRing, params.cq_off.tail);
+    cqMask = at<unsigned>(cqRing, params.cq_off.ring_mask);
+    cqes = at<void>(cqRing, params.cq_off.cqes);
+    sqEntries = params.sq_entries;
+}
+
+IoUring::~IoUring() {
+    release();
+}
+
+void IoUring::release() {
+    if (sqes)
+        munmap(sqes, sqesSize);
+    if (cqRing && cqRing != sqRing)
+        munmap(cqRing, cqRingSize);
+    if (sqRing)
+        munmap(sqRing, sqRingSize);
+    if (bufRing)
+        munmap(bufRing, bufRingSize);
+    delete[] recvBuffers;
+    if (ringFd >= 0)
+        close(ringFd); // cancels whatever is still in flight
+    sqes = sqRing = cqRing = bufRing = nullptr;
+    recvBuffers = nullptr;
+    ringFd = -1;
+}
+
+// Without SQPOLL the kernel only looks at the ring inside io_uring_enter(), so
+// publishing the tail before the caller fills the entry in is safe
+void* IoUring::nextSqe() {
+    unsigned tail = *sqTail;
+    if (tail - loadAcquire(sqHead) >= sqEntries) {
+        submitAndWait(0);
+        if (tail - loadAcquire(sqHead) >= sqEntries) {
+            return nullptr;
+        }
+    }
+    unsigned index = tail & *sqMask;
+    io_uring_sqe* sqe = &static_cast<io_uring_sqe*>(sqes)[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqArray[index] = index;
+    storeRelease(sqTail, tail + 1);
+    ++queued;
+    return sqe;
+}
+
+bool IoUring::acceptMultishot(int fd, uint64_t data) {
+    auto* sqe = static_cast<io_uring_sqe*>(nextSqe());
+    if (!sqe)
+        return false;
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = data;
+    return true;
+}
+
+bool IoUring::recvMultishot(int fd, uint16_t group, uint64_t data) {
+    auto* sqe = static_cast<io_uring_sqe*>(nextSqe());
+    if (!sqe)
+        return false;
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = group;
+    sqe->user_data = data;
+    return true;
+}
+
+bool IoUring::pollMultishot(int fd, uint64_t data) {
+    auto* sqe = static_cast<io_uring_sqe*>(nextSqe());
+    if (!sqe)
+        return false;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = data;
+    return true;
+}
+
+bool IoUring::cancel(uint64_t target, uint64_t data) {
+    auto* sqe = static_cast<io_uring_sqe*>(nextSqe());
+    if (!sqe)
+        return false;
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = target;
+    sqe->user_data = data;
+    return true;
+}
+
+bool IoUring::send(int fd, const void* buf, size_t len, uint64_t data) {
+    auto* sqe = static_cast<io_uring_sqe*>(nextSqe());
+    if (!sqe)
+        return false;
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buf);
+    sqe->len = static_cast<uint32_t>(std::min<size_t>(len, UINT32_MAX));
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = data;
+    return true;
+}
+
+bool IoUring::writeFixed(int fd, const void* buf, unsigned len, uint64_t offset, uint16_t bufIndex, uint64_t data) {
+    auto* sqe = static_cast<io_uring_sqe*>(nextSqe());
+    if (!sqe)
+        return false;
+    sqe->opcode = IORING_OP_WRITE_FIXED;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buf);
+    sqe->len = len;
+    sqe->off = offset;
+    sqe->buf_index = bufIndex;
+    sqe->user_data = data;
+    return true;
+}
+
+bool IoUring::submitAndWait(unsigned wait, int timeoutMs) {
+    if (queued == 0 && wait == 0) {
+        return true;
+    }
+    unsigned flags = 0;
+    io_uring_getevents_arg arg;
+    timespec ts;
+    const void* argp = nullptr;
+    size_t argSize = 0;
+    if (wait > 0) {
+        flags |= IORING_ENTER_GETEVENTS;
+        if (timeoutMs >= 0) {
+            ts.tv_sec = timeoutMs / 1000;
+            ts.tv_nsec = (timeoutMs % 1000) * 1000000L;
+            std::memset(&arg, 0, sizeof(arg));
+            arg.sigmask_sz = _NSIG / 8;
+            arg.ts = reinterpret_cast<uint64_t>(&ts);
+            flags |= IORING_ENTER_EXT_ARG;
+            argp = &arg;
+            argSize = sizeof(arg);
+        }
+    }
+    ++enters;
+    int submitted = ringEnter(ringFd, queued, wait, flags, argp, argSize);
+    if (submitted < 0) {
+        // ETIME: nothing completed in time; EBUSY: completions must be reaped first
+        return errno == ETIME || errno == EINTR || errno == EBUSY;
+    }
+    queued -= std::min<unsigned>(static_cast<unsigned>(submitted), queued);
+    return true;
+}
+
+bool IoUring::pop(Completion& c) {
+    unsigned head = *cqHead;
+    if (head == loadAcquire(cqTail)) {
+        return false;
+    }
+    const io_uring_cqe& cqe = static_cast<const io_uring_cqe*>(cqes)[head & *cqMask];
+    c.data = cqe.user_data;
+    c.res = cqe.res;
+    c.flags = cqe.flags;
+    storeRelease(cqHead, head + 1);
+    return true;
+}
+
+bool IoUring::registerBuffers(char* const* bufs, unsigned count, unsigned size) {
+    std::vector<iovec> iov(count);
+    for (unsigned i = 0; i < count; ++i) {
+        iov[i].iov_base = bufs[i];
+        iov[i].iov_len = size;
+    }
+    return ringRegister(ringFd, IORING_REGISTER_BUFFERS, iov.data(), count) == 0;
+}
+
+bool IoUring::setupBufferRing(uint16_t group, unsigned count, unsigned size) {
+    size_t ringBytes = count * sizeof(io_uring_buf);
+    void* memory = mmap(nullptr, ringBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        return false;
+    }
+    io_uring_buf_reg reg;
+    std::memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(memory);
+    reg.ring_entries = count;
+    reg.bgid = group;
+    if (ringRegister(ringFd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        munmap(memory, ringBytes);
+        return false;
+    }
+    bufRing = memory;
+    bufRingSize = ringBytes;
+    bufRingMask = count - 1;
+    recvBuffers = new char[static_cast<size_t>(count) * size];
+    recvBufferCount = count;
+    recvBufferSize = size;
+    for (unsigned id = 0; id < count; ++id) {
+        recycle(static_cast<int>(id));
+    }
+    return true;
+}
+
+// The ring's tail shares its slot with bufs[0].resv, so entries are filled
+// field by field and resv is never written
+void IoUring::recycle(int id) {
+    auto* bufs = static_cast<io_uring_buf*>(bufRing);
+    auto* tail = reinterpret_cast<uint16_t*>(static_cast<char*>(bufRing) + offsetof(io_uring_buf, resv));
+    uint16_t t = *tail;
+    io_uring_buf& buf = bufs[t & bufRingMask];
+    buf.addr = reinterpret_cast<uint64_t>(recvBuffers + static_cast<size_t>(id) * recvBufferSize);
+    buf.len = recvBufferSize;
+    buf.bid = static_cast<uint16_t>(id);
+    __atomic_store_n(tail, static_cast<uint16_t>(t + 1), __ATOMIC_RELEASE);
+}
+
+#else // built without io_uring :- nothing is ever supported, callers use epoll
+
+bool IoUring::Completion::more() const { return false; }
+int IoUring::Completion::bufferId() const { return -1; }
+bool IoUring::supported() { return false; }
+IoUring::IoUring(unsigned) {}
+IoUring::~IoUring() {}
+void IoUring::release() {}
+void* IoUring::nextSqe() { return nullptr; }
+bool IoUring::acceptMultishot(int, uint64_t) { return false; }
+bool IoUring::recvMultishot(int, uint16_t, uint64_t) { return false; }
+bool IoUring::pollMultishot(int, uint64_t) { return false; }
+bool IoUring::cancel(uint64_t, uint64_t) { return false; }
+bool IoUring::send(int, const void*, size_t, uint64_t) { return false; }
+bool IoUring::writeFixed(int, const void*, unsigned, uint64_t, uint16_t, uint64_t) { return false; }
+bool IoUring::submitAndWait(unsigned, int) { return false; }
+bool IoUring::pop(Completion&) { return false; }
+bool IoUring::registerBuffers(char* const*, unsigned, unsigned) { return false; }
+bool IoUring::setupBufferRing(uint16_t, unsigned, unsigned) { return false; }
+void IoUring::recycle(int) {}
+
+#endif
+
+//I/O backend
+
+IoBackend& IoBackend::getInstance() {
+    static IoBackend instance;
+    return instance;
+}
+
+const char* IoBackend::name() const {
+    switch (current) {
+        case IO_THREADS: return "io_threads";
+        case EPOLL: return "epoll";
+        case URING: return "io_uring";
+        default: return "threads";
+    }
+}
+
+std::string IoBackend::info() {
+    std::ostringstream out;
+    out << "# IO\r\n"
+        << "io_backend:" << name() << "\r\n";
+    if (current != THREADS) {
+        // the event loops' socket system calls, and the reads/writes that moved data
+        out << "io_syscalls:" << syscallCount.load(std::memory_order_relaxed) << "\r\n"
+            << "io_operations:" << operationCount.load(std::memory_order_relaxed) << "\r\n";
+    }
+    if (const WorkerPool* pool = executors.load()) {
+        // batch turns run, and how many an idle executor took from another's deque
+        out << "exec_threads:" << pool->size() << "\r\n"
+            << "exec_turns:" << pool->turns() << "\r\n"
+            << "exec_steals:" << pool->steals() << "\r\n";
+    }
+    return out.str();
+}
+
+//Snapshot file
+
+IoUringFile::IoUringFile(const std::string& path) : ring(kBuffers * 2) {
+    if (!ring.ok()) {
+        return;
+    }
+    for (unsigned i = 0; i < kBuffers; ++i) {
+        buffers[i] = new char[kBufferSize];
+    }
+    if (!ring.registerBuffers(buffers, kBuffers, kBufferSize)) {
+        return; // fd stays -1, the caller writes the file the usual way
+    }
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    setp(buffers[0], buffers[0] + kBufferSize);
+}
+
+IoUringFile::~IoUringFile() {
+    if (fd >= 0) {
+        close();
+    }
+    for (unsigned i = 0; i < kBuffers; ++i) {
+        delete[] buffers[i];
+    }
+}
+
+bool IoUringFile::close() {
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = !failed && submitCurrent();
+    for (unsigned i = 0; i < kBuffers; ++i) {
+        ok = waitFor(i) && ok;
+    }
+    ::close(fd);
+    fd = -1;
+    return ok && !failed;
+}
+
+IoUringFile::int_type IoUringFile::overflow(int_type ch) {
+    if (failed || !submitCurrent()) {
+        return traits_type::eof();
+    }
+    if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(ch);
+        pbump(1);
+    }
+    return traits_type::not_eof(ch);
+}
+
+int IoUringFile::sync() {
+    return submitCurrent() ? 0 : -1;
+}
+
+// Hand the filled buffer to the kernel and move on to the next one
+bool IoUringFile::submitCurrent() {
+    unsigned len = static_cast<unsigned>(pptr() - pbase());
+    if (len == 0) {
+        return true;
+    }
+    lengths[current] = len;
+    offsets[current] = offset;
+    busy[current] = true;
+    if (!ring.writeFixed(fd, buffers[current], len, offset, static_cast<uint16_t>(current), current) ||
+        !ring.submitAndWait(0)) {
+        busy[current] = false;
+        failed = true;
+        return false;
+    }
+    offset += len;
+    current = (current + 1) % kBuffers;
+    if (!waitFor(current)) {
+        return false;
+    }
+    setp(buffers[current], buffers[current] + kBufferSize);
+    return true;
+}
+
+bool IoUringFile::waitFor(unsigned index) {
+    while (busy[index]) {
+        IoUring::Completion c;
+        while (!ring.pop(c)) {
+            if (!ring.submitAndWait(1)) {
+                failed = true;
+                return false;
+            }
+        }
+        unsigned done = static_cast<unsigned>(c.data);
+        busy[done] = false;
+        if (c.res < 0) {
+            failed = true;
+            continue;
+        }
+        // a short write is rare for regular files :- finish it synchronously
+        unsigned written = static_cast<unsigned>(c.res);
+        while (written < lengths[done]) {
+            ssize_t n = pwrite(fd, buffers[done] + written, lengths[done] - written, offsets[done] + written);
+            if (n <= 0) {
+                failed = true;
+                break;
+            }
+            written += static_cast<unsigned>(n);
+        }
+    }
+    return !failed;
+}
@@ -0,0 +1,45 @@
+#include "../include/LazyFree.h"
+
+LazyFree& LazyFree::getInstance() {
+    static LazyFree instance;
+    return instance;
+}
+
+LazyFree::LazyFree() : worker(&LazyFree::run, this) {}
+
+LazyFree::~LazyFree() {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        stopping = true;
+    }
+    queue_cv.notify_one();
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+void LazyFree::submit(std::unique_ptr<Object> object) {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        queue.push_back(std::move(object));
+        ++pendingObjects;
+    }
+    queue_cv.notify_one();
+}
+
+void LazyFree::run() {
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    while (true) {
+        queue_cv.wait(lock, [this] { return stopping || !queue.empty(); });
+        if (queue.empty()) {
+            return; // stopping and drained
+        }
+        std::unique_ptr<Object> object = std::move(queue.front());
+        queue.pop_front();
+        lock.unlock();
+        object.reset(); // the actual work, outside every lock
+        --pendingObjects;
+        ++freedObjects;
+        lock.lock();
+    }
+}
@@ -0,0 +1,113 @@
+#include "../include/Listener.h"
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+
+namespace {
+
+// The kernel silently truncates a larger backlog, say so once
+void checkBacklog(int backlog) {
+    static bool warned = false;
+    std::ifstream in("/proc/sys/net/core/somaxconn");
+    int somaxconn = 0;
+    if (!warned && in >> somaxconn && somaxconn < backlog) {
+        warned = true;
+        std::cerr << "Warning: TCP backlog of " << backlog << " is capped by net.core.somaxconn (" << somaxconn
+                  << ")." << std::endl;
+    }
+}
+
+} // namespace
+
+namespace Listener {
+
+int tcp(const ListenOptions& options, bool reusePort) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        std::cerr << "Failed to create socket." << std::endl;
+        return -1;
+    }
+    int opt = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (reusePort && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        std::cerr << "SO_REUSEPORT is not supported: " << std::strerror(errno) << std::endl;
+        close(fd);
+        return -1;
+    }
+
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(options.port);
+    addr.sin_addr.s_addr = INADDR_ANY;
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        std::cerr << "Failed to bind socket." << std::endl;
+        close(fd);
+        return -1;
+    }
+    checkBacklog(options.backlog);
+    if (listen(fd, options.backlog) < 0) {
+        std::cerr << "Failed to listen on socket." << std::endl;
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int local(const ListenOptions& options) {
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (options.unixSocket.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "Unix socket path too long: " << options.unixSocket << std::endl;
+        return -1;
+    }
+    std::memcpy(addr.sun_path, options.unixSocket.c_str(), options.unixSocket.size());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        std::cerr << "Failed to create Unix socket." << std::endl;
+        return -1;
+    }
+    unlink(options.unixSocket.c_str()); // left behind by a previous run
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, options.backlog) < 0) {
+        std::cerr << "Failed to listen on Unix socket " << options.unixSocket << ": " << std::strerror(errno)
+                  << std::endl;
+        close(fd);
+        return -1;
+    }
+    chmod(options.unixSocket.c_str(), options.unixSocketPerm);
+    return fd;
+}
+
+void configure(int fd, const ListenOptions& options) {
+    int domain = 0;
+    socklen_t len = sizeof(domain);
+    if (getsockopt(fd, SOL_SOCKET, SO_DOMAIN, &domain, &len) < 0 || domain == AF_UNIX) {
+        return;
+    }
+    int one = 1;
+    if (options.tcpNoDelay) {
+        // small replies and pushes go out at once instead of waiting for the peer's delayed ACK
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    if (options.tcpKeepAlive > 0) {
+        // notice dead peers: first probe after the idle time, then 3 probes in the same period
+        int idle = options.tcpKeepAlive;
+        int interval = idle / 3 > 0 ? idle / 3 : 1;
+        int count = 3;
+        setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count));
+    }
+}
+
+} // namespace Listener
@@ -0,0 +1,113 @@
+#include "../include/OutputLimits.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <sys/socket.h>
+#include <poll.h>
+
+namespace {
+
+// "32mb" -> 33554432; false on anything else than digits and an optional unit
+bool parseSize(std::string text, size_t& out) {
+    std::transform(text.begin(), text.end(), text.begin(), ::tolower);
+    size_t unit = 1;
+    for (const auto& suffix : {std::make_pair("kb", 1024UL), std::make_pair("mb", 1024UL * 1024),
+                               std::make_pair("gb", 1024UL * 1024 * 1024)}) {
+        std::string s = suffix.first;
+        if (text.size() > s.size() && text.compare(text.size() - s.size(), s.size(), s) == 0) {
+            unit = suffix.second;
+            text.erase(text.size() - s.size());
+            break;
+        }
+    }
+    if (text.empty() || text.find_first_not_of("0123456789") != std::string::npos)
+        return false;
+    out = std::strtoull(text.c_str(), nullptr, 10) * unit;
+    return true;
+}
+
+} // namespace
+
+OutputLimits& OutputLimits::getInstance() {
+    static OutputLimits instance;
+    return instance;
+}
+
+OutputLimits::OutputLimits() {
+    limits[static_cast<int>(ClientClass::REPLICA)] = {256 * 1024 * 1024, 64 * 1024 * 1024, 60};
+    limits[static_cast<int>(ClientClass::PUBSUB)] = {32 * 1024 * 1024, 8 * 1024 * 1024, 60};
+    for (auto& count : disconnects)
+        count.store(0);
+}
+
+bool OutputLimits::configure(const std::string& cls, const std::string& hard, const std::string& soft, const std::string& seconds) {
+    int index;
+    if (cls == "normal")
+        index = static_cast<int>(ClientClass::NORMAL);
+    else if (cls == "replica" || cls == "slave")
+        index = static_cast<int>(ClientClass::REPLICA);
+    else if (cls == "pubsub")
+        index = static_cast<int>(ClientClass::PUBSUB);
+    else
+        return false;
+    OutputLimit limit;
+    if (!parseSize(hard, limit.hard) || !parseSize(soft, limit.soft) || seconds.empty() ||
+        seconds.find_first_not_of("0123456789") != std::string::npos)
+        return false;
+    limit.softSeconds = std::atoi(seconds.c_str());
+    limits[index] = limit;
+    return true;
+}
+
+const char* OutputLimits::name(ClientClass cls) {
+    switch (cls) {
+    case ClientClass::REPLICA:
+        return "replica";
+    case ClientClass::PUBSUB:
+        return "pubsub";
+    default:
+        return "normal";
+    }
+}
+
+bool OutputGuard::exceeded(ClientClass cls, size_t pending) {
+    const OutputLimit& limit = OutputLimits::getInstance().get(cls);
+    bool drop = false;
+    if (limit.hard && pending > limit.hard) {
+        drop = true;
+    } else if (limit.soft && pending > limit.soft) {
+        auto now = std::chrono::steady_clock::now();
+        if (!overSoft) {
+            overSoft = true;
+            softSince = now;
+        } else if (now - softSince >= std::chrono::seconds(limit.softSeconds)) {
+            drop = true;
+        }
+    } else {
+        overSoft = false;
+    }
+    if (drop)
+        OutputLimits::getInstance().countDisconnect(cls);
+    return drop;
+}
+
+bool sendLimited(int socket, const char* data, size_t size, const std::function<bool(size_t)>& overLimit) {
+    size_t sent = 0;
+    while (sent < size) {
+        ssize_t n = send(socket, data + sent, size - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n > 0) {
+            sent += n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+            return false;
+        // the client isn't reading :- wait, but look at the limits every second
+        if (overLimit(size - sent))
+            return false;
+        pollfd p{socket, POLLOUT, 0};
+        poll(&p, 1, 1000);
+    }
+    return true;
+}
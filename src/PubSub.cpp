@@ -0,0 +1,542 @@
+#include "../include/PubSub.h"
+#include "../include/Resp.h"
+#include <sstream>
+#include <unordered_set>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace {
+
+std::string bulk(const std::string& s) {
+    return "$" + std::to_string(s.size()) + "\r\n" + s + "\r\n";
+}
+
+// *3 subscribe|unsubscribe|psubscribe|punsubscribe <name> <count>, null name when there was nothing to leave.
+// A push in RESP3, where they can come between the replies of other commands.
+std::string confirmation(const char* kind, const std::string* name, size_t count) {
+    std::string kindStr(kind);
+    return Resp::push(3) + bulk(kindStr) + (name ? bulk(*name) : Resp::null()) + ":" + std::to_string(count) + "\r\n";
+}
+
+// A published message, encoded at most once per protocol in use: only the
+// header differs, an array for RESP2 subscribers and a push for RESP3 ones
+class Frames {
+public:
+    Frames(size_t count, std::string body) : count(count), body(std::move(body)) {}
+
+    const std::shared_ptr<const std::string>& of(const Subscriber& sub) {
+        bool push = sub.protocol() == 3;
+        std::shared_ptr<const std::string>& frame = frames[push];
+        if (!frame)
+            frame = std::make_shared<const std::string>((push ? ">" : "*") + std::to_string(count) + "\r\n" + body);
+        return frame;
+    }
+
+private:
+    size_t count;
+    std::string body;
+    std::shared_ptr<const std::string> frames[2];
+};
+
+const size_t kMaxIov = 64; // buffers per sendmsg()
+
+struct StateHash {
+    size_t operator()(const std::pair<const void*, size_t>& s) const {
+        return std::hash<const void*>()(s.first) ^ (s.second * 0x9e3779b97f4a7c15ULL);
+    }
+};
+
+} // namespace
+
+//GlobTrie
+
+struct GlobTrie::Node {
+    std::unordered_map<unsigned char, std::unique_ptr<Node>> chars;
+    std::unique_ptr<Node> any;  // ?
+    std::unique_ptr<Node> star; // *
+    std::vector<std::pair<std::bitset<256>, std::unique_ptr<Node>>> classes;
+    const std::string* pattern = nullptr; // a pattern ends here
+
+    bool empty() const { return !pattern && chars.empty() && !any && !star && classes.empty(); }
+};
+
+GlobTrie::GlobTrie() : root(new Node()) {}
+GlobTrie::~GlobTrie() = default;
+
+// Same syntax as KEYS/PSUBSCRIBE in Redis; a '[' without its ']' is an ordinary character
+std::vector<GlobTrie::Token> GlobTrie::compile(const std::string& pattern) {
+    std::vector<Token> tokens;
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        Token t;
+        unsigned char c = pattern[i];
+        if (c == '*') {
+            if (!tokens.empty() && tokens.back().kind == Token::STAR)
+                continue; // ** is *
+            t.kind = Token::STAR;
+        } else if (c == '?') {
+            t.kind = Token::ANY;
+        } else if (c == '\\' && i + 1 < pattern.size()) {
+            t.kind = Token::CHAR;
+            t.c = pattern[++i];
+        } else if (c == '[' && pattern.find(']', i + 1) != std::string::npos) {
+            t.kind = Token::CLASS;
+            size_t j = i + 1;
+            bool negate = j < pattern.size() && pattern[j] == '^';
+            if (negate)
+                ++j;
+            for (; j < pattern.size() && pattern[j] != ']'; ++j) {
+                unsigned char from = pattern[j];
+                if (from == '\\' && j + 1 < pattern.size()) {
+                    from = pattern[++j];
+                }
+                if (j + 2 < pattern.size() && pattern[j + 1] == '-' && pattern[j + 2] != ']') {
+                    unsigned char to = pattern[j + 2];
+                    j += 2;
+                    if (from > to)
+                        std::swap(from, to);
+                    for (unsigned v = from; v <= to; ++v)
+                        t.set.set(v);
+                } else {
+                    t.set.set(from);
+                }
+            }
+            if (j >= pattern.size()) {
+                // the only ']' was escaped inside the class, take '[' literally
+                t = Token();
+                t.kind = Token::CHAR;
+                t.c = c;
+            } else {
+                if (negate)
+                    t.set.flip();
+                i = j;
+            }
+        } else {
+            t.kind = Token::CHAR;
+            t.c = c;
+        }
+        tokens.push_back(t);
+    }
+    return tokens;
+}
+
+GlobTrie::Node* GlobTrie::child(Node* node, const Token& token, bool create) {
+    switch (token.kind) {
+        case Token::CHAR: {
+            auto it = node->chars.find(token.c);
+            if (it != node->chars.end())
+                return it->second.get();
+            if (!create)
+                return nullptr;
+            return (node->chars[token.c] = std::unique_ptr<Node>(new Node())).get();
+        }
+        case Token::ANY:
+            if (!node->any && create)
+                node->any.reset(new Node());
+            return node->any.get();
+        case Token::STAR:
+            if (!node->star && create)
+                node->star.reset(new Node());
+            return node->star.get();
+        case Token::CLASS:
+            for (auto& c : node->classes) {
+                if (c.first == token.set)
+                    return c.second.get();
+            }
+            if (!create)
+                return nullptr;
+            node->classes.emplace_back(token.set, std::unique_ptr<Node>(new Node()));
+            return node->classes.back().second.get();
+    }
+    return nullptr;
+}
+
+void GlobTrie::insert(const std::string& pattern) {
+    Node* node = root.get();
+    for (const Token& t : compile(pattern)) {
+        node = child(node, t, true);
+    }
+    if (!node->pattern)
+        ++count;
+    node->pattern = &pattern;
+}
+
+// True when node is left with nothing and can be unlinked from its parent
+bool GlobTrie::eraseFrom(Node* node, const std::vector<Token>& tokens, size_t i) {
+    if (i == tokens.size()) {
+        node->pattern = nullptr;
+        return node->empty();
+    }
+    Node* next = child(node, tokens[i], false);
+    if (!next || !eraseFrom(next, tokens, i + 1))
+        return false;
+    const Token& t = tokens[i];
+    if (t.kind == Token::CHAR) {
+        node->chars.erase(t.c);
+    } else if (t.kind == Token::ANY) {
+        node->any.reset();
+    } else if (t.kind == Token::STAR) {
+        node->star.reset();
+    } else {
+        for (size_t k = 0; k < node->classes.size(); ++k) {
+            if (node->classes[k].second.get() == next) {
+                node->classes.erase(node->classes.begin() + k);
+                break;
+            }
+        }
+    }
+    return node->empty();
+}
+
+void GlobTrie::erase(const std::string& pattern) {
+    std::vector<Token> tokens = compile(pattern);
+    Node* node = root.get();
+    for (const Token& t : tokens) {
+        node = child(node, t, false);
+        if (!node)
+            return;
+    }
+    if (!node->pattern)
+        return;
+    --count;
+    eraseFrom(root.get(), tokens, 0);
+}
+
+/* Walk the trie and the text together. A (node, position) state is expanded
+ * once, so patterns sharing a prefix are matched once for all of them and
+ * stars can't make the walk exponential. */
+void GlobTrie::match(const std::string& text, std::vector<const std::string*>& out) const {
+    const size_t len = text.size();
+    std::vector<std::pair<const Node*, size_t>> stack;
+    std::unordered_set<std::pair<const void*, size_t>, StateHash> seen;
+    stack.emplace_back(root.get(), 0);
+    while (!stack.empty()) {
+        auto state = stack.back();
+        stack.pop_back();
+        const Node* node = state.first;
+        size_t pos = state.second;
+        if (!seen.insert(state).second)
+            continue;
+        if (pos == len && node->pattern)
+            out.push_back(node->pattern);
+        if (node->star) {
+            for (size_t k = pos; k <= len; ++k) {
+                stack.emplace_back(node->star.get(), k); // * took text[pos, k)
+            }
+        }
+        if (pos == len)
+            continue;
+        unsigned char c = text[pos];
+        auto it = node->chars.find(c);
+        if (it != node->chars.end())
+            stack.emplace_back(it->second.get(), pos + 1);
+        if (node->any)
+            stack.emplace_back(node->any.get(), pos + 1);
+        for (const auto& cls : node->classes) {
+            if (cls.first.test(c))
+                stack.emplace_back(cls.second.get(), pos + 1);
+        }
+    }
+}
+
+//Subscriber
+
+Subscriber::Subscriber(int socket) : socket(socket) {
+    wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    // pushes rely on the connection's TCP_NODELAY (Listener::configure), or each
+    // one after the first waits for the delayed ACK of the previous one
+}
+
+Subscriber::~Subscriber() {
+    if (wake >= 0)
+        close(wake);
+}
+
+void Subscriber::deliver(const std::shared_ptr<const std::string>& message) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (dead)
+        return;
+    bool idle = queue.empty();
+    queue.push_back(message);
+    bytes += message->size();
+    if (idle && heldAt == SIZE_MAX) {
+        // nothing ahead of it :- straight to the socket, from this thread
+        if (!sendLocked() || queue.empty())
+            return;
+        uint64_t one = 1;
+        ssize_t n = write(wake, &one, sizeof(one)); // the connection thread takes over
+        (void)n;
+    }
+
+    // Backpressure :- the pubsub class of --client-output-buffer-limit
+    if (guard.exceeded(ClientClass::PUBSUB, bytes)) {
+        killLocked();
+        PubSub::getInstance().countSlowDisconnect();
+    }
+}
+
+void Subscriber::hold() {
+    std::lock_guard<std::mutex> lock(mutex);
+    heldAt = queue.size();
+}
+
+bool Subscriber::reply(std::string data) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (dead)
+        return false;
+    if (!data.empty()) {
+        bytes += data.size();
+        auto buffer = std::make_shared<const std::string>(std::move(data));
+        if (heldAt < queue.size())
+            queue.insert(queue.begin() + heldAt, std::move(buffer));
+        else
+            queue.push_back(std::move(buffer));
+    }
+    heldAt = SIZE_MAX;
+    return sendLocked();
+}
+
+bool Subscriber::flush() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (dead)
+        return false;
+    return sendLocked();
+}
+
+bool Subscriber::pending() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return !queue.empty() && heldAt == SIZE_MAX;
+}
+
+void Subscriber::drainWake() {
+    uint64_t value;
+    ssize_t n = read(wake, &value, sizeof(value));
+    (void)n;
+}
+
+size_t Subscriber::queuedBytes() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return bytes;
+}
+
+// Gather up to kMaxIov queued buffers into one sendmsg(), never blocks
+bool Subscriber::sendLocked() {
+    while (!queue.empty()) {
+        iovec iov[kMaxIov];
+        size_t count = 0;
+        size_t total = 0;
+        for (auto it = queue.begin(); it != queue.end() && count < kMaxIov; ++it, ++count) {
+            size_t skip = count == 0 ? offset : 0;
+            iov[count].iov_base = const_cast<char*>((*it)->data() + skip);
+            iov[count].iov_len = (*it)->size() - skip;
+            total += iov[count].iov_len;
+        }
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        ssize_t sent = sendmsg(socket, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return true; // the rest waits for POLLOUT
+            killLocked();
+            return false;
+        }
+        bytes -= sent;
+        size_t left = sent;
+        while (left > 0) {
+            size_t rest = queue.front()->size() - offset;
+            if (left < rest) {
+                offset += left;
+                break;
+            }
+            left -= rest;
+            offset = 0;
+            queue.pop_front();
+        }
+        if (static_cast<size_t>(sent) < total)
+            return true;
+    }
+    return true;
+}
+
+// Drop the queue and wake the connection thread, which then closes the connection
+void Subscriber::killLocked() {
+    dead = true;
+    queue.clear();
+    bytes = 0;
+    offset = 0;
+    shutdown(socket, SHUT_RDWR);
+}
+
+//PubSub
+
+PubSub& PubSub::getInstance() {
+    static PubSub instance;
+    return instance;
+}
+
+bool PubSub::addLocked(const std::shared_ptr<Subscriber>& sub, const std::string& name, bool pattern) {
+    auto& mine = pattern ? sub->patterns : sub->channels;
+    if (mine.count(name))
+        return false;
+    auto& index = pattern ? patternIndex : channelIndex;
+    auto it = index.find(name);
+    if (it == index.end()) {
+        it = index.emplace(name, Subscribers()).first;
+        if (pattern)
+            trie.insert(it->first); // map keys don't move
+    }
+    mine[name] = it->second.size();
+    it->second.push_back(sub);
+    sub->subscribed.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+// O(1) :- the last subscriber takes the leaving one's place
+bool PubSub::removeLocked(const std::shared_ptr<Subscriber>& sub, const std::string& name, bool pattern) {
+    auto& mine = pattern ? sub->patterns : sub->channels;
+    auto mit = mine.find(name);
+    if (mit == mine.end())
+        return false;
+    size_t pos = mit->second;
+    mine.erase(mit);
+    sub->subscribed.fetch_sub(1, std::memory_order_relaxed);
+
+    auto& index = pattern ? patternIndex : channelIndex;
+    auto it = index.find(name);
+    Subscribers& list = it->second;
+    if (pos + 1 != list.size()) {
+        list[pos] = std::move(list.back());
+        (pattern ? list[pos]->patterns : list[pos]->channels)[name] = pos;
+    }
+    list.pop_back();
+    if (list.empty()) {
+        if (pattern)
+            trie.erase(name);
+        index.erase(it);
+    }
+    return true;
+}
+
+std::string PubSub::subscribe(const std::shared_ptr<Subscriber>& sub, const std::vector<std::string>& names, bool pattern) {
+    std::unique_lock<std::shared_mutex> lock(registry_mutex);
+    std::string out;
+    for (const auto& name : names) {
+        addLocked(sub, name, pattern);
+        out += confirmation(pattern ? "psubscribe" : "subscribe", &name, sub->subscriptions());
+    }
+    return out;
+}
+
+std::string PubSub::unsubscribe(const std::shared_ptr<Subscriber>& sub, const std::vector<std::string>& names, bool pattern) {
+    std::unique_lock<std::shared_mutex> lock(registry_mutex);
+    const char* kind = pattern ? "punsubscribe" : "unsubscribe";
+    std::vector<std::string> leaving = names;
+    if (leaving.empty()) {
+        for (const auto& entry : pattern ? sub->patterns : sub->channels) {
+            leaving.push_back(entry.first);
+        }
+        if (leaving.empty())
+            return confirmation(kind, nullptr, sub->subscriptions());
+    }
+    std::string out;
+    for (const auto& name : leaving) {
+        removeLocked(sub, name, pattern);
+        out += confirmation(kind, &name, sub->subscriptions());
+    }
+    return out;
+}
+
+void PubSub::drop(const std::shared_ptr<Subscriber>& sub) {
+    std::unique_lock<std::shared_mutex> lock(registry_mutex);
+    while (!sub->channels.empty()) {
+        std::string name = sub->channels.begin()->first;
+        removeLocked(sub, name, false);
+    }
+    while (!sub->patterns.empty()) {
+        std::string name = sub->patterns.begin()->first;
+        removeLocked(sub, name, true);
+    }
+}
+
+size_t PubSub::publish(const std::string& channel, const std::string& message) {
+    published.fetch_add(1, std::memory_order_relaxed);
+    std::shared_lock<std::shared_mutex> lock(registry_mutex);
+    size_t receivers = 0;
+    auto it = channelIndex.find(channel);
+    if (it != channelIndex.end()) {
+        Frames frames(3, "$7\r\nmessage\r\n" + bulk(channel) + bulk(message));
+        for (const auto& sub : it->second) {
+            sub->deliver(frames.of(*sub));
+        }
+        receivers += it->second.size();
+    }
+    if (trie.size() == 0)
+        return receivers;
+    std::vector<const std::string*> matched;
+    trie.match(channel, matched);
+    for (const std::string* pattern : matched) {
+        const Subscribers& list = patternIndex.find(*pattern)->second;
+        Frames frames(4, "$8\r\npmessage\r\n" + bulk(*pattern) + bulk(channel) + bulk(message));
+        for (const auto& sub : list) {
+            sub->deliver(frames.of(*sub));
+        }
+        receivers += list.size();
+    }
+    return receivers;
+}
+
+std::string PubSub::channelsReply(const std::string* pattern) {
+    std::shared_lock<std::shared_mutex> lock(registry_mutex);
+    std::vector<const std::string*> names;
+    if (pattern) {
+        GlobTrie filter;
+        filter.insert(*pattern);
+        std::vector<const std::string*> hit;
+        for (const auto& entry : channelIndex) {
+            hit.clear();
+            filter.match(entry.first, hit);
+            if (!hit.empty())
+                names.push_back(&entry.first);
+        }
+    } else {
+        for (const auto& entry : channelIndex) {
+            names.push_back(&entry.first);
+        }
+    }
+    std::string out = "*" + std::to_string(names.size()) + "\r\n";
+    for (const std::string* name : names) {
+        out += bulk(*name);
+    }
+    return out;
+}
+
+std::string PubSub::numsubReply(const std::vector<std::string>& names) {
+    std::shared_lock<std::shared_mutex> lock(registry_mutex);
+    std::string out = Resp::map(names.size());
+    for (const auto& name : names) {
+        auto it = channelIndex.find(name);
+        out += bulk(name) + ":" + std::to_string(it == channelIndex.end() ? 0 : it->second.size()) + "\r\n";
+    }
+    return out;
+}
+
+size_t PubSub::numpat() {
+    std::shared_lock<std::shared_mutex> lock(registry_mutex);
+    return patternIndex.size();
+}
+
+std::string PubSub::info() {
+    std::shared_lock<std::shared_mutex> lock(registry_mutex);
+    std::ostringstream out;
+    out << "# Pubsub\r\n"
+        << "pubsub_channels:" << channelIndex.size() << "\r\n"
+        << "pubsub_patterns:" << patternIndex.size() << "\r\n"
+        << "pubsub_messages_published:" << published.load(std::memory_order_relaxed) << "\r\n"
+        << "pubsub_slow_disconnects:" << slowDisconnects.load(std::memory_order_relaxed) << "\r\n";
+    return out.str();
+}
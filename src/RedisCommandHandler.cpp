@@ -1,11 +1,18 @@
 #include "../include/RedisCommandHandler.h"
 #include "../include/RedisDatabase.h"
+#include "../include/Replication.h"
+#include "../include/Cluster.h"
+#include "../include/PubSub.h"
+#include "../include/Tracking.h"
+#include "../include/ClientRegistry.h"
+#include "../include/Resp.h"
 #include <sstream>
 #include <vector>
 #include <string>
 #include <algorithm>
 #include <iostream>
 #include <exception>
+#include <cstdlib>
 /*Resp parser :- *2\r\n$4\r\n\PING\r\n$4\r\nTEST\r\n
  * -> array
  *2-> array of 2 elements
@@ -70,83 +77,475 @@
     return tokens;
 }
 
+/* Frame extraction for pipelined input :- a single recv() may carry several
+ * commands or only part of one, so the server keeps a per-connection buffer
+ * and pulls complete frames off the front of it.
+ * Returns the number of bytes consumed, or 0 if the frame is not complete yet. */
+size_t RedisCommandHandler::extractCommand(const std::string& buffer, size_t pos, std::vector<std::string>& tokens) {
+    tokens.clear();
+    if (pos >= buffer.size()) {
+        return 0;
+    }
+
+    // Inline command (telnet/nc style) - one command per line
+    if (buffer[pos] != '*') {
+        size_t nl = buffer.find('\n', pos);
+        if (nl == std::string::npos) {
+            return buffer.size() - pos > kMaxInline ? std::string::npos : 0;
+        }
+        std::istringstream iss(buffer.substr(pos, nl - pos));
+        std::string token;
+        while (iss >> token) {
+            tokens.push_back(token);
+        }
+        return nl + 1 - pos;
+    }
+
+    size_t cur = pos + 1;
+    size_t crlf = buffer.find("\r\n", cur);
+    if (crlf == std::string::npos) {
+        return buffer.size() - cur > kMaxInline ? std::string::npos : 0;
+    }
+    long numElements = std::strtol(buffer.c_str() + cur, nullptr, 10);
+    if (numElements > kMaxMultibulk) {
+        return std::string::npos; // invalid multibulk length
+    }
+    cur = crlf + 2;
+
+    for (long i = 0; i < numElements; ++i) {
+        if (cur >= buffer.size()) {
+            return 0;
+        }
+        if (buffer[cur] != '$') {
+            tokens.clear();
+            return std::string::npos; // protocol error
+        }
+        crlf = buffer.find("\r\n", cur + 1);
+        if (crlf == std::string::npos) {
+            if (buffer.size() - cur > kMaxInline) {
+                tokens.clear();
+                return std::string::npos;
+            }
+            return 0;
+        }
+        long strLength = std::strtol(buffer.c_str() + cur + 1, nullptr, 10);
+        if (strLength < 0 || strLength > kMaxBulkLength) {
+            tokens.clear();
+            return std::string::npos; // invalid bulk length
+        }
+        cur = crlf + 2;
+        if (cur + strLength + 2 > buffer.size()) {
+            return 0;
+        }
+        tokens.emplace_back(buffer, cur, strLength);
+        cur += strLength + 2; // Move past the string and \r\n
+    }
+    return cur - pos;
+}
+
 RedisCommandHandler::RedisCommandHandler() {}
 
 // Process a Redis command and return the response in RESP FORMAT
 std::string RedisCommandHandler::processCommand(const std::string& command) {
-    auto tokens = parseRespoCommand(command);
+    return processCommand(parseRespoCommand(command));
+}
+
+std::string RedisCommandHandler::processCommand(const std::vector<std::string>& tokens) {
+    ClientSession session; // one-shot caller, no transaction state to keep
+    return processCommand(tokens, session);
+}
+
+/* Command table :- handler, where the keys are (first, last, step; last < 0
+ * counts from the end, e.g. -2 skips BLPOP's timeout) and whether the command
+ * writes (replicated, refused on a replica), then whether scripts are kept
+ * from calling it. Commands without keys leave the key fields 0.
+ * EVAL/EVALSHA/LMPOP carry a numkeys argument, MIGRATE an optional KEYS list,
+ * XREAD/XREADGROUP their keys after STREAMS and XGROUP/XINFO the key after a
+ * subcommand; those are handled in commandKeys(). */
+const std::unordered_map<std::string, RedisCommandHandler::CommandSpec>& RedisCommandHandler::commandTable() {
+    static const std::unordered_map<std::string, CommandSpec> table = {
+        // Common Commands
+        {"PING", {&RedisCommandHandler::handlePing, nullptr}},
+        {"ECHO", {&RedisCommandHandler::handleEcho, nullptr}},
+        {"FLUSHALL", {&RedisCommandHandler::handleFlushAll, nullptr, 0, 0, 0, true}},
+        {"MEMORY", {&RedisCommandHandler::handleMemory, nullptr}},
+
+        // Key/Value Operations
+        {"SET", {&RedisCommandHandler::handleSet, nullptr, 1, 1, 1, true}},
+        {"GET", {&RedisCommandHandler::handleGet, nullptr, 1, 1, 1}},
+        {"KEYS", {&RedisCommandHandler::handleKeys, nullptr}},
+        {"TYPE", {&RedisCommandHandler::handleType, nullptr, 1, 1, 1}},
+        {"DEL", {&RedisCommandHandler::handleDel, nullptr, 1, -1, 1, true}},
+        {"UNLINK", {&RedisCommandHandler::handleUnlink, nullptr, 1, -1, 1, true}},
+        {"EXISTS", {&RedisCommandHandler::handleExists, nullptr, 1, -1, 1}},
+        {"MGET", {&RedisCommandHandler::handleMget, nullptr, 1, -1, 1}},
+        {"MSET", {&RedisCommandHandler::handleMset, nullptr, 1, -1, 2, true}},
+        {"MSETNX", {&RedisCommandHandler::handleMsetnx, nullptr, 1, -1, 2, true}},
+        {"EXPIRE", {&RedisCommandHandler::handleExpire, nullptr, 1, 1, 1, true}},
+        {"RENAME", {&RedisCommandHandler::handleRename, nullptr, 1, 2, 1, true}},
+        {"INCR", {&RedisCommandHandler::handleIncr, nullptr, 1, 1, 1, true}},
+        {"DECR", {&RedisCommandHandler::handleDecr, nullptr, 1, 1, 1, true}},
+        {"INCRBY", {&RedisCommandHandler::handleIncrby, nullptr, 1, 1, 1, true}},
+        {"DECRBY", {&RedisCommandHandler::handleDecrby, nullptr, 1, 1, 1, true}},
+        {"INCRBYFLOAT", {&RedisCommandHandler::handleIncrbyfloat, nullptr, 1, 1, 1, true}},
+
+        // List Operations
+        {"LPUSH", {&RedisCommandHandler::handleLpush, nullptr, 1, 1, 1, true}},
+        {"LPOP", {&RedisCommandHandler::handleLpop, nullptr, 1, 1, 1, true}},
+        {"RPUSH", {&RedisCommandHandler::handleRpush, nullptr, 1, 1, 1, true}},
+        {"RPOP", {&RedisCommandHandler::handleRpop, nullptr, 1, 1, 1, true}},
+        {"LLEN", {&RedisCommandHandler::handleLlen, nullptr, 1, 1, 1}},
+        {"LGET", {&RedisCommandHandler::handleLget, nullptr, 1, 1, 1}},
+        {"LINDEX", {&RedisCommandHandler::handleLindex, nullptr, 1, 1, 1}},
+        {"LSET", {&RedisCommandHandler::handleLset, nullptr, 1, 1, 1, true}},
+        {"LREM", {&RedisCommandHandler::handleLrem, nullptr, 1, 1, 1, true}},
+        {"LMOVE", {&RedisCommandHandler::handleLmove, nullptr, 1, 2, 1, true}},
+        {"LRANGE", {&RedisCommandHandler::handleLrange, nullptr, 1, 1, 1}},
+        {"LTRIM", {&RedisCommandHandler::handleLtrim, nullptr, 1, 1, 1, true}},
+        {"LINSERT", {&RedisCommandHandler::handleLinsert, nullptr, 1, 1, 1, true}},
+        {"LMPOP", {&RedisCommandHandler::handleLmpop, nullptr, 0, 0, 0, true}},
+
+        // Blocking List Operations
+        {"BLPOP", {nullptr, &RedisCommandHandler::handleBlpop, 1, -2, 1, true}},
+        {"BRPOP", {nullptr, &RedisCommandHandler::handleBrpop, 1, -2, 1, true}},
+        {"BLMOVE", {nullptr, &RedisCommandHandler::handleBlmove, 1, 2, 1, true}},
+
+        // Hash Operations
+        {"HSET", {&RedisCommandHandler::handleHset, nullptr, 1, 1, 1, true}},
+        {"HGET", {&RedisCommandHandler::handleHget, nullptr, 1, 1, 1}},
+        {"HGETALL", {&RedisCommandHandler::handleHgetall, nullptr, 1, 1, 1}},
+        {"HEXISTS", {&RedisCommandHandler::handleHexists, nullptr, 1, 1, 1}},
+        {"HDEL", {&RedisCommandHandler::handleHdel, nullptr, 1, 1, 1, true}},
+        {"HKEYS", {&RedisCommandHandler::handleHkeys, nullptr, 1, 1, 1}},
+        {"HVALS", {&RedisCommandHandler::handleHvals, nullptr, 1, 1, 1}},
+        {"HLEN", {&RedisCommandHandler::handleHlen, nullptr, 1, 1, 1}},
+        {"HMSET", {&RedisCommandHandler::handleHmset, nullptr, 1, 1, 1, true}},
+        {"HMGET", {&RedisCommandHandler::handleHmget, nullptr, 1, 1, 1}},
+
+        // Sorted Set Operations
+        {"ZADD", {&RedisCommandHandler::handleZadd, nullptr, 1, 1, 1, true}},
+        {"ZINCRBY", {&RedisCommandHandler::handleZincrby, nullptr, 1, 1, 1, true}},
+        {"ZREM", {&RedisCommandHandler::handleZrem, nullptr, 1, 1, 1, true}},
+        {"ZSCORE", {&RedisCommandHandler::handleZscore, nullptr, 1, 1, 1}},
+        {"ZCARD", {&RedisCommandHandler::handleZcard, nullptr, 1, 1, 1}},
+        {"ZRANK", {&RedisCommandHandler::handleZrank, nullptr, 1, 1, 1}},
+        {"ZREVRANK", {&RedisCommandHandler::handleZrevrank, nullptr, 1, 1, 1}},
+        {"ZRANGE", {&RedisCommandHandler::handleZrange, nullptr, 1, 1, 1}},
+        {"ZREVRANGE", {&RedisCommandHandler::handleZrevrange, nullptr, 1, 1, 1}},
+        {"ZRANGEBYSCORE", {&RedisCommandHandler::handleZrangebyscore, nullptr, 1, 1, 1}},
+
+        // Set Operations
+        {"SADD", {&RedisCommandHandler::handleSadd, nullptr, 1, 1, 1, true}},
+        {"SREM", {&RedisCommandHandler::handleSrem, nullptr, 1, 1, 1, true}},
+        {"SISMEMBER", {&RedisCommandHandler::handleSismember, nullptr, 1, 1, 1}},
+        {"SMEMBERS", {&RedisCommandHandler::handleSmembers, nullptr, 1, 1, 1}},
+        {"SCARD", {&RedisCommandHandler::handleScard, nullptr, 1, 1, 1}},
+        {"SINTER", {&RedisCommandHandler::handleSinter, nullptr, 1, -1, 1}},
+        {"SUNION", {&RedisCommandHandler::handleSunion, nullptr, 1, -1, 1}},
+        {"SDIFF", {&RedisCommandHandler::handleSdiff, nullptr, 1, -1, 1}},
+
+        // Stream Operations :- writes that pick ids, trim approximately or look at idle
+        // times are session handlers, they replicate what they actually did
+        {"XADD", {nullptr, &RedisCommandHandler::handleXadd, 1, 1, 1, true}},
+        {"XLEN", {&RedisCommandHandler::handleXlen, nullptr, 1, 1, 1}},
+        {"XRANGE", {&RedisCommandHandler::handleXrange, nullptr, 1, 1, 1}},
+        {"XREVRANGE", {&RedisCommandHandler::handleXrevrange, nullptr, 1, 1, 1}},
+        {"XDEL", {&RedisCommandHandler::handleXdel, nullptr, 1, 1, 1, true}},
+        {"XTRIM", {nullptr, &RedisCommandHandler::handleXtrim, 1, 1, 1, true}},
+        {"XREAD", {nullptr, &RedisCommandHandler::handleXread}},
+        {"XREADGROUP", {nullptr, &RedisCommandHandler::handleXreadgroup, 0, 0, 0, true}},
+        {"XGROUP", {nullptr, &RedisCommandHandler::handleXgroup, 0, 0, 0, true}},
+        {"XACK", {&RedisCommandHandler::handleXack, nullptr, 1, 1, 1, true}},
+        {"XPENDING", {&RedisCommandHandler::handleXpending, nullptr, 1, 1, 1}},
+        {"XCLAIM", {nullptr, &RedisCommandHandler::handleXclaim, 1, 1, 1, true}},
+        {"XINFO", {&RedisCommandHandler::handleXinfo, nullptr}},
+
+        // Scripting
+        {"EVAL", {nullptr, &RedisCommandHandler::handleEval, 0, 0, 0, false, true}},
+        {"EVALSHA", {nullptr, &RedisCommandHandler::handleEvalsha, 0, 0, 0, false, true}},
+        {"SCRIPT", {&RedisCommandHandler::handleScript, nullptr, 0, 0, 0, false, true}},
+
+        // Replication
+        {"REPLICAOF", {&RedisCommandHandler::handleReplicaof, nullptr, 0, 0, 0, false, true}},
+        {"SLAVEOF", {&RedisCommandHandler::handleReplicaof, nullptr, 0, 0, 0, false, true}},
+        {"REPLCONF", {nullptr, &RedisCommandHandler::handleReplconf, 0, 0, 0, false, true}},
+        {"PSYNC", {nullptr, &RedisCommandHandler::handlePsync, 0, 0, 0, false, true}},
+        {"SYNC", {nullptr, &RedisCommandHandler::handlePsync, 0, 0, 0, false, true}},
+        {"ROLE", {&RedisCommandHandler::handleRole, nullptr}},
+        {"INFO", {&RedisCommandHandler::handleInfo, nullptr}},
+
+        // Cluster
+        {"CLUSTER", {&RedisCommandHandler::handleCluster, nullptr}},
+
+        // Key Migration
+        {"MIGRATE", {nullptr, &RedisCommandHandler::handleMigrate, 0, 0, 0, true, true}},
+        {"RESTORE", {&RedisCommandHandler::handleRestore, nullptr, 1, 1, 1, true}},
+        {"DUMP", {&RedisCommandHandler::handleDump, nullptr, 1, 1, 1}},
+
+        // Pub/Sub
+        {"SUBSCRIBE", {nullptr, &RedisCommandHandler::handleSubscribe, 0, 0, 0, false, true}},
+        {"UNSUBSCRIBE", {nullptr, &RedisCommandHandler::handleUnsubscribe, 0, 0, 0, false, true}},
+        {"PSUBSCRIBE", {nullptr, &RedisCommandHandler::handlePsubscribe, 0, 0, 0, false, true}},
+        {"PUNSUBSCRIBE", {nullptr, &RedisCommandHandler::handlePunsubscribe, 0, 0, 0, false, true}},
+        {"PUBLISH", {&RedisCommandHandler::handlePublish, nullptr}},
+        {"PUBSUB", {&RedisCommandHandler::handlePubsub, nullptr}},
+
+        // Connections
+        {"CLIENT", {nullptr, &RedisCommandHandler::handleClient, 0, 0, 0, false, true}},
+        {"HELLO", {nullptr, &RedisCommandHandler::handleHello, 0, 0, 0, false, true}},
+    };
+    return table;
+}
+
+std::string RedisCommandHandler::execute(const std::string& cmd, const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db) {
+    const auto& table = commandTable();
+    auto it = table.find(cmd);
+    if (it == table.end()) {
+        return "-ERR unknown command '" + cmd + "'\r\n";
+    }
+    const CommandSpec& spec = it->second;
+    if (!spec.write || session.isMaster) {
+        // reads, and our master's stream (Replication copies that into the backlog verbatim)
+        if (spec.sessionHandler) {
+            return (this->*(spec.sessionHandler))(tokens, session, db);
+        }
+        if (session.tracking && !session.trackingBcast) {
+            // The keys go into the invalidation table under the read's lock, so a
+            // write can't change them between the reply and the table entry
+            auto lock = db.acquireLock();
+            std::string reply = (this->*(spec.handler))(tokens, db);
+            std::vector<size_t> keyIndexes;
+            if ((reply.empty() || reply[0] != '-') && commandKeys(tokens, keyIndexes) && !keyIndexes.empty()) {
+                std::vector<std::string> keys;
+                for (size_t i : keyIndexes) {
+                    keys.push_back(tokens[i]);
+                }
+                Tracking::getInstance().remember(session.id, keys);
+            }
+            return reply;
+        }
+        return (this->*(spec.handler))(tokens, db);
+    }
+
+    Replication& repl = Replication::getInstance();
+    if (repl.isReplica()) {
+        return "-READONLY You can't write against a read only replica.\r\n";
+    }
+    if (spec.sessionHandler) {
+        // Blocking pops must not hold the lock while they wait; what they took is
+        // propagated as LPOP/RPOP/LMOVE through ListWaiter::onServed
+        std::string reply = (this->*(spec.sessionHandler))(tokens, session, db);
+        if (repl.active()) {
+            auto lock = db.acquireLock();
+            repl.flushDeferred();
+        }
+        return reply;
+    }
+    // Execute and propagate under one lock so the stream has the order the writes had
+    auto lock = db.acquireLock();
+    bool propagating = repl.active();
+    if (propagating) {
+        repl.flushDeferred();
+    }
+    std::string reply = (this->*(spec.handler))(tokens, db);
+    if (propagating) {
+        if (reply.empty() || reply[0] != '-') {
+            repl.propagate(tokens);
+        }
+        repl.flushDeferred(); // clients this push unblocked
+    }
+    return reply;
+}
+
+bool RedisCommandHandler::commandKeys(const std::vector<std::string>& tokens, std::vector<size_t>& keyIndexes) {
+    keyIndexes.clear();
+    if (tokens.empty()) {
+        return false;
+    }
+    std::string cmd = tokens[0];
+    std::transform(cmd.begin(), cmd.end(), cmd.begin(), ::toupper);
+    auto it = commandTable().find(cmd);
+    if (it == commandTable().end()) {
+        return false;
+    }
+
+    // numkeys-style commands :- EVAL script numkeys k..., LMPOP numkeys k...
+    size_t numkeysAt = 0;
+    if (cmd == "EVAL" || cmd == "EVALSHA")
+        numkeysAt = 2;
+    else if (cmd == "LMPOP")
+        numkeysAt = 1;
+    if (numkeysAt) {
+        if (tokens.size() > numkeysAt) {
+            long n = std::strtol(tokens[numkeysAt].c_str(), nullptr, 10);
+            for (long i = 0; i < n && numkeysAt + 1 + i < tokens.size(); ++i) {
+                keyIndexes.push_back(numkeysAt + 1 + i);
+            }
+        }
+        return true;
+    }
+    if (cmd == "MIGRATE") {
+        // MIGRATE host port key|"" db timeout [COPY] [REPLACE] [KEYS key...]
+        if (tokens.size() > 3 && !tokens[3].empty()) {
+            keyIndexes.push_back(3);
+            return true;
+        }
+        for (size_t i = 6; i < tokens.size(); ++i) {
+            std::string opt = tokens[i];
+            std::transform(opt.begin(), opt.end(), opt.begin(), ::toupper);
+            if (opt == "KEYS") {
+                for (size_t k = i + 1; k < tokens.size(); ++k) {
+                    keyIndexes.push_back(k);
+                }
+                break;
+            }
+        }
+        return true;
+    }
+    if (cmd == "XREAD" || cmd == "XREADGROUP") {
+        // ... STREAMS key [key ...] id [id ...]
+        for (size_t i = 1; i < tokens.size(); ++i) {
+            std::string opt = tokens[i];
+            std::transform(opt.begin(), opt.end(), opt.begin(), ::toupper);
+            if (opt == "STREAMS") {
+                size_t n = (tokens.size() - i - 1) / 2;
+                for (size_t k = 0; k < n; ++k) {
+                    keyIndexes.push_back(i + 1 + k);
+                }
+                break;
+            }
+        }
+        return true;
+    }
+    if (cmd == "MEMORY" || cmd == "XGROUP" || cmd == "XINFO") {
+        if (tokens.size() >= 3) {
+            keyIndexes.push_back(2); // MEMORY USAGE key, XGROUP CREATE key ..., XINFO STREAM key
+        }
+        return true;
+    }
+
+    const CommandSpec& spec = it->second;
+    if (spec.firstKey == 0) {
+        return true;
+    }
+    long last = spec.lastKey < 0 ? static_cast<long>(tokens.size()) + spec.lastKey : spec.lastKey;
+    for (long i = spec.firstKey; i <= last && i < static_cast<long>(tokens.size()); i += spec.keyStep) {
+        keyIndexes.push_back(i);
+    }
+    return true;
+}
+
+std::string RedisCommandHandler::processCommand(const std::vector<std::string>& tokens, ClientSession& session) {
+    return processCommand(tokens, session, RedisDatabase::getInstance());
+}
+
+std::string RedisCommandHandler::processCommand(const std::vector<std::string>& tokens, ClientSession& session, RedisDatabase& db) {
     if (tokens.empty()) {
         return "-ERR invalid command format\r\n";
     }
 
     std::string cmd = tokens[0];
     std::transform(cmd.begin(), cmd.end(), cmd.begin(), ::toupper);
+    Resp::Scope protocol(session.resp); // replies built below use the connection's RESP version
+    ClientActivity activity(session.info.get(), cmd); // CLIENT LIST cmd and idle, never idle while it runs
+
+    // Subscribed mode :- only (un)subscribing and PING until the last subscription is gone.
+    // RESP3 tells pushes from replies, any command can run there.
+    if (session.subscriber && session.subscriber->subscriptions() > 0 && session.resp == 2) {
+        if (cmd == "PING") {
+            const std::string arg = tokens.size() > 1 ? tokens[1] : "";
+            return "*2\r\n$4\r\npong\r\n$" + std::to_string(arg.size()) + "\r\n" + arg + "\r\n";
+        }
+        if (cmd != "SUBSCRIBE" && cmd != "UNSUBSCRIBE" && cmd != "PSUBSCRIBE" && cmd != "PUNSUBSCRIBE") {
+            return "-ERR Can't execute '" + tokens[0] +
+                   "': only (P)SUBSCRIBE / (P)UNSUBSCRIBE / PING are allowed in this context\r\n";
+        }
+    }
 
-    RedisDatabase& db = RedisDatabase::getInstance();
+    // Cluster mode :- commands on keys of another node are redirected, never run or queued.
+    // ASKING only lasts for the command right after it.
+    if (cmd == "ASKING") {
+        session.asking = true;
+        return "+OK\r\n";
+    }
+    bool asking = session.asking;
+    session.asking = false;
+    Cluster& cluster = Cluster::getInstance();
+    std::unique_lock<std::recursive_mutex> routeLock;
+    if ((cluster.enabled() || cluster.moving()) && !session.isMaster) {
+        // While keys move, the check and the command share one db lock so a key can't
+        // leave between them (not for blocking commands, they wait without the lock)
+        if (cluster.moving()) {
+            auto it = commandTable().find(cmd);
+            if (it == commandTable().end() || !it->second.sessionHandler) {
+                routeLock = db.acquireLock();
+            }
+        }
+        std::string redirect = clusterRedirect(cmd, tokens, asking, db);
+        if (!redirect.empty()) {
+            if (session.inMulti) {
+                session.multiError = true;
+            }
+            return redirect;
+        }
+    }
+
+    // Transaction control commands act on the session, never get queued
+    if (cmd == "MULTI")
+        return handleMulti(session);
+    else if (cmd == "EXEC")
+        return handleExec(session, db);
+    else if (cmd == "DISCARD")
+        return handleDiscard(session, db);
+    else if (cmd == "WATCH")
+        return handleWatch(tokens, session, db);
+    else if (cmd == "UNWATCH")
+        return handleUnwatch(session, db);
 
     // Dispatch to handlers
-    if (cmd == "PING")
-        return handlePing(tokens, db);
-    else if (cmd == "ECHO")
-        return handleEcho(tokens, db);
-    else if (cmd == "FLUSHALL")
-        return handleFlushAll(tokens, db);
-    else if (cmd == "SET")
-        return handleSet(tokens, db);
-
-    else if (cmd == "GET")
-        return handleGet(tokens, db);
-    else if (cmd == "KEYS")
-        return handleKeys(tokens, db);
-    else if (cmd == "TYPE")
-        return handleType(tokens, db);
-    else if (cmd == "DEL" || cmd == "UNLINK")
-        return handleDel(tokens, db);
-    else if (cmd == "EXPIRE")
-        return handleExpire(tokens, db);
-    else if (cmd == "RENAME")
-
-        return handleRename(tokens, db);
-    else if (cmd == "LPUSH")
-        return handleLpush(tokens, db);
-    else if (cmd == "LPOP")
-        return handleLpop(tokens, db);
-    else if (cmd == "RPUSH")
-        return handleRpush(tokens, db);
-    else if (cmd == "RPOP")
-        return handleRpop(tokens, db);
-    else if (cmd == "LLEN")
-        return handleLlen(tokens, db);
-    else if (cmd == "LGET")
-        return handleLget(tokens, db);
-    else if (cmd == "LINDEX")
-        return handleLindex(tokens, db);
-    else if (cmd == "LSET")
-        return handleLset(tokens, db);
-    else if (cmd == "LREM")
-        return handleLrem(tokens, db);
-
-    else if (cmd == "HSET")
-        return handleHset(tokens, db);
-    else if (cmd == "HGET")
-        return handleHget(tokens, db);
-    else if (cmd == "HGETALL")
-        return handleHgetall(tokens, db);
-    else if (cmd == "HEXISTS")
-        return handleHexists(tokens, db);
-    else if (cmd == "HDEL")
-        return handleHdel(tokens, db);
-    else if (cmd == "HKEYS")
-        return handleHkeys(tokens, db);
-    else if (cmd == "HVALS")
-        return handleHvals(tokens, db);
-    else if (cmd == "HLEN")
-        return handleHlen(tokens, db);
-    else if (cmd == "HMSET")
-        return handleHmset(tokens, db);
-        
-    else
-        return "-ERR unknown command '" + cmd + "'\r\n";
+    if (session.inMulti) {
+        if (commandTable().find(cmd) == commandTable().end()) {
+            session.multiError = true;
+            return "-ERR unknown command '" + cmd + "'\r\n";
+        }
+        session.queued.push_back(tokens);
+        return "+QUEUED\r\n";
+    }
+    return execute(cmd, tokens, session, db);
 }
 
+std::string RedisCommandHandler::clusterRedirect(const std::string& cmd, const std::vector<std::string>& tokens, bool asking, RedisDatabase& db) {
+    std::vector<std::string> keys;
+    if (cmd == "WATCH") {
+        keys.assign(tokens.begin() + 1, tokens.end());
+    } else {
+        std::vector<size_t> keyIndexes;
+        commandKeys(tokens, keyIndexes);
+        for (size_t i : keyIndexes) {
+            keys.push_back(tokens[i]);
+        }
+    }
+    return Cluster::getInstance().redirect(keys, asking, db);
+}
 
+void RedisCommandHandler::closeSession(ClientSession& session) {
+    closeSession(session, RedisDatabase::getInstance());
+}
+
+void RedisCommandHandler::closeSession(ClientSession& session, RedisDatabase& db) {
+    if (session.tracking || session.subscriber) {
+        Tracking::getInstance().detach(session.id);
+        session.tracking = false;
+    }
+    if (session.subscriber) {
+        PubSub::getInstance().drop(session.subscriber);
+        session.subscriber.reset();
+    }
+    handleUnwatch(session, db);
+    session.inMulti = false;
+    session.queued.clear();
+    if (session.info) {
+        ClientRegistry::getInstance().remove(session.id);
+        session.info.reset();
+    }
+}
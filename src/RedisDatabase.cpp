@@ -1,4 +1,7 @@
 #include "../include/RedisDatabase.h"
+#include "../include/LazyFree.h"
+#include "../include/Tracking.h"
+#include "../include/IoUring.h"
 #include <fstream>
 #include <mutex>
 #include <iostream>
@@ -7,6 +10,11 @@
 #include <vector>
 #include <algorithm>
 #include <iterator>
+#include <condition_variable>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
 
 RedisDatabase& RedisDatabase::getInstance() {
     static RedisDatabase instance;
@@ -14,34 +22,145 @@ RedisDatabase& RedisDatabase::getInstance() {
 }
 
     //command operations
-    bool RedisDatabase::flushAll(){
-        std::lock_guard<std::mutex> lock(db_mutex); 
+    bool RedisDatabase::flushAll(bool async){
+        std::lock_guard<std::recursive_mutex> lock(db_mutex); 
+        touchAll();
+        if(async){
+            // Swap the stores out in O(1), the background thread destroys the old contents
+            LazyFree& lazy = LazyFree::getInstance();
+            lazy.free(std::move(kv_store));
+            lazy.free(std::move(list_store));
+            lazy.free(std::move(hash_store));
+            lazy.free(std::move(zset_store));
+            lazy.free(std::move(set_store));
+            lazy.free(std::move(stream_store));
+        }
         kv_store.clear();
         list_store.clear();
         hash_store.clear();
+        zset_store.clear();
+        set_store.clear();
+        stream_store.clear();
         expiry_map.clear();
         return true;
     }
 
     //key-value operations
     bool RedisDatabase::set(const std::string& key, const std::string& value){
-        std::lock_guard<std::mutex> lock(db_mutex); 
+        std::lock_guard<std::recursive_mutex> lock(db_mutex); 
+        touch(key);
+        dropOtherType(key, "string");
         kv_store[key] = value;
         return true;
     }
 
     bool RedisDatabase::get(const std::string& key, std::string& value){//not const std::string& value
-        std::lock_guard<std::mutex> lock(db_mutex); 
+        std::lock_guard<std::recursive_mutex> lock(db_mutex); 
         auto it = kv_store.find(key);
         if(it != kv_store.end()){
-            value = it->second;
+            value = it->second.str();
             return true;
         }
         return false;
     }
 
+    std::vector<std::optional<std::string>> RedisDatabase::mget(const std::vector<std::string>& keys){
+        std::lock_guard<std::recursive_mutex> lock(db_mutex); 
+        std::vector<std::optional<std::string>> values;
+        values.reserve(keys.size());
+        for(const auto& key : keys){
+            auto it = kv_store.find(key);
+            if(it != kv_store.end()){
+                values.emplace_back(it->second.str());
+            } else {
+                values.emplace_back(std::nullopt);
+            }
+        }
+        return values;
+    }
+
+    void RedisDatabase::mset(const std::vector<std::pair<std::string, std::string>>& keyValues){
+        std::lock_guard<std::recursive_mutex> lock(db_mutex); 
+        for(const auto& kv : keyValues){
+            touch(kv.first);
+            dropOtherType(kv.first, "string");
+            kv_store[kv.first] = kv.second;
+        }
+    }
+
+    // All or nothing: the existence check and the writes happen under the same lock
+    bool RedisDatabase::msetnx(const std::vector<std::pair<std::string, std::string>>& keyValues){
+        std::lock_guard<std::recursive_mutex> lock(db_mutex); 
+        for(const auto& kv : keyValues){
+            if(std::string(typeOf(kv.first)) != "none"){
+                return false;
+            }
+        }
+        mset(keyValues);
+        return true;
+    }
+
+    // Integer-encoded values are updated in place, no parse or allocation
+    int RedisDatabase::incrby(const std::string& key, int64_t delta, int64_t& result){
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        if(wrongType(key, "string")){
+            return -1;
+        }
+        int64_t current = 0;
+        auto it = kv_store.find(key);
+        if(it != kv_store.end() && !it->second.toInt(current)){
+            return -2;
+        }
+        if(__builtin_add_overflow(current, delta, &result)){
+            return -3;
+        }
+        kv_store[key] = StringValue(result);
+        touch(key);
+        return 0;
+    }
+
+    int RedisDatabase::incrbyfloat(const std::string& key, long double delta, std::string& result){
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        if(wrongType(key, "string")){
+            return -1;
+        }
+        long double current = 0;
+        auto it = kv_store.find(key);
+        if(it != kv_store.end()){
+            std::string text = it->second.str();
+            char* end = nullptr;
+            current = std::strtold(text.c_str(), &end);
+            if(text.empty() || end != text.c_str() + text.size() || std::isspace(static_cast<unsigned char>(text[0])) || std::isnan(current)){
+                return -2;
+            }
+        }
+        long double sum = current + delta;
+        if(std::isnan(sum) || std::isinf(sum)){
+            return -3;
+        }
+        // Same human friendly form as Redis: fixed point, trailing zeros dropped
+        char buf[5120];
+        int len = snprintf(buf, sizeof(buf), "%.17Lf", sum);
+        if(len <= 0 || len >= static_cast<int>(sizeof(buf))){
+            return -3;
+        }
+        while(len > 0 && buf[len - 1] == '0'){
+            --len;
+        }
+        if(len > 0 && buf[len - 1] == '.'){
+            --len;
+        }
+        result.assign(buf, len);
+        if(result == "-0"){
+            result = "0";
+        }
+        kv_store[key] = StringValue(result);
+        touch(key);
+        return 0;
+    }
+
     std::vector<std::string> RedisDatabase::keys(){
-        std::lock_guard<std::mutex> lock(db_mutex); 
+        std::lock_guard<std::recursive_mutex> lock(db_mutex); 
         std::vector<std::string> keys;
         for(const auto& kv:kv_store){
             keys.push_back(kv.first);
@@ -52,11 +171,43 @@ RedisDatabase& RedisDatabase::getInstance() {
         for(const auto& hash:hash_store){
             keys.push_back(hash.first);
         }
+        for(const auto& zset:zset_store){
+            keys.push_back(zset.first);
+        }
+        for(const auto& set:set_store){
+            keys.push_back(set.first);
+        }
+        for(const auto& stream:stream_store){
+            keys.push_back(stream.first);
+        }
+        return keys;
+    }
+
+    std::vector<std::string> RedisDatabase::keysMatching(const std::function<bool(const std::string&)>& match, size_t limit){
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        std::vector<std::string> keys;
+        auto scan = [&](const auto& store){
+            for(auto it = store.begin(); it != store.end() && keys.size() < limit; ++it){
+                if(match(it->first)){
+                    keys.push_back(it->first);
+                }
+            }
+        };
+        scan(kv_store);
+        scan(list_store);
+        scan(hash_store);
+        scan(zset_store);
+        scan(set_store);
+        scan(stream_store);
         return keys;
     }
 
     std::string RedisDatabase::type(const std::string& key){
-        std::lock_guard<std::mutex> lock(db_mutex); 
+        std::lock_guard<std::recursive_mutex> lock(db_mutex); 
+        return typeOf(key);
+    }
+
+    const char* RedisDatabase::typeOf(const std::string& key){
         if(kv_store.find(key) != kv_store.end()){
             return "string";
         }
@@ -66,25 +217,91 @@ RedisDatabase& RedisDatabase::getInstance() {
         if(hash_store.find(key) != hash_store.end()){
             return "hash";
         }
+        if(zset_store.find(key) != zset_store.end()){
+            return "zset";
+        }
+        if(set_store.find(key) != set_store.end()){
+            return "set";
+        }
+        if(stream_store.find(key) != stream_store.end()){
+            return "stream";
+        }
         return "none";
     }
 
+    // key holds a value of some type other than expected
+    bool RedisDatabase::wrongType(const std::string& key, const char* expected){
+        std::string actual = typeOf(key);
+        return actual != "none" && actual != expected;
+    }
+
     bool RedisDatabase::del(const std::string& key){
-        std::lock_guard<std::mutex> lock(db_mutex); 
+        std::lock_guard<std::recursive_mutex> lock(db_mutex); 
+        return eraseKey(key, false);
+    }
+
+    size_t RedisDatabase::del(const std::vector<std::string>& keys, bool lazy){
+        std::lock_guard<std::recursive_mutex> lock(db_mutex); 
+        size_t deleted = 0;
+        for(const auto& key : keys){
+            if(eraseKey(key, lazy)){
+                ++deleted;
+            }
+        }
+        return deleted;
+    }
+
+    // Repeated keys are counted every time, like Redis
+    size_t RedisDatabase::exists(const std::vector<std::string>& keys){
+        std::lock_guard<std::recursive_mutex> lock(db_mutex); 
+        size_t found = 0;
+        for(const auto& key : keys){
+            if(std::string(typeOf(key)) != "none"){
+                ++found;
+            }
+        }
+        return found;
+    }
+
+    // Remove key from store; with lazy set, big values are destroyed by the LazyFree thread
+    template <typename Store>
+    static bool dropFrom(Store& store, const std::string& key, bool lazy){
+        auto it = store.find(key);
+        if(it == store.end()){
+            return false;
+        }
+        if(lazy && it->second.size() > LazyFree::kThreshold){
+            LazyFree::getInstance().free(std::move(it->second));
+        }
+        store.erase(it);
+        return true;
+    }
+
+    bool RedisDatabase::eraseKey(const std::string& key, bool lazy){
+        touch(key);
         bool deleted = false;
-        deleted |= (kv_store.erase(key) > 0);//return number of elements removed
-        deleted |= (list_store.erase(key) > 0);
-        deleted |= (hash_store.erase(key) > 0);
+        deleted |= (kv_store.erase(key) > 0); // strings are a single allocation, always freed inline
+        deleted |= dropFrom(list_store, key, lazy);
+        deleted |= dropFrom(hash_store, key, lazy);
+        deleted |= dropFrom(zset_store, key, lazy);
+        deleted |= dropFrom(set_store, key, lazy);
+        deleted |= dropFrom(stream_store, key, lazy);
         expiry_map.erase(key);
         return deleted;
     }
 
+    // A write of type `keep` replaces whatever other type the key held
+    void RedisDatabase::dropOtherType(const std::string& key, const char* keep){
+        if(wrongType(key, keep)){
+            eraseKey(key, true);
+        }
+    }
+
     bool RedisDatabase::expire(const std::string& key, int seconds){
-        std::lock_guard<std::mutex> lock(db_mutex); 
-        bool exists = (kv_store.find(key) != kv_store.end()) ||
-                      (list_store.find(key) != list_store.end()) ||
-                      (hash_store.find(key) != hash_store.end());
+        std::lock_guard<std::recursive_mutex> lock(db_mutex); 
+        bool exists = std::string(typeOf(key)) != "none";
         if(exists){
+            touch(key);
             expiry_map[key] = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
             return true;
         }
@@ -92,68 +309,133 @@ RedisDatabase& RedisDatabase::getInstance() {
     }
 
     bool RedisDatabase::rename(const std::string& oldKey, const std::string& newKey){
-        std::lock_guard<std::mutex> lock(db_mutex); 
-        if(kv_store.find(oldKey) != kv_store.end()){
-            kv_store[newKey] = kv_store[oldKey];
-            kv_store.erase(oldKey);
-            return true;
+        std::lock_guard<std::recursive_mutex> lock(db_mutex); 
+        if(std::string(typeOf(oldKey)) == "none"){
+            return false;
         }
-        if(list_store.find(oldKey) != list_store.end()){
-            list_store[newKey] = list_store[oldKey];
-            list_store.erase(oldKey);
+        if(oldKey == newKey){
             return true;
         }
-        if(hash_store.find(oldKey) != hash_store.end()){
-            hash_store[newKey] = hash_store[oldKey];
-            hash_store.erase(oldKey);
-            return true;
+        touch(oldKey);
+        eraseKey(newKey, true); // the overwritten value may be big
+        // Values are moved, not copied, so renaming a big key is O(1)
+        auto kit = kv_store.find(oldKey);
+        if(kit != kv_store.end()){
+            kv_store.emplace(newKey, std::move(kit->second));
+            kv_store.erase(kit);
         }
-        return false;
+        auto lit = list_store.find(oldKey);
+        if(lit != list_store.end()){
+            list_store.emplace(newKey, std::move(lit->second));
+            list_store.erase(lit);
+            serveListWaiters(newKey);
+        }
+        auto hit = hash_store.find(oldKey);
+        if(hit != hash_store.end()){
+            hash_store.emplace(newKey, std::move(hit->second));
+            hash_store.erase(hit);
+        }
+        auto zit = zset_store.find(oldKey);
+        if(zit != zset_store.end()){
+            zset_store.emplace(newKey, std::move(zit->second));
+            zset_store.erase(zit);
+        }
+        auto sit = set_store.find(oldKey);
+        if(sit != set_store.end()){
+            set_store.emplace(newKey, std::move(sit->second));
+            set_store.erase(sit);
+        }
+        auto xit = stream_store.find(oldKey);
+        if(xit != stream_store.end()){
+            stream_store.emplace(newKey, std::move(xit->second));
+            stream_store.erase(xit);
+            signalStreamWaiters(newKey);
+        }
+        auto eit = expiry_map.find(oldKey);
+        if(eit != expiry_map.end()){
+            expiry_map[newKey] = eit->second;
+            expiry_map.erase(eit);
+        }
+        return true;
     }
 
     //list operations
     std::vector<std::string> RedisDatabase::lget(const std::string& key) {
-        std::lock_guard<std::mutex> lock(db_mutex);
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
         auto it = list_store.find(key);
         if (it != list_store.end()) {
-            return it->second; 
+            return std::vector<std::string>(it->second.begin(), it->second.end()); 
         }
         return {}; 
     }
 
     ssize_t RedisDatabase::llen(const std::string& key) {
-        std::lock_guard<std::mutex> lock(db_mutex);
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
         auto it = list_store.find(key);
         if (it != list_store.end()) 
             return it->second.size();
         return 0;
     }
 
-    void RedisDatabase::lpush(const std::string& key, const std::string& value) {
-        std::lock_guard<std::mutex> lock(db_mutex);
-        list_store[key].insert(list_store[key].begin(), value);
+    ssize_t RedisDatabase::lpush(const std::string& key, const std::string& value) {
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        touch(key);
+        auto& lst = list_store[key];
+        lst.push_front(value);
+        ssize_t len = lst.size();
+        serveListWaiters(key);
+        return len;
     }
 
-    void RedisDatabase::rpush(const std::string& key, const std::string& value) {
-        std::lock_guard<std::mutex> lock(db_mutex);
-        list_store[key].push_back(value);
+    ssize_t RedisDatabase::rpush(const std::string& key, const std::string& value) {
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        touch(key);
+        auto& lst = list_store[key];
+        lst.push_back(value);
+        ssize_t len = lst.size();
+        serveListWaiters(key);
+        return len;
+    }
+
+    ssize_t RedisDatabase::lpush(const std::string& key, const std::vector<std::string>& values) {
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        touch(key);
+        auto& lst = list_store[key];
+        for (const auto& value : values) {
+            lst.push_front(value);
+        }
+        ssize_t len = lst.size();
+        serveListWaiters(key);
+        return len;
+    }
+
+    ssize_t RedisDatabase::rpush(const std::string& key, const std::vector<std::string>& values) {
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        touch(key);
+        auto& lst = list_store[key];
+        lst.insert(lst.end(), values.begin(), values.end());
+        ssize_t len = lst.size();
+        serveListWaiters(key);
+        return len;
     }
 
     bool RedisDatabase::lpop(const std::string& key, std::string& value) {
-        std::lock_guard<std::mutex> lock(db_mutex);
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
         auto it = list_store.find(key);
         if (it != list_store.end() && !it->second.empty()) {
-            value = it->second.front();
-            it->second.erase(it->second.begin());
+            touch(key);
+            value = std::move(it->second.front());
+            it->second.pop_front();
             return true;
         }
         return false;
     }
 
     bool RedisDatabase::rpop(const std::string& key, std::string& value) {
-        std::lock_guard<std::mutex> lock(db_mutex);
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
         auto it = list_store.find(key);
         if (it != list_store.end() && !it->second.empty()) {
+            touch(key);
             value = it->second.back();
             it->second.pop_back();
             return true;
@@ -162,13 +444,14 @@ RedisDatabase& RedisDatabase::getInstance() {
     }
 
     int RedisDatabase::lrem(const std::string& key, int count, const std::string& value) {
-        std::lock_guard<std::mutex> lock(db_mutex);
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
         int removed = 0;
         auto it = list_store.find(key);
         if (it == list_store.end()) 
             return 0;
 
         auto& lst = it->second;
+        touch(key);
 
         if (count == 0) {
             // Remove all occurances
@@ -193,7 +476,7 @@ RedisDatabase& RedisDatabase::getInstance() {
                     --fwdIter;
                     fwdIter = lst.erase(fwdIter);
                     ++removed;
-                    riter = std::reverse_iterator<std::vector<std::string>::iterator>(fwdIter);
+                    riter = std::reverse_iterator<std::deque<std::string>::iterator>(fwdIter);
                 } else {
                     ++riter;
                 }
@@ -203,7 +486,7 @@ RedisDatabase& RedisDatabase::getInstance() {
     }
 
     bool RedisDatabase::lindex(const std::string& key, int index, std::string& value) {
-        std::lock_guard<std::mutex> lock(db_mutex);
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
         auto it = list_store.find(key);
         if (it == list_store.end()) 
             return false;
@@ -219,7 +502,7 @@ RedisDatabase& RedisDatabase::getInstance() {
     }
 
     bool RedisDatabase::lset(const std::string& key, int index, const std::string& value) {
-        std::lock_guard<std::mutex> lock(db_mutex);
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
         auto it = list_store.find(key);
         if (it == list_store.end()) 
             return false;
@@ -230,20 +513,229 @@ RedisDatabase& RedisDatabase::getInstance() {
         if (index < 0 || index >= static_cast<int>(lst.size()))
             return false;
         
+        touch(key);
         lst[index] = value;
         return true;
     }
 
+    bool RedisDatabase::lmove(const std::string& source, const std::string& destination, bool fromLeft, bool toLeft, std::string& value) {
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        if (!popFront(source, fromLeft, value))
+            return false;
+        pushTo(destination, toLeft, value);
+        serveListWaiters(destination);
+        return true;
+    }
+
+    bool RedisDatabase::popFront(const std::string& key, bool fromLeft, std::string& value) {
+        auto it = list_store.find(key);
+        if (it == list_store.end() || it->second.empty())
+            return false;
+        touch(key);
+        auto& lst = it->second;
+        if (fromLeft) {
+            value = std::move(lst.front());
+            lst.pop_front();
+        } else {
+            value = std::move(lst.back());
+            lst.pop_back();
+        }
+        if (lst.empty()) {
+            list_store.erase(it); // an emptied list is gone, TTL and all, like Redis
+            expiry_map.erase(key);
+        }
+        return true;
+    }
+
+    void RedisDatabase::pushTo(const std::string& key, bool toLeft, const std::string& value) {
+        touch(key);
+        auto& lst = list_store[key];
+        if (toLeft)
+            lst.push_front(value);
+        else
+            lst.push_back(value);
+    }
+
+    // Clamp Redis style inclusive indexes to [0, size), false if the range is empty
+    bool RedisDatabase::normalizeRange(size_t size, long& start, long& stop) {
+        long len = static_cast<long>(size);
+        if (start < 0) start = std::max(0L, len + start);
+        if (stop < 0) stop = len + stop;
+        if (stop >= len) stop = len - 1;
+        return start <= stop && start < len;
+    }
+
+    std::vector<std::string> RedisDatabase::lrange(const std::string& key, long start, long stop) {
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        auto it = list_store.find(key);
+        if (it == list_store.end() || !normalizeRange(it->second.size(), start, stop))
+            return {};
+        // copy only the requested slice
+        return std::vector<std::string>(it->second.begin() + start, it->second.begin() + stop + 1);
+    }
+
+    bool RedisDatabase::ltrim(const std::string& key, long start, long stop) {
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        auto it = list_store.find(key);
+        if (it == list_store.end())
+            return true;
+        touch(key);
+        auto& lst = it->second;
+        if (!normalizeRange(lst.size(), start, stop)) {
+            list_store.erase(it); // nothing left in range, the key goes like any emptied list
+            expiry_map.erase(key);
+            return true;
+        }
+        // erase the tail first so the head erase doesn't shift it
+        lst.erase(lst.begin() + stop + 1, lst.end());
+        lst.erase(lst.begin(), lst.begin() + start);
+        return true;
+    }
+
+    ssize_t RedisDatabase::linsert(const std::string& key, bool before, const std::string& pivot, const std::string& value) {
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        auto it = list_store.find(key);
+        if (it == list_store.end())
+            return 0;
+        auto& lst = it->second;
+        auto pos = std::find(lst.begin(), lst.end(), pivot);
+        if (pos == lst.end())
+            return -1;
+        touch(key);
+        lst.insert(before ? pos : pos + 1, value);
+        return lst.size();
+    }
+
+    std::vector<std::string> RedisDatabase::popMany(const std::string& key, bool fromLeft, size_t count) {
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        std::vector<std::string> popped;
+        std::string value;
+        while (popped.size() < count && popFront(key, fromLeft, value)) {
+            popped.push_back(std::move(value));
+        }
+        return popped;
+    }
+
+    std::vector<std::string> RedisDatabase::lmpop(const std::vector<std::string>& keys, bool fromLeft, size_t count, std::string& poppedKey) {
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        for (const auto& key : keys) {
+            auto it = list_store.find(key);
+            if (it != list_store.end() && !it->second.empty()) {
+                poppedKey = key;
+                return popMany(key, fromLeft, count);
+            }
+        }
+        return {};
+    }
+
+    //blocking list operations
+
+    bool RedisDatabase::tryServe(const std::shared_ptr<ListWaiter>& waiter) {
+        for (const auto& key : waiter->keys) {
+            if (popFront(key, waiter->fromLeft, waiter->value)) {
+                waiter->servedKey = key;
+                waiter->served = true;
+                if (waiter->onServed)
+                    waiter->onServed();
+                if (waiter->move) {
+                    pushTo(waiter->destination, waiter->toLeft, waiter->value);
+                    serveListWaiters(waiter->destination);
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool RedisDatabase::popOrBlock(const std::shared_ptr<ListWaiter>& waiter) {
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        if (tryServe(waiter))
+            return true;
+        for (const auto& key : waiter->keys) {
+            list_waiters[key].push_back(waiter);
+        }
+        return false;
+    }
+
+    void RedisDatabase::cancelWait(const std::shared_ptr<ListWaiter>& waiter) {
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        unregisterWaiter(waiter);
+    }
+
+    void RedisDatabase::unregisterWaiter(const std::shared_ptr<ListWaiter>& waiter) {
+        for (const auto& key : waiter->keys) {
+            auto it = list_waiters.find(key);
+            if (it == list_waiters.end())
+                continue;
+            auto& queue = it->second;
+            queue.erase(std::remove(queue.begin(), queue.end(), waiter), queue.end());
+            if (queue.empty())
+                list_waiters.erase(it);
+        }
+    }
+
+    // Hand elements of key to blocked clients, oldest first, one element each
+    void RedisDatabase::serveListWaiters(const std::string& key) {
+        while (true) {
+            auto wit = list_waiters.find(key);
+            if (wit == list_waiters.end())
+                return;
+            auto lit = list_store.find(key);
+            if (lit == list_store.end() || lit->second.empty())
+                return;
+            std::shared_ptr<ListWaiter> waiter = wit->second.front();
+            unregisterWaiter(waiter); // also drops it from its other keys
+            popFront(key, waiter->fromLeft, waiter->value);
+            waiter->servedKey = key;
+            waiter->served = true;
+            if (waiter->onServed)
+                waiter->onServed();
+            if (waiter->move) {
+                pushTo(waiter->destination, waiter->toLeft, waiter->value);
+            }
+            if (waiter->notify)
+                waiter->notify();
+            if (waiter->move && waiter->destination != key) {
+                serveListWaiters(waiter->destination);
+            }
+        }
+    }
+
+    bool RedisDatabase::blockingPop(const std::shared_ptr<ListWaiter>& waiter, std::chrono::milliseconds timeout,
+                                    const std::function<bool()>& cancelled) {
+        std::unique_lock<std::recursive_mutex> lock(db_mutex);
+        std::condition_variable_any cv;
+        waiter->notify = [&cv]() { cv.notify_one(); };
+        if (popOrBlock(waiter))
+            return true;
+
+        bool forever = timeout.count() == 0;
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (!waiter->served) {
+            // Wake up now and then to notice a client that hung up while blocked
+            auto slice = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+            cv.wait_until(lock, forever ? slice : std::min(slice, deadline));
+            if (waiter->served)
+                break;
+            if ((!forever && std::chrono::steady_clock::now() >= deadline) || (cancelled && cancelled())) {
+                unregisterWaiter(waiter);
+                return false;
+            }
+        }
+        return true;
+    }
+
     //Hash operations
 
     bool RedisDatabase::hset(const std::string& key, const std::string& field, const std::string& value) {
-        std::lock_guard<std::mutex> lock(db_mutex);
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        touch(key);
         hash_store[key][field] = value;
         return true;
     }
 
     bool RedisDatabase::hget(const std::string& key, const std::string& field, std::string& value) {
-        std::lock_guard<std::mutex> lock(db_mutex);
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
         auto it = hash_store.find(key);
         if (it != hash_store.end()) {
             auto field_it = it->second.find(field);
@@ -256,7 +748,7 @@ RedisDatabase& RedisDatabase::getInstance() {
     }
 
     bool RedisDatabase::hexists(const std::string& key, const std::string& field) {
-        std::lock_guard<std::mutex> lock(db_mutex);
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
         auto it = hash_store.find(key);
         if (it != hash_store.end()) {
             return it->second.find(field) != it->second.end();
@@ -265,16 +757,49 @@ RedisDatabase& RedisDatabase::getInstance() {
     }
 
     bool RedisDatabase::hdel(const std::string& key, const std::string& field) {
-        std::lock_guard<std::mutex> lock(db_mutex);
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
         auto it = hash_store.find(key);
         if (it != hash_store.end()) {
+            touch(key);
             return it->second.erase(field) > 0;
         }
         return false;
     }
 
+    size_t RedisDatabase::hdel(const std::string& key, const std::vector<std::string>& fields) {
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        auto it = hash_store.find(key);
+        if (it == hash_store.end())
+            return 0;
+        size_t removed = 0;
+        for (const auto& field : fields) {
+            removed += it->second.erase(field);
+        }
+        if (removed > 0)
+            touch(key);
+        if (it->second.empty()) {
+            hash_store.erase(it);
+            expiry_map.erase(key);
+        }
+        return removed;
+    }
+
+    std::vector<std::optional<std::string>> RedisDatabase::hmget(const std::string& key, const std::vector<std::string>& fields) {
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        std::vector<std::optional<std::string>> values(fields.size());
+        auto it = hash_store.find(key);
+        if (it == hash_store.end())
+            return values;
+        for (size_t i = 0; i < fields.size(); ++i) {
+            auto field_it = it->second.find(fields[i]);
+            if (field_it != it->second.end())
+                values[i] = field_it->second;
+        }
+        return values;
+    }
+
     std::unordered_map<std::string, std::string> RedisDatabase::hgetall(const std::string& key) {
-        std::lock_guard<std::mutex> lock(db_mutex);
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
         auto it = hash_store.find(key);
         if (it != hash_store.end()) {
             return it->second;
@@ -283,7 +808,7 @@ RedisDatabase& RedisDatabase::getInstance() {
     }
 
     std::vector<std::string> RedisDatabase::hkeys(const std::string& key) {
-        std::lock_guard<std::mutex> lock(db_mutex);
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
         std::vector<std::string> keys;
         auto it = hash_store.find(key);
         if (it != hash_store.end()) {
@@ -295,7 +820,7 @@ RedisDatabase& RedisDatabase::getInstance() {
     }
 
     std::vector<std::string> RedisDatabase::hvals(const std::string& key) {
-        std::lock_guard<std::mutex> lock(db_mutex);
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
         std::vector<std::string> values;
         auto it = hash_store.find(key);
         if (it != hash_store.end()) {
@@ -307,7 +832,7 @@ RedisDatabase& RedisDatabase::getInstance() {
     }
 
     ssize_t RedisDatabase::hlen(const std::string& key) {
-        std::lock_guard<std::mutex> lock(db_mutex);
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
         auto it = hash_store.find(key);
         if (it != hash_store.end()) {
             return it->second.size();
@@ -316,88 +841,812 @@ RedisDatabase& RedisDatabase::getInstance() {
     }
 
     bool RedisDatabase::hmset(const std::string& key, const std::vector<std::pair<std::string, std::string>>& fieldValues) {
-        std::lock_guard<std::mutex> lock(db_mutex);
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        touch(key);
         for (const auto& pair : fieldValues) {
             hash_store[key][pair.first] = pair.second;
         }
         return true;
     }
 
+    //sorted set operations
+
+    long RedisDatabase::zadd(const std::string& key, const std::vector<std::pair<double, std::string>>& entries, int flags, size_t& changed) {
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        changed = 0;
+        if (wrongType(key, "zset"))
+            return -1;
+        if ((flags & ZADD_XX) && zset_store.find(key) == zset_store.end())
+            return 0;
+        SortedSet& zset = zset_store[key];
+        long added = 0;
+        for (const auto& entry : entries) {
+            double current;
+            bool exists = zset.score(entry.second, current);
+            if ((exists && (flags & ZADD_NX)) || (!exists && (flags & ZADD_XX)))
+                continue;
+            if (exists && current == entry.first)
+                continue;
+            if (zset.add(entry.second, entry.first))
+                ++added;
+            ++changed;
+        }
+        if (zset.size() == 0)
+            zset_store.erase(key); // every entry was filtered out by NX/XX
+        if (changed > 0)
+            touch(key);
+        return added;
+    }
+
+    int RedisDatabase::zincrby(const std::string& key, const std::string& member, double delta, double& newScore) {
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        if (wrongType(key, "zset"))
+            return -1;
+        SortedSet& zset = zset_store[key];
+        double current = 0;
+        zset.score(member, current);
+        newScore = current + delta;
+        if (std::isnan(newScore)) {
+            if (zset.size() == 0)
+                zset_store.erase(key);
+            return -2;
+        }
+        zset.add(member, newScore);
+        touch(key);
+        return 0;
+    }
+
+    size_t RedisDatabase::zrem(const std::string& key, const std::vector<std::string>& members) {
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        auto it = zset_store.find(key);
+        if (it == zset_store.end())
+            return 0;
+        size_t removed = 0;
+        for (const auto& member : members) {
+            if (it->second.remove(member))
+                ++removed;
+        }
+        if (removed > 0)
+            touch(key);
+        if (it->second.size() == 0)
+            zset_store.erase(it);
+        return removed;
+    }
+
+    bool RedisDatabase::zscore(const std::string& key, const std::string& member, double& score) {
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        auto it = zset_store.find(key);
+        return it != zset_store.end() && it->second.score(member, score);
+    }
+
+    long RedisDatabase::zrank(const std::string& key, const std::string& member, bool reverse) {
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        auto it = zset_store.find(key);
+        if (it == zset_store.end())
+            return -1;
+        return it->second.rank(member, reverse);
+    }
+
+    ssize_t RedisDatabase::zcard(const std::string& key) {
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        auto it = zset_store.find(key);
+        return it != zset_store.end() ? it->second.size() : 0;
+    }
+
+    std::vector<std::pair<std::string, double>> RedisDatabase::zrange(const std::string& key, long start, long stop, bool reverse) {
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        auto it = zset_store.find(key);
+        if (it == zset_store.end() || !normalizeRange(it->second.size(), start, stop))
+            return {};
+        return it->second.rangeByRank(start, stop, reverse);
+    }
+
+    std::vector<std::pair<std::string, double>> RedisDatabase::zrangebyscore(const std::string& key, const ScoreRange& range, size_t offset, long count) {
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        auto it = zset_store.find(key);
+        if (it == zset_store.end())
+            return {};
+        return it->second.rangeByScore(range, offset, count);
+    }
+
+    //set operations
+
+    ssize_t RedisDatabase::sadd(const std::string& key, const std::vector<std::string>& members) {
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        if (wrongType(key, "set"))
+            return -1;
+        Set& set = set_store[key];
+        ssize_t added = 0;
+        for (const auto& member : members) {
+            if (set.add(member))
+                ++added;
+        }
+        if (added > 0)
+            touch(key);
+        return added;
+    }
+
+    size_t RedisDatabase::srem(const std::string& key, const std::vector<std::string>& members) {
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        auto it = set_store.find(key);
+        if (it == set_store.end())
+            return 0;
+        size_t removed = 0;
+        for (const auto& member : members) {
+            if (it->second.remove(member))
+                ++removed;
+        }
+        if (removed > 0)
+            touch(key);
+        if (it->second.size() == 0)
+            set_store.erase(it);
+        return removed;
+    }
+
+    bool RedisDatabase::sismember(const std::string& key, const std::string& member) {
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        auto it = set_store.find(key);
+        return it != set_store.end() && it->second.contains(member);
+    }
+
+    std::vector<std::string> RedisDatabase::smembers(const std::string& key) {
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        auto it = set_store.find(key);
+        if (it == set_store.end())
+            return {};
+        return it->second.members();
+    }
+
+    ssize_t RedisDatabase::scard(const std::string& key) {
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        auto it = set_store.find(key);
+        return it != set_store.end() ? it->second.size() : 0;
+    }
+
+    // Missing keys become nullptr (empty set); false if a key holds another type
+    bool RedisDatabase::collectSets(const std::vector<std::string>& keys, std::vector<const Set*>& sets) {
+        sets.clear();
+        for (const auto& key : keys) {
+            if (wrongType(key, "set"))
+                return false;
+            auto it = set_store.find(key);
+            sets.push_back(it != set_store.end() ? &it->second : nullptr);
+        }
+        return true;
+    }
+
+    bool RedisDatabase::sinter(const std::vector<std::string>& keys, std::vector<std::string>& out) {
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        std::vector<const Set*> sets;
+        if (!collectSets(keys, sets))
+            return false;
+        out = Set::intersect(sets).members();
+        return true;
+    }
+
+    bool RedisDatabase::sunion(const std::vector<std::string>& keys, std::vector<std::string>& out) {
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        std::vector<const Set*> sets;
+        if (!collectSets(keys, sets))
+            return false;
+        out = Set::unite(sets).members();
+        return true;
+    }
+
+    bool RedisDatabase::sdiff(const std::vector<std::string>& keys, std::vector<std::string>& out) {
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        std::vector<const Set*> sets;
+        if (!collectSets(keys, sets))
+            return false;
+        out = Set::difference(sets).members();
+        return true;
+    }
+
+    //stream operations
+
+    int RedisDatabase::withStream(const std::string& key, bool create, bool write, const std::function<void(Stream&)>& fn) {
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        if (wrongType(key, "stream"))
+            return -1;
+        auto it = stream_store.find(key);
+        if (it == stream_store.end()) {
+            if (!create)
+                return 0;
+            it = stream_store.emplace(key, Stream()).first;
+        }
+        StreamID last = it->second.lastId();
+        fn(it->second);
+        if (write) {
+            touch(key);
+            if (it->second.lastId() != last)
+                signalStreamWaiters(key); // only new entries can satisfy a blocked read
+        }
+        return 1;
+    }
+
+    void RedisDatabase::signalStreamWaiters(const std::string& key) {
+        auto it = stream_waiters.find(key);
+        if (it == stream_waiters.end())
+            return;
+        for (const auto& waiter : it->second) {
+            waiter->ready = true;
+            if (waiter->notify)
+                waiter->notify();
+        }
+    }
+
+    void RedisDatabase::unregisterStreamWaiter(const std::shared_ptr<StreamWaiter>& waiter) {
+        for (const auto& key : waiter->keys) {
+            auto it = stream_waiters.find(key);
+            if (it == stream_waiters.end())
+                continue;
+            auto& waiters = it->second;
+            waiters.erase(std::remove(waiters.begin(), waiters.end(), waiter), waiters.end());
+            if (waiters.empty())
+                stream_waiters.erase(it);
+        }
+    }
+
+    bool RedisDatabase::blockOnStreams(const std::vector<std::string>& keys, std::chrono::milliseconds timeout,
+                                       const std::function<bool()>& attempt, const std::function<bool()>& cancelled) {
+        std::unique_lock<std::recursive_mutex> lock(db_mutex);
+        if (attempt())
+            return true;
+        std::condition_variable_any cv;
+        auto waiter = std::make_shared<StreamWaiter>();
+        waiter->keys = keys;
+        waiter->notify = [&cv]() { cv.notify_one(); };
+        for (const auto& key : keys) {
+            stream_waiters[key].push_back(waiter);
+        }
+
+        bool forever = timeout.count() == 0;
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (true) {
+            // Wake up now and then to notice a client that hung up while blocked
+            auto slice = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+            cv.wait_until(lock, forever ? slice : std::min(slice, deadline));
+            if (waiter->ready) {
+                waiter->ready = false;
+                if (attempt())
+                    break;
+            }
+            if ((!forever && std::chrono::steady_clock::now() >= deadline) || (cancelled && cancelled())) {
+                unregisterStreamWaiter(waiter);
+                return false;
+            }
+        }
+        unregisterStreamWaiter(waiter);
+        return true;
+    }
+
+    //transaction support
+
+    std::unique_lock<std::recursive_mutex> RedisDatabase::acquireLock() {
+        return std::unique_lock<std::recursive_mutex>(db_mutex);
+    }
+
+    uint64_t RedisDatabase::watchKey(const std::string& key) {
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        WatchEntry& entry = watched_keys[key];
+        ++entry.watchers;
+        return entry.version;
+    }
+
+    void RedisDatabase::unwatchKey(const std::string& key) {
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        auto it = watched_keys.find(key);
+        if (it != watched_keys.end() && --it->second.watchers == 0) {
+            watched_keys.erase(it);
+        }
+    }
+
+    uint64_t RedisDatabase::keyVersion(const std::string& key) {
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        auto it = watched_keys.find(key);
+        return it != watched_keys.end() ? it->second.version : 0;
+    }
+
+    void RedisDatabase::touch(const std::string& key) {
+        Tracking& tracking = Tracking::getInstance();
+        if (tracking.active()) {
+            tracking.keyModified(key); // clients caching it locally are told to drop it
+        }
+        if (watched_keys.empty()) {
+            return; // common case, nobody is watching anything
+        }
+        auto it = watched_keys.find(key);
+        if (it != watched_keys.end()) {
+            ++it->second.version;
+        }
+    }
+
+    void RedisDatabase::touchAll() {
+        Tracking& tracking = Tracking::getInstance();
+        if (tracking.active()) {
+            tracking.flushed();
+        }
+        for (auto& entry : watched_keys) {
+            ++entry.second.version;
+        }
+    }
+
+    //memory introspection
+
+    static size_t stringHeapBytes(const std::string& s){
+        return s.capacity() > 15 ? s.capacity() + 1 : 0; // short strings live inside the std::string (SSO)
+    }
+
+    // Slab block of one keyspace node: key/value pair plus the next pointer and cached hash
+    template <typename V>
+    static size_t nodeBytes(const std::string& key){
+        return SlabAllocator::usableSize(sizeof(std::pair<const std::string, V>) + 2 * sizeof(void*)) + stringHeapBytes(key);
+    }
+
+    bool RedisDatabase::memoryUsage(const std::string& key, size_t& bytes){
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        auto kit = kv_store.find(key);
+        if(kit != kv_store.end()){
+            bytes = nodeBytes<StringValue>(key) + kit->second.allocatedBytes();
+            return true;
+        }
+        auto lit = list_store.find(key);
+        if(lit != list_store.end()){
+            bytes = nodeBytes<std::deque<std::string>>(key);
+            for(const auto& item : lit->second){
+                bytes += sizeof(std::string) + stringHeapBytes(item);
+            }
+            return true;
+        }
+        auto hit = hash_store.find(key);
+        if(hit != hash_store.end()){
+            bytes = nodeBytes<std::unordered_map<std::string, std::string>>(key) + hit->second.bucket_count() * sizeof(void*);
+            for(const auto& field : hit->second){
+                bytes += sizeof(field) + 2 * sizeof(void*) + stringHeapBytes(field.first) + stringHeapBytes(field.second);
+            }
+            return true;
+        }
+        auto zit = zset_store.find(key);
+        if(zit != zset_store.end()){
+            bytes = nodeBytes<SortedSet>(key) + zit->second.memoryUsage();
+            return true;
+        }
+        auto sit = set_store.find(key);
+        if(sit != set_store.end()){
+            bytes = nodeBytes<Set>(key) + sit->second.memoryUsage();
+            return true;
+        }
+        auto xit = stream_store.find(key);
+        if(xit != stream_store.end()){
+            bytes = nodeBytes<Stream>(key) + xit->second.memoryUsage();
+            return true;
+        }
+        return false;
+    }
+
+    size_t RedisDatabase::keyCount(){
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        return kv_store.size() + list_store.size() + hash_store.size() + zset_store.size() + set_store.size() + stream_store.size();
+    }
+
     //SIMPLE DUMP AND LOAD IMPLEMENTATION USING A BINARY FILE 
 
+    // Snapshot encoding :- a "TYPE key" line opens a value, indented lines hold its
+    // elements. Shared by dump() and DUMP/MIGRATE, which cut big values into chunks.
+    static void writeItem(std::ostream& out, const std::string& item){
+        out << "  ITEM " << item << "\n";
+    }
+
+    static void writeField(std::ostream& out, const std::string& field, const std::string& value){
+        out << "  FIELD " << field << " " << value << "\n";
+    }
+
+    static void writeMember(std::ostream& out, const std::string& member, double score){
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.17g", score);
+        out << "  MEMBER " << buf << " " << member << "\n";
+    }
+
+    static void writeSetMember(std::ostream& out, const std::string& member){
+        out << "  SMEMBER " << member << "\n";
+    }
+
+    // Stream entry :- fields and values are length prefixed ("3:foo"), they may hold spaces
+    static void writeEntry(std::ostream& out, const StreamEntry& entry){
+        out << "  ENTRY " << entry.id.str() << " ";
+        for(const auto& s : entry.fields){
+            out << s.size() << ":" << s;
+        }
+        out << "\n";
+    }
+
+    // What isn't entries :- last id, then every group with its consumers and pending entries
+    static void writeStreamState(std::ostream& out, const Stream& stream){
+        out << "  LASTID " << stream.lastId().str() << "\n";
+        for(const auto& g : stream.groupList()){
+            out << "  GROUP " << g.first << " " << g.second.lastDelivered.str() << "\n";
+            for(const auto& c : g.second.consumers){
+                out << "  CONSUMER " << g.first << " " << c.first << "\n";
+            }
+            g.second.pel.forEach([&](const StreamID& id, const Stream::Pending& p){
+                out << "  PENDING " << g.first << " " << id.str() << " " << p.deliveries << " " << p.consumer << "\n";
+            });
+        }
+    }
+
     bool RedisDatabase::dump(const std::string& filename){
-        std::lock_guard<std::mutex> lock(db_mutex);// lock the database during dump
-        // For simplicity, we just create an empty file to simulate dumping
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);// lock the database during dump
+        if(IoBackend::getInstance().kind() == IoBackend::URING){
+            // written in 1MB registered buffers while the next ones are filled
+            IoUringFile file(filename);
+            if(file.ok()){
+                std::ostream out(&file);
+                bool ok = dump(out);
+                out.flush();
+                return file.close() && ok;
+            }
+        }
         std::ofstream ofs(filename, std::ios::binary);
         if(!ofs){
             return false;
         }
-        // In a real implementation, serialize the database contents 
+        return dump(ofs);
+    }
+
+    // Same snapshot into any stream (full resync sends it to a replica)
+    bool RedisDatabase::dump(std::ostream& ofs){
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
         for(const auto& kv:kv_store){
-            ofs << "KV " << kv.first << " " << kv.second << "\n";
+            ofs << "KV " << kv.first << " " << kv.second.str() << "\n";
         }
         for(const auto& list:list_store){
             ofs << "LIST " << list.first << "\n";
             for(const auto& item:list.second){
-                ofs << "  ITEM " << item << "\n";
+                writeItem(ofs, item);
             }
         }
         for(const auto& hash:hash_store){
             ofs << "HASH " << hash.first << "\n";
             for(const auto& field:hash.second){
-                ofs << "  FIELD " << field.first << " " << field.second << "\n";
+                writeField(ofs, field.first, field.second);
             }
         }
-        return true;
+        for(const auto& zset:zset_store){
+            ofs << "ZSET " << zset.first << "\n";
+            zset.second.forEach([&ofs](const std::string& member, double score){
+                writeMember(ofs, member, score);
+            });
+        }
+        for(const auto& set:set_store){
+            ofs << "SET " << set.first << "\n";
+            set.second.forEach([&ofs](const std::string& member){
+                writeSetMember(ofs, member);
+            });
+        }
+        for(const auto& stream:stream_store){
+            ofs << "STREAM " << stream.first << "\n";
+            stream.second.forEach([&ofs](const StreamEntry& entry){
+                writeEntry(ofs, entry);
+            });
+            writeStreamState(ofs, stream.second);
+        }
+        return static_cast<bool>(ofs);
     }
 
 
     bool RedisDatabase::load(const std::string& filename){
-        std::lock_guard<std::mutex> lock(db_mutex);// lock the database during load
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);// lock the database during load
         // For simplicity, we just check if the file exists to simulate loading
         std::ifstream ifs(filename, std::ios::binary);
         if(!ifs){
             return false;
         }
+        return load(ifs);
+    }
 
-        // In a real implementation, deserialize the database contents
+    // Apply one snapshot line; current is the container the element lines after it fill
+    void RedisDatabase::loadLine(const std::string& line, std::string& current){
+        std::istringstream iss(line);
+        std::string type;
+        iss >> type;
+        if(type == "KV"){
+            std::string key, value;
+            iss >> key;
+            std::getline(iss >> std::ws, value);
+            kv_store[key] = value;
+        } else if(type == "LIST"){
+            iss >> current;
+            list_store[current];
+        } else if(type == "HASH"){
+            iss >> current;
+            hash_store[current];
+        } else if(type == "ZSET"){
+            iss >> current;
+            zset_store[current];
+        } else if(type == "SET"){
+            iss >> current;
+            set_store[current];
+        } else if(type == "STREAM"){
+            iss >> current;
+            stream_store[current];
+        } else if(type == "ENTRY"){
+            std::string id, packed;
+            iss >> id;
+            std::getline(iss >> std::ws, packed);
+            StreamEntry entry;
+            if(!StreamID::parse(id, entry.id, 0)){
+                return;
+            }
+            size_t pos = 0;
+            while(pos < packed.size()){
+                size_t colon = packed.find(':', pos);
+                if(colon == std::string::npos){
+                    return;
+                }
+                size_t len = std::strtoul(packed.c_str() + pos, nullptr, 10);
+                entry.fields.push_back(packed.substr(colon + 1, len));
+                pos = colon + 1 + len;
+            }
+            stream_store[current].add(entry.id, entry.fields);
+        } else if(type == "LASTID"){
+            std::string id;
+            iss >> id;
+            StreamID last;
+            if(StreamID::parse(id, last, 0)){
+                stream_store[current].setLastId(last);
+            }
+        } else if(type == "GROUP"){
+            std::string name, id;
+            iss >> name >> id;
+            StreamID lastDelivered;
+            if(StreamID::parse(id, lastDelivered, 0)){
+                stream_store[current].createGroup(name, lastDelivered);
+            }
+        } else if(type == "CONSUMER" || type == "PENDING"){
+            std::string group;
+            iss >> group;
+            Stream& stream = stream_store[current];
+            Stream::Group* g = stream.group(group);
+            if(!g){
+                return;
+            }
+            auto now = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+            if(type == "CONSUMER"){
+                std::string name;
+                iss >> name;
+                stream.consumer(*g, name, now);
+                return;
+            }
+            std::string id, consumer;
+            uint64_t deliveries = 0;
+            iss >> id >> deliveries >> consumer;
+            StreamID pendingId;
+            if(!StreamID::parse(id, pendingId, 0)){
+                return;
+            }
+            Stream::Pending& p = g->pel[pendingId];
+            p.consumer = consumer;
+            p.deliveryTime = now;
+            p.deliveries = deliveries;
+            stream.consumer(*g, consumer, now).pending[pendingId] = 1;
+        } else if(type == "SMEMBER"){
+            std::string member;
+            std::getline(iss >> std::ws, member);
+            set_store[current].add(member);
+        } else if(type == "ITEM"){
+            std::string item;
+            std::getline(iss >> std::ws, item);
+            list_store[current].push_back(item);
+        } else if(type == "FIELD"){
+            std::string field, value;
+            iss >> field;
+            std::getline(iss >> std::ws, value);
+            hash_store[current][field] = value;
+        } else if(type == "MEMBER"){
+            std::string score, member;
+            iss >> score; // strtod, unlike >>, understands inf
+            std::getline(iss >> std::ws, member);
+            zset_store[current].add(member, std::strtod(score.c_str(), nullptr));
+        }
+    }
+
+    // Replace the whole dataset with a snapshot read from ifs
+    bool RedisDatabase::load(std::istream& ifs){
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        touchAll();
         kv_store.clear();
         list_store.clear();
         hash_store.clear();
+        zset_store.clear();
+        set_store.clear();
+        stream_store.clear();
+        expiry_map.clear();
 
-        std::string line;
+        // LIST/HASH/ZSET/SET/STREAM lines open a container, the indented lines after them fill it
+        std::string line, current;
         while(std::getline(ifs, line)){
+            loadLine(line, current);
+        }
+        return true;
+    }
+
+    //key migration
+
+    bool RedisDatabase::extractKey(const std::string& key, DetachedKey& out, bool remove){
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        out = DetachedKey();
+        out.key = key;
+        out.type = typeOf(key);
+        if(out.type == "none"){
+            return false;
+        }
+        auto eit = expiry_map.find(key);
+        if(eit != expiry_map.end()){
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(eit->second - std::chrono::steady_clock::now());
+            out.ttlMs = std::max<long long>(1, left.count());
+        }
+        // Containers are moved out in O(1); copying is only for DUMP and MIGRATE COPY
+        if(out.type == "string"){
+            out.str = kv_store.find(key)->second.str();
+        } else if(out.type == "list"){
+            auto& value = list_store.find(key)->second;
+            out.list = remove ? std::move(value) : value;
+        } else if(out.type == "hash"){
+            auto& value = hash_store.find(key)->second;
+            out.hash = remove ? std::move(value) : value;
+        } else if(out.type == "zset"){
+            auto& value = zset_store.find(key)->second;
+            out.zset = remove ? std::move(value) : value;
+        } else if(out.type == "set"){
+            auto& value = set_store.find(key)->second;
+            out.set = remove ? std::move(value) : value;
+        } else {
+            auto& value = stream_store.find(key)->second;
+            out.stream = remove ? std::move(value) : value;
+        }
+        if(remove){
+            eraseKey(key, false);
+        }
+        return true;
+    }
+
+    bool RedisDatabase::attachKey(DetachedKey&& detached){
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        const std::string& key = detached.key;
+        if(std::string(typeOf(key)) != "none"){
+            return false; // recreated meanwhile, the newer value wins
+        }
+        touch(key);
+        if(detached.type == "string"){
+            kv_store[key] = detached.str;
+        } else if(detached.type == "list"){
+            list_store[key] = std::move(detached.list);
+            serveListWaiters(key);
+        } else if(detached.type == "hash"){
+            hash_store[key] = std::move(detached.hash);
+        } else if(detached.type == "zset"){
+            zset_store[key] = std::move(detached.zset);
+        } else if(detached.type == "set"){
+            set_store[key] = std::move(detached.set);
+        } else {
+            stream_store[key] = std::move(detached.stream);
+            signalStreamWaiters(key);
+        }
+        if(detached.ttlMs > 0){
+            expiry_map[key] = std::chrono::steady_clock::now() + std::chrono::milliseconds(detached.ttlMs);
+        }
+        return true;
+    }
+
+    // Snapshot lines of one key, at most chunkElements elements per chunk; every
+    // chunk repeats the opening line so it can be applied on its own
+    void RedisDatabase::encodeKey(const DetachedKey& detached, size_t chunkElements, std::vector<std::string>& chunks){
+        chunks.clear();
+        const std::string& key = detached.key;
+        if(detached.type == "string"){
+            chunks.push_back("KV " + key + " " + detached.str + "\n");
+            return;
+        }
+        const char* header = detached.type == "list" ? "LIST " : detached.type == "hash" ? "HASH " :
+                             detached.type == "zset" ? "ZSET " : detached.type == "set" ? "SET " : "STREAM ";
+        std::ostringstream out;
+        size_t inChunk = 0;
+        auto element = [&](){
+            if(++inChunk == chunkElements){
+                chunks.push_back(out.str());
+                out.str("");
+                out << header << key << "\n";
+                inChunk = 0;
+            }
+        };
+        out << header << key << "\n";
+        if(detached.type == "list"){
+            for(const auto& item : detached.list){
+                writeItem(out, item);
+                element();
+            }
+        } else if(detached.type == "hash"){
+            for(const auto& field : detached.hash){
+                writeField(out, field.first, field.second);
+                element();
+            }
+        } else if(detached.type == "zset"){
+            detached.zset.forEach([&](const std::string& member, double score){
+                writeMember(out, member, score);
+                element();
+            });
+        } else if(detached.type == "set"){
+            detached.set.forEach([&](const std::string& member){
+                writeSetMember(out, member);
+                element();
+            });
+        } else {
+            detached.stream.forEach([&](const StreamEntry& entry){
+                writeEntry(out, entry);
+                element();
+            });
+            writeStreamState(out, detached.stream); // last chunk, after the entries it refers to
+            ++inChunk; // so it goes out even if the entries filled the previous chunk exactly
+        }
+        if(inChunk > 0 || chunks.empty()){
+            chunks.push_back(out.str());
+        }
+    }
+
+    int RedisDatabase::restoreKey(const std::string& key, const std::string& payload, long long ttlMs, bool replace, bool append){
+        // Every opening line must name key, and agree on the type
+        static const char* kHeaders[][2] = {{"KV", "string"}, {"LIST", "list"}, {"HASH", "hash"}, {"ZSET", "zset"}, {"SET", "set"}, {"STREAM", "stream"}};
+        std::string type;
+        std::istringstream lines(payload);
+        std::string line;
+        while(std::getline(lines, line)){
+            if(line.empty() || line[0] == ' '){
+                continue;
+            }
             std::istringstream iss(line);
-            std::string type;
-            iss >> type;
-            if(type == "KV"){
-                std::string key, value;
-                iss >> key >> value;
-                kv_store[key] = value;
-            } else if(type == "LIST"){
-                std::string list_name;
-                iss >> list_name;
-                std::string item;
-                std::vector<std::string> list;
-                while(iss >> item){
-                    list.push_back(item);
-                }
-                list_store[list_name] = list;
-            } else if(type == "HASH"){
-                std::string hash_name;
-                iss >> hash_name;
-                std::unordered_map<std::string, std::string> fields;
-                std::string pairs;
-                while(iss >> pairs){
-                    auto pos = pairs.find(' ');
-                    if(pos != std::string::npos){
-                        std::string field = pairs.substr(0, pos);
-                        std::string value = pairs.substr(pos + 1);
-                        fields[field] = value;
-                    }
+            std::string tag, name;
+            iss >> tag >> name;
+            const char* lineType = nullptr;
+            for(const auto& h : kHeaders){
+                if(tag == h[0]){
+                    lineType = h[1];
                 }
-                hash_store[hash_name] = fields;
             }
+            if(!lineType || name != key || (!type.empty() && type != lineType)){
+                return -2;
+            }
+            type = lineType;
         }
-        return true;
-    }
\ No newline at end of file
+        if(type.empty()){
+            return -2;
+        }
+
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        std::string existing = typeOf(key);
+        if(append){
+            if(existing != "none" && existing != type){
+                return -3;
+            }
+        } else if(existing != "none"){
+            if(!replace){
+                return -1;
+            }
+            eraseKey(key, true);
+        }
+        touch(key);
+        std::istringstream in(payload);
+        std::string current;
+        while(std::getline(in, line)){
+            loadLine(line, current);
+        }
+        if(ttlMs > 0){
+            expiry_map[key] = std::chrono::steady_clock::now() + std::chrono::milliseconds(ttlMs);
+        }
+        if(type == "list"){
+            serveListWaiters(key);
+        } else if(type == "stream"){
+            signalStreamWaiters(key);
+        }
+        return 0;
+    }
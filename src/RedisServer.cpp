@@ -1,16 +1,28 @@
 #include "../include/RedisServer.h"
 #include "../include/RedisCommandHandler.h"
 #include "../include/RedisDatabase.h"
+#include "../include/PubSub.h"
+#include "../include/IoThreads.h"
+#include "../include/IoUring.h"
+#include "../include/ClientRegistry.h"
+#include "../include/OutputLimits.h"
 #include <iostream>
 #include <sys/socket.h>
 #include <unistd.h>
 #include <netinet/in.h>
+#include <poll.h>
 #include <thread>
+#include <functional>
 #include <vector>
 #include <cstring>
+#include <cerrno>
 #include <signal.h>
+#include <atomic>
+#include <chrono>
+#include <unordered_map>
 
 static RedisServer* globalServer = nullptr; // global pointer to the RedisServer instance
+static std::atomic<uint64_t> nextClientId{0};  // CLIENT ID of the next connection
 
 // Signal handler for graceful shutdown
 void signalHandler(int signum) {
@@ -21,96 +33,289 @@ void signalHandler(int signum) {
     exit(signum);
 }
 
+// send() may write only part of a large reply, keep going until all of it is out
+// or the client broke the normal class of the output buffer limits
+static bool sendReply(ClientSession& session, OutputGuard& guard, const std::string& data){
+    bool ok = sendLimited(session.socket, data.data(), data.size(), [&session, &guard](size_t unsent){
+        if(session.info){
+            session.info->outputBuffer = unsent;
+        }
+        return guard.exceeded(ClientClass::NORMAL, unsent);
+    });
+    if(session.info){
+        session.info->outputBuffer = 0;
+    }
+    return ok;
+}
+
+// Subscribed connections :- wait until the client sent something, sending queued
+// pub/sub messages whenever the socket can take more. False once it must close.
+static bool waitForInput(int sock, Subscriber& sub) {
+    while (true) {
+        pollfd fds[2];
+        fds[0].fd = sock;
+        fds[0].events = POLLIN | (sub.pending() ? POLLOUT : 0);
+        fds[1].fd = sub.wakeFd();
+        fds[1].events = POLLIN;
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        if (fds[1].revents & POLLIN)
+            sub.drainWake();
+        if ((fds[0].revents & POLLOUT) && !sub.flush())
+            return false;
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR))
+            return true; // recv() tells data from hang-up
+    }
+}
+
 void RedisServer::setupSignalHandlers() {
     signal(SIGINT, signalHandler); 
 } 
 
 
-RedisServer::RedisServer(int port) : port(port) , server_socket(-1) , running(true){
+RedisServer::RedisServer(const ListenOptions& options, const std::string& dumpFile, const ThreadOptions& threads) : options(options) , dumpFile(dumpFile) , running(true) , threads(threads){
     globalServer = this;// set the global server pointer
 
 }
 
+RedisServer::~RedisServer() = default;
+
 void RedisServer::shutdown(){
     running = false;
-    if(server_socket != -1){
-        close(server_socket);
+    for(int listener : listeners){
+        ::shutdown(listener, SHUT_RDWR); // wakes the thread blocked in accept()
+        close(listener);
+    }
+    if(!options.unixSocket.empty()){
+        unlink(options.unixSocket.c_str());
     }
     std::cout << "Server shutdown initiated." << std::endl;
 }
 
 void RedisServer::run(){
-    server_socket = socket(AF_INET,SOCK_STREAM ,0);// create a TCP socket 
-    //AF_INET for IPv4,SOCK_STREAM for TCP,0 for default protocol 
-    if(server_socket < 0){
-        std::cerr << "Failed to create socket." << std::endl;
-        return;
+    // One TCP listener, or with --reuseport N several bound to the same port so
+    // that each accept thread has its own queue of incoming connections
+    bool reusePort = options.acceptors > 1;
+    for(size_t i = 0; i < options.acceptors; ++i){
+        int listener = Listener::tcp(options, reusePort);
+        if(listener < 0){
+            return;
+        }
+        listeners.push_back(listener);
+    }
+    if(!options.unixSocket.empty()){
+        int listener = Listener::local(options);
+        if(listener < 0){
+            return;
+        }
+        listeners.push_back(listener);
     }
 
-    int opt = 1;
-    setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));// set socket options  
-    //SOL_SOCKET to manipulate the socket at the socket level, SO_REUSEADDR to allow reuse of local addresses
-    
-    sockaddr_in serverAddr;
-    serverAddr.sin_family = AF_INET; // IPv4
-    serverAddr.sin_port = htons(port); // set port,htons to convert to network byte order
-    serverAddr.sin_addr.s_addr = INADDR_ANY; // bind to any available interface
+    std::cout << "Server is running on port " << options.port;
+    if(reusePort){
+        std::cout << " with " << options.acceptors << " SO_REUSEPORT listeners";
+    }
+    if(!options.unixSocket.empty()){
+        std::cout << " and Unix socket " << options.unixSocket;
+    }
+    if(threads.ioThreads > 0){
+        std::cout << ", " << threads.ioThreads << " I/O threads, " << threads.execThreads << " executors";
+    }
+    std::cout << std::endl;
 
-    if(bind(server_socket, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) < 0){
-        std::cerr << "Failed to bind socket." << std::endl;
-        close(server_socket);
-        return;
+    RedisCommandHandler cmdHandler;
+    if(threads.ioThreads > 0){
+        IoBackend::getInstance().select(IoBackend::IO_THREADS);
+        io = std::make_unique<IoThreads>(threads, cmdHandler,
+            [this, &cmdHandler](int fd, ClientSession& session, std::string& input, std::string& output){
+                uint64_t id = session.id;
+                std::lock_guard<std::mutex> lock(threadsMutex);
+                clientThreads.emplace(id, std::thread([this, &cmdHandler, id, s = std::move(session), in = std::move(input), out = std::move(output)]() mutable {
+                    serveSession(s, std::move(in), std::move(out), cmdHandler);
+                    finished(id);
+                }));
+            });
+        io->start();
+    }
+    std::thread cron(&RedisServer::cronLoop, this);
+    std::vector<std::thread> acceptors;
+    for(size_t i = 1; i < listeners.size(); ++i){
+        acceptors.emplace_back(&RedisServer::acceptLoop, this, listeners[i], std::ref(cmdHandler));
+    }
+    acceptLoop(listeners[0], cmdHandler);
+    for(auto& t : acceptors){
+        t.join();
+    }
+    cron.join();
+    if(io){
+        io->stop();
     }
 
-    if(listen(server_socket,10)<0){
-        std::cerr << "Failed to listen on socket." << std::endl;
-        close(server_socket);
-        return;
+    // Join all threads before exiting because they are handling client connections
+    //if we don't join them, they may continue running after server shutdown
+    std::unordered_map<uint64_t, std::thread> remaining;
+    {
+        std::lock_guard<std::mutex> lock(threadsMutex);
+        remaining.swap(clientThreads);
+    }
+    for(auto& entry : remaining){
+        entry.second.join();
     }
 
-    std::cout << "Server is running on port " << port << std::endl;
+    //before shutting down the server, we load the database from db
+    if(!RedisDatabase::getInstance().dump(dumpFile)){
+        std::cerr << "Failed to dump database to " << dumpFile << " during shutdown." << std::endl;
+    } else {
+        std::cout << "Database dumped to " << dumpFile << " successfully during shutdown." << std::endl;
+    }
 
-    std::vector<std::thread> threads;
-    RedisCommandHandler cmdHandler;
+}
 
+void RedisServer::acceptLoop(int listener, RedisCommandHandler& cmdHandler){
     while(running){
-        int client_socket = accept (server_socket, nullptr, nullptr);// accept incoming connection
+        int client_socket = accept (listener, nullptr, nullptr);// accept incoming connection
         if(client_socket < 0){
+            if(errno == EINTR || errno == ECONNABORTED){
+                continue;
+            }
             if(running){
                 std::cerr << "Failed to accept connection." << std::endl;
             }
             break;
         }
+        // maxclients :- refused here, before a thread or a buffer is spent on it
+        uint64_t id = ++nextClientId;
+        std::shared_ptr<ClientInfo> info = ClientRegistry::getInstance().admit(id, client_socket);
+        if(!info){
+            ClientRegistry::reject(client_socket);
+            continue;
+        }
+        Listener::configure(client_socket, options);
 
-        threads.emplace_back([client_socket, &cmdHandler]() {
-            char buffer[1024];
-            while(true){
-                memset(buffer, 0, sizeof(buffer));// clear the buffer & memset used to fill a block of memory with a particular value
-                int bytes = recv(client_socket, buffer, sizeof(buffer)-1, 0);// receive data from client
-                if(bytes <= 0){
-                    break; // connection closed or error
-                }
-                std::string request(buffer, bytes);// construct string from received data
-                std::string response = cmdHandler.processCommand(request);// process the command
-                send(client_socket, response.c_str(), response.size(), 0);// send response back to client
-            }
-            close(client_socket);// close client socket
-        });
+        if(io){
+            io->adopt(client_socket, info);
+            continue;
+        }
+        std::lock_guard<std::mutex> lock(threadsMutex);
+        clientThreads.emplace(id, std::thread(&RedisServer::serveClient, this, client_socket, info, std::ref(cmdHandler)));
     }
+}
 
-    // Join all threads before exiting because they are handling client connections
-    //if we don't join them, they may continue running after server shutdown
-    for(auto& t : threads){
-        if(t.joinable()){
-            t.join();
+// Once a second :- join the threads of closed connections and close idle ones (--timeout)
+void RedisServer::cronLoop(){
+    int ticks = 0;
+    while(running){
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        if(++ticks % 10 != 0){
+            continue;
+        }
+        std::vector<std::thread> done;
+        {
+            std::lock_guard<std::mutex> lock(threadsMutex);
+            for(uint64_t id : finishedThreads){
+                auto it = clientThreads.find(id);
+                if(it != clientThreads.end()){
+                    done.push_back(std::move(it->second));
+                    clientThreads.erase(it);
+                }
+            }
+            finishedThreads.clear();
+        }
+        for(auto& t : done){
+            t.join(); // already past serveSession(), returns at once
         }
+        ClientRegistry::getInstance().closeIdle();
     }
+}
 
-    //before shutting down the server, we load the database from db
-    if(!RedisDatabase::getInstance().dump("dump.my_rdb")){
-        std::cerr << "Failed to dump database to dump.my_rdb during shutdown." << std::endl;
-    } else {
-        std::cout << "Database dumped to dump.my_rdb successfully during shutdown." << std::endl;
+void RedisServer::finished(uint64_t clientId){
+    std::lock_guard<std::mutex> lock(threadsMutex);
+    finishedThreads.push_back(clientId);
+}
+
+void RedisServer::serveClient(int client_socket, std::shared_ptr<ClientInfo> info, RedisCommandHandler& cmdHandler){
+    ClientSession session; // MULTI/WATCH state of this connection
+    session.socket = client_socket;
+    session.id = info->id;
+    session.info = std::move(info);
+    serveSession(session, "", "", cmdHandler);
+    finished(session.id);
+}
+
+void RedisServer::serveSession(ClientSession& session, std::string pending, std::string output, RedisCommandHandler& cmdHandler){
+    serveConnection(session, std::move(pending), std::move(output), [&cmdHandler](const std::vector<std::string>& tokens, ClientSession& s){
+        return cmdHandler.processCommand(tokens, s);// process the command
+    });
+    cmdHandler.closeSession(session);
+    close(session.socket);// close client socket
+}
+
+void RedisServer::serveConnection(ClientSession& session, std::string pending, std::string output, const CommandRunner& run){
+    int client_socket = session.socket;
+    char buffer[4096];
+    std::vector<std::string> tokens;
+    bool open = true;
+    OutputGuard guard;
+    if(!output.empty()){
+        open = session.subscriber ? session.subscriber->reply(std::move(output)) : sendReply(session, guard, output);
     }
+    bool haveInput = !pending.empty(); // pending = bytes received but not yet parsed into a full command
+    while(open){
+        if(!haveInput){
+            if(session.subscriber && !waitForInput(client_socket, *session.subscriber)){
+                break;
+            }
+            int bytes = recv(client_socket, buffer, sizeof(buffer), 0);// receive data from client
+            if(bytes <= 0){
+                break; // connection closed or error
+            }
+            pending.append(buffer, bytes);
+        }
+        haveInput = false;
 
+        // A pipelining client may send many commands in one packet, answer them with
+        // one send, or one per kWriteChunk of replies so a deep pipeline doesn't pile up here
+        std::string response;
+        if(session.subscriber){
+            session.subscriber->hold(); // messages published meanwhile go after these replies
+        }
+        size_t pos = 0;
+        while(pos < pending.size()){
+            size_t used = RedisCommandHandler::extractCommand(pending, pos, tokens);
+            if(used == 0){
+                break; // wait for the rest of the frame
+            }
+            if(used == std::string::npos){
+                response += "-ERR Protocol error\r\n";
+                open = false;
+                break;
+            }
+            pos += used;
+            if(!tokens.empty()){
+                response += run(tokens, session);
+            }
+            if(!session.subscriber && response.size() >= OutputLimits::kWriteChunk){
+                if(!sendReply(session, guard, response)){
+                    open = false;
+                    response.clear();
+                    break;
+                }
+                response.clear();
+            }
+        }
+        pending.erase(0, pos);
+        if(session.info){
+            session.info->queryBuffer = pending.size();
+        }
+        if(session.subscriber){
+            if(!session.subscriber->reply(std::move(response))){
+                break;
+            }
+        } else if(!response.empty() && !sendReply(session, guard, response)){
+            break;
+        }
+    }
 }
\ No newline at end of file
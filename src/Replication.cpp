@@ -0,0 +1,541 @@
+#include "../include/Replication.h"
+#include "../include/RedisDatabase.h"
+#include "../include/RedisCommandHandler.h"
+#include "../include/ClientSession.h"
+#include "../include/ClientRegistry.h"
+#include <sstream>
+#include <random>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <strings.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+
+namespace {
+
+const size_t kMaxChunk = 64 * 1024; // stream bytes sent to a replica per send()
+
+std::string encodeCommand(const std::vector<std::string>& tokens) {
+    std::string out = "*" + std::to_string(tokens.size()) + "\r\n";
+    for (const auto& t : tokens) {
+        out += "$" + std::to_string(t.size()) + "\r\n" + t + "\r\n";
+    }
+    return out;
+}
+
+bool sendAll(int sock, const char* data, size_t len) {
+    size_t sent = 0;
+    while (sent < len) {
+        ssize_t n = send(sock, data + sent, len - sent, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        sent += n;
+    }
+    return true;
+}
+
+bool sendAll(int sock, const std::string& data) {
+    return sendAll(sock, data.data(), data.size());
+}
+
+// Block until buffer holds at least n bytes
+bool fill(int sock, std::string& buffer, size_t n) {
+    char chunk[16384];
+    while (buffer.size() < n) {
+        ssize_t r = recv(sock, chunk, sizeof(chunk), 0);
+        if (r <= 0) {
+            return false;
+        }
+        buffer.append(chunk, r);
+    }
+    return true;
+}
+
+// One \r\n terminated line off the front of buffer, reading more as needed
+bool readLine(int sock, std::string& buffer, std::string& line) {
+    size_t crlf;
+    while ((crlf = buffer.find("\r\n")) == std::string::npos) {
+        if (!fill(sock, buffer, buffer.size() + 1)) {
+            return false;
+        }
+    }
+    line = buffer.substr(0, crlf);
+    buffer.erase(0, crlf + 2);
+    return true;
+}
+
+int connectTo(const std::string& host, int port) {
+    addrinfo hints{};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* result = nullptr;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result) != 0) {
+        return -1;
+    }
+    int sock = -1;
+    for (addrinfo* ai = result; ai; ai = ai->ai_next) {
+        sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (sock >= 0 && connect(sock, ai->ai_addr, ai->ai_addrlen) == 0) {
+            break;
+        }
+        if (sock >= 0) {
+            close(sock);
+            sock = -1;
+        }
+    }
+    freeaddrinfo(result);
+    return sock;
+}
+
+std::string peerAddress(int sock) {
+    sockaddr_storage storage{};
+    socklen_t len = sizeof(storage);
+    char ip[INET_ADDRSTRLEN] = "?";
+    if (getpeername(sock, (sockaddr*)&storage, &len) == 0) {
+        if (storage.ss_family == AF_UNIX)
+            return "127.0.0.1"; // a replica on this host, its announced port is TCP
+        inet_ntop(AF_INET, &((sockaddr_in*)&storage)->sin_addr, ip, sizeof(ip));
+    }
+    return ip;
+}
+
+std::string bulk(const std::string& s) {
+    return "$" + std::to_string(s.size()) + "\r\n" + s + "\r\n";
+}
+
+} // namespace
+
+Replication& Replication::getInstance() {
+    // Never destroyed: the replica link thread is detached and may outlive main()
+    static Replication* instance = new Replication();
+    return *instance;
+}
+
+Replication::Replication() : replid(newReplicationId()) {}
+
+std::string Replication::newReplicationId() {
+    static const char hex[] = "0123456789abcdef";
+    std::random_device rd;
+    std::mt19937_64 gen((static_cast<uint64_t>(rd()) << 32) ^ rd() ^
+                        std::chrono::steady_clock::now().time_since_epoch().count());
+    std::string id(40, '0');
+    for (auto& c : id) {
+        c = hex[gen() & 15];
+    }
+    return id;
+}
+
+void Replication::startStreamingLocked() {
+    if (streaming.load()) {
+        return;
+    }
+    backlog.assign(kBacklogSize, 0);
+    backlogLen = 0;
+    streaming.store(true, std::memory_order_release);
+}
+
+void Replication::appendLocked(const char* data, size_t len) {
+    while (len > 0) {
+        size_t pos = static_cast<size_t>(masterOffset % kBacklogSize);
+        size_t n = std::min(len, kBacklogSize - pos);
+        std::memcpy(backlog.data() + pos, data, n);
+        data += n;
+        len -= n;
+        masterOffset += n;
+        backlogLen = std::min(kBacklogSize, backlogLen + n);
+    }
+}
+
+void Replication::propagate(const std::vector<std::string>& tokens) {
+    std::string command = encodeCommand(tokens);
+    {
+        std::lock_guard<std::mutex> lock(repl_mutex);
+        if (!streaming.load()) {
+            return;
+        }
+        appendLocked(command.data(), command.size());
+    }
+    stream_cv.notify_all();
+}
+
+void Replication::propagateLater(std::vector<std::string> tokens) {
+    std::lock_guard<std::mutex> lock(repl_mutex);
+    deferred.push_back(std::move(tokens));
+}
+
+void Replication::flushDeferred() {
+    {
+        std::lock_guard<std::mutex> lock(repl_mutex);
+        if (deferred.empty()) {
+            return;
+        }
+        flushDeferredLocked();
+    }
+    stream_cv.notify_all();
+}
+
+void Replication::flushDeferredLocked() {
+    for (const auto& tokens : deferred) {
+        std::string command = encodeCommand(tokens);
+        appendLocked(command.data(), command.size());
+    }
+    deferred.clear();
+}
+
+void Replication::serveReplica(int socket, const std::string& id, long long offset, int replicaPort, RedisDatabase& db,
+                               ClientInfo* info) {
+    long long sendFrom;
+    uint64_t replicaId, epoch;
+    std::string header, payload;
+    {
+        // db_mutex first: no write can slip in between the snapshot and its offset
+        auto dbLock = db.acquireLock();
+        std::lock_guard<std::mutex> lock(repl_mutex);
+        startStreamingLocked();
+        flushDeferredLocked(); // pops already applied belong before the snapshot's offset
+        long long firstByte = masterOffset - static_cast<long long>(backlogLen);
+        bool known = (id == replid) || (!replid2.empty() && id == replid2 && offset <= secondOffset);
+        if (known && offset >= firstByte && offset <= masterOffset) {
+            sendFrom = offset;
+            header = "+CONTINUE " + replid + "\r\n";
+            ++partialSyncs;
+        } else {
+            std::ostringstream snapshot;
+            db.dump(snapshot);
+            payload = snapshot.str();
+            sendFrom = masterOffset;
+            ++fullSyncs;
+            header = "+FULLRESYNC " + replid + " " + std::to_string(masterOffset) + "\r\n$" +
+                     std::to_string(payload.size()) + "\r\n";
+        }
+        replicaId = nextReplicaId++;
+        epoch = streamEpoch;
+        replicas.push_back({replicaId, peerAddress(socket), replicaPort, sendFrom, false});
+    }
+
+    auto self = [this, replicaId]() {
+        return std::find_if(replicas.begin(), replicas.end(),
+                            [replicaId](const ReplicaInfo& r) { return r.id == replicaId; });
+    };
+    // Output limits :- what the replica is behind (the snapshot itself doesn't count), call with repl_mutex held
+    OutputGuard guard;
+    auto overLimitLocked = [&]() {
+        size_t lag = static_cast<size_t>(masterOffset - sendFrom);
+        if (info)
+            info->outputBuffer = lag;
+        return guard.exceeded(ClientClass::REPLICA, lag);
+    };
+    auto overLimit = [&](size_t) {
+        std::lock_guard<std::mutex> lock(repl_mutex);
+        return overLimitLocked();
+    };
+    bool ok = sendLimited(socket, header.data(), header.size(), overLimit) &&
+              sendLimited(socket, payload.data(), payload.size(), overLimit);
+    payload.clear();
+    {
+        std::lock_guard<std::mutex> lock(repl_mutex);
+        self()->online = true;
+    }
+
+    std::string in;
+    std::vector<std::string> tokens;
+    std::vector<char> chunk;
+    while (ok) {
+        chunk.clear();
+        {
+            std::unique_lock<std::mutex> lock(repl_mutex);
+            stream_cv.wait_for(lock, std::chrono::milliseconds(100),
+                               [&]() { return masterOffset > sendFrom || streamEpoch != epoch; });
+            if (streamEpoch != epoch || sendFrom < masterOffset - static_cast<long long>(backlogLen)) {
+                break; // the stream was replaced, or this replica fell out of the backlog :- it has to resync
+            }
+            if (overLimitLocked()) {
+                break;
+            }
+            size_t n = static_cast<size_t>(std::min<long long>(masterOffset - sendFrom, kMaxChunk));
+            for (size_t i = 0; i < n; ++i) {
+                chunk.push_back(backlog[(sendFrom + i) % kBacklogSize]);
+            }
+        }
+        if (!chunk.empty()) {
+            ok = sendLimited(socket, chunk.data(), chunk.size(), overLimit);
+            sendFrom += chunk.size();
+        }
+
+        // REPLCONF ACK <offset> from the replica, or its hang-up
+        char buf[512];
+        ssize_t r;
+        while ((r = recv(socket, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+            in.append(buf, r);
+        }
+        if (r == 0 || (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+            break;
+        }
+        size_t pos = 0, used;
+        while ((used = RedisCommandHandler::extractCommand(in, pos, tokens)) != 0 && used != std::string::npos) {
+            pos += used;
+            if (tokens.size() == 3 && strcasecmp(tokens[0].c_str(), "REPLCONF") == 0 &&
+                strcasecmp(tokens[1].c_str(), "ACK") == 0) {
+                std::lock_guard<std::mutex> lock(repl_mutex);
+                self()->ackOffset = std::strtoll(tokens[2].c_str(), nullptr, 10);
+            }
+        }
+        if (used == std::string::npos) {
+            break; // not RESP, or a frame past the limits :- drop the link instead of buffering it
+        }
+        in.erase(0, pos);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(repl_mutex);
+        replicas.erase(self());
+    }
+    shutdown(socket, SHUT_RDWR); // the connection thread sees EOF and closes it
+}
+
+void Replication::replicaOf(const std::string& host, int port, RedisDatabase& db) {
+    std::lock_guard<std::mutex> lock(repl_mutex);
+    ++generation;
+    if (masterSocket >= 0) {
+        shutdown(masterSocket, SHUT_RDWR); // wakes the old link thread, it exits on the new generation
+    }
+    if (host.empty()) {
+        if (replicaMode.load()) {
+            // Promotion: new history, but replicas of the old master may still continue from ours
+            replid2 = replid;
+            secondOffset = masterOffset;
+            replid = newReplicationId();
+        }
+        replicaMode.store(false, std::memory_order_release);
+        masterHost.clear();
+        masterPort = 0;
+        return;
+    }
+    masterHost = host;
+    masterPort = port;
+    linkState = "connect";
+    replicaMode.store(true, std::memory_order_release);
+    startStreamingLocked(); // a replica keeps the stream it applies, for its own replicas
+    std::thread(&Replication::replicaLoop, this, generation, &db).detach();
+}
+
+void Replication::replicaLoop(uint64_t gen, RedisDatabase* db) {
+    while (true) {
+        std::string host;
+        int port;
+        {
+            std::lock_guard<std::mutex> lock(repl_mutex);
+            if (generation != gen) {
+                return;
+            }
+            host = masterHost;
+            port = masterPort;
+            linkState = "connect";
+        }
+        int sock = connectTo(host, port);
+        if (sock >= 0) {
+            bool current;
+            {
+                std::lock_guard<std::mutex> lock(repl_mutex);
+                current = (generation == gen);
+                if (current) {
+                    masterSocket = sock;
+                }
+            }
+            std::string buffer;
+            if (current && syncWithMaster(sock, buffer, *db)) {
+                streamFromMaster(sock, buffer, *db, gen);
+            }
+            {
+                std::lock_guard<std::mutex> lock(repl_mutex);
+                if (masterSocket == sock) {
+                    masterSocket = -1;
+                }
+            }
+            close(sock);
+        }
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
+}
+
+// Handshake and PSYNC; on a full resync the snapshot replaces the whole dataset
+bool Replication::syncWithMaster(int sock, std::string& buffer, RedisDatabase& db) {
+    std::string line;
+    if (!sendAll(sock, encodeCommand({"PING"})) || !readLine(sock, buffer, line) || line.empty() || line[0] == '-') {
+        return false;
+    }
+    if (!sendAll(sock, encodeCommand({"REPLCONF", "listening-port", std::to_string(listeningPort)})) ||
+        !readLine(sock, buffer, line)) {
+        return false;
+    }
+
+    std::string id;
+    long long offset;
+    {
+        std::lock_guard<std::mutex> lock(repl_mutex);
+        id = replid;
+        offset = masterOffset;
+        linkState = "sync";
+    }
+    if (!sendAll(sock, encodeCommand({"PSYNC", id, std::to_string(offset)})) || !readLine(sock, buffer, line)) {
+        return false;
+    }
+
+    std::istringstream reply(line);
+    std::string status, newId;
+    reply >> status >> newId;
+    if (status == "+FULLRESYNC") {
+        long long newOffset = -1;
+        reply >> newOffset;
+        std::string sizeLine;
+        if (newOffset < 0 || !readLine(sock, buffer, sizeLine) || sizeLine.empty() || sizeLine[0] != '$') {
+            return false;
+        }
+        size_t size = std::strtoull(sizeLine.c_str() + 1, nullptr, 10);
+        if (!fill(sock, buffer, size)) {
+            return false;
+        }
+        std::istringstream snapshot(buffer.substr(0, size));
+        buffer.erase(0, size);
+
+        auto dbLock = db.acquireLock();
+        db.load(snapshot);
+        std::lock_guard<std::mutex> lock(repl_mutex);
+        replid = newId;
+        replid2.clear();
+        secondOffset = -1;
+        masterOffset = newOffset;
+        backlogLen = 0;
+        deferred.clear();
+        ++streamEpoch; // our own replicas were following the old stream
+    } else if (status == "+CONTINUE") {
+        std::lock_guard<std::mutex> lock(repl_mutex);
+        if (!newId.empty() && newId != replid) {
+            replid2 = replid; // the master was promoted, same history under a new id
+            secondOffset = masterOffset;
+            replid = newId;
+        }
+    } else {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(repl_mutex);
+    linkState = "connected";
+    return true;
+}
+
+// Apply every command the master sends, copy it into our backlog, ACK once a second
+void Replication::streamFromMaster(int sock, std::string& buffer, RedisDatabase& db, uint64_t gen) {
+    RedisCommandHandler handler;
+    ClientSession master;
+    master.isMaster = true;
+    std::vector<std::string> tokens;
+    auto lastAck = std::chrono::steady_clock::now() - std::chrono::seconds(1);
+
+    while (true) {
+        size_t pos = 0;
+        while (true) {
+            size_t used = RedisCommandHandler::extractCommand(buffer, pos, tokens);
+            if (used == 0) {
+                break;
+            }
+            if (used == std::string::npos) {
+                return;
+            }
+            {
+                auto dbLock = db.acquireLock();
+                if (!tokens.empty()) {
+                    handler.processCommand(tokens, master, db);
+                }
+                std::lock_guard<std::mutex> lock(repl_mutex);
+                appendLocked(buffer.data() + pos, used);
+            }
+            stream_cv.notify_all();
+            pos += used;
+        }
+        buffer.erase(0, pos);
+
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastAck >= std::chrono::seconds(1)) {
+            lastAck = now;
+            long long offset;
+            {
+                std::lock_guard<std::mutex> lock(repl_mutex);
+                if (generation != gen) {
+                    return;
+                }
+                offset = masterOffset;
+            }
+            if (!sendAll(sock, encodeCommand({"REPLCONF", "ACK", std::to_string(offset)}))) {
+                return;
+            }
+        }
+
+        pollfd pfd{sock, POLLIN, 0};
+        if (poll(&pfd, 1, 1000) > 0) {
+            char chunk[16384];
+            ssize_t r = recv(sock, chunk, sizeof(chunk), 0);
+            if (r <= 0) {
+                return;
+            }
+            buffer.append(chunk, r);
+        }
+    }
+}
+
+// ROLE
+std::string Replication::roleReply() {
+    std::lock_guard<std::mutex> lock(repl_mutex);
+    if (replicaMode.load()) {
+        return "*5\r\n" + bulk("slave") + bulk(masterHost) + ":" + std::to_string(masterPort) + "\r\n" +
+               bulk(linkState) + ":" + std::to_string(masterOffset) + "\r\n";
+    }
+    std::string out = "*3\r\n" + bulk("master") + ":" + std::to_string(masterOffset) + "\r\n*" +
+                      std::to_string(replicas.size()) + "\r\n";
+    for (const auto& r : replicas) {
+        out += "*3\r\n" + bulk(r.ip) + bulk(std::to_string(r.port)) + bulk(std::to_string(r.ackOffset));
+    }
+    return out;
+}
+
+// INFO replication section
+std::string Replication::info() {
+    std::lock_guard<std::mutex> lock(repl_mutex);
+    std::ostringstream out;
+    out << "# Replication\r\n";
+    if (replicaMode.load()) {
+        out << "role:slave\r\n"
+            << "master_host:" << masterHost << "\r\n"
+            << "master_port:" << masterPort << "\r\n"
+            << "master_link_status:" << (linkState == "connected" ? "up" : "down") << "\r\n"
+            << "master_sync_in_progress:" << (linkState == "sync" ? 1 : 0) << "\r\n"
+            << "slave_repl_offset:" << masterOffset << "\r\n";
+    } else {
+        out << "role:master\r\n";
+    }
+    out << "connected_slaves:" << replicas.size() << "\r\n";
+    for (size_t i = 0; i < replicas.size(); ++i) {
+        const auto& r = replicas[i];
+        out << "slave" << i << ":ip=" << r.ip << ",port=" << r.port
+            << ",state=" << (r.online ? "online" : "wait_bgsave") << ",offset=" << r.ackOffset << "\r\n";
+    }
+    out << "master_replid:" << replid << "\r\n"
+        << "master_replid2:" << (replid2.empty() ? std::string(40, '0') : replid2) << "\r\n"
+        << "master_repl_offset:" << masterOffset << "\r\n"
+        << "second_repl_offset:" << secondOffset << "\r\n"
+        << "repl_backlog_active:" << (streaming.load() ? 1 : 0) << "\r\n"
+        << "repl_backlog_size:" << kBacklogSize << "\r\n"
+        << "repl_backlog_first_byte_offset:" << (masterOffset - static_cast<long long>(backlogLen)) << "\r\n"
+        << "repl_backlog_histlen:" << backlogLen << "\r\n"
+        << "sync_full:" << fullSyncs << "\r\n"
+        << "sync_partial_ok:" << partialSyncs << "\r\n";
+    return out.str();
+}
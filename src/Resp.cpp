@@ -0,0 +1,72 @@
+#include "../include/Resp.h"
+
+namespace {
+
+thread_local int current = 2;
+
+std::string header(char type, size_t n) {
+    return type + std::to_string(n) + "\r\n";
+}
+
+} // namespace
+
+namespace Resp {
+
+int protocol() {
+    return current;
+}
+
+Scope::Scope(int version) : previous(current) {
+    current = version;
+}
+
+Scope::~Scope() {
+    current = previous;
+}
+
+std::string bulk(const std::string& s) {
+    return "$" + std::to_string(s.size()) + "\r\n" + s + "\r\n";
+}
+
+std::string null() {
+    return current == 3 ? "_\r\n" : "$-1\r\n";
+}
+
+std::string nullArray() {
+    return current == 3 ? "_\r\n" : "*-1\r\n";
+}
+
+std::string map(size_t pairs) {
+    return current == 3 ? header('%', pairs) : header('*', pairs * 2);
+}
+
+std::string set(size_t size) {
+    return header(current == 3 ? '~' : '*', size);
+}
+
+std::string push(size_t size) {
+    return header(current == 3 ? '>' : '*', size);
+}
+
+std::string dbl(const std::string& formatted) {
+    return current == 3 ? "," + formatted + "\r\n" : bulk(formatted);
+}
+
+std::string boolean(bool value) {
+    if (current == 3)
+        return value ? "#t\r\n" : "#f\r\n";
+    return value ? ":1\r\n" : ":0\r\n";
+}
+
+std::string bigNumber(const std::string& digits) {
+    return current == 3 ? "(" + digits + "\r\n" : bulk(digits);
+}
+
+// The three characters before the colon say how to show the text, txt = plain
+std::string verbatim(const std::string& text) {
+    if (current != 3)
+        return bulk(text);
+    return "=" + std::to_string(text.size() + 4) + "\r\ntxt:" + text + "\r\n";
+}
+
+} // namespace Resp
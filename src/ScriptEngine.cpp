@@ -0,0 +1,904 @@
+#include "../include/ScriptEngine.h"
+#include "../include/Resp.h"
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+/* Script engine :- lexer -> single pass compiler -> stack VM
+ * The compiler emits bytecode straight from the recursive descent parser,
+ * locals live in numbered slots resolved at compile time, so the VM never
+ * looks anything up by name while running. */
+
+namespace {
+
+enum BuiltinId { BUILTIN_CALL, BUILTIN_TONUMBER, BUILTIN_TOSTRING, BUILTIN_TYPE };
+
+const size_t kMaxStringSize = 64 * 1024 * 1024;  // sandbox: no building giant strings
+const size_t kMaxArraySize = 1024 * 1024;
+const int kMaxNesting = 200;  // blocks, expressions and tables inside each other, the parser recurses on each
+
+struct Token {
+    enum Type { END, NAME, NUMBER, STRING, SYMBOL } type;
+    std::string text;
+    int line;
+};
+
+bool isKeyword(const std::string& s) {
+    static const char* keywords[] = {"local", "if", "then", "elseif", "else", "end", "while", "do",
+                                     "return", "and", "or", "not", "nil", "true", "false"};
+    for (const char* k : keywords) {
+        if (s == k) return true;
+    }
+    return false;
+}
+
+std::vector<Token> tokenize(const std::string& src) {
+    std::vector<Token> tokens;
+    size_t i = 0;
+    int line = 1;
+    while (i < src.size()) {
+        char c = src[i];
+        if (c == '\n') { ++line; ++i; continue; }
+        if (isspace(static_cast<unsigned char>(c))) { ++i; continue; }
+        if (c == '-' && i + 1 < src.size() && src[i + 1] == '-') { // comment to end of line
+            while (i < src.size() && src[i] != '\n') ++i;
+            continue;
+        }
+        if (isalpha(static_cast<unsigned char>(c)) || c == '_') {
+            size_t start = i;
+            while (i < src.size() && (isalnum(static_cast<unsigned char>(src[i])) || src[i] == '_')) ++i;
+            tokens.push_back({Token::NAME, src.substr(start, i - start), line});
+            continue;
+        }
+        if (isdigit(static_cast<unsigned char>(c))) {
+            size_t start = i;
+            while (i < src.size() && (isalnum(static_cast<unsigned char>(src[i])) || src[i] == '.')) ++i;
+            tokens.push_back({Token::NUMBER, src.substr(start, i - start), line});
+            continue;
+        }
+        if (c == '"' || c == '\'') {
+            std::string value;
+            ++i;
+            while (i < src.size() && src[i] != c) {
+                if (src[i] == '\\' && i + 1 < src.size()) {
+                    ++i;
+                    switch (src[i]) {
+                        case 'n': value.push_back('\n'); break;
+                        case 't': value.push_back('\t'); break;
+                        case 'r': value.push_back('\r'); break;
+                        default: value.push_back(src[i]); break;
+                    }
+                } else {
+                    if (src[i] == '\n') ++line;
+                    value.push_back(src[i]);
+                }
+                ++i;
+            }
+            if (i >= src.size()) {
+                throw ScriptError("line " + std::to_string(line) + ": unfinished string");
+            }
+            ++i;
+            tokens.push_back({Token::STRING, value, line});
+            continue;
+        }
+        static const char* twoChar[] = {"==", "~=", "<=", ">=", ".."};
+        bool matched = false;
+        for (const char* op : twoChar) {
+            if (src.compare(i, 2, op) == 0) {
+                tokens.push_back({Token::SYMBOL, op, line});
+                i += 2;
+                matched = true;
+                break;
+            }
+        }
+        if (matched) continue;
+        if (strchr("+-*/%<>=()[]{},#;.", c)) {
+            tokens.push_back({Token::SYMBOL, std::string(1, c), line});
+            ++i;
+            continue;
+        }
+        throw ScriptError("line " + std::to_string(line) + ": unexpected character '" + std::string(1, c) + "'");
+    }
+    tokens.push_back({Token::END, "<eof>", line});
+    return tokens;
+}
+
+class Compiler {
+public:
+    Compiler(const std::string& src, CompiledScript& out) : tokens(tokenize(src)), pos(0), out(out) {}
+
+    void compile() {
+        scopes.push_back(0);
+        block();
+        if (peek().type != Token::END) {
+            error("unexpected '" + peek().text + "'");
+        }
+        emit(OpCode::PUSH_NIL);
+        emit(OpCode::RETURN);
+    }
+
+private:
+    const Token& peek() const { return tokens[pos]; }
+    bool check(const char* text) const {
+        return (peek().type == Token::SYMBOL || peek().type == Token::NAME) && peek().text == text;
+    }
+    bool accept(const char* text) {
+        if (check(text)) { ++pos; return true; }
+        return false;
+    }
+    void expect(const char* text) {
+        if (!accept(text)) error("'" + std::string(text) + "' expected near '" + peek().text + "'");
+    }
+    [[noreturn]] void error(const std::string& msg) const {
+        throw ScriptError("line " + std::to_string(peek().line) + ": " + msg);
+    }
+
+    int emit(OpCode op, int a = 0, int b = 0) {
+        out.code.push_back({op, a, b});
+        return static_cast<int>(out.code.size()) - 1;
+    }
+    int here() const { return static_cast<int>(out.code.size()); }
+    void patch(int at, int target) { out.code[at].a = target; }
+
+    int constant(const ScriptValue& v) {
+        out.constants.push_back(v);
+        return static_cast<int>(out.constants.size()) - 1;
+    }
+
+    // Locals: names in declaration order, scopes remember where each block started
+    int findLocal(const std::string& name) const {
+        for (int i = static_cast<int>(locals.size()) - 1; i >= 0; --i) {
+            if (locals[i] == name) return i;
+        }
+        return -1;
+    }
+    int declareLocal(const std::string& name) {
+        locals.push_back(name);
+        out.numLocals = std::max(out.numLocals, static_cast<int>(locals.size()));
+        return static_cast<int>(locals.size()) - 1;
+    }
+    // One per recursive parse level :- a script nested past kMaxNesting is refused instead of overflowing the stack
+    struct Nest {
+        explicit Nest(Compiler& c) : c(c) {
+            if (++c.depth > kMaxNesting) throw ScriptError("too many nested levels");
+        }
+        ~Nest() { --c.depth; }
+        Compiler& c;
+    };
+
+    void openScope() { scopes.push_back(locals.size()); }
+    void closeScope() { locals.resize(scopes.back()); scopes.pop_back(); }
+
+    bool blockEnds() const {
+        return peek().type == Token::END || check("end") || check("else") || check("elseif");
+    }
+
+    void block() {
+        Nest nest(*this);
+        while (!blockEnds()) {
+            if (accept(";")) continue;
+            if (check("return")) {
+                ++pos;
+                if (blockEnds() || check(";")) emit(OpCode::PUSH_NIL);
+                else expression();
+                emit(OpCode::RETURN);
+                accept(";");
+                if (!blockEnds()) error("'end' expected after return");
+                return;
+            }
+            statement();
+        }
+    }
+
+    void statement() {
+        if (accept("local")) {
+            if (peek().type != Token::NAME || isKeyword(peek().text)) error("name expected after 'local'");
+            std::string name = tokens[pos++].text;
+            if (accept("=")) expression();
+            else emit(OpCode::PUSH_NIL);
+            emit(OpCode::STORE_LOCAL, declareLocal(name)); // declared after the initializer: local x = x
+            return;
+        }
+        if (accept("if")) {
+            std::vector<int> exits;
+            expression();
+            expect("then");
+            int skip = emit(OpCode::JMP_IF_FALSE);
+            openScope(); block(); closeScope();
+            while (true) {
+                if (accept("elseif")) {
+                    exits.push_back(emit(OpCode::JMP));
+                    patch(skip, here());
+                    expression();
+                    expect("then");
+                    skip = emit(OpCode::JMP_IF_FALSE);
+                    openScope(); block(); closeScope();
+                    continue;
+                }
+                if (accept("else")) {
+                    exits.push_back(emit(OpCode::JMP));
+                    patch(skip, here());
+                    skip = -1;
+                    openScope(); block(); closeScope();
+                }
+                break;
+            }
+            expect("end");
+            if (skip >= 0) patch(skip, here());
+            for (int e : exits) patch(e, here());
+            return;
+        }
+        if (accept("while")) {
+            int top = here();
+            expression();
+            expect("do");
+            int exit = emit(OpCode::JMP_IF_FALSE);
+            openScope(); block(); closeScope();
+            expect("end");
+            emit(OpCode::JMP, top);
+            patch(exit, here());
+            return;
+        }
+        if (peek().type == Token::NAME) {
+            int slot = findLocal(peek().text);
+            if (slot >= 0) {
+                ++pos;
+                if (accept("=")) {
+                    expression();
+                    emit(OpCode::STORE_LOCAL, slot);
+                    return;
+                }
+                // t[i][j] = v : walk the index chain, the last one becomes a store
+                emit(OpCode::LOAD_LOCAL, slot);
+                while (accept("[")) {
+                    expression();
+                    expect("]");
+                    if (accept("=")) {
+                        expression();
+                        emit(OpCode::SET_INDEX);
+                        return;
+                    }
+                    emit(OpCode::GET_INDEX);
+                }
+                error("syntax error near '" + peek().text + "'");
+            }
+            // Otherwise it must be a function call used as a statement
+            size_t before = out.code.size();
+            expression();
+            if (out.code.empty() || out.code.size() == before || out.code.back().op != OpCode::CALL_BUILTIN) {
+                error("syntax error, only function calls can be statements");
+            }
+            emit(OpCode::POP);
+            return;
+        }
+        error("unexpected '" + peek().text + "'");
+    }
+
+    void expression() {
+        Nest nest(*this);
+        orExpr();
+    }
+
+    void orExpr() {
+        andExpr();
+        while (accept("or")) {
+            int jump = emit(OpCode::JMP_IF_TRUE_KEEP);
+            andExpr();
+            patch(jump, here());
+        }
+    }
+
+    void andExpr() {
+        comparison();
+        while (accept("and")) {
+            int jump = emit(OpCode::JMP_IF_FALSE_KEEP);
+            comparison();
+            patch(jump, here());
+        }
+    }
+
+    void comparison() {
+        concat();
+        while (true) {
+            OpCode op;
+            if (accept("==")) op = OpCode::EQ;
+            else if (accept("~=")) op = OpCode::NE;
+            else if (accept("<=")) op = OpCode::LE;
+            else if (accept(">=")) op = OpCode::GE;
+            else if (accept("<")) op = OpCode::LT;
+            else if (accept(">")) op = OpCode::GT;
+            else return;
+            concat();
+            emit(op);
+        }
+    }
+
+    void concat() {
+        additive();
+        if (accept("..")) {
+            Nest nest(*this);
+            concat(); // right associative
+            emit(OpCode::CONCAT);
+        }
+    }
+
+    void additive() {
+        multiplicative();
+        while (true) {
+            if (accept("+")) { multiplicative(); emit(OpCode::ADD); }
+            else if (accept("-")) { multiplicative(); emit(OpCode::SUB); }
+            else return;
+        }
+    }
+
+    void multiplicative() {
+        unary();
+        while (true) {
+            if (accept("*")) { unary(); emit(OpCode::MUL); }
+            else if (accept("/")) { unary(); emit(OpCode::DIV); }
+            else if (accept("%")) { unary(); emit(OpCode::MOD); }
+            else return;
+        }
+    }
+
+    void unary() {
+        OpCode op;
+        if (accept("not")) op = OpCode::NOT;
+        else if (accept("-")) op = OpCode::NEG;
+        else if (accept("#")) op = OpCode::LEN;
+        else { postfix(); return; }
+        Nest nest(*this);
+        unary();
+        emit(op);
+    }
+
+    void postfix() {
+        primary();
+        while (accept("[")) {
+            expression();
+            expect("]");
+            emit(OpCode::GET_INDEX);
+        }
+    }
+
+    int builtinId(const std::string& name) {
+        if (name == "call") return BUILTIN_CALL;
+        if (name == "tonumber") return BUILTIN_TONUMBER;
+        if (name == "tostring") return BUILTIN_TOSTRING;
+        if (name == "type") return BUILTIN_TYPE;
+        return -1;
+    }
+
+    void primary() {
+        const Token tok = peek();
+        if (tok.type == Token::NUMBER) {
+            ++pos;
+            char* end = nullptr;
+            ScriptValue v;
+            v.type = ScriptValue::NUMBER;
+            v.number = strtod(tok.text.c_str(), &end);
+            if (*end != '\0') error("malformed number '" + tok.text + "'");
+            emit(OpCode::PUSH_CONST, constant(v));
+            return;
+        }
+        if (tok.type == Token::STRING) {
+            ++pos;
+            ScriptValue v;
+            v.type = ScriptValue::STRING;
+            v.str = tok.text;
+            emit(OpCode::PUSH_CONST, constant(v));
+            return;
+        }
+        if (accept("nil")) { emit(OpCode::PUSH_NIL); return; }
+        if (accept("true")) { emit(OpCode::PUSH_TRUE); return; }
+        if (accept("false")) { emit(OpCode::PUSH_FALSE); return; }
+        if (accept("(")) {
+            expression();
+            expect(")");
+            return;
+        }
+        if (accept("{")) {
+            Nest nest(*this);
+            int count = 0;
+            if (!check("}")) {
+                do {
+                    expression();
+                    ++count;
+                } while (accept(","));
+            }
+            expect("}");
+            emit(OpCode::NEW_ARRAY, count);
+            return;
+        }
+        if (tok.type == Token::NAME && !isKeyword(tok.text)) {
+            ++pos;
+            int slot = findLocal(tok.text);
+            if (slot >= 0) { emit(OpCode::LOAD_LOCAL, slot); return; }
+            if (tok.text == "KEYS") { emit(OpCode::LOAD_KEYS); return; }
+            if (tok.text == "ARGV") { emit(OpCode::LOAD_ARGV); return; }
+
+            std::string name = tok.text;
+            if (name == "redis") { // redis.call(...) spelling
+                expect(".");
+                if (peek().type != Token::NAME) error("name expected after 'redis.'");
+                name = tokens[pos++].text;
+            }
+            int id = builtinId(name);
+            if (id < 0) error("undefined variable '" + name + "'");
+            expect("(");
+            int argc = 0;
+            if (!check(")")) {
+                do {
+                    expression();
+                    ++argc;
+                } while (accept(","));
+            }
+            expect(")");
+            emit(OpCode::CALL_BUILTIN, id, argc);
+            return;
+        }
+        error("unexpected '" + tok.text + "'");
+    }
+
+    std::vector<Token> tokens;
+    size_t pos;
+    int depth = 0;
+    CompiledScript& out;
+    std::vector<std::string> locals;
+    std::vector<size_t> scopes;
+};
+
+// Helpers used by the VM
+
+ScriptValue makeNumber(double n) {
+    ScriptValue v;
+    v.type = ScriptValue::NUMBER;
+    v.number = n;
+    return v;
+}
+
+ScriptValue makeString(std::string s) {
+    ScriptValue v;
+    v.type = ScriptValue::STRING;
+    v.str = std::move(s);
+    return v;
+}
+
+ScriptValue makeBool(bool b) {
+    ScriptValue v;
+    v.type = ScriptValue::BOOL;
+    v.boolean = b;
+    return v;
+}
+
+bool truthy(const ScriptValue& v) {
+    return !(v.type == ScriptValue::NIL || (v.type == ScriptValue::BOOL && !v.boolean));
+}
+
+std::string numberToString(double n) {
+    char buf[32];
+    if (std::floor(n) == n && std::fabs(n) < 1e15) {
+        snprintf(buf, sizeof(buf), "%lld", static_cast<long long>(n));
+    } else {
+        snprintf(buf, sizeof(buf), "%.17g", n);
+    }
+    return buf;
+}
+
+bool stringToNumber(const std::string& s, double& out) {
+    if (s.empty()) return false;
+    char* end = nullptr;
+    out = strtod(s.c_str(), &end);
+    return end == s.c_str() + s.size();
+}
+
+const char* typeName(const ScriptValue& v) {
+    switch (v.type) {
+        case ScriptValue::NIL: return "nil";
+        case ScriptValue::BOOL: return "boolean";
+        case ScriptValue::NUMBER: return "number";
+        case ScriptValue::STRING: return "string";
+        case ScriptValue::ARRAY: return "table";
+    }
+    return "?";
+}
+
+double toNumber(const ScriptValue& v, const char* what) {
+    double n;
+    if (v.type == ScriptValue::NUMBER) return v.number;
+    if (v.type == ScriptValue::STRING && stringToNumber(v.str, n)) return n;
+    throw ScriptError(std::string("attempt to ") + what + " a " + typeName(v) + " value");
+}
+
+std::string toStringValue(const ScriptValue& v, const char* what) {
+    if (v.type == ScriptValue::STRING) return v.str;
+    if (v.type == ScriptValue::NUMBER) return numberToString(v.number);
+    throw ScriptError(std::string("attempt to ") + what + " a " + typeName(v) + " value");
+}
+
+// Arrays are freed one at a time instead of recursively :- t = {t} in a loop builds a chain
+// deep enough to overflow the stack if each vector destroyed its children inline
+struct ArrayDeleter {
+    void operator()(std::vector<ScriptValue>* array) const {
+        static thread_local std::vector<std::vector<ScriptValue>*> pending;
+        static thread_local bool draining = false;
+        pending.push_back(array);
+        if (draining) return;
+        draining = true;
+        while (!pending.empty()) {
+            std::vector<ScriptValue>* next = pending.back();
+            pending.pop_back();
+            delete next; // children that drop to zero land in pending
+        }
+        draining = false;
+    }
+};
+
+std::shared_ptr<std::vector<ScriptValue>> newArray(std::vector<ScriptValue> items = {}) {
+    return std::shared_ptr<std::vector<ScriptValue>>(new std::vector<ScriptValue>(std::move(items)), ArrayDeleter());
+}
+
+// RESP reply of a command -> script value (errors abort the script like redis.call)
+ScriptValue parseReply(const std::string& resp, size_t& pos) {
+    size_t crlf = resp.find("\r\n", pos);
+    if (pos >= resp.size() || crlf == std::string::npos) {
+        throw ScriptError("malformed reply from command");
+    }
+    char type = resp[pos];
+    std::string line = resp.substr(pos + 1, crlf - pos - 1);
+    pos = crlf + 2;
+    switch (type) {
+        case '+': return makeString(line);
+        case '-': throw ScriptError(line);
+        case ':': return makeNumber(strtod(line.c_str(), nullptr));
+        case '$': {
+            long len = strtol(line.c_str(), nullptr, 10);
+            if (len < 0) return ScriptValue();
+            ScriptValue v = makeString(resp.substr(pos, len));
+            pos += len + 2;
+            return v;
+        }
+        case '*': {
+            long count = strtol(line.c_str(), nullptr, 10);
+            if (count < 0) return ScriptValue();
+            ScriptValue v;
+            v.type = ScriptValue::ARRAY;
+            v.array = newArray();
+            for (long i = 0; i < count; ++i) {
+                v.array->push_back(parseReply(resp, pos));
+            }
+            return v;
+        }
+        default:
+            throw ScriptError("unsupported reply type from command");
+    }
+}
+
+void toResp(const ScriptValue& v, std::string& out, int depth = 0) {
+    switch (v.type) {
+        case ScriptValue::NIL:
+            out += Resp::null();
+            break;
+        case ScriptValue::BOOL:
+            if (Resp::protocol() == 3)
+                out += Resp::boolean(v.boolean);
+            else
+                out += v.boolean ? ":1\r\n" : "$-1\r\n";
+            break;
+        case ScriptValue::NUMBER:
+            // integers, like Redis :- inf, nan and anything outside long long have no integer to truncate to
+            if (!std::isfinite(v.number) || v.number < -9223372036854775808.0 || v.number >= 9223372036854775808.0)
+                out += "-ERR script returned a number that does not fit in an integer reply\r\n";
+            else
+                out += ":" + std::to_string(static_cast<long long>(v.number)) + "\r\n";
+            break;
+        case ScriptValue::STRING:
+            out += "$" + std::to_string(v.str.size()) + "\r\n" + v.str + "\r\n";
+            break;
+        case ScriptValue::ARRAY:
+            if (depth >= kMaxNesting) throw ScriptError("reply nested too deeply"); // also a table holding itself
+            out += "*" + std::to_string(v.array->size()) + "\r\n";
+            for (const auto& e : *v.array) toResp(e, out, depth + 1);
+            break;
+    }
+}
+
+ScriptValue makeArgArray(const std::vector<std::string>& items) {
+    ScriptValue v;
+    v.type = ScriptValue::ARRAY;
+    v.array = newArray();
+    for (const auto& s : items) v.array->push_back(makeString(s));
+    return v;
+}
+
+bool valuesEqual(const ScriptValue& a, const ScriptValue& b) {
+    if (a.type != b.type) return false;
+    switch (a.type) {
+        case ScriptValue::NIL: return true;
+        case ScriptValue::BOOL: return a.boolean == b.boolean;
+        case ScriptValue::NUMBER: return a.number == b.number;
+        case ScriptValue::STRING: return a.str == b.str;
+        case ScriptValue::ARRAY: return a.array == b.array;
+    }
+    return false;
+}
+
+// <, <= : numbers with numbers, strings with strings
+int compareValues(const ScriptValue& a, const ScriptValue& b) {
+    if (a.type == ScriptValue::NUMBER && b.type == ScriptValue::NUMBER) {
+        return a.number < b.number ? -1 : (a.number > b.number ? 1 : 0);
+    }
+    if (a.type == ScriptValue::STRING && b.type == ScriptValue::STRING) {
+        return a.str.compare(b.str);
+    }
+    throw ScriptError(std::string("attempt to compare ") + typeName(a) + " with " + typeName(b));
+}
+
+} // namespace
+
+ScriptEngine& ScriptEngine::getInstance() {
+    static ScriptEngine instance;
+    return instance;
+}
+
+std::shared_ptr<CompiledScript> ScriptEngine::load(const std::string& source, std::string& error) {
+    std::string sha = sha1Hex(source);
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        auto it = script_cache.find(sha);
+        if (it != script_cache.end()) {
+            return it->second;
+        }
+    }
+    auto script = std::make_shared<CompiledScript>();
+    script->sha = sha;
+    try {
+        Compiler(source, *script).compile();
+    } catch (const ScriptError& e) {
+        error = e.what();
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    script_cache[sha] = script;
+    return script;
+}
+
+std::shared_ptr<CompiledScript> ScriptEngine::find(const std::string& sha) {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    auto it = script_cache.find(sha);
+    return it != script_cache.end() ? it->second : nullptr;
+}
+
+bool ScriptEngine::exists(const std::string& sha) {
+    return find(sha) != nullptr;
+}
+
+void ScriptEngine::flush() {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    script_cache.clear();
+}
+
+std::string ScriptEngine::run(const CompiledScript& script, const std::vector<std::string>& keys,
+                              const std::vector<std::string>& argv, const CommandExecutor& executor) {
+    std::vector<ScriptValue> stack;
+    std::vector<ScriptValue> locals(script.numLocals);
+    ScriptValue keysValue = makeArgArray(keys);
+    ScriptValue argvValue = makeArgArray(argv);
+    // Arrays an array was stored into :- the only way to build a cycle (t[1] = t), which reference
+    // counting never frees, so they are emptied when the script ends, however it ends
+    struct Unlinker {
+        std::vector<std::weak_ptr<std::vector<ScriptValue>>> arrays;
+        ~Unlinker() {
+            for (auto& w : arrays) {
+                if (auto a = w.lock()) a->clear();
+            }
+        }
+    } linked;
+    long budget = kInstructionBudget;
+
+    auto pop = [&stack]() {
+        ScriptValue v = std::move(stack.back());
+        stack.pop_back();
+        return v;
+    };
+
+    try {
+        size_t pc = 0;
+        while (true) {
+            if (--budget < 0) {
+                throw ScriptError("script exceeded the instruction limit");
+            }
+            const Instruction& ins = script.code[pc++];
+            switch (ins.op) {
+                case OpCode::PUSH_CONST: stack.push_back(script.constants[ins.a]); break;
+                case OpCode::PUSH_NIL: stack.emplace_back(); break;
+                case OpCode::PUSH_TRUE: stack.push_back(makeBool(true)); break;
+                case OpCode::PUSH_FALSE: stack.push_back(makeBool(false)); break;
+                case OpCode::LOAD_LOCAL: stack.push_back(locals[ins.a]); break;
+                case OpCode::STORE_LOCAL: locals[ins.a] = pop(); break;
+                case OpCode::LOAD_KEYS: stack.push_back(keysValue); break;
+                case OpCode::LOAD_ARGV: stack.push_back(argvValue); break;
+
+                case OpCode::GET_INDEX: {
+                    ScriptValue index = pop();
+                    ScriptValue container = pop();
+                    if (container.type != ScriptValue::ARRAY) {
+                        throw ScriptError(std::string("attempt to index a ") + typeName(container) + " value");
+                    }
+                    double i = toNumber(index, "index with");
+                    if (i >= 1 && i <= container.array->size() && std::floor(i) == i) {
+                        stack.push_back((*container.array)[static_cast<size_t>(i) - 1]); // 1-based like Lua
+                    } else {
+                        stack.emplace_back();
+                    }
+                    break;
+                }
+                case OpCode::SET_INDEX: {
+                    ScriptValue value = pop();
+                    ScriptValue index = pop();
+                    ScriptValue container = pop();
+                    if (container.type != ScriptValue::ARRAY) {
+                        throw ScriptError(std::string("attempt to index a ") + typeName(container) + " value");
+                    }
+                    double i = toNumber(index, "index with");
+                    size_t size = container.array->size();
+                    if (value.type == ScriptValue::ARRAY) linked.arrays.push_back(container.array);
+                    if (i >= 1 && i <= size && std::floor(i) == i) {
+                        (*container.array)[static_cast<size_t>(i) - 1] = std::move(value);
+                    } else if (i == size + 1 && size < kMaxArraySize) {
+                        container.array->push_back(std::move(value));
+                    } else {
+                        throw ScriptError("array index out of range");
+                    }
+                    break;
+                }
+                case OpCode::NEW_ARRAY: {
+                    ScriptValue v;
+                    v.type = ScriptValue::ARRAY;
+                    v.array = newArray(std::vector<ScriptValue>(
+                        std::make_move_iterator(stack.end() - ins.a), std::make_move_iterator(stack.end())));
+                    stack.resize(stack.size() - ins.a);
+                    stack.push_back(std::move(v));
+                    break;
+                }
+
+                case OpCode::ADD: case OpCode::SUB: case OpCode::MUL: case OpCode::DIV: case OpCode::MOD: {
+                    double b = toNumber(pop(), "perform arithmetic on");
+                    double a = toNumber(pop(), "perform arithmetic on");
+                    double r = 0;
+                    switch (ins.op) {
+                        case OpCode::ADD: r = a + b; break;
+                        case OpCode::SUB: r = a - b; break;
+                        case OpCode::MUL: r = a * b; break;
+                        case OpCode::DIV: r = a / b; break;
+                        default: r = a - std::floor(a / b) * b; break;
+                    }
+                    stack.push_back(makeNumber(r));
+                    break;
+                }
+                case OpCode::NEG: stack.push_back(makeNumber(-toNumber(pop(), "perform arithmetic on"))); break;
+                case OpCode::NOT: stack.push_back(makeBool(!truthy(pop()))); break;
+                case OpCode::LEN: {
+                    ScriptValue v = pop();
+                    if (v.type == ScriptValue::STRING) stack.push_back(makeNumber(v.str.size()));
+                    else if (v.type == ScriptValue::ARRAY) stack.push_back(makeNumber(v.array->size()));
+                    else throw ScriptError(std::string("attempt to get length of a ") + typeName(v) + " value");
+                    break;
+                }
+                case OpCode::CONCAT: {
+                    std::string b = toStringValue(pop(), "concatenate");
+                    std::string a = toStringValue(pop(), "concatenate");
+                    if (a.size() + b.size() > kMaxStringSize) {
+                        throw ScriptError("string length limit exceeded");
+                    }
+                    stack.push_back(makeString(a + b));
+                    break;
+                }
+
+                case OpCode::EQ: { ScriptValue b = pop(), a = pop(); stack.push_back(makeBool(valuesEqual(a, b))); break; }
+                case OpCode::NE: { ScriptValue b = pop(), a = pop(); stack.push_back(makeBool(!valuesEqual(a, b))); break; }
+                case OpCode::LT: { ScriptValue b = pop(), a = pop(); stack.push_back(makeBool(compareValues(a, b) < 0)); break; }
+                case OpCode::LE: { ScriptValue b = pop(), a = pop(); stack.push_back(makeBool(compareValues(a, b) <= 0)); break; }
+                case OpCode::GT: { ScriptValue b = pop(), a = pop(); stack.push_back(makeBool(compareValues(a, b) > 0)); break; }
+                case OpCode::GE: { ScriptValue b = pop(), a = pop(); stack.push_back(makeBool(compareValues(a, b) >= 0)); break; }
+
+                case OpCode::JMP: pc = ins.a; break;
+                case OpCode::JMP_IF_FALSE:
+                    if (!truthy(pop())) pc = ins.a;
+                    break;
+                case OpCode::JMP_IF_FALSE_KEEP: // 'and': keep the falsy operand as the result
+                    if (!truthy(stack.back())) pc = ins.a;
+                    else stack.pop_back();
+                    break;
+                case OpCode::JMP_IF_TRUE_KEEP:  // 'or': keep the truthy operand as the result
+                    if (truthy(stack.back())) pc = ins.a;
+                    else stack.pop_back();
+                    break;
+
+                case OpCode::CALL_BUILTIN: {
+                    std::vector<ScriptValue> args(std::make_move_iterator(stack.end() - ins.b),
+                                                  std::make_move_iterator(stack.end()));
+                    stack.resize(stack.size() - ins.b);
+                    switch (ins.a) {
+                        case BUILTIN_CALL: {
+                            if (args.empty()) throw ScriptError("redis.call needs at least a command name");
+                            std::vector<std::string> command;
+                            for (const auto& a : args) {
+                                command.push_back(toStringValue(a, "pass to redis.call"));
+                            }
+                            std::string reply = executor(command);
+                            size_t rpos = 0;
+                            stack.push_back(parseReply(reply, rpos));
+                            break;
+                        }
+                        case BUILTIN_TONUMBER: {
+                            double n;
+                            if (!args.empty() && args[0].type == ScriptValue::NUMBER) stack.push_back(args[0]);
+                            else if (!args.empty() && args[0].type == ScriptValue::STRING && stringToNumber(args[0].str, n))
+                                stack.push_back(makeNumber(n));
+                            else stack.emplace_back();
+                            break;
+                        }
+                        case BUILTIN_TOSTRING: {
+                            if (args.empty() || args[0].type == ScriptValue::NIL) stack.push_back(makeString("nil"));
+                            else if (args[0].type == ScriptValue::BOOL) stack.push_back(makeString(args[0].boolean ? "true" : "false"));
+                            else if (args[0].type == ScriptValue::ARRAY) stack.push_back(makeString("table"));
+                            else stack.push_back(makeString(toStringValue(args[0], "convert")));
+                            break;
+                        }
+                        case BUILTIN_TYPE:
+                            stack.push_back(makeString(args.empty() ? "nil" : typeName(args[0])));
+                            break;
+                    }
+                    break;
+                }
+                case OpCode::POP: stack.pop_back(); break;
+                case OpCode::RETURN: {
+                    std::string reply;
+                    toResp(stack.back(), reply);
+                    return reply;
+                }
+            }
+        }
+    } catch (const ScriptError& e) {
+        return "-ERR Error running script (call to f_" + script.sha + "): " + e.what() + "\r\n";
+    }
+}
+
+// SHA1 (FIPS 180-1), only used to name cached scripts
+std::string ScriptEngine::sha1Hex(const std::string& data) {
+    uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+    std::string msg = data;
+    uint64_t bitLen = static_cast<uint64_t>(data.size()) * 8;
+    msg.push_back(static_cast<char>(0x80));
+    while (msg.size() % 64 != 56) msg.push_back(0);
+    for (int i = 7; i >= 0; --i) msg.push_back(static_cast<char>((bitLen >> (i * 8)) & 0xFF));
+
+    auto rol = [](uint32_t v, int n) { return (v << n) | (v >> (32 - n)); };
+    for (size_t chunk = 0; chunk < msg.size(); chunk += 64) {
+        uint32_t w[80];
+        for (int i = 0; i < 16; ++i) {
+            const unsigned char* p = reinterpret_cast<const unsigned char*>(msg.data() + chunk + i * 4);
+            w[i] = (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+        }
+        for (int i = 16; i < 80; ++i) w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; ++i) {
+            uint32_t f, k;
+            if (i < 20) { f = (b & c) | (~b & d); k = 0x5A827999; }
+            else if (i < 40) { f = b ^ c ^ d; k = 0x6ED9EBA1; }
+            else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+            else { f = b ^ c ^ d; k = 0xCA62C1D6; }
+            uint32_t temp = rol(a, 5) + f + e + k + w[i];
+            e = d; d = c; c = rol(b, 30); b = a; a = temp;
+        }
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+    }
+
+    char hex[41];
+    for (int i = 0; i < 5; ++i) snprintf(hex + i * 8, 9, "%08x", h[i]);
+    return std::string(hex, 40);
+}
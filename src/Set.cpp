@@ -0,0 +1,249 @@
+#include "../include/Set.h"
+#include "../include/StringValue.h"
+#include <algorithm>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+/* Intersection kernels for sorted int64 arrays
+ *  - galloping :- when one side is much smaller, exponential + binary search
+ *    each small element in the big one, O(m log(n/m))
+ *  - merge :- similar sizes; with AVX2 each element of a is compared against
+ *    4 elements of b at once and whole blocks of b are skipped at a time.
+ * The AVX2 path is picked at runtime, so the binary still runs on older CPUs. */
+
+namespace {
+
+const size_t kGallopRatio = 32; // use galloping when one side is 32x bigger
+
+void intersectGallop(const std::vector<int64_t>& small, const std::vector<int64_t>& big, std::vector<int64_t>& out) {
+    size_t lo = 0;
+    for (int64_t x : small) {
+        size_t step = 1, hi = lo;
+        while (hi < big.size() && big[hi] < x) {
+            lo = hi + 1;
+            hi += step;
+            step <<= 1;
+        }
+        auto it = std::lower_bound(big.begin() + lo, big.begin() + std::min(hi + 1, big.size()), x);
+        lo = it - big.begin();
+        if (lo == big.size())
+            return;
+        if (*it == x)
+            out.push_back(x);
+    }
+}
+
+size_t intersectMergeScalar(const std::vector<int64_t>& a, size_t i, const std::vector<int64_t>& b, size_t j, std::vector<int64_t>& out) {
+    while (i < a.size() && j < b.size()) {
+        if (a[i] < b[j]) {
+            ++i;
+        } else if (b[j] < a[i]) {
+            ++j;
+        } else {
+            out.push_back(a[i]);
+            ++i;
+            ++j;
+        }
+    }
+    return i;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx2")))
+void intersectMergeAvx2(const std::vector<int64_t>& a, const std::vector<int64_t>& b, std::vector<int64_t>& out) {
+    size_t i = 0, j = 0;
+    while (i < a.size() && j + 4 <= b.size()) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b.data() + j));
+        __m256i needle = _mm256_set1_epi64x(a[i]);
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi64(needle, block)) != 0)
+            out.push_back(a[i]);
+        if (b[j + 3] <= a[i]) {
+            j += 4; // everything in this block is <= a[i], and a only grows
+            if (b[j - 1] == a[i])
+                ++i;
+        } else {
+            ++i;
+        }
+    }
+    intersectMergeScalar(a, i, b, j, out);
+}
+
+bool haveAvx2() {
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+}
+#endif
+
+} // namespace
+
+void Set::intersectSorted(const std::vector<int64_t>& a, const std::vector<int64_t>& b, std::vector<int64_t>& out) {
+    out.clear();
+    const std::vector<int64_t>& small = a.size() <= b.size() ? a : b;
+    const std::vector<int64_t>& big = a.size() <= b.size() ? b : a;
+    if (small.empty())
+        return;
+    out.reserve(small.size());
+    if (big.size() / small.size() >= kGallopRatio) {
+        intersectGallop(small, big, out);
+        return;
+    }
+#if defined(__x86_64__)
+    if (haveAvx2()) {
+        intersectMergeAvx2(small, big, out);
+        return;
+    }
+#endif
+    intersectMergeScalar(small, 0, big, 0, out);
+}
+
+void Set::convertToHash() {
+    strs.reserve(ints.size() + 1);
+    for (int64_t v : ints) {
+        strs.insert(intToString(v));
+    }
+    ints.clear();
+    ints.shrink_to_fit();
+    hashed = true;
+}
+
+bool Set::add(const std::string& member) {
+    if (!hashed) {
+        int64_t v;
+        if (parseCanonicalInt(member, v)) {
+            auto it = std::lower_bound(ints.begin(), ints.end(), v);
+            if (it != ints.end() && *it == v)
+                return false;
+            if (ints.size() < kMaxIntsetEntries) {
+                ints.insert(it, v);
+                return true;
+            }
+        }
+        convertToHash();
+    }
+    return strs.insert(member).second;
+}
+
+bool Set::remove(const std::string& member) {
+    if (hashed)
+        return strs.erase(member) > 0;
+    int64_t v;
+    if (!parseCanonicalInt(member, v))
+        return false;
+    auto it = std::lower_bound(ints.begin(), ints.end(), v);
+    if (it == ints.end() || *it != v)
+        return false;
+    ints.erase(it);
+    return true;
+}
+
+bool Set::contains(const std::string& member) const {
+    if (hashed)
+        return strs.count(member) > 0;
+    int64_t v;
+    return parseCanonicalInt(member, v) && std::binary_search(ints.begin(), ints.end(), v);
+}
+
+size_t Set::size() const {
+    return hashed ? strs.size() : ints.size();
+}
+
+std::vector<std::string> Set::members() const {
+    std::vector<std::string> out;
+    out.reserve(size());
+    forEach([&out](const std::string& m) { out.push_back(m); });
+    return out;
+}
+
+void Set::forEach(const std::function<void(const std::string&)>& fn) const {
+    if (hashed) {
+        for (const auto& m : strs) {
+            fn(m);
+        }
+        return;
+    }
+    for (int64_t v : ints) {
+        fn(intToString(v));
+    }
+}
+
+size_t Set::memoryUsage() const {
+    if (!hashed)
+        return ints.capacity() * sizeof(int64_t);
+    size_t bytes = strs.bucket_count() * sizeof(void*);
+    for (const auto& m : strs) {
+        bytes += sizeof(std::string) + 2 * sizeof(void*) + (m.capacity() > 15 ? m.capacity() + 1 : 0);
+    }
+    return bytes;
+}
+
+Set Set::intersect(std::vector<const Set*> sets) {
+    Set result;
+    if (sets.empty())
+        return result;
+    for (const Set* s : sets) {
+        if (!s || s->size() == 0)
+            return result; // intersection with an empty set
+    }
+    // Smallest first: it bounds the result and keeps every later step cheap
+    std::sort(sets.begin(), sets.end(), [](const Set* x, const Set* y) { return x->size() < y->size(); });
+
+    if (!sets[0]->hashed) {
+        // Anything hashed holds no members of an all-integer set except ones that
+        // went in as strings; probe those instead of running the int kernel
+        result.ints = sets[0]->ints;
+        std::vector<int64_t> scratch;
+        for (size_t k = 1; k < sets.size() && !result.ints.empty(); ++k) {
+            if (!sets[k]->hashed) {
+                intersectSorted(result.ints, sets[k]->ints, scratch);
+                result.ints.swap(scratch);
+            } else {
+                auto& strsK = sets[k]->strs;
+                result.ints.erase(std::remove_if(result.ints.begin(), result.ints.end(),
+                                                 [&strsK](int64_t v) { return strsK.count(intToString(v)) == 0; }),
+                                  result.ints.end());
+            }
+        }
+        return result;
+    }
+
+    sets[0]->forEach([&](const std::string& m) {
+        for (size_t k = 1; k < sets.size(); ++k) {
+            if (!sets[k]->contains(m))
+                return;
+        }
+        result.add(m);
+    });
+    return result;
+}
+
+Set Set::unite(const std::vector<const Set*>& sets) {
+    Set result;
+    for (const Set* s : sets) {
+        if (!s)
+            continue;
+        if (!s->hashed && !result.hashed && result.ints.size() + s->ints.size() <= kMaxIntsetEntries) {
+            std::vector<int64_t> merged;
+            merged.reserve(result.ints.size() + s->ints.size());
+            std::set_union(result.ints.begin(), result.ints.end(), s->ints.begin(), s->ints.end(), std::back_inserter(merged));
+            result.ints.swap(merged);
+            continue;
+        }
+        s->forEach([&result](const std::string& m) { result.add(m); });
+    }
+    return result;
+}
+
+Set Set::difference(const std::vector<const Set*>& sets) {
+    Set result;
+    if (sets.empty() || !sets[0])
+        return result;
+    sets[0]->forEach([&](const std::string& m) {
+        for (size_t k = 1; k < sets.size(); ++k) {
+            if (sets[k] && sets[k]->contains(m))
+                return;
+        }
+        result.add(m);
+    });
+    return result;
+}
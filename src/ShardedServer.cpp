@@ -0,0 +1,1025 @@
+#include "../include/ShardedServer.h"
+#include "../include/RedisServer.h"
+#include "../include/RedisCommandHandler.h"
+#include "../include/RedisDatabase.h"
+#include "../include/ClientSession.h"
+#include "../include/IoUring.h"
+#include "../include/OutputLimits.h"
+#include "../include/ClientRegistry.h"
+#include <iostream>
+#include <thread>
+#include <deque>
+#include <unordered_map>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+
+namespace {
+
+const size_t kRingCapacity = 4096;
+const int kDumpIntervalSeconds = 300; // same period as the single-keyspace server
+const uint64_t kListenerId = 0;      // epoll tags, connections count up from kFirstConnId
+const uint64_t kWakeId = 1;
+const uint64_t kLocalListenerId = 2; // the Unix socket
+const uint64_t kCancelId = 3;        // io_uring: the cancelled recv of a connection being handed over
+const uint64_t kFirstConnId = 4;
+
+// io_uring backend :- an operation's user data is (tag << 2) | kind
+const unsigned kRingEntries = 1024;
+const unsigned kRecvBuffers = 256; // provided buffer ring shared by every connection of a shard
+const unsigned kRecvBufferSize = 16384;
+const uint64_t kOpRecv = 0;
+const uint64_t kOpSend = 1;
+const uint64_t kOpAccept = 2;
+const uint64_t kOpWake = 3;
+
+// How the replies of a command that went to several shards are put back together
+enum class Merge {
+    NONE,     // one part, passed through
+    POSITION, // MGET :- array elements go back to their key's position
+    SUM,      // DEL/UNLINK/EXISTS :- integers added up
+    OK,       // MSET/FLUSHALL :- +OK unless a part failed
+    CONCAT    // KEYS :- arrays appended
+};
+
+std::atomic<uint64_t> nextClientId{0}; // CLIENT ID, unique over every shard
+
+const char* const kCrossSlot = "-CROSSSLOT Keys in request don't hash to the same shard\r\n";
+
+// Commands that wait block the thread running them, and a subscribed connection
+// is written to by publishers, so their connection leaves the loop
+bool takesOver(const std::vector<std::string>& tokens) {
+    std::string cmd = tokens[0];
+    std::transform(cmd.begin(), cmd.end(), cmd.begin(), ::toupper);
+    if (cmd == "BLPOP" || cmd == "BRPOP" || cmd == "BLMOVE" || cmd == "SUBSCRIBE" || cmd == "PSUBSCRIBE") {
+        return true;
+    }
+    if (cmd == "XREAD" || cmd == "XREADGROUP") {
+        for (const auto& token : tokens) {
+            std::string opt = token;
+            std::transform(opt.begin(), opt.end(), opt.begin(), ::toupper);
+            if (opt == "STREAMS")
+                break;
+            if (opt == "BLOCK")
+                return true;
+        }
+    }
+    return false;
+}
+
+bool setNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+// Raw RESP elements of an array reply (bulk strings, nulls or integers)
+bool splitArray(const std::string& reply, std::vector<std::string>& elements) {
+    if (reply.empty() || reply[0] != '*') {
+        return false;
+    }
+    size_t crlf = reply.find("\r\n");
+    long n = std::strtol(reply.c_str() + 1, nullptr, 10);
+    size_t pos = crlf + 2;
+    for (long i = 0; i < n && pos < reply.size(); ++i) {
+        size_t end = reply.find("\r\n", pos) + 2;
+        if (reply[pos] == '$') {
+            long len = std::strtol(reply.c_str() + pos + 1, nullptr, 10);
+            if (len >= 0) {
+                end += len + 2;
+            }
+        }
+        elements.emplace_back(reply, pos, end - pos);
+        pos = end;
+    }
+    return true;
+}
+
+} // namespace
+
+struct ShardedServer::Message {
+    bool isReply = false;
+    size_t from = 0;     // shard that owns the client connection
+    uint64_t connId = 0;
+    uint64_t seq = 0;    // reply slot on that connection
+    size_t part = 0;     // piece of a split command
+    int resp = 2;        // the client's protocol, the reply is built in it
+    uint64_t clientId = 0;
+    bool tracking = false; // CLIENT TRACKING without BCAST :- the keys it reads are remembered for it
+    std::vector<std::string> tokens;
+    std::string reply;
+};
+
+struct ShardedServer::PendingReply {
+    uint64_t seq = 0;
+    bool ready = false;
+    std::string data;
+
+    // Filled in while parts are outstanding
+    Merge merge = Merge::NONE;
+    size_t partsLeft = 0;
+    std::vector<std::string> parts;
+    std::vector<std::vector<size_t>> positions; // POSITION: original index of every key of every part
+    size_t total = 0;                           // POSITION: number of keys in the original command
+};
+
+struct ShardedServer::Connection {
+    int fd = -1;
+    uint64_t id = 0;
+    std::string in;
+    std::string out;
+    uint32_t events = EPOLLIN; // epoll interest :- EPOLLOUT while out waits, no EPOLLIN while paused
+    // io_uring: out is swapped into sending while a SEND owns it
+    std::string sending;
+    size_t sendOffset = 0;
+    bool sendBusy = false;
+    bool recvArmed = false;
+    bool closing = false; // session closed, the fd goes once nothing is in flight
+    bool leaving = false; // its next command waits :- handed over once its replies are in
+    ClientSession session;
+    OutputGuard guard;
+    std::chrono::steady_clock::time_point lastActive = std::chrono::steady_clock::now(); // --timeout
+    // Replies in command order; the front ones go out as soon as they are ready
+    std::deque<PendingReply> replies;
+    uint64_t nextSeq = 0;
+
+    // written replies not sent yet
+    size_t pendingOutput() const { return out.size() + (sending.size() - std::min(sendOffset, sending.size())); }
+};
+
+struct ShardedServer::Shard {
+    size_t index = 0;
+    RedisDatabase* db = nullptr; // never destroyed, like the singleton
+    RedisCommandHandler handler;
+    int listenFd = -1;
+    int localFd = -1; // Unix socket listener, shard 0 only
+    int epollFd = -1;
+    int wakeFd = -1; // eventfd, written by other shards after they queue a message
+    std::unique_ptr<IoUring> ring; // --io-backend uring, epoll otherwise
+    std::string dumpFile;
+    uint64_t syscalls = 0;   // since the last report to IoBackend
+    uint64_t operations = 0;
+
+    uint64_t nextConnId = kFirstConnId;
+    std::unordered_map<uint64_t, std::unique_ptr<Connection>> connections;
+
+    std::vector<std::deque<Message*>> backlog; // per destination, used while its ring is full
+    std::vector<bool> pendingWake;             // destinations to signal at the end of this iteration
+    std::vector<uint64_t> leaving;             // connections to hand over (Connection::leaving)
+};
+
+ShardedServer::ShardedServer(const ListenOptions& options, size_t numShards, bool uring)
+    : options(options), numShards(numShards), uring(uring) {
+    for (size_t i = 0; i < numShards; ++i) {
+        auto shard = std::make_unique<Shard>();
+        shard->index = i;
+        shard->db = new RedisDatabase();
+        // a single event loop (--io-backend without --shards) keeps the usual file
+        shard->dumpFile = numShards == 1 ? "dump.my_rdb"
+                                         : "dump.shard" + std::to_string(i) + "-of-" + std::to_string(numShards) + ".my_rdb";
+        shard->backlog.resize(numShards);
+        shard->pendingWake.assign(numShards, false);
+        if (shard->db->load(shard->dumpFile)) {
+            std::cout << "Shard " << i << " loaded from " << shard->dumpFile << std::endl;
+        }
+        shards.push_back(std::move(shard));
+    }
+    for (size_t i = 0; i < numShards * numShards; ++i) {
+        rings.push_back(std::make_unique<SpscRing<Message*>>(kRingCapacity));
+    }
+}
+
+ShardedServer::~ShardedServer() {
+    for (auto& shard : shards) {
+        if (shard->listenFd >= 0) close(shard->listenFd);
+        if (shard->localFd >= 0) close(shard->localFd);
+        if (shard->epollFd >= 0) close(shard->epollFd);
+        if (shard->wakeFd >= 0) close(shard->wakeFd);
+    }
+}
+
+size_t ShardedServer::shardOf(const std::string& key) const {
+    return std::hash<std::string>{}(key) % numShards;
+}
+
+void ShardedServer::run() {
+    for (auto& shard : shards) {
+        if (!listen(*shard)) {
+            return;
+        }
+    }
+    std::cout << "Server is running on port " << options.port << " with " << numShards << " shards ("
+              << IoBackend::getInstance().name() << ")";
+    if (!options.unixSocket.empty()) {
+        std::cout << " and Unix socket " << options.unixSocket;
+    }
+    std::cout << std::endl;
+    std::cout << "Not served by the event loop: REPLICAOF, SLAVEOF, PSYNC, SYNC, REPLCONF (replication)" << std::endl;
+
+    std::vector<std::thread> threads;
+    for (auto& shard : shards) {
+        Shard* s = shard.get();
+        threads.emplace_back([this, s]() { shardLoop(*s); });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+}
+
+// Every shard binds the same port, the kernel spreads new connections over them
+bool ShardedServer::listen(Shard& shard) {
+    // io_uring waits for a blocking socket itself, so only epoll needs O_NONBLOCK
+    shard.listenFd = Listener::tcp(options, true);
+    if (shard.listenFd < 0 || (!uring && !setNonBlocking(shard.listenFd))) {
+        return false;
+    }
+    if (shard.index == 0 && !options.unixSocket.empty()) {
+        shard.localFd = Listener::local(options);
+        if (shard.localFd < 0 || (!uring && !setNonBlocking(shard.localFd))) {
+            return false;
+        }
+    }
+
+    shard.wakeFd = eventfd(0, EFD_NONBLOCK);
+    if (uring) {
+        shard.ring = std::make_unique<IoUring>(kRingEntries);
+        if (shard.wakeFd < 0 || !shard.ring->ok() || !shard.ring->setupBufferRing(0, kRecvBuffers, kRecvBufferSize)) {
+            std::cerr << "Failed to create io_uring event loop." << std::endl;
+            return false;
+        }
+        shard.ring->acceptMultishot(shard.listenFd, (kListenerId << 2) | kOpAccept);
+        shard.ring->pollMultishot(shard.wakeFd, (kWakeId << 2) | kOpWake);
+        if (shard.localFd >= 0) {
+            shard.ring->acceptMultishot(shard.localFd, (kLocalListenerId << 2) | kOpAccept);
+        }
+        return true;
+    }
+
+    shard.epollFd = epoll_create1(0);
+    if (shard.epollFd < 0 || shard.wakeFd < 0) {
+        std::cerr << "Failed to create event loop." << std::endl;
+        return false;
+    }
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.u64 = kListenerId;
+    epoll_ctl(shard.epollFd, EPOLL_CTL_ADD, shard.listenFd, &ev);
+    ev.data.u64 = kWakeId;
+    epoll_ctl(shard.epollFd, EPOLL_CTL_ADD, shard.wakeFd, &ev);
+    if (shard.localFd >= 0) {
+        ev.data.u64 = kLocalListenerId;
+        epoll_ctl(shard.epollFd, EPOLL_CTL_ADD, shard.localFd, &ev);
+    }
+    return true;
+}
+
+void ShardedServer::shardLoop(Shard& shard) {
+    unsigned cores = std::thread::hardware_concurrency();
+    if (cores > 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(shard.index % cores, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+
+    auto lastDump = std::chrono::steady_clock::now();
+    auto lastLimitCheck = lastDump;
+    while (true) {
+        bool backlogged = std::any_of(shard.backlog.begin(), shard.backlog.end(),
+                                      [](const std::deque<Message*>& q) { return !q.empty(); });
+        if (shard.ring) {
+            pollUring(shard, backlogged ? 1 : 100);
+        } else {
+            pollEpoll(shard, backlogged ? 1 : 100);
+        }
+
+        drainInbox(shard);
+        flushBacklog(shard);
+        handOverLeaving(shard);
+        for (size_t to = 0; to < numShards; ++to) {
+            if (shard.pendingWake[to]) {
+                shard.pendingWake[to] = false;
+                uint64_t one = 1;
+                ssize_t ignored = write(shards[to]->wakeFd, &one, sizeof(one));
+                (void)ignored;
+                ++shard.syscalls;
+            }
+        }
+        IoBackend::getInstance().count(shard.syscalls, shard.operations);
+        shard.syscalls = shard.operations = 0;
+
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastLimitCheck >= std::chrono::seconds(1)) {
+            lastLimitCheck = now;
+            checkClients(shard);
+        }
+        if (now - lastDump >= std::chrono::seconds(kDumpIntervalSeconds)) {
+            lastDump = now;
+            if (!shard.db->dump(shard.dumpFile)) {
+                std::cerr << "Failed to dump shard " << shard.index << " to " << shard.dumpFile << std::endl;
+            }
+        }
+    }
+}
+
+// One epoll_wait, then a system call per accept, recv and send
+void ShardedServer::pollEpoll(Shard& shard, int timeoutMs) {
+    epoll_event events[256];
+    int n = epoll_wait(shard.epollFd, events, 256, timeoutMs);
+    ++shard.syscalls;
+    for (int i = 0; i < n; ++i) {
+        uint64_t tag = events[i].data.u64;
+        if (tag == kListenerId || tag == kLocalListenerId) {
+            accept(shard, tag == kListenerId ? shard.listenFd : shard.localFd);
+            continue;
+        }
+        if (tag == kWakeId) {
+            uint64_t count;
+            while (read(shard.wakeFd, &count, sizeof(count)) > 0) {
+                ++shard.syscalls;
+            }
+            ++shard.syscalls;
+            continue; // the inbox is drained by the caller anyway
+        }
+        auto it = shard.connections.find(tag);
+        if (it == shard.connections.end()) {
+            continue;
+        }
+        Connection& conn = *it->second;
+        bool alive = true;
+        if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+            alive = readConnection(shard, conn);
+        }
+        if (alive && (events[i].events & EPOLLOUT)) {
+            alive = flush(shard, conn);
+            if (alive && !conn.in.empty() && conn.pendingOutput() < OutputLimits::kPauseBytes) {
+                alive = runCommands(shard, conn); // paused until now
+            }
+        }
+        if (!alive) {
+            closeConnection(shard, tag);
+        }
+    }
+}
+
+// One io_uring_enter() submits every send queued since the last one and waits;
+// multishot accept and recv stay armed and keep completing without resubmission
+void ShardedServer::pollUring(Shard& shard, int timeoutMs) {
+    IoUring& ring = *shard.ring;
+    uint64_t entered = ring.syscalls();
+    ring.submitAndWait(1, timeoutMs);
+    IoUring::Completion c;
+    while (ring.pop(c)) {
+        uint64_t tag = c.data >> 2;
+        uint64_t op = c.data & 3;
+        if (op == kOpAccept) {
+            if (c.res >= 0) {
+                addConnection(shard, c.res);
+            }
+            if (!c.more()) {
+                ring.acceptMultishot(tag == kListenerId ? shard.listenFd : shard.localFd, c.data);
+            }
+            continue;
+        }
+        if (tag == kCancelId) {
+            continue; // the recv it cancelled completes on its own
+        }
+        if (op == kOpWake) {
+            uint64_t count;
+            while (read(shard.wakeFd, &count, sizeof(count)) > 0) {
+                ++shard.syscalls;
+            }
+            ++shard.syscalls;
+            if (!c.more()) {
+                ring.pollMultishot(shard.wakeFd, c.data);
+            }
+            continue;
+        }
+
+        auto it = shard.connections.find(tag);
+        if (it == shard.connections.end()) {
+            if (c.bufferId() >= 0) {
+                ring.recycle(c.bufferId());
+            }
+            continue;
+        }
+        Connection& conn = *it->second;
+        if (op == kOpRecv) {
+            if (c.bufferId() >= 0) {
+                if (c.res > 0 && !conn.closing) {
+                    conn.in.append(ring.buffer(c.bufferId()), c.res);
+                }
+                ring.recycle(c.bufferId());
+            }
+            bool alive = !conn.closing && (c.res > 0 || c.res == -ENOBUFS || // out of buffers: rearm below
+                                           (conn.leaving && c.res == -ECANCELED));
+            if (c.res > 0) {
+                ++shard.operations;
+                alive = alive && runCommands(shard, conn);
+            }
+            if (!c.more()) {
+                conn.recvArmed = alive && !conn.leaving && ring.recvMultishot(conn.fd, 0, (conn.id << 2) | kOpRecv);
+                alive = alive && (conn.recvArmed || conn.leaving);
+            }
+            if (!alive) {
+                closeConnection(shard, conn.id);
+            }
+        } else {
+            conn.sendBusy = false;
+            bool alive = !conn.closing && c.res > 0;
+            if (alive) {
+                ++shard.operations;
+                conn.sendOffset += c.res;
+                alive = flush(shard, conn); // the rest of a short send, or what queued up meanwhile
+                if (alive && !conn.in.empty() && conn.pendingOutput() < OutputLimits::kPauseBytes) {
+                    alive = runCommands(shard, conn); // paused until now
+                }
+            }
+            if (!alive) {
+                closeConnection(shard, conn.id);
+            }
+        }
+        if (conn.closing && !conn.recvArmed && !conn.sendBusy) {
+            close(conn.fd);
+            shard.connections.erase(it);
+        }
+    }
+    shard.syscalls += ring.syscalls() - entered;
+}
+
+void ShardedServer::accept(Shard& shard, int listenFd) {
+    while (true) {
+        int fd = ::accept(listenFd, nullptr, nullptr);
+        ++shard.syscalls;
+        if (fd < 0) {
+            return; // EAGAIN: no more pending connections
+        }
+        addConnection(shard, fd);
+    }
+}
+
+void ShardedServer::addConnection(Shard& shard, int fd) {
+    uint64_t clientId = ++nextClientId;
+    std::shared_ptr<ClientInfo> info = ClientRegistry::getInstance().admit(clientId, fd);
+    if (!info) {
+        ClientRegistry::reject(fd); // maxclients
+        return;
+    }
+    Listener::configure(fd, options);
+    auto conn = std::make_unique<Connection>();
+    conn->fd = fd;
+    conn->id = shard.nextConnId++;
+    conn->session.id = clientId;
+    conn->session.socket = fd;
+    conn->session.info = std::move(info);
+    if (shard.ring) {
+        conn->recvArmed = shard.ring->recvMultishot(fd, 0, (conn->id << 2) | kOpRecv);
+        if (!conn->recvArmed) {
+            ClientRegistry::getInstance().remove(clientId);
+            close(fd);
+            return;
+        }
+    } else {
+        setNonBlocking(fd);
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.u64 = conn->id;
+        epoll_ctl(shard.epollFd, EPOLL_CTL_ADD, fd, &ev);
+        ++shard.syscalls;
+    }
+    shard.connections[conn->id] = std::move(conn);
+}
+
+// Read what is there, run every complete command, false once the connection is done
+bool ShardedServer::readConnection(Shard& shard, Connection& conn) {
+    char buffer[16384];
+    while (true) {
+        ssize_t bytes = recv(conn.fd, buffer, sizeof(buffer), 0);
+        ++shard.syscalls;
+        if (bytes > 0) {
+            conn.in.append(buffer, bytes);
+            ++shard.operations;
+            continue;
+        }
+        if (bytes == 0) {
+            return false;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        }
+        return false;
+    }
+    return runCommands(shard, conn);
+}
+
+// Run every complete command in the input buffer and flush the replies. Pauses
+// while kPauseBytes of output wait, until a flush here or on EPOLLOUT took them.
+bool ShardedServer::runCommands(Shard& shard, Connection& conn) {
+    if (conn.leaving) {
+        return true; // what's left is for the thread taking it over
+    }
+    std::vector<std::string> tokens;
+    conn.lastActive = std::chrono::steady_clock::now();
+    bool paused = true;
+    while (paused) {
+        size_t pos = 0;
+        paused = false;
+        while (pos < conn.in.size() && !conn.leaving) {
+            if (conn.pendingOutput() >= OutputLimits::kPauseBytes) {
+                paused = true;
+                break;
+            }
+            size_t used = RedisCommandHandler::extractCommand(conn.in, pos, tokens);
+            if (used == 0) {
+                break;
+            }
+            if (used == std::string::npos) {
+                conn.out += "-ERR Protocol error\r\n";
+                flush(shard, conn);
+                return false;
+            }
+            if (!tokens.empty() && !conn.session.inMulti && takesOver(tokens)) {
+                leave(shard, conn); // runs there, after the replies in front of it
+                break;
+            }
+            pos += used;
+            if (!tokens.empty()) {
+                dispatch(shard, conn, tokens);
+            }
+            if (conn.session.subscriber && !conn.leaving) {
+                leave(shard, conn); // RESP3 tracking gave it an output queue, which writes to the socket itself
+            }
+        }
+        conn.in.erase(0, pos);
+        if (conn.session.info) {
+            conn.session.info->queryBuffer = conn.in.size();
+            conn.session.info->lastActive = steadyMs(); // forwarded commands don't touch it
+        }
+        if (!flush(shard, conn)) {
+            return false;
+        }
+        paused = paused && conn.pendingOutput() < OutputLimits::kPauseBytes;
+    }
+    return true;
+}
+
+// Move ready replies to the output buffer and write as much as the socket takes;
+// false on an error or when the rest breaks the output buffer limits
+bool ShardedServer::flush(Shard& shard, Connection& conn) {
+    while (!conn.replies.empty() && conn.replies.front().ready) {
+        conn.out += conn.replies.front().data;
+        conn.replies.pop_front();
+    }
+    if (conn.guard.exceeded(ClientClass::NORMAL, conn.pendingOutput())) {
+        return false;
+    }
+    if (shard.ring) {
+        if (conn.session.info) {
+            conn.session.info->outputBuffer = conn.pendingOutput(); // a SEND in flight counts until it completes
+        }
+        // one SEND in flight per connection; its buffer must stay put until it completes.
+        // A leaving connection's output goes to the thread taking it over.
+        if (conn.sendBusy || conn.closing || conn.leaving) {
+            return true;
+        }
+        if (conn.sendOffset >= conn.sending.size()) {
+            if (conn.out.empty()) {
+                return true;
+            }
+            conn.sending.clear();
+            conn.sending.swap(conn.out);
+            conn.sendOffset = 0;
+        }
+        conn.sendBusy = shard.ring->send(conn.fd, conn.sending.data() + conn.sendOffset,
+                                         conn.sending.size() - conn.sendOffset, (conn.id << 2) | kOpSend);
+        return conn.sendBusy;
+    }
+    size_t sent = 0;
+    while (sent < conn.out.size()) {
+        ssize_t n = ::send(conn.fd, conn.out.data() + sent, conn.out.size() - sent, MSG_NOSIGNAL);
+        ++shard.syscalls;
+        if (n > 0) {
+            ++shard.operations;
+            sent += n;
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        return false;
+    }
+    conn.out.erase(0, sent);
+    if (conn.session.info) {
+        conn.session.info->outputBuffer = conn.out.size();
+    }
+
+    // stop reading a client that doesn't take its replies, TCP then holds it back
+    uint32_t events = (conn.out.size() < OutputLimits::kPauseBytes ? EPOLLIN : 0) | (conn.out.empty() ? 0 : EPOLLOUT);
+    if (events != conn.events) {
+        conn.events = events;
+        epoll_event ev{};
+        ev.events = events;
+        ev.data.u64 = conn.id;
+        epoll_ctl(shard.epollFd, EPOLL_CTL_MOD, conn.fd, &ev);
+        ++shard.syscalls;
+    }
+    return true;
+}
+
+// A client that reads nothing gets no events :- its soft limit is timed here.
+// Also closes connections that sent nothing for --timeout seconds.
+void ShardedServer::checkClients(Shard& shard) {
+    int timeout = ClientRegistry::getInstance().idleTimeout();
+    auto now = std::chrono::steady_clock::now();
+    std::vector<uint64_t> over;
+    for (auto& entry : shard.connections) {
+        Connection& conn = *entry.second;
+        if (conn.closing) {
+            continue;
+        }
+        bool waiting = conn.pendingOutput() > 0 || !conn.replies.empty();
+        if (conn.pendingOutput() > 0 && conn.guard.exceeded(ClientClass::NORMAL, conn.pendingOutput())) {
+            over.push_back(entry.first);
+        } else if (timeout > 0 && !waiting && now - conn.lastActive >= std::chrono::seconds(timeout)) {
+            ClientRegistry::getInstance().countIdleClosed();
+            over.push_back(entry.first);
+        }
+    }
+    for (uint64_t connId : over) {
+        closeConnection(shard, connId);
+    }
+}
+
+void ShardedServer::closeConnection(Shard& shard, uint64_t connId) {
+    auto it = shard.connections.find(connId);
+    if (it == shard.connections.end()) {
+        return;
+    }
+    Connection& conn = *it->second;
+    if (conn.closing) {
+        return;
+    }
+    shard.handler.closeSession(conn.session, *shard.db);
+    if (shard.ring) {
+        // ends the armed recv, a send in flight still delivers (a protocol error);
+        // pollUring() closes the fd once both have completed
+        conn.closing = true;
+        shutdown(conn.fd, SHUT_RD);
+        return;
+    }
+    epoll_ctl(shard.epollFd, EPOLL_CTL_DEL, conn.fd, nullptr);
+    close(conn.fd);
+    shard.connections.erase(it); // replies still on their way are dropped in onReply
+}
+
+// Its next command waits or it got an output queue :- stop running its commands;
+// io_uring also cancels its recv, the socket must be left to the new thread
+void ShardedServer::leave(Shard& shard, Connection& conn) {
+    conn.leaving = true;
+    shard.leaving.push_back(conn.id);
+    if (shard.ring && conn.recvArmed) {
+        shard.ring->cancel((conn.id << 2) | kOpRecv, (kCancelId << 2) | kOpRecv);
+    }
+}
+
+// Hand over the connections whose next command waits once every reply in
+// front of it is ready and (io_uring) no recv or send is in flight; the
+// thread taking one over sends the replies first
+void ShardedServer::handOverLeaving(Shard& shard) {
+    std::vector<uint64_t> waiting;
+    for (uint64_t connId : shard.leaving) {
+        auto it = shard.connections.find(connId);
+        if (it == shard.connections.end() || it->second->closing) {
+            continue;
+        }
+        Connection& conn = *it->second;
+        if (!flush(shard, conn)) {
+            closeConnection(shard, connId);
+        } else if (!conn.replies.empty() || conn.recvArmed || conn.sendBusy) {
+            waiting.push_back(connId); // parts still out on other shards, or io_uring operations
+        } else {
+            handOver(shard, conn);
+        }
+    }
+    shard.leaving.swap(waiting);
+}
+
+// From now on the connection has a thread of its own, blocking again, like the
+// default server's. Its commands run there against the owning shard's database.
+void ShardedServer::handOver(Shard& shard, Connection& conn) {
+    if (!shard.ring) {
+        epoll_ctl(shard.epollFd, EPOLL_CTL_DEL, conn.fd, nullptr);
+        int flags = fcntl(conn.fd, F_GETFL, 0);
+        fcntl(conn.fd, F_SETFL, flags & ~O_NONBLOCK);
+        shard.syscalls += 3;
+    }
+    // io_uring sockets are blocking already; a short send left the rest in sending
+    std::string out = conn.sending.substr(std::min(conn.sendOffset, conn.sending.size())) + conn.out;
+    Shard* home = &shard;
+    std::thread([this, home, session = std::move(conn.session), in = std::move(conn.in), out = std::move(out)]() mutable {
+        RedisServer::serveConnection(session, std::move(in), std::move(out),
+            [this, home](const std::vector<std::string>& tokens, ClientSession& s) { return runAlone(*home, s, tokens); });
+        home->handler.closeSession(session, *home->db);
+        close(session.socket);
+    }).detach();
+    shard.connections.erase(conn.id);
+}
+
+// Replication would need one stream of every shard's writes. A transaction runs
+// on the connection's shard, where its WATCH versions are kept, so a command in
+// it (or a WATCH) with a key on another shard fails and makes EXEC abort.
+std::string ShardedServer::refusal(size_t home, ClientSession& session, const std::string& cmd,
+                                   const std::vector<std::string>& tokens) const {
+    if (cmd == "REPLICAOF" || cmd == "SLAVEOF" || cmd == "PSYNC" || cmd == "SYNC" || cmd == "REPLCONF") {
+        return "-ERR " + cmd + " is not supported in sharded mode\r\n";
+    }
+    if (cmd != "WATCH" && (!session.inMulti || cmd == "MULTI" || cmd == "EXEC" || cmd == "DISCARD")) {
+        return "";
+    }
+    bool here;
+    if (cmd == "KEYS" || cmd == "FLUSHALL") {
+        here = numShards == 1;
+    } else {
+        std::vector<size_t> keyIndexes;
+        if (cmd == "WATCH") {
+            for (size_t i = 1; i < tokens.size(); ++i) {
+                keyIndexes.push_back(i);
+            }
+        } else {
+            RedisCommandHandler::commandKeys(tokens, keyIndexes);
+        }
+        here = std::all_of(keyIndexes.begin(), keyIndexes.end(),
+                           [&](size_t i) { return shardOf(tokens[i]) == home; });
+    }
+    if (here) {
+        return "";
+    }
+    if (session.inMulti) {
+        session.multiError = true;
+    }
+    return "-CROSSSLOT Keys in request don't hash to this connection's shard\r\n";
+}
+
+void ShardedServer::dispatch(Shard& shard, Connection& conn, const std::vector<std::string>& tokens) {
+    std::string cmd = tokens[0];
+    std::transform(cmd.begin(), cmd.end(), cmd.begin(), ::toupper);
+
+    std::string error = refusal(shard.index, conn.session, cmd, tokens);
+    std::vector<std::pair<size_t, std::vector<std::string>>> parts;
+    PendingReply pending;
+    if (error.empty() && !route(shard.index, cmd, tokens, parts, pending)) {
+        error = kCrossSlot;
+    }
+    if (!error.empty()) {
+        PendingReply done;
+        done.seq = conn.nextSeq++;
+        done.ready = true;
+        done.data = std::move(error);
+        conn.replies.push_back(std::move(done));
+        return;
+    }
+    if (parts.size() > 1 || parts[0].first != shard.index) {
+        if (conn.session.info) {
+            std::lock_guard<std::mutex> lock(conn.session.info->mutex);
+            conn.session.info->lastCommand = cmd; // CLIENT LIST cmd, processCommand() records the local ones
+        }
+        scatter(shard, conn, parts, pending);
+        return;
+    }
+    std::string reply = shard.handler.processCommand(tokens, conn.session, *shard.db);
+    if (conn.replies.empty()) {
+        conn.out += reply; // nothing pending in front of it
+    } else {
+        PendingReply done;
+        done.seq = conn.nextSeq++;
+        done.ready = true;
+        done.data = std::move(reply);
+        conn.replies.push_back(std::move(done));
+    }
+}
+
+// Which shards run a command and how their replies are merged; false when its
+// keys span shards and it can't be split. Keyless commands run on home.
+bool ShardedServer::route(size_t home, const std::string& cmd, const std::vector<std::string>& tokens,
+                          std::vector<std::pair<size_t, std::vector<std::string>>>& parts, PendingReply& pending) const {
+    if (cmd == "KEYS" || cmd == "FLUSHALL") {
+        for (size_t s = 0; s < numShards; ++s) {
+            parts.emplace_back(s, tokens);
+        }
+        pending.merge = (cmd == "KEYS") ? Merge::CONCAT : Merge::OK;
+        return true;
+    }
+
+    std::vector<size_t> keyIndexes;
+    if (!RedisCommandHandler::commandKeys(tokens, keyIndexes) || keyIndexes.empty()) {
+        parts.emplace_back(home, tokens); // keyless, or unknown (the handler reports it)
+        return true;
+    }
+    size_t owner = shardOf(tokens[keyIndexes[0]]);
+    bool single = std::all_of(keyIndexes.begin(), keyIndexes.end(),
+                              [&](size_t i) { return shardOf(tokens[i]) == owner; });
+    if (single) {
+        parts.emplace_back(owner, tokens);
+        return true;
+    }
+
+    // Keys on several shards :- only commands that are a set of independent
+    // per-key operations can be split (MSET is therefore not atomic across shards)
+    bool pairs = (cmd == "MSET");
+    if (cmd == "MGET") {
+        pending.merge = Merge::POSITION;
+    } else if (cmd == "DEL" || cmd == "UNLINK" || cmd == "EXISTS") {
+        pending.merge = Merge::SUM;
+    } else if (pairs) {
+        pending.merge = Merge::OK;
+    } else {
+        return false;
+    }
+    std::vector<long> partOf(numShards, -1);
+    for (size_t n = 0; n < keyIndexes.size(); ++n) {
+        size_t i = keyIndexes[n];
+        size_t s = shardOf(tokens[i]);
+        if (partOf[s] < 0) {
+            partOf[s] = static_cast<long>(parts.size());
+            parts.emplace_back(s, std::vector<std::string>{tokens[0]});
+            pending.positions.emplace_back();
+        }
+        auto& partTokens = parts[partOf[s]].second;
+        partTokens.push_back(tokens[i]);
+        if (pairs && i + 1 < tokens.size()) {
+            partTokens.push_back(tokens[i + 1]);
+        }
+        pending.positions[partOf[s]].push_back(n);
+    }
+    pending.total = keyIndexes.size();
+    return true;
+}
+
+// All parts are in :- build the client's reply from them
+static void mergeParts(ShardedServer::PendingReply& pending) {
+    auto firstError = std::find_if(pending.parts.begin(), pending.parts.end(),
+                                   [](const std::string& r) { return !r.empty() && r[0] == '-'; });
+    if (pending.merge == Merge::NONE) {
+        pending.data = std::move(pending.parts[0]);
+    } else if (firstError != pending.parts.end()) {
+        pending.data = *firstError;
+    } else if (pending.merge == Merge::SUM) {
+        long long sum = 0;
+        for (const auto& r : pending.parts) {
+            sum += std::strtoll(r.c_str() + 1, nullptr, 10);
+        }
+        pending.data = ":" + std::to_string(sum) + "\r\n";
+    } else if (pending.merge == Merge::OK) {
+        pending.data = "+OK\r\n";
+    } else {
+        std::vector<std::string> elements(pending.merge == Merge::POSITION ? pending.total : 0);
+        for (size_t p = 0; p < pending.parts.size(); ++p) {
+            std::vector<std::string> partElements;
+            splitArray(pending.parts[p], partElements);
+            if (pending.merge == Merge::CONCAT) {
+                elements.insert(elements.end(), partElements.begin(), partElements.end());
+                continue;
+            }
+            for (size_t e = 0; e < partElements.size() && e < pending.positions[p].size(); ++e) {
+                elements[pending.positions[p][e]] = std::move(partElements[e]);
+            }
+        }
+        pending.data = "*" + std::to_string(elements.size()) + "\r\n";
+        for (const auto& e : elements) {
+            pending.data += e;
+        }
+    }
+    pending.parts.clear();
+    pending.ready = true;
+}
+
+// A handed-over connection's command :- every part runs right here, under the
+// owning shard's database lock, and the parts are merged as usual
+std::string ShardedServer::runAlone(Shard& home, ClientSession& session, const std::vector<std::string>& tokens) {
+    std::string cmd = tokens[0];
+    std::transform(cmd.begin(), cmd.end(), cmd.begin(), ::toupper);
+    std::string error = refusal(home.index, session, cmd, tokens);
+    if (!error.empty()) {
+        return error;
+    }
+    std::vector<std::pair<size_t, std::vector<std::string>>> parts;
+    PendingReply pending;
+    if (!route(home.index, cmd, tokens, parts, pending)) {
+        return kCrossSlot;
+    }
+    pending.parts.resize(parts.size());
+    for (size_t p = 0; p < parts.size(); ++p) {
+        Shard& owner = *shards[parts[p].first];
+        pending.parts[p] = owner.handler.processCommand(parts[p].second, session, *owner.db);
+    }
+    mergeParts(pending);
+    return pending.data;
+}
+
+// Queue the reply slot, run the local part here and send the others away
+void ShardedServer::scatter(Shard& shard, Connection& conn, std::vector<std::pair<size_t, std::vector<std::string>>>& parts,
+                            PendingReply& pending) {
+    pending.seq = conn.nextSeq++;
+    pending.partsLeft = parts.size();
+    pending.parts.resize(parts.size());
+    conn.replies.push_back(std::move(pending));
+    PendingReply& slot = conn.replies.back();
+
+    for (size_t p = 0; p < parts.size(); ++p) {
+        if (parts[p].first == shard.index) {
+            slot.parts[p] = shard.handler.processCommand(parts[p].second, conn.session, *shard.db);
+            --slot.partsLeft;
+            continue;
+        }
+        Message* msg = new Message();
+        msg->from = shard.index;
+        msg->connId = conn.id;
+        msg->seq = slot.seq;
+        msg->part = p;
+        msg->resp = conn.session.resp;
+        msg->clientId = conn.session.id;
+        msg->tracking = conn.session.tracking && !conn.session.trackingBcast;
+        msg->tokens = std::move(parts[p].second);
+        send(shard, parts[p].first, msg);
+    }
+    if (slot.partsLeft == 0) {
+        mergeParts(slot); // every part was local, runCommands() flushes it
+    }
+}
+
+// A part came back :- once all are in, merge them into the reply
+void ShardedServer::onReply(Shard& shard, Message* msg) {
+    auto it = shard.connections.find(msg->connId);
+    if (it == shard.connections.end() || it->second->closing) {
+        return; // client went away meanwhile
+    }
+    Connection& conn = *it->second;
+    PendingReply& slot = conn.replies[msg->seq - conn.replies.front().seq];
+    if (msg->part < slot.parts.size()) {
+        slot.parts[msg->part] = std::move(msg->reply);
+        --slot.partsLeft;
+    }
+    if (slot.partsLeft > 0) {
+        return;
+    }
+
+    mergeParts(slot);
+    if (&slot == &conn.replies.front() && !flush(shard, conn)) {
+        closeConnection(shard, conn.id);
+    }
+}
+
+void ShardedServer::send(Shard& from, size_t to, Message* msg) {
+    auto& backlog = from.backlog[to];
+    if (!backlog.empty() || !rings[from.index * numShards + to]->push(msg)) {
+        backlog.push_back(msg); // keep per-destination order, retried every loop iteration
+    }
+    from.pendingWake[to] = true;
+}
+
+void ShardedServer::flushBacklog(Shard& shard) {
+    for (size_t to = 0; to < numShards; ++to) {
+        auto& backlog = shard.backlog[to];
+        while (!backlog.empty() && rings[shard.index * numShards + to]->push(backlog.front())) {
+            backlog.pop_front();
+            shard.pendingWake[to] = true;
+        }
+    }
+}
+
+// Requests are executed against this shard's database and the message goes
+// back as the reply; replies complete a slot on one of our connections
+void ShardedServer::drainInbox(Shard& shard) {
+    for (size_t from = 0; from < numShards; ++from) {
+        if (from == shard.index) {
+            continue;
+        }
+        SpscRing<Message*>& ring = *rings[from * numShards + shard.index];
+        Message* msg;
+        while (ring.pop(msg)) {
+            if (msg->isReply) {
+                onReply(shard, msg);
+                delete msg;
+                continue;
+            }
+            ClientSession scratch; // forwarded commands carry no transaction state
+            scratch.resp = msg->resp;
+            scratch.id = msg->clientId;
+            scratch.tracking = msg->tracking;
+            msg->reply = shard.handler.processCommand(msg->tokens, scratch, *shard.db);
+            msg->tokens.clear();
+            msg->isReply = true;
+            send(shard, msg->from, msg);
+        }
+    }
+}
@@ -0,0 +1,115 @@
+#include "../include/SlabAllocator.h"
+#include <new>
+
+namespace {
+
+// Spacing grows with size so rounding never wastes more than ~25%
+const size_t kClassSizes[] = {8, 16, 24, 32, 48, 64, 80, 96, 128, 160, 192, 256, 320, 384, 448, 512};
+const size_t kNumClasses = sizeof(kClassSizes) / sizeof(kClassSizes[0]);
+
+// (size + 7) / 8 -> class index, filled once
+struct ClassLookup {
+    uint8_t index[SlabAllocator::kMaxSmall / 8 + 1];
+    ClassLookup() {
+        size_t c = 0;
+        for (size_t words = 0; words <= SlabAllocator::kMaxSmall / 8; ++words) {
+            while (kClassSizes[c] < words * 8) {
+                ++c;
+            }
+            index[words] = static_cast<uint8_t>(c);
+        }
+    }
+};
+
+const ClassLookup& lookup() {
+    static const ClassLookup table;
+    return table;
+}
+
+} // namespace
+
+SlabAllocator& SlabAllocator::getInstance() {
+    // Never destroyed: containers freed during static destruction (or by the
+    // LazyFree thread at exit) may still hand blocks back
+    static SlabAllocator* instance = new SlabAllocator();
+    return *instance;
+}
+
+SlabAllocator::SlabAllocator() : classes(kNumClasses) {
+    for (size_t i = 0; i < kNumClasses; ++i) {
+        classes[i].blockSize = kClassSizes[i];
+    }
+}
+
+size_t SlabAllocator::classIndex(size_t size) {
+    return lookup().index[(size + 7) / 8];
+}
+
+size_t SlabAllocator::usableSize(size_t size) {
+    if (size == 0 || size > kMaxSmall) {
+        return size;
+    }
+    return kClassSizes[classIndex(size)];
+}
+
+void* SlabAllocator::allocate(size_t size) {
+    if (size == 0) {
+        size = 1;
+    }
+    if (size > kMaxSmall) {
+        largeBytes += size;
+        ++largeCount;
+        return ::operator new(size);
+    }
+    SizeClass& sc = classes[classIndex(size)];
+    std::lock_guard<std::mutex> lock(sc.lock);
+    void* block;
+    if (sc.freeList) {
+        block = sc.freeList;
+        sc.freeList = *static_cast<void**>(block);
+    } else {
+        if (sc.bump + sc.blockSize > sc.bumpEnd) {
+            sc.bump = static_cast<char*>(::operator new(kSlabSize));
+            sc.bumpEnd = sc.bump + (kSlabSize / sc.blockSize) * sc.blockSize;
+            ++sc.slabs;
+        }
+        block = sc.bump;
+        sc.bump += sc.blockSize;
+    }
+    ++sc.inUse;
+    return block;
+}
+
+void SlabAllocator::deallocate(void* p, size_t size) {
+    if (!p) {
+        return;
+    }
+    if (size == 0) {
+        size = 1;
+    }
+    if (size > kMaxSmall) {
+        largeBytes -= size;
+        --largeCount;
+        ::operator delete(p);
+        return;
+    }
+    SizeClass& sc = classes[classIndex(size)];
+    std::lock_guard<std::mutex> lock(sc.lock);
+    *static_cast<void**>(p) = sc.freeList;
+    sc.freeList = p;
+    --sc.inUse;
+}
+
+SlabAllocator::Stats SlabAllocator::stats() {
+    Stats out;
+    for (auto& sc : classes) {
+        std::lock_guard<std::mutex> lock(sc.lock);
+        out.smallInUse += sc.inUse * sc.blockSize;
+        out.smallReserved += sc.slabs * kSlabSize;
+        out.allocations += sc.inUse;
+        out.classes.push_back({sc.blockSize, sc.inUse, sc.slabs});
+    }
+    out.largeInUse = largeBytes.load();
+    out.allocations += largeCount.load();
+    return out;
+}
@@ -0,0 +1,405 @@
+#include "../include/SortedSet.h"
+#include <algorithm>
+#include <random>
+
+/* Skiplist with spans :- every forward link records how many level-0 nodes it
+ * jumps over, so the rank of a node is the sum of the spans walked to reach it
+ * (same scheme as Redis' zskiplist). */
+
+namespace {
+
+const int kMaxLevel = 32;
+
+bool lessThan(double s1, const std::string& m1, double s2, const std::string& m2) {
+    return s1 < s2 || (s1 == s2 && m1 < m2);
+}
+
+int randomLevel() {
+    thread_local std::mt19937 rng(std::random_device{}());
+    int level = 1;
+    while (level < kMaxLevel && (rng() & 0xFFFF) < (0xFFFF / 4)) { // p = 1/4
+        ++level;
+    }
+    return level;
+}
+
+bool aboveMin(double score, const ScoreRange& r) {
+    return r.minExclusive ? score > r.min : score >= r.min;
+}
+
+bool belowMax(double score, const ScoreRange& r) {
+    return r.maxExclusive ? score < r.max : score <= r.max;
+}
+
+} // namespace
+
+struct SortedSet::SkipList {
+    struct Node {
+        struct Level {
+            Node* forward = nullptr;
+            size_t span = 0;
+        };
+        std::string member;
+        double score;
+        Node* backward = nullptr;
+        std::vector<Level> levels;
+
+        Node(int level, double score, std::string member)
+            : member(std::move(member)), score(score), levels(level) {}
+    };
+
+    Node* header;
+    Node* tail = nullptr;
+    size_t length = 0;
+    int level = 1;
+    std::unordered_map<std::string, double> dict; // member -> score, O(1) ZSCORE
+
+    SkipList() : header(new Node(kMaxLevel, 0, "")) {}
+
+    ~SkipList() {
+        Node* x = header;
+        while (x) {
+            Node* next = x->levels[0].forward;
+            delete x;
+            x = next;
+        }
+    }
+
+    void insert(double score, const std::string& member) {
+        Node* update[kMaxLevel];
+        size_t rank[kMaxLevel];
+        Node* x = header;
+        for (int i = level - 1; i >= 0; --i) {
+            rank[i] = (i == level - 1) ? 0 : rank[i + 1];
+            while (x->levels[i].forward && lessThan(x->levels[i].forward->score, x->levels[i].forward->member, score, member)) {
+                rank[i] += x->levels[i].span;
+                x = x->levels[i].forward;
+            }
+            update[i] = x;
+        }
+        int newLevel = randomLevel();
+        if (newLevel > level) {
+            for (int i = level; i < newLevel; ++i) {
+                rank[i] = 0;
+                update[i] = header;
+                update[i]->levels[i].span = length;
+            }
+            level = newLevel;
+        }
+        x = new Node(newLevel, score, member);
+        for (int i = 0; i < newLevel; ++i) {
+            x->levels[i].forward = update[i]->levels[i].forward;
+            update[i]->levels[i].forward = x;
+            x->levels[i].span = update[i]->levels[i].span - (rank[0] - rank[i]);
+            update[i]->levels[i].span = (rank[0] - rank[i]) + 1;
+        }
+        for (int i = newLevel; i < level; ++i) {
+            update[i]->levels[i].span++;
+        }
+        x->backward = (update[0] == header) ? nullptr : update[0];
+        if (x->levels[0].forward) {
+            x->levels[0].forward->backward = x;
+        } else {
+            tail = x;
+        }
+        ++length;
+    }
+
+    bool erase(double score, const std::string& member) {
+        Node* update[kMaxLevel];
+        Node* x = header;
+        for (int i = level - 1; i >= 0; --i) {
+            while (x->levels[i].forward && lessThan(x->levels[i].forward->score, x->levels[i].forward->member, score, member)) {
+                x = x->levels[i].forward;
+            }
+            update[i] = x;
+        }
+        x = x->levels[0].forward;
+        if (!x || x->score != score || x->member != member) {
+            return false;
+        }
+        for (int i = 0; i < level; ++i) {
+            if (update[i]->levels[i].forward == x) {
+                update[i]->levels[i].span += x->levels[i].span - 1;
+                update[i]->levels[i].forward = x->levels[i].forward;
+            } else {
+                update[i]->levels[i].span -= 1;
+            }
+        }
+        if (x->levels[0].forward) {
+            x->levels[0].forward->backward = x->backward;
+        } else {
+            tail = x->backward;
+        }
+        while (level > 1 && header->levels[level - 1].forward == nullptr) {
+            --level;
+        }
+        --length;
+        delete x;
+        return true;
+    }
+
+    // 1-based rank, 0 if not found
+    size_t rankOf(double score, const std::string& member) const {
+        size_t rank = 0;
+        Node* x = header;
+        for (int i = level - 1; i >= 0; --i) {
+            while (x->levels[i].forward &&
+                   (x->levels[i].forward->score < score ||
+                    (x->levels[i].forward->score == score && x->levels[i].forward->member <= member))) {
+                rank += x->levels[i].span;
+                x = x->levels[i].forward;
+            }
+            if (x != header && x->member == member) {
+                return rank;
+            }
+        }
+        return 0;
+    }
+
+    // Node at 1-based rank
+    Node* byRank(size_t rank) const {
+        size_t traversed = 0;
+        Node* x = header;
+        for (int i = level - 1; i >= 0; --i) {
+            while (x->levels[i].forward && traversed + x->levels[i].span <= rank) {
+                traversed += x->levels[i].span;
+                x = x->levels[i].forward;
+            }
+            if (traversed == rank) {
+                return x;
+            }
+        }
+        return nullptr;
+    }
+
+    Node* firstInRange(const ScoreRange& range) const {
+        Node* x = header;
+        for (int i = level - 1; i >= 0; --i) {
+            while (x->levels[i].forward && !aboveMin(x->levels[i].forward->score, range)) {
+                x = x->levels[i].forward;
+            }
+        }
+        x = x->levels[0].forward;
+        return (x && belowMax(x->score, range)) ? x : nullptr;
+    }
+};
+
+SortedSet::SortedSet() : skiplist(nullptr) {}
+
+SortedSet::~SortedSet() {
+    delete skiplist;
+}
+
+SortedSet::SortedSet(const SortedSet& other) : compact(other.compact), skiplist(nullptr) {
+    if (other.skiplist) {
+        skiplist = new SkipList();
+        other.forEach([this](const std::string& member, double score) {
+            skiplist->insert(score, member);
+            skiplist->dict[member] = score;
+        });
+    }
+}
+
+SortedSet& SortedSet::operator=(const SortedSet& other) {
+    if (this != &other) {
+        SortedSet copy(other);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+SortedSet::SortedSet(SortedSet&& other) noexcept : compact(std::move(other.compact)), skiplist(other.skiplist) {
+    other.skiplist = nullptr;
+}
+
+SortedSet& SortedSet::operator=(SortedSet&& other) noexcept {
+    if (this != &other) {
+        delete skiplist;
+        compact = std::move(other.compact);
+        skiplist = other.skiplist;
+        other.skiplist = nullptr;
+    }
+    return *this;
+}
+
+void SortedSet::convertToSkiplist() {
+    skiplist = new SkipList();
+    for (const auto& entry : compact) {
+        skiplist->insert(entry.first, entry.second);
+        skiplist->dict[entry.second] = entry.first;
+    }
+    compact.clear();
+    compact.shrink_to_fit();
+}
+
+bool SortedSet::add(const std::string& member, double score) {
+    if (!skiplist) {
+        auto it = std::find_if(compact.begin(), compact.end(),
+                               [&member](const std::pair<double, std::string>& e) { return e.second == member; });
+        bool isNew = (it == compact.end());
+        if (!isNew) {
+            if (it->first == score) {
+                return false;
+            }
+            compact.erase(it);
+        }
+        if (isNew && (compact.size() + 1 > kMaxCompactEntries || member.size() > kMaxCompactMember)) {
+            convertToSkiplist();
+        } else {
+            auto pos = std::lower_bound(compact.begin(), compact.end(), std::make_pair(score, member));
+            compact.insert(pos, std::make_pair(score, member));
+            return isNew;
+        }
+    }
+
+    auto it = skiplist->dict.find(member);
+    if (it != skiplist->dict.end()) {
+        if (it->second != score) {
+            skiplist->erase(it->second, member);
+            skiplist->insert(score, member);
+            it->second = score;
+        }
+        return false;
+    }
+    skiplist->insert(score, member);
+    skiplist->dict.emplace(member, score);
+    return true;
+}
+
+bool SortedSet::remove(const std::string& member) {
+    if (!skiplist) {
+        auto it = std::find_if(compact.begin(), compact.end(),
+                               [&member](const std::pair<double, std::string>& e) { return e.second == member; });
+        if (it == compact.end()) {
+            return false;
+        }
+        compact.erase(it);
+        return true;
+    }
+    auto it = skiplist->dict.find(member);
+    if (it == skiplist->dict.end()) {
+        return false;
+    }
+    skiplist->erase(it->second, member);
+    skiplist->dict.erase(it);
+    return true;
+}
+
+bool SortedSet::score(const std::string& member, double& out) const {
+    if (!skiplist) {
+        for (const auto& e : compact) {
+            if (e.second == member) {
+                out = e.first;
+                return true;
+            }
+        }
+        return false;
+    }
+    auto it = skiplist->dict.find(member);
+    if (it == skiplist->dict.end()) {
+        return false;
+    }
+    out = it->second;
+    return true;
+}
+
+long SortedSet::rank(const std::string& member, bool reverse) const {
+    long r = -1;
+    if (!skiplist) {
+        for (size_t i = 0; i < compact.size(); ++i) {
+            if (compact[i].second == member) {
+                r = static_cast<long>(i);
+                break;
+            }
+        }
+    } else {
+        auto it = skiplist->dict.find(member);
+        if (it != skiplist->dict.end()) {
+            r = static_cast<long>(skiplist->rankOf(it->second, member)) - 1;
+        }
+    }
+    if (r >= 0 && reverse) {
+        r = static_cast<long>(size()) - 1 - r;
+    }
+    return r;
+}
+
+size_t SortedSet::size() const {
+    return skiplist ? skiplist->length : compact.size();
+}
+
+std::vector<std::pair<std::string, double>> SortedSet::rangeByRank(size_t start, size_t stop, bool reverse) const {
+    std::vector<std::pair<std::string, double>> out;
+    size_t n = size();
+    if (start > stop || start >= n) {
+        return out;
+    }
+    stop = std::min(stop, n - 1);
+    out.reserve(stop - start + 1);
+    if (!skiplist) {
+        for (size_t i = start; i <= stop; ++i) {
+            const auto& e = reverse ? compact[n - 1 - i] : compact[i];
+            out.emplace_back(e.second, e.first);
+        }
+        return out;
+    }
+    // One O(log n) descent to the first node, then walk the level-0 links
+    SkipList::Node* x = reverse ? skiplist->byRank(n - start) : skiplist->byRank(start + 1);
+    for (size_t i = start; i <= stop && x; ++i) {
+        out.emplace_back(x->member, x->score);
+        x = reverse ? x->backward : x->levels[0].forward;
+    }
+    return out;
+}
+
+std::vector<std::pair<std::string, double>> SortedSet::rangeByScore(const ScoreRange& range, size_t offset, long count) const {
+    std::vector<std::pair<std::string, double>> out;
+    if (!skiplist) {
+        for (const auto& e : compact) {
+            if (!aboveMin(e.first, range)) continue;
+            if (!belowMax(e.first, range)) break;
+            if (offset > 0) { --offset; continue; }
+            if (count >= 0 && static_cast<long>(out.size()) >= count) break;
+            out.emplace_back(e.second, e.first);
+        }
+        return out;
+    }
+    for (SkipList::Node* x = skiplist->firstInRange(range); x && belowMax(x->score, range); x = x->levels[0].forward) {
+        if (offset > 0) { --offset; continue; }
+        if (count >= 0 && static_cast<long>(out.size()) >= count) break;
+        out.emplace_back(x->member, x->score);
+    }
+    return out;
+}
+
+void SortedSet::forEach(const std::function<void(const std::string&, double)>& fn) const {
+    if (!skiplist) {
+        for (const auto& e : compact) {
+            fn(e.second, e.first);
+        }
+        return;
+    }
+    for (SkipList::Node* x = skiplist->header->levels[0].forward; x; x = x->levels[0].forward) {
+        fn(x->member, x->score);
+    }
+}
+
+size_t SortedSet::memoryUsage() const {
+    auto heapBytes = [](const std::string& str) { return str.capacity() > 15 ? str.capacity() + 1 : 0; };
+    size_t bytes = 0;
+    if (!skiplist) {
+        bytes += compact.capacity() * sizeof(compact[0]);
+        for (const auto& e : compact) {
+            bytes += heapBytes(e.second);
+        }
+        return bytes;
+    }
+    bytes += sizeof(SkipList) + skiplist->dict.bucket_count() * sizeof(void*);
+    for (SkipList::Node* x = skiplist->header; x; x = x->levels[0].forward) {
+        bytes += sizeof(SkipList::Node) + x->levels.capacity() * sizeof(SkipList::Node::Level);
+        bytes += 2 * heapBytes(x->member); // node copy + dict key
+        bytes += sizeof(std::pair<const std::string, double>) + 2 * sizeof(void*); // dict node
+    }
+    return bytes;
+}
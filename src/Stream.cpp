@@ -0,0 +1,534 @@
+#include "../include/Stream.h"
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+
+namespace {
+
+const uint8_t kDeleted = 1;    // flags :- XDEL'ed or trimmed, skipped by reads
+const uint8_t kSameFields = 2; // flags :- field names are the node's master fields
+
+void putVarint(std::string& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<char>((v & 0x7f) | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+}
+
+uint64_t getVarint(const std::string& in, size_t& pos) {
+    uint64_t v = 0;
+    int shift = 0;
+    while (true) {
+        uint8_t b = static_cast<uint8_t>(in[pos++]);
+        v |= static_cast<uint64_t>(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return v;
+        shift += 7;
+    }
+}
+
+void putString(std::string& out, const std::string& s) {
+    putVarint(out, s.size());
+    out.append(s);
+}
+
+void skipString(const std::string& in, size_t& pos) {
+    size_t len = getVarint(in, pos);
+    pos += len;
+}
+
+std::string getString(const std::string& in, size_t& pos) {
+    size_t len = getVarint(in, pos);
+    std::string s(in, pos, len);
+    pos += len;
+    return s;
+}
+
+bool parseUnsigned(const std::string& text, uint64_t& out) {
+    if (text.empty() || !std::isdigit(static_cast<unsigned char>(text[0])))
+        return false;
+    char* end = nullptr;
+    errno = 0;
+    unsigned long long v = std::strtoull(text.c_str(), &end, 10);
+    if (*end != '\0' || errno == ERANGE)
+        return false;
+    out = v;
+    return true;
+}
+
+} // namespace
+
+//StreamID
+
+bool StreamID::increment() {
+    if (seq != UINT64_MAX) {
+        ++seq;
+        return true;
+    }
+    if (ms == UINT64_MAX)
+        return false;
+    ++ms;
+    seq = 0;
+    return true;
+}
+
+bool StreamID::decrement() {
+    if (seq != 0) {
+        --seq;
+        return true;
+    }
+    if (ms == 0)
+        return false;
+    --ms;
+    seq = UINT64_MAX;
+    return true;
+}
+
+std::string StreamID::str() const {
+    return std::to_string(ms) + "-" + std::to_string(seq);
+}
+
+bool StreamID::parse(const std::string& text, StreamID& out, uint64_t missingSeq) {
+    size_t dash = text.find('-');
+    if (dash == std::string::npos) {
+        out.seq = missingSeq;
+        return parseUnsigned(text, out.ms);
+    }
+    return parseUnsigned(text.substr(0, dash), out.ms) && parseUnsigned(text.substr(dash + 1), out.seq);
+}
+
+/* Entry layout inside Node::data
+ *   flags           1 byte, kDeleted | kSameFields
+ *   ms delta        varint, id.ms - master.ms
+ *   seq             varint, id.seq - master.seq when the ms delta is 0, else id.seq
+ *   [field count]   varint, only without kSameFields
+ *   [field]/value   length prefixed strings, fields only without kSameFields */
+class NodeReader {
+public:
+    NodeReader(const std::string& data, const StreamID& master, const std::vector<std::string>& masterFields)
+        : data(data), master(master), masterFields(masterFields) {}
+
+    // Step to the next entry, false at the end of the node
+    bool next() {
+        if (pos == data.size())
+            return false;
+        offset = pos;
+        flags = static_cast<uint8_t>(data[pos++]);
+        uint64_t msDelta = getVarint(data, pos);
+        uint64_t seq = getVarint(data, pos);
+        id.ms = master.ms + msDelta;
+        id.seq = msDelta == 0 ? master.seq + seq : seq;
+        payload = pos;
+        // skip the fields so the next call starts at the next entry
+        size_t pairs = masterFields.size();
+        if (!(flags & kSameFields))
+            pairs = getVarint(data, pos);
+        for (size_t i = 0; i < pairs; ++i) {
+            if (!(flags & kSameFields))
+                skipString(data, pos);
+            skipString(data, pos);
+        }
+        return true;
+    }
+
+    // Entry starting at a previously seen offset
+    void seek(size_t at) {
+        pos = at;
+        next();
+    }
+
+    void fields(std::vector<std::string>& out) const {
+        out.clear();
+        size_t p = payload;
+        if (flags & kSameFields) {
+            for (const auto& name : masterFields) {
+                out.push_back(name);
+                out.push_back(getString(data, p));
+            }
+            return;
+        }
+        size_t pairs = getVarint(data, p);
+        for (size_t i = 0; i < pairs; ++i) {
+            out.push_back(getString(data, p));
+            out.push_back(getString(data, p));
+        }
+    }
+
+    StreamEntry entry() const {
+        StreamEntry e;
+        e.id = id;
+        fields(e.fields);
+        return e;
+    }
+
+    bool deleted() const { return flags & kDeleted; }
+
+    StreamID id;
+    size_t offset = 0; // of the current entry's flags byte
+
+private:
+    const std::string& data;
+    const StreamID& master;
+    const std::vector<std::string>& masterFields;
+    size_t pos = 0;
+    size_t payload = 0;
+    uint8_t flags = 0;
+};
+
+//appending and deleting
+
+bool Stream::nextId(StreamID& id, bool autoMs, bool autoSeq, uint64_t nowMs) const {
+    if (autoMs) {
+        if (nowMs > last.ms) {
+            id = StreamID{nowMs, 0};
+            return true;
+        }
+        id = last;
+        return id.increment();
+    }
+    if (autoSeq) {
+        if (id.ms < last.ms)
+            return false;
+        if (id.ms > last.ms) {
+            id.seq = 0;
+            return true;
+        }
+        id.seq = last.seq;
+        if (id.seq == UINT64_MAX)
+            return false;
+        ++id.seq;
+        return true;
+    }
+    return id > last;
+}
+
+bool Stream::add(const StreamID& id, const std::vector<std::string>& fields) {
+    if (id <= last)
+        return false;
+    StreamID masterId;
+    Node* node = index.last(&masterId);
+    if (!node || node->entries >= kNodeMaxEntries || node->data.size() >= kNodeMaxBytes) {
+        node = &index[id];
+        node->master = id;
+        for (size_t i = 0; i < fields.size(); i += 2)
+            node->masterFields.push_back(fields[i]);
+    }
+
+    bool same = node->masterFields.size() * 2 == fields.size();
+    for (size_t i = 0; same && i < fields.size(); i += 2)
+        same = fields[i] == node->masterFields[i / 2];
+    std::string& out = node->data;
+    out.push_back(static_cast<char>(same ? kSameFields : 0));
+    uint64_t msDelta = id.ms - node->master.ms;
+    putVarint(out, msDelta);
+    putVarint(out, msDelta == 0 ? id.seq - node->master.seq : id.seq);
+    if (same) {
+        for (size_t i = 1; i < fields.size(); i += 2)
+            putString(out, fields[i]);
+    } else {
+        putVarint(out, fields.size() / 2);
+        for (const auto& s : fields)
+            putString(out, s);
+    }
+    ++node->entries;
+    ++node->live;
+    ++length;
+    last = id;
+    return true;
+}
+
+bool Stream::markDeleted(Node& node, const StreamID& id) {
+    NodeReader reader(node.data, node.master, node.masterFields);
+    while (reader.next()) {
+        if (reader.id == id) {
+            if (reader.deleted())
+                return false;
+            node.data[reader.offset] = static_cast<char>(node.data[reader.offset] | kDeleted);
+            --node.live;
+            --length;
+            return true;
+        }
+        if (reader.id > id)
+            return false;
+    }
+    return false;
+}
+
+size_t Stream::remove(const std::vector<StreamID>& ids) {
+    size_t removed = 0;
+    for (const auto& id : ids) {
+        StreamID masterId;
+        Node* node = index.floor(id, &masterId);
+        if (!node || !markDeleted(*node, id))
+            continue;
+        ++removed;
+        if (node->live == 0)
+            index.erase(masterId);
+    }
+    return removed;
+}
+
+size_t Stream::trim(size_t maxLen, bool approx) {
+    size_t removed = 0;
+    while (length > maxLen) {
+        StreamID masterId;
+        Node* node = index.first(&masterId);
+        if (length - node->live >= maxLen) {
+            // whole node goes, no decoding
+            length -= node->live;
+            removed += node->live;
+            index.erase(masterId);
+            continue;
+        }
+        if (approx)
+            break;
+        size_t drop = length - maxLen;
+        NodeReader reader(node->data, node->master, node->masterFields);
+        while (drop > 0 && reader.next()) {
+            if (reader.deleted())
+                continue;
+            node->data[reader.offset] = static_cast<char>(node->data[reader.offset] | kDeleted);
+            --node->live;
+            --length;
+            --drop;
+            ++removed;
+        }
+    }
+    return removed;
+}
+
+void Stream::setLastId(const StreamID& id) {
+    if (id > last)
+        last = id;
+}
+
+//reading
+
+void Stream::range(const StreamID& start, const StreamID& end, size_t count, bool reverse, std::vector<StreamEntry>& out) const {
+    if (start > end)
+        return;
+    size_t wanted = count == 0 ? SIZE_MAX : out.size() + count;
+    StreamID masterId;
+    if (!reverse) {
+        // the node holding start begins at or before it
+        const Node* node = index.floor(start, &masterId);
+        if (!node)
+            node = index.ceil(start, &masterId);
+        while (node && masterId <= end) {
+            NodeReader reader(node->data, node->master, node->masterFields);
+            while (reader.next()) {
+                if (reader.id > end || out.size() >= wanted)
+                    return;
+                if (!reader.deleted() && reader.id >= start)
+                    out.push_back(reader.entry());
+            }
+            node = index.next(masterId, &masterId);
+        }
+        return;
+    }
+
+    const Node* node = index.floor(end, &masterId);
+    std::vector<std::pair<StreamID, size_t>> positions;
+    while (node) {
+        positions.clear();
+        NodeReader reader(node->data, node->master, node->masterFields);
+        while (reader.next()) {
+            if (reader.id > end)
+                break;
+            if (!reader.deleted() && reader.id >= start)
+                positions.emplace_back(reader.id, reader.offset);
+        }
+        for (auto it = positions.rbegin(); it != positions.rend(); ++it) {
+            if (out.size() >= wanted)
+                return;
+            reader.seek(it->second);
+            out.push_back(reader.entry());
+        }
+        if (masterId <= start)
+            return; // older nodes only hold ids before start
+        node = index.prev(masterId, &masterId);
+    }
+}
+
+bool Stream::get(const StreamID& id, StreamEntry& out) const {
+    StreamID masterId;
+    const Node* node = index.floor(id, &masterId);
+    if (!node)
+        return false;
+    NodeReader reader(node->data, node->master, node->masterFields);
+    while (reader.next()) {
+        if (reader.id == id) {
+            if (reader.deleted())
+                return false;
+            out = reader.entry();
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Stream::firstEntry(StreamEntry& out) const {
+    std::vector<StreamEntry> one;
+    range(StreamID::min(), StreamID::max(), 1, false, one);
+    if (one.empty())
+        return false;
+    out = std::move(one[0]);
+    return true;
+}
+
+bool Stream::lastEntry(StreamEntry& out) const {
+    std::vector<StreamEntry> one;
+    range(StreamID::min(), StreamID::max(), 1, true, one);
+    if (one.empty())
+        return false;
+    out = std::move(one[0]);
+    return true;
+}
+
+void Stream::forEach(const std::function<void(const StreamEntry&)>& fn) const {
+    index.forEach([&fn](const StreamID&, const Node& node) {
+        NodeReader reader(node.data, node.master, node.masterFields);
+        while (reader.next()) {
+            if (!reader.deleted())
+                fn(reader.entry());
+        }
+    });
+}
+
+//consumer groups
+
+Stream::Group* Stream::group(const std::string& name) {
+    auto it = groups.find(name);
+    return it == groups.end() ? nullptr : &it->second;
+}
+
+bool Stream::createGroup(const std::string& name, const StreamID& lastDelivered) {
+    if (groups.count(name))
+        return false;
+    groups[name].lastDelivered = lastDelivered;
+    return true;
+}
+
+bool Stream::destroyGroup(const std::string& name) {
+    return groups.erase(name) > 0;
+}
+
+Stream::Consumer& Stream::consumer(Group& g, const std::string& name, uint64_t nowMs) {
+    Consumer& c = g.consumers[name];
+    c.seenTime = nowMs;
+    return c;
+}
+
+void Stream::readNew(Group& g, const std::string& name, size_t count, bool noack, uint64_t nowMs, std::vector<StreamEntry>& out) {
+    Consumer& c = consumer(g, name, nowMs);
+    StreamID start = g.lastDelivered;
+    if (!start.increment())
+        return;
+    size_t first = out.size();
+    range(start, StreamID::max(), count, false, out);
+    for (size_t i = first; i < out.size(); ++i) {
+        const StreamID& id = out[i].id;
+        g.lastDelivered = id;
+        if (noack)
+            continue;
+        Pending& p = g.pel[id];
+        if (!p.consumer.empty() && p.consumer != name) {
+            g.consumers[p.consumer].pending.erase(id); // delivered before a SETID moved the group back
+        }
+        p.consumer = name;
+        p.deliveryTime = nowMs;
+        p.deliveries = 1;
+        c.pending[id] = 1;
+    }
+}
+
+void Stream::readPending(Group& g, const std::string& name, const StreamID& start, size_t count, uint64_t nowMs,
+                         std::vector<StreamEntry>& out) {
+    Consumer& c = consumer(g, name, nowMs);
+    StreamID id;
+    size_t taken = 0;
+    for (const char* v = c.pending.next(start, &id); v && (count == 0 || taken < count); v = c.pending.next(id, &id)) {
+        StreamEntry e;
+        if (!get(id, e)) {
+            e.id = id;
+            e.deleted = true;
+        }
+        Pending* p = g.pel.find(id);
+        if (p) {
+            p->deliveryTime = nowMs;
+            ++p->deliveries;
+        }
+        out.push_back(std::move(e));
+        ++taken;
+    }
+}
+
+size_t Stream::ack(Group& g, const std::vector<StreamID>& ids) {
+    size_t acked = 0;
+    for (const auto& id : ids) {
+        Pending* p = g.pel.find(id);
+        if (!p)
+            continue;
+        auto cit = g.consumers.find(p->consumer);
+        if (cit != g.consumers.end())
+            cit->second.pending.erase(id);
+        g.pel.erase(id);
+        ++acked;
+    }
+    return acked;
+}
+
+void Stream::claim(Group& g, const std::string& name, uint64_t minIdle, const std::vector<StreamID>& ids, bool force,
+                   bool bumpDeliveries, uint64_t nowMs, std::vector<StreamID>& claimed) {
+    Consumer& c = consumer(g, name, nowMs);
+    for (const auto& id : ids) {
+        Pending* p = g.pel.find(id);
+        if (!p) {
+            StreamEntry e;
+            if (!force || !get(id, e))
+                continue;
+            p = &g.pel[id];
+        } else if (minIdle > 0 && nowMs - p->deliveryTime < minIdle) {
+            continue;
+        }
+        if (!p->consumer.empty() && p->consumer != name) {
+            g.consumers[p->consumer].pending.erase(id);
+        }
+        p->consumer = name;
+        p->deliveryTime = nowMs;
+        if (bumpDeliveries)
+            ++p->deliveries;
+        c.pending[id] = 1;
+        claimed.push_back(id);
+    }
+}
+
+long Stream::deleteConsumer(Group& g, const std::string& name) {
+    auto it = g.consumers.find(name);
+    if (it == g.consumers.end())
+        return -1;
+    long pending = static_cast<long>(it->second.pending.size());
+    it->second.pending.forEach([&g](const StreamID& id, const char&) { g.pel.erase(id); });
+    g.consumers.erase(it);
+    return pending;
+}
+
+//memory introspection
+
+size_t Stream::memoryUsage() const {
+    auto heapBytes = [](const std::string& str) { return str.capacity() > 15 ? str.capacity() + 1 : 0; };
+    size_t bytes = index.memoryUsage();
+    index.forEach([&](const StreamID&, const Node& node) {
+        bytes += node.data.capacity() + node.masterFields.capacity() * sizeof(std::string);
+        for (const auto& f : node.masterFields)
+            bytes += heapBytes(f);
+    });
+    for (const auto& g : groups) {
+        bytes += sizeof(g) + g.second.pel.memoryUsage() + heapBytes(g.first);
+        for (const auto& c : g.second.consumers) {
+            bytes += sizeof(c) + c.second.pending.memoryUsage() + heapBytes(c.first);
+        }
+    }
+    return bytes;
+}
@@ -0,0 +1,218 @@
+#include "../include/StringValue.h"
+#include "../include/SlabAllocator.h"
+#include <cstring>
+#include <vector>
+
+namespace {
+
+const char kDigitPairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+// Shared small integers :- decimal text and RESP reply built once at startup
+struct SharedIntegers {
+    std::vector<std::string> text;
+    std::vector<std::string> reply;
+
+    SharedIntegers() {
+        text.reserve(StringValue::kSharedIntegers);
+        reply.reserve(StringValue::kSharedIntegers);
+        char buf[24];
+        for (int64_t i = 0; i < StringValue::kSharedIntegers; ++i) {
+            size_t n = formatInt(i, buf);
+            text.emplace_back(buf, n);
+            reply.push_back(":" + text.back() + "\r\n");
+        }
+    }
+};
+
+const SharedIntegers& shared() {
+    static const SharedIntegers pool;
+    return pool;
+}
+
+bool isShared(int64_t v) {
+    return v >= 0 && v < StringValue::kSharedIntegers;
+}
+
+} // namespace
+
+bool parseCanonicalInt(const std::string& s, int64_t& out) {
+    size_t len = s.size();
+    if (len == 0 || len > 20)
+        return false;
+    size_t i = 0;
+    bool negative = (s[0] == '-');
+    if (negative && ++i == len)
+        return false;
+    if (s[i] == '0')
+        return len == 1 ? (out = 0, true) : false; // "0" only; no "-0" or leading zeros
+    uint64_t v = 0;
+    for (; i < len; ++i) {
+        if (s[i] < '0' || s[i] > '9')
+            return false;
+        uint64_t digit = s[i] - '0';
+        if (v > (UINT64_MAX - digit) / 10)
+            return false;
+        v = v * 10 + digit;
+    }
+    if (negative) {
+        if (v > static_cast<uint64_t>(INT64_MAX) + 1)
+            return false;
+        out = static_cast<int64_t>(0 - v);
+    } else {
+        if (v > static_cast<uint64_t>(INT64_MAX))
+            return false;
+        out = static_cast<int64_t>(v);
+    }
+    return true;
+}
+
+size_t formatInt(int64_t v, char* buf) {
+    uint64_t u = v < 0 ? 0 - static_cast<uint64_t>(v) : static_cast<uint64_t>(v);
+    char tmp[24];
+    char* p = tmp + sizeof(tmp);
+    while (u >= 100) {
+        unsigned idx = static_cast<unsigned>(u % 100) * 2;
+        u /= 100;
+        *--p = kDigitPairs[idx + 1];
+        *--p = kDigitPairs[idx];
+    }
+    if (u >= 10) {
+        unsigned idx = static_cast<unsigned>(u) * 2;
+        *--p = kDigitPairs[idx + 1];
+        *--p = kDigitPairs[idx];
+    } else {
+        *--p = static_cast<char>('0' + u);
+    }
+    if (v < 0)
+        *--p = '-';
+    size_t n = tmp + sizeof(tmp) - p;
+    std::memcpy(buf, p, n);
+    return n;
+}
+
+std::string intToString(int64_t v) {
+    if (isShared(v))
+        return shared().text[v];
+    char buf[24];
+    return std::string(buf, formatInt(v, buf));
+}
+
+std::string integerReply(int64_t v) {
+    if (isShared(v))
+        return shared().reply[v];
+    char buf[24];
+    buf[0] = ':';
+    size_t n = 1 + formatInt(v, buf + 1);
+    buf[n++] = '\r';
+    buf[n++] = '\n';
+    return std::string(buf, n);
+}
+
+StringValue::StringValue(const std::string& s) : encoding(EMBED), embeddedLen(0) {
+    if (parseCanonicalInt(s, ival)) {
+        encoding = INT;
+    } else {
+        assign(s.data(), s.size());
+    }
+}
+
+StringValue::StringValue(const StringValue& other) : encoding(EMBED), embeddedLen(0) {
+    *this = other;
+}
+
+StringValue::StringValue(StringValue&& other) noexcept : encoding(EMBED), embeddedLen(0) {
+    *this = std::move(other);
+}
+
+StringValue& StringValue::operator=(const StringValue& other) {
+    if (this == &other)
+        return *this;
+    if (other.encoding == HEAP) {
+        assign(other.heap.data, other.heap.len);
+        return *this;
+    }
+    release();
+    std::memcpy(embedded, other.embedded, kMaxEmbedded); // also copies ival
+    encoding = other.encoding;
+    embeddedLen = other.embeddedLen;
+    return *this;
+}
+
+StringValue& StringValue::operator=(StringValue&& other) noexcept {
+    if (this == &other)
+        return *this;
+    release();
+    std::memcpy(embedded, other.embedded, kMaxEmbedded); // steals heap.data too
+    encoding = other.encoding;
+    embeddedLen = other.embeddedLen;
+    other.encoding = EMBED;
+    other.embeddedLen = 0;
+    return *this;
+}
+
+StringValue::~StringValue() {
+    release();
+}
+
+void StringValue::release() {
+    if (encoding == HEAP) {
+        SlabAllocator::getInstance().deallocate(heap.data, heap.len);
+    }
+    encoding = EMBED;
+    embeddedLen = 0;
+}
+
+void StringValue::assign(const char* data, size_t len) {
+    release();
+    if (len <= kMaxEmbedded) {
+        std::memcpy(embedded, data, len);
+        embeddedLen = static_cast<uint8_t>(len);
+        encoding = EMBED;
+        return;
+    }
+    char* block = static_cast<char*>(SlabAllocator::getInstance().allocate(len));
+    std::memcpy(block, data, len);
+    heap.data = block;
+    heap.len = len;
+    encoding = HEAP;
+}
+
+bool StringValue::toInt(int64_t& out) const {
+    if (encoding != INT)
+        return false; // raw values already failed the canonical parse
+    out = ival;
+    return true;
+}
+
+std::string StringValue::str() const {
+    switch (encoding) {
+        case INT: return intToString(ival);
+        case EMBED: return std::string(embedded, embeddedLen);
+        default: return std::string(heap.data, heap.len);
+    }
+}
+
+size_t StringValue::size() const {
+    switch (encoding) {
+        case INT: {
+            char buf[24];
+            return formatInt(ival, buf);
+        }
+        case EMBED: return embeddedLen;
+        default: return heap.len;
+    }
+}
+
+size_t StringValue::allocatedBytes() const {
+    return encoding == HEAP ? SlabAllocator::usableSize(heap.len) : 0;
+}
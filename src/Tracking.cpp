@@ -0,0 +1,187 @@
+#include "../include/Tracking.h"
+#include "../include/PubSub.h"
+#include <algorithm>
+#include <sstream>
+
+namespace {
+
+const std::string kInvalidateChannel = "__redis__:invalidate";
+
+// RESP2 :- *3 message __redis__:invalidate [key], RESP3 :- >2 invalidate [key].
+// The key is a one key array, or null for "everything".
+std::shared_ptr<const std::string> invalidation(const std::string* key, bool push) {
+    std::string frame;
+    if (push)
+        frame = ">2\r\n$10\r\ninvalidate\r\n";
+    else
+        frame = "*3\r\n$7\r\nmessage\r\n$" + std::to_string(kInvalidateChannel.size()) + "\r\n" +
+                kInvalidateChannel + "\r\n";
+    if (key)
+        frame += "*1\r\n$" + std::to_string(key->size()) + "\r\n" + *key + "\r\n";
+    else
+        frame += push ? "_\r\n" : "$-1\r\n";
+    return std::make_shared<const std::string>(std::move(frame));
+}
+
+} // namespace
+
+Tracking& Tracking::getInstance() {
+    static Tracking instance;
+    return instance;
+}
+
+//tracking state of a connection
+
+void Tracking::enable(uint64_t client, uint64_t redirect, bool bcast, const std::vector<std::string>& prefixes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = clients.find(client);
+    if (it == clients.end()) {
+        it = clients.emplace(client, Client()).first;
+        trackingClients.fetch_add(1, std::memory_order_relaxed);
+    }
+    bool wasBcast = it->second.bcast;
+    it->second.redirect = redirect;
+    it->second.bcast = bcast;
+    it->second.prefixes = prefixes;
+    if (bcast && !wasBcast)
+        broadcasters.push_back(client);
+    else if (!bcast && wasBcast)
+        broadcasters.erase(std::find(broadcasters.begin(), broadcasters.end(), client));
+}
+
+void Tracking::disable(uint64_t client) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = clients.find(client);
+    if (it == clients.end())
+        return;
+    if (it->second.bcast)
+        broadcasters.erase(std::find(broadcasters.begin(), broadcasters.end(), client));
+    clients.erase(it);
+    trackingClients.fetch_sub(1, std::memory_order_relaxed);
+    // its ids left in the table are skipped when the keys get invalidated
+}
+
+uint64_t Tracking::redirectOf(uint64_t client) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = clients.find(client);
+    return it == clients.end() ? UINT64_MAX : it->second.redirect;
+}
+
+bool Tracking::tracking(uint64_t client) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return clients.count(client) > 0;
+}
+
+void Tracking::attach(uint64_t client, const std::shared_ptr<Subscriber>& sub) {
+    std::lock_guard<std::mutex> lock(mutex);
+    receivers[client] = sub;
+}
+
+bool Tracking::attached(uint64_t client) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return receivers.count(client) > 0;
+}
+
+void Tracking::detach(uint64_t client) {
+    disable(client);
+    std::lock_guard<std::mutex> lock(mutex);
+    receivers.erase(client);
+}
+
+//invalidation table
+
+void Tracking::remember(uint64_t client, const std::vector<std::string>& keys) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& key : keys) {
+        auto it = table.find(key);
+        if (it == table.end()) {
+            if (table.size() >= kMaxKeys) {
+                // full :- make room by invalidating some other key early
+                auto victim = table.begin();
+                std::vector<uint64_t> ids = std::move(victim->second);
+                std::string victimKey = victim->first;
+                tableItems -= ids.size();
+                table.erase(victim);
+                invalidateLocked(ids, &victimKey);
+            }
+            it = table.emplace(key, std::vector<uint64_t>()).first;
+        }
+        if (std::find(it->second.begin(), it->second.end(), client) == it->second.end()) {
+            it->second.push_back(client);
+            ++tableItems;
+        }
+    }
+}
+
+void Tracking::keyModified(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<uint64_t> ids;
+    auto it = table.find(key);
+    if (it != table.end()) {
+        ids = std::move(it->second);
+        tableItems -= ids.size();
+        table.erase(it);
+    }
+    for (uint64_t client : broadcasters) {
+        const auto& prefixes = clients[client].prefixes;
+        bool match = prefixes.empty();
+        for (size_t i = 0; i < prefixes.size() && !match; ++i)
+            match = key.compare(0, prefixes[i].size(), prefixes[i]) == 0;
+        if (match)
+            ids.push_back(client);
+    }
+    if (!ids.empty())
+        invalidateLocked(ids, &key);
+}
+
+void Tracking::flushed() {
+    std::lock_guard<std::mutex> lock(mutex);
+    table.clear();
+    tableItems = 0;
+    std::vector<uint64_t> ids;
+    for (const auto& entry : clients)
+        ids.push_back(entry.first);
+    invalidateLocked(ids, nullptr);
+}
+
+void Tracking::invalidateLocked(const std::vector<uint64_t>& ids, const std::string* key) {
+    Frames frames; // encoded at most once per protocol, shared by every receiver
+    std::vector<uint64_t> sentTo;
+    for (uint64_t id : ids) {
+        auto client = clients.find(id);
+        if (client == clients.end())
+            continue; // stopped tracking since it read the key
+        sendLocked(client->second.redirect ? client->second.redirect : id, key, frames, sentTo);
+    }
+}
+
+// Several clients may redirect to one connection, it gets the key once
+void Tracking::sendLocked(uint64_t client, const std::string* key, Frames& frames, std::vector<uint64_t>& sentTo) {
+    if (std::find(sentTo.begin(), sentTo.end(), client) != sentTo.end())
+        return;
+    sentTo.push_back(client);
+    auto it = receivers.find(client);
+    if (it == receivers.end())
+        return;
+    std::shared_ptr<Subscriber> sub = it->second.lock();
+    if (!sub)
+        return;
+    bool push = sub->protocol() == 3;
+    if (!push && sub->subscriptions() == 0)
+        return; // not (or no longer) in subscribed mode, RESP2 can't push to it
+    if (!frames[push])
+        frames[push] = invalidation(key, push);
+    sub->deliver(frames[push]);
+    ++invalidations;
+}
+
+std::string Tracking::info() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::ostringstream out;
+    out << "# Tracking\r\n"
+        << "tracking_clients:" << clients.size() << "\r\n"
+        << "tracking_total_keys:" << table.size() << "\r\n"
+        << "tracking_total_items:" << tableItems << "\r\n"
+        << "tracking_invalidations_sent:" << invalidations << "\r\n";
+    return out.str();
+}
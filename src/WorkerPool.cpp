@@ -0,0 +1,163 @@
+#include "../include/WorkerPool.h"
+#include <cstdlib>
+#include <pthread.h>
+#include <sched.h>
+
+WorkerPool::WorkerPool(size_t threads, std::vector<int> cpus, Run run, Drain drain)
+    : cpus(std::move(cpus)), run(std::move(run)), drain(std::move(drain)) {
+    for (size_t i = 0; i < threads; ++i) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    stop();
+}
+
+void WorkerPool::start() {
+    for (size_t i = 0; i < queues.size(); ++i) {
+        queues[i]->thread = std::thread(&WorkerPool::workerLoop, this, i);
+    }
+}
+
+void WorkerPool::stop() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wakeUp.notify_all();
+    for (auto& q : queues) {
+        if (q->thread.joinable()) {
+            q->thread.join();
+        }
+    }
+}
+
+void WorkerPool::submit(const std::vector<Task*>& tasks) {
+    if (tasks.empty()) {
+        return;
+    }
+    // consecutive tasks go to consecutive deques, the next submit carries on where this one stopped
+    size_t first = nextQueue.fetch_add(tasks.size(), std::memory_order_relaxed);
+    for (size_t i = 0; i < tasks.size(); ++i) {
+        Queue& q = *queues[(first + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        q.tasks.push_back(tasks[i]);
+    }
+    {
+        // under sleepMutex :- a worker between its last look and wait() can't miss this
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        queued.fetch_add(tasks.size(), std::memory_order_relaxed);
+    }
+    // one sleeper at a time: it wakes the next if there is still work (workerLoop), so a
+    // handful of small batches doesn't get every worker up to fight over them
+    if (sleeping.load(std::memory_order_relaxed) > 0) {
+        wakeUp.notify_one();
+    }
+}
+
+void WorkerPool::workerLoop(size_t index) {
+    pin(cpus, index);
+    size_t sinceDrain = 0;
+    while (!stopping) {
+        Task* task = pop(index);
+        if (!task) {
+            task = steal(index);
+        }
+        if (!task) {
+            drain(index);
+            sinceDrain = 0;
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            sleeping.fetch_add(1, std::memory_order_relaxed);
+            wakeUp.wait(lock, [this]() { return queued.load(std::memory_order_relaxed) > 0 || stopping; });
+            sleeping.fetch_sub(1, std::memory_order_relaxed);
+            continue;
+        }
+        if (queued.load(std::memory_order_relaxed) > 0 && sleeping.load(std::memory_order_relaxed) > 0) {
+            wakeUp.notify_one(); // more than this worker can take right now
+        }
+        if (run(task, index)) {
+            push(index, task); // its turn is over, not its work
+        }
+        turnCount.fetch_add(1, std::memory_order_relaxed);
+        if (++sinceDrain >= kDrainEvery) {
+            drain(index);
+            sinceDrain = 0;
+        }
+    }
+}
+
+WorkerPool::Task* WorkerPool::pop(size_t index) {
+    Queue& q = *queues[index];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if (q.tasks.empty()) {
+        return nullptr;
+    }
+    Task* task = q.tasks.front();
+    q.tasks.pop_front();
+    queued.fetch_sub(1, std::memory_order_relaxed);
+    return task;
+}
+
+// The newest task of the first other worker that has any
+WorkerPool::Task* WorkerPool::steal(size_t index) {
+    for (size_t i = 1; i < queues.size(); ++i) {
+        Queue& q = *queues[(index + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (q.tasks.empty()) {
+            continue;
+        }
+        Task* task = q.tasks.back();
+        q.tasks.pop_back();
+        queued.fetch_sub(1, std::memory_order_relaxed);
+        stealCount.fetch_add(1, std::memory_order_relaxed);
+        return task;
+    }
+    return nullptr;
+}
+
+void WorkerPool::push(size_t index, Task* task) {
+    Queue& q = *queues[index];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    q.tasks.push_back(task);
+    queued.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool WorkerPool::parseCpuList(const std::string& text, std::vector<int>& cpus) {
+    cpus.clear();
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t end = text.find(',', pos);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+        std::string part = text.substr(pos, end - pos);
+        size_t dash = part.find('-');
+        std::string lo = part.substr(0, dash);
+        std::string hi = dash == std::string::npos ? lo : part.substr(dash + 1);
+        if (lo.empty() || hi.empty() || lo.find_first_not_of("0123456789") != std::string::npos ||
+            hi.find_first_not_of("0123456789") != std::string::npos) {
+            return false;
+        }
+        int from = std::atoi(lo.c_str());
+        int to = std::atoi(hi.c_str());
+        if (from > to || to >= CPU_SETSIZE) {
+            return false;
+        }
+        for (int cpu = from; cpu <= to; ++cpu) {
+            cpus.push_back(cpu);
+        }
+        pos = end + 1;
+    }
+    return !cpus.empty();
+}
+
+void WorkerPool::pin(const std::vector<int>& cpus, size_t index) {
+    if (cpus.empty()) {
+        return;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpus[index % cpus.size()], &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
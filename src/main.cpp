@@ -1,34 +1,146 @@
 #include "../include/RedisServer.h"
 #include "../include/RedisDatabase.h"
+#include "../include/ShardedServer.h"
+#include "../include/Replication.h"
+#include "../include/Cluster.h"
+#include "../include/IoUring.h"
+#include "../include/OutputLimits.h"
+#include "../include/ClientRegistry.h"
+#include "../include/WorkerPool.h"
 #include <iostream>
 #include <thread>
 #include <chrono>    
+#include <algorithm>
 #include <csignal>
 #include <signal.h>
+#include <sys/resource.h>
 
 
 int main(int argc, char* argv[]) {
-    int port = 6379;
-    if(argc >= 2){
-        port = std::stoi(argv[1]);
+    ListenOptions listen;
+    size_t shards = 1;
+    std::string clusterConfig;
+    std::string ioBackend;
+    ThreadOptions threads;
+    size_t maxClients = ClientRegistry::kDefaultMaxClients;
+    int idleTimeout = 0;
+    for(int i = 1; i < argc; ++i){
+        std::string arg = argv[i];
+        if(arg == "--shards" && i + 1 < argc){
+            shards = std::stoul(argv[++i]);
+        } else if(arg == "--cluster" && i + 1 < argc){
+            clusterConfig = argv[++i];
+        } else if(arg == "--unixsocket" && i + 1 < argc){
+            listen.unixSocket = argv[++i];
+        } else if(arg == "--unixsocketperm" && i + 1 < argc){
+            listen.unixSocketPerm = std::stoi(argv[++i], nullptr, 8);
+        } else if(arg == "--reuseport" && i + 1 < argc){
+            listen.acceptors = std::max<size_t>(1, std::stoul(argv[++i]));
+        } else if(arg == "--tcp-backlog" && i + 1 < argc){
+            listen.backlog = std::stoi(argv[++i]);
+        } else if(arg == "--tcp-nodelay" && i + 1 < argc){
+            listen.tcpNoDelay = std::string(argv[++i]) != "no";
+        } else if(arg == "--tcp-keepalive" && i + 1 < argc){
+            listen.tcpKeepAlive = std::stoi(argv[++i]);
+        } else if(arg == "--io-backend" && i + 1 < argc){
+            ioBackend = argv[++i];
+        } else if(arg == "--io-threads" && i + 1 < argc){
+            threads.ioThreads = std::stoul(argv[++i]);
+        } else if(arg == "--exec-threads" && i + 1 < argc){
+            // command executors of --io-threads, "auto" = one per core
+            std::string count = argv[++i];
+            threads.execThreads = count == "auto" ? std::max(1u, std::thread::hardware_concurrency())
+                                                  : std::max<size_t>(1, std::stoul(count));
+        } else if((arg == "--io-cpus" || arg == "--exec-cpus") && i + 1 < argc){
+            // pin the I/O threads or the executors in turn to these CPUs, e.g. 0-3 or 0,2,4
+            if(!WorkerPool::parseCpuList(argv[i + 1], arg == "--io-cpus" ? threads.ioCpus : threads.execCpus)){
+                std::cerr << "Bad " << arg << " " << argv[i + 1] << std::endl;
+                return 1;
+            }
+            ++i;
+        } else if(arg == "--client-output-buffer-limit" && i + 4 < argc){
+            // <normal|replica|pubsub> <hard> <soft> <seconds>, e.g. pubsub 32mb 8mb 60
+            if(!OutputLimits::getInstance().configure(argv[i + 1], argv[i + 2], argv[i + 3], argv[i + 4])){
+                std::cerr << "Bad --client-output-buffer-limit " << argv[i + 1] << " " << argv[i + 2] << " "
+                          << argv[i + 3] << " " << argv[i + 4] << std::endl;
+                return 1;
+            }
+            i += 4;
+        } else if(arg == "--maxclients" && i + 1 < argc){
+            maxClients = std::max<size_t>(1, std::stoul(argv[++i]));
+        } else if(arg == "--timeout" && i + 1 < argc){
+            idleTimeout = std::max(0, std::stoi(argv[++i]));
+        } else {
+            listen.port = std::stoi(arg);
+        }
+    }
+    int port = listen.port;
+
+    // Every client is an fd :- ask for room for maxclients plus listeners, dump files and the like
+    ClientRegistry::getInstance().configure(maxClients, idleTimeout);
+    rlimit files{};
+    if(getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur < maxClients + 32){
+        files.rlim_cur = std::min<rlim_t>(files.rlim_max, maxClients + 32);
+        setrlimit(RLIMIT_NOFILE, &files);
+    }
+
+    Replication::getInstance().setListeningPort(port);
+
+    if(!ioBackend.empty() && ioBackend != "epoll" && ioBackend != "uring"){
+        std::cerr << "--io-backend must be epoll or uring." << std::endl;
+        return 1;
+    }
+    if((shards > 1 || !ioBackend.empty()) && !clusterConfig.empty()){
+        std::cerr << "--cluster can't be combined with --shards or --io-backend." << std::endl;
+        return 1;
     }
-    if(RedisDatabase::getInstance().load("dump.my_rdb")){
-        std::cout << "Database loaded from dump.my_rdb successfully." << std::endl;
+    if(threads.ioThreads > 0 && (shards > 1 || !ioBackend.empty())){
+        std::cerr << "--io-threads can't be combined with --shards or --io-backend." << std::endl;
+        return 1;
+    }
+
+    // io_uring needs a 5.19+ kernel that allows it (containers often don't)
+    bool uring = ioBackend == "uring";
+    if(uring && !IoUring::supported()){
+        std::cerr << "io_uring is not available, using epoll." << std::endl;
+        uring = false;
+    }
+
+    // Shared-nothing mode: every shard loads, dumps and serves its own keyspace.
+    // --io-backend alone runs the same event loop with one shard.
+    if(shards > 1 || !ioBackend.empty()){
+        IoBackend::getInstance().select(uring ? IoBackend::URING : IoBackend::EPOLL);
+        ShardedServer server(listen, std::max<size_t>(1, shards), uring);
+        server.run();
+        return 0;
+    }
+
+    // Cluster mode: several nodes usually share a directory, so each dumps to its own file
+    std::string dumpFile = "dump.my_rdb";
+    if(!clusterConfig.empty()){
+        if(!Cluster::getInstance().load(clusterConfig, port)){
+            return 1;
+        }
+        dumpFile = "dump-" + std::to_string(port) + ".my_rdb";
+    }
+
+    if(RedisDatabase::getInstance().load(dumpFile)){
+        std::cout << "Database loaded from " << dumpFile << " successfully." << std::endl;
     } else {
         std::cout << "No existing database found. Starting with an empty database." << std::endl;
     }
-    RedisServer server(port);
+    RedisServer server(listen, dumpFile, threads);
 
     //Background persistance thread - dumping the database every 300 seconds((5*60 save databse to disk))
 
-    std::thread persistenceThread([&server]() {
+    std::thread persistenceThread([&server, dumpFile]() {
         while (true) {
             std::this_thread::sleep_for(std::chrono::seconds(300));
             // the database 
-            if(!RedisDatabase::getInstance().dump("dump.my_rdb")){
+            if(!RedisDatabase::getInstance().dump(dumpFile)){
                 std::cerr << "Failed to dump database to disk." << std::endl;
             } else {
-                std::cout << "Database dumped to dump.my_rdb successfully." << std::endl;
+                std::cout << "Database dumped to " << dumpFile << " successfully." << std::endl;
             }
         }
     });
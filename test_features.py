@@ -68,6 +68,62 @@ def test_strings(client):
     print("✓ SET product:1 'redis book'")
     client.send_command("SET", "product:1", "redis book")
 
+def test_counters(client):
+    print("\n" + "="*50)
+    print("TESTING COUNTERS")
+    print("="*50)
+    
+    print("\n✓ INCR page:views")
+    result = client.send_command("INCR", "page:views")
+    print(f"  Response: {result}")
+    
+    print("\n✓ INCRBY page:views 10")
+    result = client.send_command("INCRBY", "page:views", "10")
+    print(f"  Response: {result}")
+    
+    print("\n✓ DECR page:views")
+    result = client.send_command("DECR", "page:views")
+    print(f"  Response: {result}")
+    
+    print("\n✓ INCRBYFLOAT price 2.5")
+    result = client.send_command("INCRBYFLOAT", "price", "2.5")
+    print(f"  Response: {result}")
+    
+    print("\n✓ INCR mykey (not an integer)")
+    client.send_command("SET", "mykey", "hello")
+    result = client.send_command("INCR", "mykey")
+    print(f"  Response: {result}")
+
+def test_multikey(client):
+    print("\n" + "="*50)
+    print("TESTING MULTI-KEY OPERATIONS")
+    print("="*50)
+    
+    print("\n✓ MSET user:1 alice user:2 bob user:3 carol")
+    result = client.send_command("MSET", "user:1", "alice", "user:2", "bob", "user:3", "carol")
+    print(f"  Response: {result}")
+    
+    print("\n✓ MGET user:1 user:2 user:404 user:3")
+    result = client.send_command("MGET", "user:1", "user:2", "user:404", "user:3")
+    print(f"  Response: {result}")
+    
+    print("\n✓ MSETNX user:3 dave user:4 erin (user:3 exists)")
+    result = client.send_command("MSETNX", "user:3", "dave", "user:4", "erin")
+    print(f"  Response: {result}")
+    
+    print("\n✓ EXISTS user:1 user:2 user:4")
+    result = client.send_command("EXISTS", "user:1", "user:2", "user:4")
+    print(f"  Response: {result}")
+    
+    print("\n✓ DEL user:1 user:2 user:3")
+    result = client.send_command("DEL", "user:1", "user:2", "user:3")
+    print(f"  Response: {result}")
+    
+    print("\n✓ UNLINK biglist (freed in the background)")
+    client.send_command("RPUSH", "biglist", *[str(i) for i in range(1000)])
+    result = client.send_command("UNLINK", "biglist")
+    print(f"  Response: {result}")
+
 def test_keys(client):
     print("\n" + "="*50)
     print("TESTING KEY OPERATIONS")
@@ -133,6 +189,34 @@ def test_lists(client):
     print("\n✓ LSET mylist 0 mango")
     result = client.send_command("LSET", "mylist", "0", "mango")
     print(f"  Response: {result}")
+    
+    print("\n✓ RPUSH mylist kiwi lime plum")
+    result = client.send_command("RPUSH", "mylist", "kiwi", "lime", "plum")
+    print(f"  Response: {result}")
+    
+    print("\n✓ LRANGE mylist 1 -1")
+    result = client.send_command("LRANGE", "mylist", "1", "-1")
+    print(f"  Response: {result}")
+    
+    print("\n✓ LINSERT mylist BEFORE lime fig")
+    result = client.send_command("LINSERT", "mylist", "BEFORE", "lime", "fig")
+    print(f"  Response: {result}")
+    
+    print("\n✓ LTRIM mylist 0 3")
+    result = client.send_command("LTRIM", "mylist", "0", "3")
+    print(f"  Response: {result}")
+    
+    print("\n✓ RPOP mylist 2")
+    result = client.send_command("RPOP", "mylist", "2")
+    print(f"  Response: {result}")
+    
+    print("\n✓ BLPOP mylist emptylist 1")
+    result = client.send_command("BLPOP", "mylist", "emptylist", "1")
+    print(f"  Response: {result}")
+    
+    print("\n✓ BRPOP emptylist 0.1 (times out)")
+    result = client.send_command("BRPOP", "emptylist", "0.1")
+    print(f"  Response: {result}")
 
 def test_hashes(client):
     print("\n" + "="*50)
@@ -175,10 +259,102 @@ def test_hashes(client):
     result = client.send_command("HGETALL", "myhash")
     print(f"  Response: {result}")
     
+    print("\n✓ HMGET myhash field1 field2 nonexistent")
+    result = client.send_command("HMGET", "myhash", "field1", "field2", "nonexistent")
+    print(f"  Response: {result}")
+    
     print("\n✓ HDEL myhash field2")
     result = client.send_command("HDEL", "myhash", "field2")
     print(f"  Response: {result}")
 
+def test_zsets(client):
+    print("\n" + "="*50)
+    print("TESTING SORTED SET OPERATIONS")
+    print("="*50)
+    
+    print("\n✓ ZADD leaderboard 100 alice 250 bob 175 carol")
+    result = client.send_command("ZADD", "leaderboard", "100", "alice", "250", "bob", "175", "carol")
+    print(f"  Response: {result}")
+    
+    print("\n✓ ZINCRBY leaderboard 200 alice")
+    result = client.send_command("ZINCRBY", "leaderboard", "200", "alice")
+    print(f"  Response: {result}")
+    
+    print("\n✓ ZREVRANGE leaderboard 0 1 WITHSCORES")
+    result = client.send_command("ZREVRANGE", "leaderboard", "0", "1", "WITHSCORES")
+    print(f"  Response: {result}")
+    
+    print("\n✓ ZRANK leaderboard carol")
+    result = client.send_command("ZRANK", "leaderboard", "carol")
+    print(f"  Response: {result}")
+    
+    print("\n✓ ZRANGEBYSCORE leaderboard (175 +inf LIMIT 0 1")
+    result = client.send_command("ZRANGEBYSCORE", "leaderboard", "(175", "+inf", "LIMIT", "0", "1")
+    print(f"  Response: {result}")
+
+def test_sets(client):
+    print("\n" + "="*50)
+    print("TESTING SET OPERATIONS")
+    print("="*50)
+    
+    print("\n✓ SADD tags:1 10 20 30 40")
+    result = client.send_command("SADD", "tags:1", "10", "20", "30", "40")
+    print(f"  Response: {result}")
+    
+    print("\n✓ SADD tags:2 20 40 60")
+    result = client.send_command("SADD", "tags:2", "20", "40", "60")
+    print(f"  Response: {result}")
+    
+    print("\n✓ SINTER tags:1 tags:2")
+    result = client.send_command("SINTER", "tags:1", "tags:2")
+    print(f"  Response: {result}")
+    
+    print("\n✓ SUNION tags:1 tags:2")
+    result = client.send_command("SUNION", "tags:1", "tags:2")
+    print(f"  Response: {result}")
+    
+    print("\n✓ SDIFF tags:1 tags:2")
+    result = client.send_command("SDIFF", "tags:1", "tags:2")
+    print(f"  Response: {result}")
+    
+    print("\n✓ SISMEMBER tags:1 30")
+    result = client.send_command("SISMEMBER", "tags:1", "30")
+    print(f"  Response: {result}")
+    
+    print("\n✓ SREM tags:1 10")
+    result = client.send_command("SREM", "tags:1", "10")
+    print(f"  Response: {result}")
+
+def test_streams(client):
+    print("\n" + "="*50)
+    print("TESTING STREAM OPERATIONS")
+    print("="*50)
+
+    print("\n✓ XADD events 1-1 type click / 1-2 type view")
+    result = client.send_command("XADD", "events", "1-1", "type", "click")
+    print(f"  Response: {result}")
+    result = client.send_command("XADD", "events", "1-2", "type", "view")
+    print(f"  Response: {result}")
+
+    print("\n✓ XRANGE events - +")
+    result = client.send_command("XRANGE", "events", "-", "+")
+    print(f"  Response: {result}")
+
+    print("\n✓ XREAD COUNT 1 STREAMS events 1-1")
+    result = client.send_command("XREAD", "COUNT", "1", "STREAMS", "events", "1-1")
+    print(f"  Response: {result}")
+
+    print("\n✓ XGROUP CREATE events workers 0 / XREADGROUP GROUP workers w1 STREAMS events >")
+    client.send_command("XGROUP", "CREATE", "events", "workers", "0")
+    result = client.send_command("XREADGROUP", "GROUP", "workers", "w1", "STREAMS", "events", ">")
+    print(f"  Response: {result}")
+
+    print("\n✓ XACK events workers 1-1 (then XPENDING events workers)")
+    result = client.send_command("XACK", "events", "workers", "1-1")
+    print(f"  Response: {result}")
+    result = client.send_command("XPENDING", "events", "workers")
+    print(f"  Response: {result}")
+
 def test_misc(client):
     print("\n" + "="*50)
     print("TESTING MISC OPERATIONS")
@@ -197,10 +373,232 @@ def test_misc(client):
     result = client.send_command("RENAME", "mykey", "mynewkey")
     print(f"  Response: {result}")
     
+    print("\n✓ MEMORY USAGE mynewkey")
+    result = client.send_command("MEMORY", "USAGE", "mynewkey")
+    print(f"  Response: {result}")
+    
     print("\n✓ EXPIRE mynewkey 3600")
     result = client.send_command("EXPIRE", "mynewkey", "3600")
     print(f"  Response: {result}")
 
+    print("\n✓ INFO io")
+    result = client.send_command("INFO", "io")
+    print(f"  Response: {result}")
+
+    print("\n✓ CLIENT LIST")
+    result = client.send_command("CLIENT", "LIST")
+    print(f"  Response: {result}")
+
+    print("\n✓ INFO clients")
+    result = client.send_command("INFO", "clients")
+    print(f"  Response: {result}")
+
+    print("\n✓ CLIENT SETNAME test-client")
+    result = client.send_command("CLIENT", "SETNAME", "test-client")
+    print(f"  Response: {result}")
+
+    print("\n✓ CLIENT GETNAME")
+    result = client.send_command("CLIENT", "GETNAME")
+    print(f"  Response: {result}")
+
+    print("\n✓ CLIENT KILL 1.2.3.4:5 (no such client)")
+    result = client.send_command("CLIENT", "KILL", "1.2.3.4:5")
+    print(f"  Response: {result}")
+
+def test_transactions(client):
+    print("\n" + "="*50)
+    print("TESTING TRANSACTIONS")
+    print("="*50)
+    
+    print("\n✓ WATCH balance")
+    client.send_command("SET", "balance", "100")
+    result = client.send_command("WATCH", "balance")
+    print(f"  Response: {result}")
+    
+    print("\n✓ MULTI / SET balance 90 / HSET audit last 90 / EXEC")
+    client.send_command("MULTI")
+    client.send_command("SET", "balance", "90")
+    client.send_command("HSET", "audit", "last", "90")
+    result = client.send_command("EXEC")
+    print(f"  Response: {result}")
+    
+    print("\n✓ MULTI / DISCARD")
+    client.send_command("MULTI")
+    client.send_command("SET", "balance", "0")
+    result = client.send_command("DISCARD")
+    print(f"  Response: {result}")
+
+def test_scripting(client):
+    print("\n" + "="*50)
+    print("TESTING SCRIPTING")
+    print("="*50)
+    
+    script = ('local v = redis.call("LINDEX", KEYS[1], ARGV[1]) '
+              'if v == nil then return nil end '
+              'local n = tonumber(v) + tonumber(ARGV[2]) '
+              'redis.call("LSET", KEYS[1], ARGV[1], n) '
+              'return n')
+    client.send_command("RPUSH", "counters", "10", "20")
+    print("\n✓ EVAL <lindex/lset script> 1 counters 1 5")
+    result = client.send_command("EVAL", script, "1", "counters", "1", "5")
+    print(f"  Response: {result}")
+    
+    print("\n✓ SCRIPT LOAD <script>")
+    sha = client.send_command("SCRIPT", "LOAD", script).split("\r\n")[-1]
+    print(f"  Response: {sha}")
+    
+    print("\n✓ EVALSHA <sha> 1 counters 0 1")
+    result = client.send_command("EVALSHA", sha, "1", "counters", "0", "1")
+    print(f"  Response: {result}")
+    
+    print("\n✓ EVAL \"return 1/0\" 0 (should be an error)")
+    result = client.send_command("EVAL", "return 1/0", "0")
+    print(f"  Response: {result}")
+    
+    print("\n✓ EVAL \"return 9223372036854775808\" 0 (2^63, should be an error)")
+    result = client.send_command("EVAL", "return 9223372036854775808", "0")
+    print(f"  Response: {result}")
+
+def test_replication(client):
+    print("\n" + "="*50)
+    print("TESTING REPLICATION")
+    print("="*50)
+    
+    print("\n✓ ROLE")
+    result = client.send_command("ROLE")
+    print(f"  Response: {result}")
+    
+    print("\n✓ INFO replication")
+    result = client.send_command("INFO", "replication")
+    print(f"  Response: {result}")
+    
+    print("\n✓ REPLICAOF 127.0.0.1 notaport")
+    result = client.send_command("REPLICAOF", "127.0.0.1", "notaport")
+    print(f"  Response: {result}")
+
+def test_cluster(client):
+    print("\n" + "="*50)
+    print("TESTING CLUSTER")
+    print("="*50)
+    
+    print("\n✓ CLUSTER KEYSLOT foo (cluster mode off)")
+    result = client.send_command("CLUSTER", "KEYSLOT", "foo")
+    print(f"  Response: {result}")
+    
+    print("\n✓ INFO cluster")
+    result = client.send_command("INFO", "cluster")
+    print(f"  Response: {result}")
+    
+    print("\n✓ ASKING")
+    result = client.send_command("ASKING")
+    print(f"  Response: {result}")
+    
+    print("\n✓ DUMP / RESTORE")
+    client.send_command("DEL", "dumpsrc", "dumpdst")
+    client.send_command("RPUSH", "dumpsrc", "a", "b", "c")
+    payload = client.send_command("DUMP", "dumpsrc").split("\r\n", 1)[1]
+    print(f"  DUMP: {payload!r}")
+    result = client.send_command("RESTORE", "dumpdst", "0", payload.replace("dumpsrc", "dumpdst"))
+    print(f"  RESTORE: {result}")
+    result = client.send_command("LRANGE", "dumpdst", "0", "-1")
+    print(f"  LRANGE dumpdst: {result}")
+    
+    print("\n✓ MIGRATE to a closed port")
+    result = client.send_command("MIGRATE", "127.0.0.1", "1", "dumpsrc", "0", "200")
+    print(f"  Response: {result}")
+
+def test_pubsub(client):
+    print("\n" + "="*50)
+    print("TESTING PUB/SUB")
+    print("="*50)
+    
+    subscriber = RedisClient()
+    print("\n✓ SUBSCRIBE news")
+    result = subscriber.send_command("SUBSCRIBE", "news")
+    print(f"  Response: {result}")
+    
+    print("\n✓ PUBSUB NUMSUB news")
+    result = client.send_command("PUBSUB", "NUMSUB", "news")
+    print(f"  Response: {result}")
+    
+    print("\n✓ PUBLISH news hello")
+    result = client.send_command("PUBLISH", "news", "hello")
+    print(f"  Response: {result}")
+    result = subscriber.read_response()
+    print(f"  Subscriber got: {result}")
+    
+    print("\n✓ GET in subscribed mode")
+    result = subscriber.send_command("GET", "foo")
+    print(f"  Response: {result}")
+    
+    print("\n✓ UNSUBSCRIBE")
+    result = subscriber.send_command("UNSUBSCRIBE")
+    print(f"  Response: {result}")
+    subscriber.close()
+
+def test_client_tracking(client):
+    print("\n" + "="*50)
+    print("TESTING CLIENT TRACKING")
+    print("="*50)
+    
+    receiver = RedisClient()
+    print("\n✓ CLIENT ID (invalidation connection)")
+    receiver_id = receiver.send_command("CLIENT", "ID").lstrip(":")
+    print(f"  Response: {receiver_id}")
+    result = receiver.send_command("SUBSCRIBE", "__redis__:invalidate")
+    print(f"  SUBSCRIBE __redis__:invalidate: {result}")
+    
+    reader = RedisClient()
+    print(f"\n✓ CLIENT TRACKING ON REDIRECT {receiver_id}")
+    result = reader.send_command("CLIENT", "TRACKING", "ON", "REDIRECT", receiver_id)
+    print(f"  Response: {result}")
+    
+    client.send_command("SET", "config:mode", "fast")
+    print("\n✓ GET config:mode (tracked read)")
+    result = reader.send_command("GET", "config:mode")
+    print(f"  Response: {result}")
+    
+    print("\n✓ SET config:mode slow (from another connection)")
+    result = client.send_command("SET", "config:mode", "slow")
+    print(f"  Response: {result}")
+    result = receiver.read_response()
+    print(f"  Invalidation: {result}")
+    
+    print("\n✓ CLIENT TRACKING OFF")
+    result = reader.send_command("CLIENT", "TRACKING", "OFF")
+    print(f"  Response: {result}")
+    reader.close()
+    receiver.close()
+
+def test_resp3(client):
+    print("\n" + "="*50)
+    print("TESTING RESP3")
+    print("="*50)
+    
+    conn = RedisClient()
+    print("\n✓ HELLO 3")
+    result = conn.send_command("HELLO", "3")
+    print(f"  Response: {result[:40]}...")
+    
+    conn.send_command("HSET", "resp3:hash", "field", "value")
+    print("\n✓ HGETALL resp3:hash (map)")
+    result = conn.send_command("HGETALL", "resp3:hash")
+    print(f"  Response: {result!r}")
+    
+    conn.send_command("ZADD", "resp3:zset", "1.5", "member")
+    print("\n✓ ZSCORE resp3:zset member (double)")
+    result = conn.send_command("ZSCORE", "resp3:zset", "member")
+    print(f"  Response: {result!r}")
+    
+    print("\n✓ GET resp3:missing (null)")
+    result = conn.send_command("GET", "resp3:missing")
+    print(f"  Response: {result!r}")
+    
+    print("\n✓ HELLO 2")
+    result = conn.send_command("HELLO", "2")
+    print(f"  Response: {result[:40]}...")
+    conn.close()
+
 def main():
     try:
         print("\n🚀 REDIS C++ IMPLEMENTATION - FEATURE TEST")
@@ -209,10 +607,22 @@ def main():
         client = RedisClient()
         
         test_strings(client)
+        test_counters(client)
+        test_multikey(client)
         test_keys(client)
         test_lists(client)
         test_hashes(client)
+        test_zsets(client)
+        test_sets(client)
+        test_streams(client)
         test_misc(client)
+        test_transactions(client)
+        test_scripting(client)
+        test_replication(client)
+        test_cluster(client)
+        test_pubsub(client)
+        test_client_tracking(client)
+        test_resp3(client)
         
         client.close()
         